@@ -0,0 +1,41 @@
+// Progressive accumulation of a still camera
+//
+// restir_shade.rgen averages every frame into the accumulation image, the
+// color in rgb and the squared luminance in a, so the image holds the first
+// two moments of every pixel. accumulation_tiles.comp turns them into the
+// worst relative standard error of every tile, which the host reads back to
+// stop once the image is clean enough. Needs sampling.glsl
+
+// Raytracer::ACCUMULATION_TILE_SIZE
+#define ACCUMULATION_TILE_SIZE 16
+// Keeps dark pixels from dominating the relative error
+#define ACCUMULATION_MIN_LUMINANCE 0.01F
+
+layout(binding = 17, set = 0, rgba32f) uniform image2D accumulationImage;
+layout(binding = 18, set = 0) buffer AccumulationTiles { float error[]; } accumulationTiles;
+
+// Averages this frame's color into the pixel's moments and returns them
+vec4 accumulate(ivec2 pixel, vec3 color)
+{
+    const float n = float(frame.accumulatedFrames);
+    const float lum = luminance(color);
+    const vec4 current = vec4(color, lum * lum);
+    if (n == 0.0F) {
+        imageStore(accumulationImage, pixel, current);
+        return current;
+    }
+
+    const vec4 moments = imageLoad(accumulationImage, pixel);
+    const vec4 mean = moments + (current - moments) / (n + 1.0F);
+    imageStore(accumulationImage, pixel, mean);
+    return mean;
+}
+
+// The standard error of a pixel's mean luminance over that luminance, after
+// frames samples
+float relativeError(vec4 moments, float frames)
+{
+    const float mean = luminance(moments.rgb);
+    const float variance = max(moments.a - mean * mean, 0.0F);
+    return sqrt(variance / max(frames, 1.0F)) / max(mean, ACCUMULATION_MIN_LUMINANCE);
+}
@@ -0,0 +1,50 @@
+// Alpha testing of masked geometries, shared by the any-hit shaders and the
+// ray queries of ray_query.glsl. Declares the UBO and the scene bindings the
+// test reads, closesthit.rchit shades with the same ones
+
+// Shadows only need the rough outline of the foliage, so they read a coarser
+// mip level
+#define SHADOW_ALPHA_LOD 2.0F
+
+layout(binding = 0, set = 1) uniform UBO 
+{
+	mat4 viewInverse;
+	mat4 projInverse;
+	mat4 prevViewProjection;
+	int vertexSize;
+    int lightsCount;
+    uint restirHistory;
+} ubo;
+layout(binding = 4, set = 0) buffer Vertices { uvec4 v[]; } vertices;
+layout(binding = 5, set = 0) buffer Indices { uint i[]; } indices;
+layout(binding = 6, set = 0) uniform sampler samp;
+layout(binding = 7, set = 0) uniform texture2D textures[];
+layout(binding = 10, set = 0) buffer Geometries { GeometryInfo g[]; } geometries;
+layout(binding = 11, set = 0) buffer Materials { MaterialInfo m[]; } materials;
+
+vec2 unpackUV(uint index)
+{
+	// The uv is the third component of the packed vertex structure
+	const int m = ubo.vertexSize / 16;
+	return unpackHalf2x16(vertices.v[m * index].z);
+}
+
+// True if the material's alpha cutoff cuts the hit away. The geometry is
+// the instance custom index plus the geometry index of the hit
+bool alphaMasked(uint geometryIndex, uint primitive, vec2 attribs, float lod)
+{
+	const GeometryInfo geometry = geometries.g[geometryIndex];
+	const MaterialInfo material = materials.m[geometry.materialIndex];
+	const uint firstIndex = geometry.firstIndex + 3 * primitive;
+
+	float alpha = material.baseColorFactor.a;
+	if (material.baseColorTexture != 0) {
+		const vec3 barycentricCoords = vec3(1.0f - attribs.x - attribs.y, attribs.x, attribs.y);
+		vec2 uv = unpackUV(indices.i[firstIndex]) * barycentricCoords.x +
+			unpackUV(indices.i[firstIndex + 1]) * barycentricCoords.y +
+			unpackUV(indices.i[firstIndex + 2]) * barycentricCoords.z;
+		alpha *= textureLod(sampler2D(textures[nonuniformEXT(material.baseColorTexture)], samp), uv, lod).a;
+	}
+
+	return alpha < material.alphaCutoff;
+}
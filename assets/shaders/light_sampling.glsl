@@ -0,0 +1,98 @@
+// Light importance sampling
+//
+// Picks one of the lights with a probability close to its contribution, so a
+// hit traces a constant number of shadow rays however many lights there are.
+// The tables are built on the host by light_sampler::buildAliasTable and
+// light_sampler::buildBvh. Needs utils.glsl for LIGHT_SAMPLING
+
+// light_sampler::Strategy
+#define LIGHT_SAMPLING_ALIAS_TABLE 0
+#define LIGHT_SAMPLING_BVH 1
+
+// light_sampler::LEAF_BIT
+#define LIGHT_LEAF_BIT 0x80000000U
+// Keeps the light a point is inside of from taking every sample
+#define MIN_LIGHT_DISTANCE_SQUARED 0.0001F
+// The largest float below one
+#define ONE_MINUS_EPSILON 0.99999994F
+
+// light_sampler::AliasEntry
+struct AliasEntry {
+    float probability;
+    uint alias;
+    float pdf;
+    uint padding;
+};
+
+// light_sampler::LightNode
+struct LightNode {
+    vec3 boundsMin;
+    float power;
+    vec3 boundsMax;
+    uint payload;
+};
+
+layout(binding = 13, set = 0) readonly buffer LightAliasTable { AliasEntry e[]; } lightAliasTable;
+layout(binding = 14, set = 0) readonly buffer LightBvh { LightNode n[]; } lightBvh;
+
+// Picks a light proportional to its power
+uint sampleLightAliasTable(float u, uint count, out float pdf)
+{
+    const float scaled = u * float(count);
+    const uint bucket = min(uint(scaled), count - 1);
+    const AliasEntry entry = lightAliasTable.e[bucket];
+
+    const uint light = scaled - float(bucket) < entry.probability ? bucket : entry.alias;
+    pdf = lightAliasTable.e[light].pdf;
+    return light;
+}
+
+// The estimated contribution of a node's lights at a point, its power over
+// the squared distance to its center. The distance is clamped to the node's
+// extent, a point inside a cluster can not tell its lights apart
+float lightNodeImportance(LightNode node, vec3 position)
+{
+    const vec3 extent = node.boundsMax - node.boundsMin;
+    const vec3 toCenter = position - 0.5F * (node.boundsMin + node.boundsMax);
+    const float distanceSquared = max(dot(toCenter, toCenter),
+                                      max(0.25F * dot(extent, extent), MIN_LIGHT_DISTANCE_SQUARED));
+    return node.power / distanceSquared;
+}
+
+// Walks the light BVH from the root, picking a child proportional to its
+// importance. The pdf is the product of the choices, the random number is
+// rescaled at every level so one number drives the whole walk
+uint sampleLightBvh(float u, vec3 position, out float pdf)
+{
+    uint node = 0;
+    pdf = 1.0F;
+    while ((lightBvh.n[node].payload & LIGHT_LEAF_BIT) == 0) {
+        const uint left = node + 1;
+        const uint right = lightBvh.n[node].payload;
+        const float leftImportance = lightNodeImportance(lightBvh.n[left], position);
+        const float rightImportance = lightNodeImportance(lightBvh.n[right], position);
+        const float total = leftImportance + rightImportance;
+        const float leftProbability = total > 0.0F ? leftImportance / total : 0.5F;
+
+        if (u < leftProbability) {
+            node = left;
+            u /= leftProbability;
+            pdf *= leftProbability;
+        } else {
+            node = right;
+            u = (u - leftProbability) / (1.0F - leftProbability);
+            pdf *= 1.0F - leftProbability;
+        }
+        u = min(u, ONE_MINUS_EPSILON);
+    }
+    return lightBvh.n[node].payload & ~LIGHT_LEAF_BIT;
+}
+
+// Picks one of count lights for a point with the LIGHT_SAMPLING strategy
+uint sampleLight(float u, uint count, vec3 position, out float pdf)
+{
+    if (LIGHT_SAMPLING == LIGHT_SAMPLING_BVH) {
+        return sampleLightBvh(u, position, pdf);
+    }
+    return sampleLightAliasTable(u, count, pdf);
+}
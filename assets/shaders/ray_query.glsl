@@ -0,0 +1,62 @@
+// Inline ray queries, for shaders that trace without the shader binding
+// table. Masked geometries are alpha tested in the traversal loop, the way
+// anyhit.rahit and shadow.rahit test them. Needs GL_EXT_ray_query,
+// alpha_mask.glsl and topLevelAS, the acceleration structure of binding 0
+
+// The closest hit of a ray
+struct QueryHit {
+    uint geometry;        // The instance custom index plus the geometry index
+    uint primitive;       // The triangle within the geometry
+    vec2 barycentrics;    // The hit attributes
+    float t;              // The distance along the ray
+    mat4x3 worldToObject; // The instance's transform into the mesh's space
+};
+
+// Finds the closest hit of a ray, false if it missed
+bool queryClosestHit(vec3 origin, float tMin, vec3 direction, float tMax, out QueryHit hit)
+{
+    rayQueryEXT query;
+    rayQueryInitializeEXT(query, topLevelAS, gl_RayFlagsNoneEXT, 0xFF, origin, tMin, direction, tMax);
+
+    // Opaque geometries commit their hits themselves, only masked ones stop
+    // the traversal
+    while (rayQueryProceedEXT(query)) {
+        const uint geometry = rayQueryGetIntersectionInstanceCustomIndexEXT(query, false) +
+                              rayQueryGetIntersectionGeometryIndexEXT(query, false);
+        if (!alphaMasked(geometry, rayQueryGetIntersectionPrimitiveIndexEXT(query, false),
+                         rayQueryGetIntersectionBarycentricsEXT(query, false), 0.0F)) {
+            rayQueryConfirmIntersectionEXT(query);
+        }
+    }
+
+    if (rayQueryGetIntersectionTypeEXT(query, true) != gl_RayQueryCommittedIntersectionTriangleEXT) {
+        return false;
+    }
+
+    hit.geometry = rayQueryGetIntersectionInstanceCustomIndexEXT(query, true) +
+                   rayQueryGetIntersectionGeometryIndexEXT(query, true);
+    hit.primitive = rayQueryGetIntersectionPrimitiveIndexEXT(query, true);
+    hit.barycentrics = rayQueryGetIntersectionBarycentricsEXT(query, true);
+    hit.t = rayQueryGetIntersectionTEXT(query, true);
+    hit.worldToObject = rayQueryGetIntersectionWorldToObjectEXT(query, true);
+    return true;
+}
+
+// True if anything blocks the ray, the first hit that passes the coarser
+// shadow alpha test ends the traversal
+bool queryOccluded(vec3 origin, float tMin, vec3 direction, float tMax)
+{
+    rayQueryEXT query;
+    rayQueryInitializeEXT(query, topLevelAS, gl_RayFlagsTerminateOnFirstHitEXT, 0xFF, origin, tMin, direction, tMax);
+
+    while (rayQueryProceedEXT(query)) {
+        const uint geometry = rayQueryGetIntersectionInstanceCustomIndexEXT(query, false) +
+                              rayQueryGetIntersectionGeometryIndexEXT(query, false);
+        if (!alphaMasked(geometry, rayQueryGetIntersectionPrimitiveIndexEXT(query, false),
+                         rayQueryGetIntersectionBarycentricsEXT(query, false), SHADOW_ALPHA_LOD)) {
+            rayQueryConfirmIntersectionEXT(query);
+        }
+    }
+
+    return rayQueryGetIntersectionTypeEXT(query, true) != gl_RayQueryCommittedIntersectionNoneEXT;
+}
@@ -0,0 +1,94 @@
+// ReSTIR DI, see Bitterli et al., Spatiotemporal reservoir resampling for
+// real-time ray tracing with dynamic direct lighting
+//
+// A frame runs three passes over the primary hits:
+// 1. raygen.rgen picks one of RESTIR_CANDIDATES lights per pixel by resampled
+//    importance sampling and merges it with the reservoir its hit had in the
+//    previous frame, found by reprojection
+// 2. restir_spatial.comp merges the reservoirs of RESTIR_SPATIAL_SAMPLES
+//    random neighbours
+// 3. restir_shade.rgen traces one shadow ray to the chosen light and shades
+//
+// Every frame in flight owns a segment of Raytracer::restirBuffer. A frame
+// writes its own segment and reads the previous frame's one. Needs
+// utils.glsl and sampling.glsl. restir_gi.glsl resamples the indirect light
+// of the same primary hits
+
+// Neighbours are only reused if their hit looks like the pixel's own
+#define RESTIR_NORMAL_THRESHOLD 0.9F
+#define RESTIR_DEPTH_THRESHOLD 0.1F
+// Caps the history, so stale samples fade out
+#define RESTIR_MAX_HISTORY 20.0F
+// Pixels the spatial pass picks its neighbours from
+#define RESTIR_SPATIAL_RADIUS 30.0F
+// Random number dimensions of the spatial pass, after the path's ones
+#define RESTIR_SPATIAL_DIMENSION 1024U
+// Marks a pixel whose primary ray missed
+#define RESTIR_NO_HIT -1.0F
+
+// A weighted reservoir holding one light
+struct Reservoir {
+    uint light;       // The chosen light
+    float weightSum;  // The summed resampling weights
+    float M;          // The number of candidates seen
+    float W;          // The unbiased contribution weight of the light
+};
+
+// Raytracer::ReSTIRPixel
+struct ReSTIRPixel {
+    vec4 position;    // The primary hit and its distance to the camera
+    vec4 normal;      // The shading normal of the primary hit
+    vec4 albedo;      // The color the direct light is applied to
+    vec4 indirect;    // Everything but the primary hit's direct light
+    Reservoir temporal;  // After temporal reuse, read by the spatial pass
+    Reservoir reservoir; // After spatial reuse, read by the next frame
+};
+
+layout(binding = 8, set = 0) buffer PrevReSTIRPixels { ReSTIRPixel p[]; } prevPixels;
+layout(binding = 9, set = 0) buffer ReSTIRPixels { ReSTIRPixel p[]; } pixels;
+
+Reservoir emptyReservoir()
+{
+    return Reservoir(0, 0.0F, 0.0F, 0.0F);
+}
+
+// Streams one candidate into the reservoir, u picks whether it replaces the
+// current light
+bool updateReservoir(inout Reservoir r, uint light, float weight, float count, float u)
+{
+    r.weightSum += weight;
+    r.M += count;
+    if (weight > 0.0F && u * r.weightSum < weight) {
+        r.light = light;
+        return true;
+    }
+    return false;
+}
+
+// Merges another reservoir whose light has the target value targetPdf at
+// this pixel
+bool combineReservoir(inout Reservoir r, Reservoir other, float targetPdf, float u)
+{
+    return updateReservoir(r, other.light, targetPdf * other.W * other.M, other.M, u);
+}
+
+// Sets the contribution weight once all candidates are in
+void finalizeReservoir(inout Reservoir r, float targetPdf)
+{
+    r.W = targetPdf > 0.0F && r.M > 0.0F ? r.weightSum / (r.M * targetPdf) : 0.0F;
+}
+
+// Whether a neighbour's hit is close enough to reuse its reservoir
+bool similarSurface(ReSTIRPixel pixel, ReSTIRPixel neighbour)
+{
+    return neighbour.position.w != RESTIR_NO_HIT &&
+           dot(pixel.normal.xyz, neighbour.normal.xyz) > RESTIR_NORMAL_THRESHOLD &&
+           abs(neighbour.position.w - pixel.position.w) < RESTIR_DEPTH_THRESHOLD * pixel.position.w;
+}
+
+// The target function, the unshadowed light the camera sees at a hit
+float restirTarget(vec4 light, ReSTIRPixel pixel, vec3 camera)
+{
+    return lightContribution(light, pixel.position.xyz, pixel.normal.xyz, camera,
+                             pixel.position.xyz - camera);
+}
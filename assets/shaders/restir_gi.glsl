@@ -0,0 +1,119 @@
+// ReSTIR GI, see Ouyang et al., ReSTIR GI: Path resampling for real-time path
+// tracing
+//
+// Resamples one bounce of indirect light at the primary hits of restir.glsl.
+// A sample is the hit of the bounce and the radiance leaving it towards the
+// primary hit it was traced from:
+// 1. raygen.rgen traces one cosine weighted bounce per pixel and merges it
+//    with the reservoir its hit had in the previous frame
+// 2. restir_spatial.comp merges the reservoirs of random neighbours
+// 3. restir_shade.rgen adds the reservoir's radiance to the pixel
+//
+// A sample reused by another primary hit is seen under another solid angle,
+// the Jacobian of the move corrects its weight. Reused samples are assumed
+// visible, no ray is traced to them. Every frame in flight owns a segment of
+// Raytracer::giBuffer. Needs restir.glsl
+
+// Samples whose Jacobian is larger than this are rejected, they would be
+// fireflies
+#define RESTIR_GI_MAX_JACOBIAN 10.0F
+// Keeps the bounce from hitting the primary hit it leaves
+#define RESTIR_GI_RAY_OFFSET 0.01F
+
+// A weighted reservoir holding one indirect light sample
+struct GIReservoir {
+    vec4 position;    // The sample point
+    vec4 normal;      // The normal at the sample point
+    vec4 radiance;    // The radiance leaving the sample point
+    float weightSum;  // The summed resampling weights
+    float M;          // The number of candidates seen
+    float W;          // The unbiased contribution weight of the sample
+    uint padding;
+};
+
+// Raytracer::GIPixel
+struct GIPixel {
+    GIReservoir temporal;  // After temporal reuse, read by the spatial pass
+    GIReservoir reservoir; // After spatial reuse, read by the next frame
+};
+
+layout(binding = 15, set = 0) buffer PrevGIPixels { GIPixel p[]; } prevGIPixels;
+layout(binding = 16, set = 0) buffer GIPixels { GIPixel p[]; } giPixels;
+
+GIReservoir emptyGIReservoir()
+{
+    return GIReservoir(vec4(0.0F), vec4(0.0F), vec4(0.0F), 0.0F, 0.0F, 0.0F, 0);
+}
+
+// The cosine between the primary hit's normal and the direction to a sample
+float giCosine(GIReservoir s, ReSTIRPixel pixel)
+{
+    const vec3 toSample = s.position.xyz - pixel.position.xyz;
+    const float len = length(toSample);
+    return len > 0.0F ? max(dot(pixel.normal.xyz, toSample / len), 0.0F) : 0.0F;
+}
+
+// The target function, the luminance the sample adds to a primary hit
+float giTarget(GIReservoir s, ReSTIRPixel pixel)
+{
+    return luminance(s.radiance.xyz) * giCosine(s, pixel);
+}
+
+// The ratio of the solid angles the sample covers seen from the primary hit
+// `to` and the one it was traced from, `from`
+float giJacobian(GIReservoir s, vec3 from, vec3 to)
+{
+    const vec3 fromSample = from - s.position.xyz;
+    const vec3 toSample = to - s.position.xyz;
+    const float fromDistanceSquared = dot(fromSample, fromSample);
+    const float toDistanceSquared = dot(toSample, toSample);
+    if (fromDistanceSquared <= 0.0F || toDistanceSquared <= 0.0F) {
+        return 0.0F;
+    }
+
+    const float fromCosine = abs(dot(s.normal.xyz, fromSample)) * inversesqrt(fromDistanceSquared);
+    const float toCosine = abs(dot(s.normal.xyz, toSample)) * inversesqrt(toDistanceSquared);
+    if (fromCosine <= 0.0F) {
+        return 0.0F;
+    }
+    return toCosine / fromCosine * fromDistanceSquared / toDistanceSquared;
+}
+
+// Streams one sample into the reservoir, u picks whether it replaces the
+// current one
+bool updateGIReservoir(inout GIReservoir r, GIReservoir s, float weight, float count, float u)
+{
+    r.weightSum += weight;
+    r.M += count;
+    if (weight > 0.0F && u * r.weightSum < weight) {
+        r.position = s.position;
+        r.normal = s.normal;
+        r.radiance = s.radiance;
+        return true;
+    }
+    return false;
+}
+
+// Merges the reservoir of the primary hit at `from` into the pixel's
+bool combineGIReservoir(inout GIReservoir r, GIReservoir other, ReSTIRPixel pixel, vec3 from, float u)
+{
+    float jacobian = giJacobian(other, from, pixel.position.xyz);
+    if (jacobian > RESTIR_GI_MAX_JACOBIAN) {
+        jacobian = 0.0F;
+    }
+    return updateGIReservoir(r, other, giTarget(other, pixel) * other.W * other.M * jacobian, other.M, u);
+}
+
+// Sets the contribution weight once all candidates are in
+void finalizeGIReservoir(inout GIReservoir r, ReSTIRPixel pixel)
+{
+    const float targetPdf = giTarget(r, pixel);
+    r.W = targetPdf > 0.0F && r.M > 0.0F ? r.weightSum / (r.M * targetPdf) : 0.0F;
+}
+
+// The indirect light of the reservoir's sample at the primary hit, still to
+// be multiplied by the hit's albedo. Lambertian, so the BRDF is 1 / pi
+vec3 giRadiance(GIReservoir r, ReSTIRPixel pixel)
+{
+    return r.radiance.xyz * giCosine(r, pixel) * r.W / PI;
+}
@@ -0,0 +1,107 @@
+// Random numbers for the ray tracing shaders
+//
+// Every pixel, frame and dimension, i.e. the index of a random number within
+// the pixel's path, hashes to an independent PCG value. With blue noise
+// enabled the dimensions read a tiled blue noise texture instead, so the error
+// of neighbouring pixels is spread out rather than clumped. A per frame
+// Cranley-Patterson rotation keeps the tiles from repeating over time
+
+// The blue noise is fetched without a sampler
+#extension GL_EXT_samplerless_texture_functions : require
+
+// Side of the blue noise tile, blue_noise::DEFAULT_SIZE
+#define BLUE_NOISE_SIZE 64
+#define GOLDEN_RATIO_BITS 0x9E3779B9U
+#define PI 3.14159265F
+
+// Changes every frame, so it is pushed instead of going through the UBO
+layout(push_constant) uniform FrameConstants
+{
+    float dTime;
+    int width;
+    uint frameIndex;
+    uint blueNoise;
+    int height;
+    // Progressive accumulation, see accumulation.glsl
+    uint accumulate;
+    uint accumulatedFrames;
+    // SVGF, see svgf.glsl
+    uint denoiserHistory;
+    uint denoiseStep;
+    // The wavefront path tracer, see wavefront.glsl
+    uint wavefrontSample;
+    uint wavefrontBounce;
+} frame;
+
+layout(binding = 12, set = 0) uniform texture2D blueNoiseTexture;
+
+// PCG hash, see Jarzynski and Olano, Hash Functions for GPU Rendering
+uint pcgHash(uint v)
+{
+    const uint state = v * 747796405U + 2891336453U;
+    const uint word = ((state >> ((state >> 28U) + 4U)) ^ state) * 277803737U;
+    return (word >> 22U) ^ word;
+}
+
+// Maps the upper 24 bits to [0, 1)
+float uintToUnitFloat(uint v)
+{
+    return float(v >> 8) * (1.0F / 16777216.0F);
+}
+
+struct Sampler {
+    uvec2 pixel;
+    uint dimension;
+};
+
+Sampler initSampler(uvec2 pixel)
+{
+    return Sampler(pixel, 0);
+}
+
+// The next dimension's random number in [0, 1)
+float nextSample(inout Sampler s)
+{
+    const uint dimension = s.dimension++;
+    // The same for every pixel, so the rotation keeps the blue noise spectrum
+    const uint frameHash = pcgHash(frame.frameIndex * GOLDEN_RATIO_BITS + pcgHash(dimension));
+
+    if (frame.blueNoise != 0) {
+        // Every four dimensions read the tile at another offset
+        const uint tile = pcgHash(dimension / 4);
+        const uvec2 offset = uvec2(tile, tile >> 16);
+        const ivec2 texel = ivec2((s.pixel + offset) % BLUE_NOISE_SIZE);
+        const float value = texelFetch(blueNoiseTexture, texel, 0)[dimension % 4];
+        return fract(value + uintToUnitFloat(frameHash));
+    }
+
+    return uintToUnitFloat(pcgHash(pcgHash(s.pixel.x + pcgHash(s.pixel.y)) ^ frameHash));
+}
+
+vec2 nextSample2D(inout Sampler s)
+{
+    return vec2(nextSample(s), nextSample(s));
+}
+
+// Uniformly distributed direction on the unit sphere
+vec3 sampleSphere(vec2 u)
+{
+    const float z = 1.0F - 2.0F * u.x;
+    const float r = sqrt(max(0.0F, 1.0F - z * z));
+    const float phi = 2.0F * PI * u.y;
+    return vec3(r * cos(phi), r * sin(phi), z);
+}
+
+// Cosine weighted direction around a normal, the normal moved by a point on
+// the unit sphere is distributed that way. The pdf is the cosine over pi
+vec3 sampleCosineHemisphere(vec3 normal, vec2 u, out float pdf)
+{
+    const vec3 direction = normal + sampleSphere(u);
+    const float len = length(direction);
+    if (len < EPSILON) {
+        pdf = 1.0F / PI;
+        return normal;
+    }
+    pdf = max(dot(normal, direction / len), 0.0F) / PI;
+    return direction / len;
+}
@@ -0,0 +1,84 @@
+// SVGF, see Schied et al., Spatiotemporal variance-guided filtering:
+// real-time reconstruction for path-traced global illumination
+//
+// Denoises the illumination of the primary hits of restir.glsl, so a single
+// path per pixel gives a clean image:
+// 1. raygen.rgen, or wavefront_connect.comp, writes the motion of every
+//    primary hit, restir_shade.rgen its demodulated illumination, the color
+//    divided by the albedo
+// 2. svgf_temporal.comp blends the illumination and its first two luminance
+//    moments into the history the hit had in the previous frame
+// 3. svgf_variance.comp estimates the variance of the illumination, from its
+//    neighbours where the history is still short
+// 4. svgf_atrous.comp runs DENOISE_ITERATIONS edge-aware a-trous wavelet
+//    passes. The first one is the next frame's history, the last one
+//    multiplies the albedo back in and writes the image
+//
+// Every frame in flight owns a segment of Raytracer::denoiserBuffer, the
+// wavelet passes ping-pong between the two segments of
+// Raytracer::denoiserFilterBuffer. Needs restir.glsl
+
+// Raytracer::DENOISER_WORKGROUP_SIZE
+#define SVGF_WORKGROUP_SIZE 8
+// The least the new frame counts in the history
+#define SVGF_ALPHA 0.2F
+#define SVGF_MOMENTS_ALPHA 0.2F
+// Histories shorter than this get their variance from the neighbours
+#define SVGF_MIN_HISTORY 4.0F
+#define SVGF_MAX_HISTORY 32.0F
+// Edge stopping, the luminance in standard deviations, the normal as an
+// exponent of the cosine and the distance from the pixel's tangent plane
+// relative to its distance from the camera
+#define SVGF_PHI_LUMINANCE 4.0F
+#define SVGF_PHI_NORMAL 128.0F
+#define SVGF_PHI_PLANE 0.02F
+// Keeps black albedos from blowing up the illumination
+#define SVGF_MIN_ALBEDO 0.001F
+// The motion of a hit the previous frame did not see
+#define SVGF_NO_MOTION 1.0e9F
+
+// Raytracer::DenoiserPixel
+struct DenoiserPixel {
+    vec4 illumination; // The demodulated illumination, its variance in w
+    vec4 moments;      // The luminance's first two moments, the history length in z
+    vec2 motion;       // The offset to the pixel's position in the previous frame
+    vec2 padding;
+};
+
+layout(binding = 19, set = 0) buffer PrevDenoiserPixels { DenoiserPixel p[]; } prevDenoiserPixels;
+layout(binding = 20, set = 0) buffer DenoiserPixels { DenoiserPixel p[]; } denoiserPixels;
+// The illumination and its variance, the wavelet passes read one and write
+// the other
+layout(binding = 21, set = 0) buffer DenoiserFilterA { vec4 p[]; } denoiserFilterA;
+layout(binding = 22, set = 0) buffer DenoiserFilterB { vec4 p[]; } denoiserFilterB;
+
+// The albedo the illumination is divided by, 1 where the primary ray missed
+vec3 svgfAlbedo(ReSTIRPixel pixel)
+{
+    return pixel.position.w == RESTIR_NO_HIT ? vec3(1.0F) : max(pixel.albedo.xyz, vec3(SVGF_MIN_ALBEDO));
+}
+
+// The offset from the pixel to where the previous frame saw its primary hit
+vec2 svgfMotion(ReSTIRPixel pixel, mat4 prevViewProjection, uvec2 id, uvec2 size)
+{
+    const vec4 clip = prevViewProjection * vec4(pixel.position.xyz, 1.0F);
+    if (pixel.position.w == RESTIR_NO_HIT || clip.w <= 0.0F) {
+        return vec2(SVGF_NO_MOTION);
+    }
+    const vec2 prevUV = (clip.xy / clip.w) * 0.5F + 0.5F;
+    return prevUV * vec2(size) - (vec2(id) + 0.5F);
+}
+
+// How much the neighbour's illumination counts for the pixel, by their
+// geometry and the difference of their luminance. phiLuminance is the
+// luminance difference that costs a factor of e
+float svgfWeight(ReSTIRPixel pixel, ReSTIRPixel neighbour, float luminanceDifference, float phiLuminance)
+{
+    if (neighbour.position.w == RESTIR_NO_HIT) {
+        return 0.0F;
+    }
+
+    const float normalWeight = pow(max(dot(pixel.normal.xyz, neighbour.normal.xyz), 0.0F), SVGF_PHI_NORMAL);
+    const float plane = abs(dot(pixel.normal.xyz, neighbour.position.xyz - pixel.position.xyz));
+    return normalWeight * exp(-plane / (SVGF_PHI_PLANE * pixel.position.w) - abs(luminanceDifference) / phiLuminance);
+}
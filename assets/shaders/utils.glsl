@@ -1,11 +1,27 @@
 #define EPSILON 0.01F
 
-#define SAMPLES 3
-#define MAX_REFLECTIONS 3
-#define LIGHT_SAMPLES 32
-#define LIGHT_SAMPLES_SQRT 7 // = SQRT(LIGHT_SAMPLES)
-#define AMBIENT_LIGHT 0.24F
-#define LIGHT_MULTIPLIER 36
+// Quality settings, specialized by Raytracer::QualitySettings when the
+// pipeline is created. The defaults are the medium preset
+layout(constant_id = 0) const int SAMPLES = 3;
+layout(constant_id = 1) const int MAX_REFLECTIONS = 3;
+layout(constant_id = 2) const int LIGHT_SAMPLES = 49;
+layout(constant_id = 3) const float AMBIENT_LIGHT = 0.24F;
+layout(constant_id = 4) const float LIGHT_MULTIPLIER = 36.0F;
+layout(constant_id = 5) const bool SHADOW_RAYS = true;
+layout(constant_id = 6) const int LIGHTS_PER_HIT = 4;
+layout(constant_id = 7) const int LIGHT_SAMPLING = 1;
+layout(constant_id = 8) const bool RESTIR = true;
+layout(constant_id = 9) const int RESTIR_CANDIDATES = 16;
+layout(constant_id = 10) const int RESTIR_SPATIAL_SAMPLES = 4;
+layout(constant_id = 11) const bool RESTIR_GI = false;
+layout(constant_id = 12) const bool DENOISE = false;
+layout(constant_id = 13) const int DENOISE_ITERATIONS = 5;
+
+// Hit records per geometry, RAY_TYPE_COUNT in raytracer.hpp. Primary rays use
+// the first record, shadow rays the second
+#define RAY_TYPE_COUNT 2
+#define PRIMARY_RAY 0
+#define SHADOW_RAY 1
 
 struct RayPayload {
 	vec3 color;
@@ -14,22 +30,72 @@ struct RayPayload {
 	vec3 normal;
 	float reflector;
     float material;
+    // The next random number dimension of the pixel, carried through the
+    // hit so its light samples do not reuse the path's numbers
+    uint sampleDimension;
+    // Zero if the hit leaves direct lighting to ReSTIR, see restir.glsl
+    uint directLight;
+};
+
+// A BLAS geometry, GeometryInfo in raytracer.hpp
+struct GeometryInfo {
+  uint firstIndex;
+  uint materialIndex;
+};
+
+// A scene material, MaterialInfo in raytracer.hpp. Texture 0 means none
+struct MaterialInfo {
+  vec4 baseColorFactor;
+  uint baseColorTexture;
+  uint emissiveTexture;
+  uint normalTexture;
+  float roughnessFactor;
+  float alphaCutoff;
+  uint _pad0;
+  uint _pad1;
+  uint _pad2;
 };
 
 struct Vertex {
-  vec3 pos;
   vec3 normal;
+  vec4 tangent;
   vec2 uv;
   vec4 color;
-  vec4 texId;
-  vec4 normalId;
-  vec4 _pad2;
  };
 
-uint random_uint(int seed) {
-    uint rand = seed;
-    for (int i = 0; i < 3; i++) {
-        rand = (1140671485 * rand + 128201163) % uint(pow(2, 23));
+// Inverse of the octahedral projection in gltf_model::PackedVertex::pack
+vec3 octahedralDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0F - abs(e.x) - abs(e.y));
+    if (v.z < 0.0F) {
+        v.xy = (1.0F - abs(v.yx)) * vec2(v.x >= 0.0F ? 1.0F : -1.0F, v.y >= 0.0F ? 1.0F : -1.0F);
     }
-    return rand;
+    return normalize(v);
+}
+
+// Decodes the shading attributes of a gltf_model::PackedVertex
+Vertex unpackVertex(uvec4 data) {
+    Vertex v;
+    v.normal = octahedralDecode(unpackSnorm2x16(data.x));
+    // The lowest bit of the tangent holds the bitangent sign
+    v.tangent = vec4(octahedralDecode(unpackSnorm2x16(data.y)), (data.y & 0x10000U) != 0 ? -1.0F : 1.0F);
+    v.uv = unpackHalf2x16(data.z);
+    v.color = unpackUnorm4x8(data.w);
+    return v;
+}
+
+// Rec. 709 luminance
+float luminance(vec3 color)
+{
+    return dot(color, vec3(0.2126F, 0.7152F, 0.0722F));
+}
+
+// Blinn-Phong lighting from one light without occlusion, seen along a ray
+float lightContribution(vec4 light, vec3 position, vec3 normal, vec3 rayOrigin, vec3 rayDirection)
+{
+    float dist = distance(position, light.xyz);
+    float intensity = LIGHT_MULTIPLIER * light.w / (dist * dist);
+
+    vec3 halfway = normalize(normalize(light.xyz) - normalize(rayOrigin) - normalize(rayDirection));
+    float halfway_dot = clamp(abs(dot(halfway, normal)), 0.0F, 1.0F);
+    return 4 * halfway_dot * intensity / sqrt(float(LIGHT_SAMPLES));
 }
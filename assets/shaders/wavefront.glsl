@@ -0,0 +1,213 @@
+// A wavefront path tracer, see Laine et al., Megakernels considered harmful:
+// wavefront path tracing on GPUs
+//
+// The alternative to the path loop of raygen.rgen, selected with
+// Raytracer::Integrator::Wavefront. Every pixel has one path in flight, the
+// paths live in buffers and every stage is its own compute dispatch over a
+// queue, so the threads of a dispatch all do the same kind of work:
+// 1. wavefront_generate.comp starts the path of every pixel and queues its
+//    camera ray
+// 2. wavefront_extend.comp finds the closest hit of every queued ray with a
+//    ray query and counts the hits of every material
+// 3. wavefront_scan.comp turns the counts into the first sorted slot of
+//    every material, wavefront_scatter.comp sorts the hits by material
+// 4. wavefront_shade.comp evaluates the surfaces in material order and
+//    queues a shadow ray per sampled light
+// 5. wavefront_shadow.comp traces the queued shadow rays
+// 6. wavefront_connect.comp lights the hits, adds them to the ReSTIR pixels
+//    and queues the bounces
+// Steps 2 to 6 run MAX_REFLECTIONS times, all of it SAMPLES times. The
+// ReSTIR pixels then go through restir_shade.rgen like the megakernel's.
+//
+// Queues append with one atomic per subgroup, and every workgroup grows the
+// workgroup count of the queue's indirect dispatch once when it is done. The
+// ray and hit queues alternate with the parity of the bounce, so a stage
+// never fills the queue it reads. Needs restir.glsl
+
+#extension GL_KHR_shader_subgroup_ballot : require
+
+// Raytracer::WAVEFRONT_WORKGROUP_SIZE
+#define WAVEFRONT_WORKGROUP_SIZE 64
+// Raytracer::WAVEFRONT_MAX_GROUPS, a dispatch loops over the rest
+#define WAVEFRONT_MAX_GROUPS 65535U
+// Random number dimensions of one sample's path
+#define WAVEFRONT_SAMPLE_DIMENSIONS 256U
+// The extent of the rays, as in raygen.rgen
+#define WAVEFRONT_TMIN 0.001F
+#define WAVEFRONT_TMAX 10000.0F
+
+// Raytracer::WavefrontQueues. The xyz of a queue are the workgroups of the
+// indirect dispatch over it, w its length
+struct WavefrontQueues {
+    uvec4 rays[2];
+    uvec4 hits[2];
+    uvec4 shadows;
+};
+
+// Raytracer::WavefrontPath, the path of the pixel with the same index
+struct WavefrontPath {
+    float throughput; // What the light of the next hit is scaled by
+    uint dimension;   // The next random number dimension
+};
+
+// Raytracer::WavefrontRay
+struct WavefrontRay {
+    vec3 origin;
+    uint path;
+    vec3 direction;
+    uint padding;
+};
+
+// Raytracer::WavefrontHit
+struct WavefrontHit {
+    vec4 normalTransform[3]; // The columns of the world to object rotation
+    vec2 barycentrics;
+    float t;
+    uint ray;                // The ray's index in rays
+    uint geometry;           // The instance custom index plus the geometry index
+    uint primitive;
+    uint material;
+    uint padding;
+};
+
+// Raytracer::WavefrontSurface, what connecting a hit needs of its shading
+struct WavefrontSurface {
+    vec3 color;
+    float reflector;
+    vec3 normal;
+    uint padding;
+};
+
+// Raytracer::WavefrontShadowRay. Every hit has LIGHTS_PER_HIT of them, the
+// ones that are not traced or occluded contribute 0
+struct WavefrontShadowRay {
+    uint light;
+    float contribution; // The light's share of the hit's lighting
+};
+
+layout(binding = 23, set = 0) buffer WavefrontQueueCounts { WavefrontQueues q; } queues;
+layout(binding = 24, set = 0) buffer WavefrontPaths { WavefrontPath p[]; } paths;
+// Two queues of one ray per path
+layout(binding = 25, set = 0) buffer WavefrontRays { WavefrontRay r[]; } rays;
+layout(binding = 26, set = 0) buffer WavefrontHits { WavefrontHit h[]; } hits;
+layout(binding = 27, set = 0) buffer WavefrontSortedHits { uint h[]; } sortedHits;
+layout(binding = 28, set = 0) buffer WavefrontSurfaces { WavefrontSurface s[]; } surfaces;
+layout(binding = 29, set = 0) buffer WavefrontShadowRays { WavefrontShadowRay r[]; } shadowRays;
+// The shadow rays that are traced
+layout(binding = 30, set = 0) buffer WavefrontShadowQueue { uint r[]; } shadowQueue;
+// The hits of every material in x, the next sorted slot in y
+layout(binding = 31, set = 0) buffer WavefrontMaterialBins { uvec2 b[]; } materialBins;
+
+// The threads of a dispatch step through its queue by this much
+#define WAVEFRONT_STRIDE (gl_NumWorkGroups.x * WAVEFRONT_WORKGROUP_SIZE)
+
+uint wavefrontPathCount()
+{
+    return uint(frame.width * frame.height);
+}
+
+uvec2 wavefrontPixel(uint path)
+{
+    return uvec2(path % frame.width, path / frame.width);
+}
+
+// The workgroups a queue of some length needs
+uint wavefrontGroups(uint length)
+{
+    return min((length + WAVEFRONT_WORKGROUP_SIZE - 1) / WAVEFRONT_WORKGROUP_SIZE, WAVEFRONT_MAX_GROUPS);
+}
+
+// The end of the slots the workgroup appended, see endAppends
+shared uint wavefrontAppendEnd;
+
+// Call in uniform control flow before the workgroup appends
+void beginAppends()
+{
+    if (gl_LocalInvocationIndex == 0) {
+        wavefrontAppendEnd = 0;
+    }
+    barrier();
+}
+
+// Call in uniform control flow after the workgroup appended. Returns the
+// workgroups the queue needs for the slots of this workgroup, the first
+// invocation grows the queue's dispatch with them
+uint endAppends()
+{
+    barrier();
+    return wavefrontGroups(wavefrontAppendEnd);
+}
+
+// The elected invocation reserved count slots from first, every active
+// invocation gets the one of its rank
+uint wavefrontSlot(uvec4 ballot, uint first)
+{
+    return subgroupBroadcastFirst(first) + subgroupBallotExclusiveBitCount(ballot);
+}
+
+// Appends to the ray queue of a parity, the slot is relative to the queue
+uint appendRay(uint parity)
+{
+    const uvec4 ballot = subgroupBallot(true);
+    uint first = 0;
+    if (subgroupElect()) {
+        const uint count = subgroupBallotBitCount(ballot);
+        first = atomicAdd(queues.q.rays[parity].w, count);
+        atomicMax(wavefrontAppendEnd, first + count);
+    }
+    return wavefrontSlot(ballot, first);
+}
+
+uint appendHit(uint parity)
+{
+    const uvec4 ballot = subgroupBallot(true);
+    uint first = 0;
+    if (subgroupElect()) {
+        const uint count = subgroupBallotBitCount(ballot);
+        first = atomicAdd(queues.q.hits[parity].w, count);
+        atomicMax(wavefrontAppendEnd, first + count);
+    }
+    return wavefrontSlot(ballot, first);
+}
+
+uint appendShadowRay()
+{
+    const uvec4 ballot = subgroupBallot(true);
+    uint first = 0;
+    if (subgroupElect()) {
+        const uint count = subgroupBallotBitCount(ballot);
+        first = atomicAdd(queues.q.shadows.w, count);
+        atomicMax(wavefrontAppendEnd, first + count);
+    }
+    return wavefrontSlot(ballot, first);
+}
+
+// The invocations of a subgroup with the same material share one atomic on
+// its bin, every iteration takes the material of the first active one
+void countMaterial(uint material)
+{
+    for (;;) {
+        if (subgroupBroadcastFirst(material) == material) {
+            const uvec4 ballot = subgroupBallot(true);
+            if (subgroupElect()) {
+                atomicAdd(materialBins.b[material].x, subgroupBallotBitCount(ballot));
+            }
+            return;
+        }
+    }
+}
+
+// Reserves the next sorted slot of a material, like countMaterial
+uint materialSlot(uint material)
+{
+    for (;;) {
+        if (subgroupBroadcastFirst(material) == material) {
+            const uvec4 ballot = subgroupBallot(true);
+            uint first = 0;
+            if (subgroupElect()) {
+                first = atomicAdd(materialBins.b[material].y, subgroupBallotBitCount(ballot));
+            }
+            return wavefrontSlot(ballot, first);
+        }
+    }
+}
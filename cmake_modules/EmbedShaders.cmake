@@ -0,0 +1,66 @@
+# Writes a C++ source that embeds compiled SPIR-V modules, so the executables
+# start without reading shaders from disk. Run in script mode:
+#
+#   cmake -DSPIRV_FILES="a.spv|b.spv" -DOUTPUT=embedded_shaders.cpp
+#         -P EmbedShaders.cmake
+#
+# The list is separated by "|" as ";" does not survive a custom command.
+# Every module is looked up as "shaders/<file name>", the path the
+# executables load it from otherwise.
+
+string(REPLACE "|" ";" SPIRV_FILES "${SPIRV_FILES}")
+
+# CMake regular expressions have no repetition counts
+string(REPEAT "0x[0-9a-f][0-9a-f]," 12 BYTES_PER_LINE)
+
+set(ARRAYS "")
+set(ENTRIES "")
+set(INDEX 0)
+foreach(SPIRV ${SPIRV_FILES})
+  get_filename_component(FILE_NAME ${SPIRV} NAME)
+  file(READ ${SPIRV} HEX_CONTENTS HEX)
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," BYTES "${HEX_CONTENTS}")
+  string(REGEX REPLACE "(${BYTES_PER_LINE})" "\\1\n    " BYTES "${BYTES}")
+  string(APPEND ARRAYS
+         "alignas(4) const unsigned char SHADER_${INDEX}[] = {\n    ${BYTES}};\n\n")
+  string(APPEND ENTRIES
+         "    {\"shaders/${FILE_NAME}\", SHADER_${INDEX}, sizeof(SHADER_${INDEX})},\n")
+  math(EXPR INDEX "${INDEX} + 1")
+endforeach()
+
+if(INDEX EQUAL 0)
+  message(FATAL_ERROR "No SPIR-V modules to embed")
+endif()
+
+file(WRITE ${OUTPUT}.tmp
+"// Generated by cmake_modules/EmbedShaders.cmake, do not edit
+#include \"vulkan_utils/embedded_shaders.hpp\"
+
+#include <cstring>
+
+namespace embedded_shaders {
+namespace {
+${ARRAYS}const Shader SHADERS[] = {
+${ENTRIES}};
+} // namespace
+
+const Shader *find(const char *name) {
+    for (const Shader &shader : SHADERS) {
+        if (strcmp(shader.name, name) == 0) {
+            return &shader;
+        }
+    }
+    return nullptr;
+}
+} // namespace embedded_shaders
+")
+
+# Only touch the output if it changed, so an unchanged shader does not
+# rebuild the base library. file(COPY_FILE) would need CMake 3.21
+execute_process(
+  COMMAND ${CMAKE_COMMAND} -E copy_if_different ${OUTPUT}.tmp ${OUTPUT}
+  RESULT_VARIABLE COPY_RESULT)
+if(NOT COPY_RESULT EQUAL 0)
+  message(FATAL_ERROR "Could not write ${OUTPUT}")
+endif()
+file(REMOVE ${OUTPUT}.tmp)
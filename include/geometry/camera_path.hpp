@@ -0,0 +1,90 @@
+#pragma once
+#include "common.hpp"
+#include "geometry/camera.hpp"
+
+namespace geometry {
+/* Default recording properties */
+static const float DEFAULT_RECORD_INTERVAL =
+    1.0F / 30.0F; /**< Minimal time between two recorded keys */
+
+/**
+ * \brief A single camera key on a path
+ */
+struct CameraKey {
+    float time = 0.0F;                       /**< Time of the key in seconds */
+    glm::vec3 position = {0.0F, 0.0F, 0.0F}; /**< Camera position */
+    float rotationVert = 0.0F;               /**< Camera yaw, see Camera */
+    float rotationHoriz = 0.0F;              /**< Camera pitch, see Camera */
+};
+
+/**
+ * \brief A camera path through a scene
+ *
+ * The path is a Catmull-Rom spline through the keys, in position as well as
+ * in rotation. It can be scripted, recorded from a live session and saved to
+ * or loaded from a text file with one "time x y z yaw pitch" key per line.
+ */
+struct CameraPath {
+    std::vector<CameraKey> keys; /**< The keys, sorted by time */
+
+    /**
+     * \fn void record(float time, const Camera &camera, float minInterval)
+     *
+     * \brief Appends the camera state as a key
+     *
+     * \param time - the time of the key, must not decrease
+     * \param camera - the camera to record
+     * \param minInterval - keys closer than this to the last one are dropped
+     */
+    void record(float time, const Camera &camera,
+                float minInterval = DEFAULT_RECORD_INTERVAL);
+
+    /**
+     * \fn void apply(float time, Camera &camera) const
+     *
+     * \brief Moves the camera to its position on the path at the given time
+     *
+     * \param time - the time on the path, clamped to the path duration
+     * \param camera - the camera to move
+     */
+    void apply(float time, Camera &camera) const;
+
+    /**
+     * \fn float duration() const
+     *
+     * \return The time of the last key
+     */
+    [[nodiscard]] float duration() const;
+
+    /**
+     * \fn void save(const std::string &filename) const
+     *
+     * \brief Writes the keys to a file
+     *
+     * \param filename - the file to write
+     */
+    void save(const std::string &filename) const;
+
+    /**
+     * \fn static CameraPath load(const std::string &filename)
+     *
+     * \brief Reads keys written by save()
+     *
+     * \param filename - the file to read
+     *
+     * \return The loaded path
+     *
+     * \throw std::runtime_error if the file can not be read or has no keys
+     */
+    static CameraPath load(const std::string &filename);
+
+    /**
+     * \fn static CameraPath sponzaFlythrough()
+     *
+     * \brief A scripted loop around the sponza atrium
+     *
+     * \return The scripted path
+     */
+    static CameraPath sponzaFlythrough();
+};
+} // namespace geometry
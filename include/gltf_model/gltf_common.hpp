@@ -36,7 +36,8 @@ enum FileLoadingFlags {
     PreTransformVertices = 0x00000001,
     PreMultiplyVertexColors = 0x00000002,
     FlipY = 0x00000004,
-    DontLoadImages = 0x00000008
+    DontLoadImages = 0x00000008,
+    KeepHostGeometry = 0x00000010
 };
 
 enum RenderFlags {
@@ -15,10 +15,13 @@ struct Mesh {
 
     std::vector<Primitive *> primitives;
     std::string name;
+    // Hash of the primitives' positions and indices, keys cached
+    // acceleration structures
+    uint64_t geometryHash = 0;
 
     struct UniformBuffer {
         VkBuffer buffer;
-        VkDeviceMemory memory;
+        memory_allocator::Allocation memory;
         VkDescriptorBufferInfo descriptor;
         VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
         void *mapped;
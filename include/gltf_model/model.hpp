@@ -18,6 +18,9 @@ class Model {
     gltf_model::Texture *getTexture(uint32_t index);
     gltf_model::Texture emptyTexture;
     void createEmptyTexture(VkQueue transferQueue);
+    void uploadBuffer(VkQueue transferQueue, VkBufferUsageFlags usage,
+                      const void *data, VkDeviceSize size, VkBuffer *buffer,
+                      memory_allocator::Allocation *memory);
 
     std::shared_ptr<device::DeviceHandler> m_deviceHandler;
     std::shared_ptr<command_buffer::CommandBufferHandler> m_commandBuffer;
@@ -28,15 +31,30 @@ class Model {
     struct Vertices {
         int count;
         VkBuffer buffer;
-        VkDeviceMemory memory;
+        memory_allocator::Allocation memory;
     } vertices;
 
     struct Indices {
         int count;
         VkBuffer buffer;
-        VkDeviceMemory memory;
+        memory_allocator::Allocation memory;
     } indices;
 
+    // Split vertex streams for ray tracing, indexed like the vertex buffer:
+    // tightly packed positions as BLAS build input and PackedVertex shading
+    // attributes for the hit shaders
+    struct VertexStream {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        memory_allocator::Allocation memory;
+    };
+    VertexStream positions;
+    VertexStream attributes;
+
+    // Copies of the position stream and the index buffer in host memory, only
+    // filled with FileLoadingFlags::KeepHostGeometry
+    std::vector<glm::vec3> hostPositions;
+    std::vector<uint32_t> hostIndices;
+
     std::vector<Node *> nodes;
     std::vector<Node *> linearNodes;
 
@@ -57,6 +75,7 @@ class Model {
     bool metallicRoughnessWorkflow = true;
     bool buffersBound = false;
     std::string path;
+    uint32_t fileLoadingFlags = gltf_model::FileLoadingFlags::None;
 
     Model() = default;
     ~Model();
@@ -21,9 +21,12 @@ struct Node {
     glm::vec3 translation{};
     glm::vec3 scale{1.0F};
     glm::quat rotation{};
+    // Set when the node's world matrix changed, cleared by whoever consumes it
+    bool transformDirty = false;
     [[nodiscard]] glm::mat4 localMatrix() const;
     [[nodiscard]] glm::mat4 getMatrix() const;
     void update();
+    void markDirty();
     ~Node();
 };
 
@@ -14,7 +14,7 @@ struct Texture {
     std::string name;
     VkImage image;
     VkImageLayout imageLayout;
-    VkDeviceMemory deviceMemory;
+    memory_allocator::Allocation deviceMemory;
     VkImageView view;
     uint32_t width, height;
     uint32_t mipLevels;
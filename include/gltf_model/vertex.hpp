@@ -12,8 +12,7 @@ enum class VertexComponent {
     UV,
     Color,
     Tangent,
-    Weight0,
-    TextureID
+    Weight0
 };
 
 struct Vertex {
@@ -21,7 +20,6 @@ struct Vertex {
     glm::vec3 normal;
     glm::vec2 uv;
     glm::vec4 color;
-    glm::vec4 texId;
     glm::vec4 weight0;
     glm::vec4 tangent;
     static VkVertexInputBindingDescription vertexInputBindingDescription;
@@ -42,4 +40,17 @@ struct Vertex {
     static VkPipelineVertexInputStateCreateInfo *
     getPipelineVertexInputState(std::vector<VertexComponent> components);
 };
+
+/*
+    Shading attributes of a vertex as the ray tracing hit shaders fetch them,
+   PackedVertex in utils.glsl. Positions live in a stream of their own
+*/
+struct PackedVertex {
+    uint32_t normal;  // Octahedral, two snorm16
+    uint32_t tangent; // Octahedral, two snorm16, the lowest bit of the
+                      // second one is set for a negative bitangent sign
+    uint32_t uv;      // Two halfs
+    uint32_t color;   // Four unorm8
+    static PackedVertex pack(const Vertex &vertex);
+};
 } // namespace gltf_model
@@ -0,0 +1,128 @@
+#pragma once
+#include "common.hpp"
+#include "vulkan_utils/raytracer_base.hpp"
+
+namespace as_build_scheduler {
+/**
+ * \file
+ * \brief Packs many acceleration structure builds into few build commands.
+ *
+ * Builds inside one vkCmdBuildAccelerationStructuresKHR call may run
+ * concurrently, so each needs its own scratch range. The scheduler packs the
+ * builds into batches whose scratch fits one arena, and the batches reuse the
+ * arena one after the other.
+ */
+
+const VkDeviceSize DEFAULT_SCRATCH_ARENA_SIZE =
+    64ULL * 1024 * 1024; /**< Scratch memory shared by a batch, grown to fit
+                            the largest single build */
+
+/**
+ * \struct BuildRequest
+ * \brief A single acceleration structure build.
+ */
+struct BuildRequest {
+    VkAccelerationStructureBuildGeometryInfoKHR
+        info; /**< The build, its scratch address is set by the scheduler. */
+    const VkAccelerationStructureBuildRangeInfoKHR
+        *ranges; /**< One range per geometry, kept alive by the caller. */
+    VkDeviceSize scratchSize; /**< The buildScratchSize of the build. */
+};
+
+/**
+ * \class BuildScheduler
+ * \brief Batches acceleration structure builds over one scratch arena.
+ *
+ * Requests are packed first-fit by decreasing scratch size. Every batch is
+ * one build command, batches are separated by a barrier because they reuse
+ * the same scratch memory.
+ */
+class BuildScheduler {
+  public:
+    /**
+     * \fn BuildScheduler(raytracer::RaytracerBase &raytracer,
+     *                    VkDeviceSize arenaSize)
+     *
+     * \brief Creates an empty scheduler, the arena is created on first use.
+     *
+     * \param raytracer Provides the build functions and scratch buffers.
+     * \param arenaSize The scratch budget of a batch.
+     */
+    explicit BuildScheduler(
+        raytracer::RaytracerBase &raytracer,
+        VkDeviceSize arenaSize = DEFAULT_SCRATCH_ARENA_SIZE);
+
+    /**
+     * \fn ~BuildScheduler()
+     *
+     * \brief Frees the arena, recorded builds must have completed.
+     */
+    ~BuildScheduler();
+
+    BuildScheduler(const BuildScheduler &) = delete;
+    BuildScheduler &operator=(const BuildScheduler &) = delete;
+
+    /**
+     * \fn void add(const VkAccelerationStructureBuildGeometryInfoKHR &info,
+     *              const VkAccelerationStructureBuildRangeInfoKHR *ranges,
+     *              VkDeviceSize scratchSize)
+     *
+     * \brief Queues a build.
+     *
+     * \param info The build, its geometries must outlive the build.
+     * \param ranges One range per geometry.
+     * \param scratchSize The scratch size reported for the build type that
+     * will be used.
+     */
+    void add(const VkAccelerationStructureBuildGeometryInfoKHR &info,
+             const VkAccelerationStructureBuildRangeInfoKHR *ranges,
+             VkDeviceSize scratchSize);
+
+    /**
+     * \fn void record(VkCommandBuffer commandBuffer)
+     *
+     * \brief Records the queued builds on the device and clears the queue.
+     *
+     * The arena is reused by later calls, so the command buffer must have
+     * completed before the next record().
+     *
+     * \param commandBuffer The command buffer to record into.
+     */
+    void record(VkCommandBuffer commandBuffer);
+
+    /**
+     * \fn VkResult buildOnHost()
+     *
+     * \brief Builds the queued requests on the host, batch after batch, and
+     * clears the queue. See RaytracerBase::buildAccelerationStructuresOnHost.
+     *
+     * \return The result of the first failing batch, or VK_SUCCESS.
+     */
+    VkResult buildOnHost();
+
+    /**
+     * \fn uint32_t getBatchCount() const
+     *
+     * \return The number of build commands the last build was split into.
+     */
+    [[nodiscard]] uint32_t getBatchCount() const { return m_batchCount; }
+
+  private:
+    raytracer::RaytracerBase &m_raytracer;
+    VkDeviceSize m_arenaSize;
+    VkDeviceSize m_alignment;
+
+    std::vector<BuildRequest> m_requests;
+    std::vector<std::vector<uint32_t>> m_batches;
+    std::vector<VkDeviceSize> m_scratchOffsets; // per request, in its batch
+    VkDeviceSize m_requiredArenaSize = 0;
+    uint32_t m_batchCount = 0;
+
+    raytracer::RaytracerBase::ScratchBuffer m_deviceArena{};
+    VkDeviceSize m_deviceArenaSize = 0;
+    std::vector<uint8_t> m_hostArena;
+
+    void m_pack();
+    void m_clear();
+};
+} // namespace as_build_scheduler
@@ -0,0 +1,103 @@
+#pragma once
+#include "common.hpp"
+#include "vulkan_utils/device.hpp"
+
+namespace as_cache {
+/**
+ * \file
+ * \brief On-disk cache of serialized acceleration structures.
+ *
+ * Serialized acceleration structures are only valid for the device and driver
+ * that produced them, so every key includes the device and driver UUIDs. The
+ * data itself is checked with vkGetDeviceAccelerationStructureCompatibilityKHR
+ * before it is deserialized.
+ */
+
+const size_t SERIALIZED_HEADER_SIZE =
+    2 * VK_UUID_SIZE +
+    3 * sizeof(uint64_t); /**< Driver and compatibility UUIDs, serialized
+                             size, deserialized size and handle count */
+const VkDeviceSize SERIALIZED_ALIGNMENT =
+    256; /**< Required alignment of serialized data in device memory. */
+
+/**
+ * \class AccelerationStructureCache
+ * \brief Stores serialized acceleration structures in a directory, one file
+ * per key.
+ */
+class AccelerationStructureCache {
+  public:
+    /**
+     * \fn AccelerationStructureCache(const device::DeviceHandler
+     * &deviceHandler, std::string directory)
+     *
+     * \brief Opens a cache directory, it is created on the first store.
+     *
+     * \param deviceHandler The device the structures are built on.
+     * \param directory The cache directory.
+     */
+    AccelerationStructureCache(const device::DeviceHandler &deviceHandler,
+                               std::string directory);
+
+    /**
+     * \fn std::string key(uint64_t geometryHash,
+     *                     VkBuildAccelerationStructureFlagsKHR flags) const
+     *
+     * \brief The key of an acceleration structure.
+     *
+     * \param geometryHash A hash of the geometry the structure is built from.
+     * \param flags The build flags.
+     *
+     * \return The key, usable as a file name.
+     */
+    [[nodiscard]] std::string
+    key(uint64_t geometryHash,
+        VkBuildAccelerationStructureFlagsKHR flags) const;
+
+    /**
+     * \fn bool load(const std::string &key, std::vector<uint8_t> &data) const
+     *
+     * \brief Reads a serialized acceleration structure and checks that the
+     * device can deserialize it.
+     *
+     * \param key The key.
+     * \param data The serialized data, empty if the function fails.
+     *
+     * \return False if the key is missing, the file is damaged or the data
+     * is incompatible with the device. The structure must be built then.
+     */
+    bool load(const std::string &key, std::vector<uint8_t> &data) const;
+
+    /**
+     * \fn void store(const std::string &key, const void *data, size_t size)
+     * const
+     *
+     * \brief Writes a serialized acceleration structure. Failures only cost
+     * a rebuild on the next start, so they are reported and ignored.
+     *
+     * \param key The key.
+     * \param data The serialized data.
+     * \param size The size of the data.
+     */
+    void store(const std::string &key, const void *data, size_t size) const;
+
+    /**
+     * \fn static VkDeviceSize deserializedSize(const std::vector<uint8_t>
+     * &data)
+     *
+     * \param data Serialized acceleration structure data.
+     *
+     * \return The size of the acceleration structure it deserializes into.
+     */
+    static VkDeviceSize deserializedSize(const std::vector<uint8_t> &data);
+
+  private:
+    VkDevice m_device;
+    PFN_vkGetDeviceAccelerationStructureCompatibilityKHR
+        m_vkGetDeviceAccelerationStructureCompatibilityKHR;
+    std::string m_directory;
+    uint64_t m_deviceHash; /**< Hash of the device and driver UUIDs. */
+
+    [[nodiscard]] std::string m_path(const std::string &key) const;
+};
+} // namespace as_cache
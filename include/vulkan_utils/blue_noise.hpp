@@ -0,0 +1,38 @@
+#pragma once
+#include "common.hpp"
+
+namespace blue_noise {
+/**
+ * \file
+ * \brief Generation of tileable blue noise textures.
+ *
+ * Blue noise has no low frequencies, so neighbouring pixels that sample with
+ * it make errors that average out over a few pixels instead of forming
+ * clumps.
+ */
+
+const uint32_t DEFAULT_SIZE = 64;  /**< Side of the generated tile. */
+const float DEFAULT_SIGMA = 1.5F;  /**< Width of the energy filter. */
+const float KERNEL_RADIUS_SIGMAS =
+    4.0F; /**< The energy filter is cut off past this many sigmas. */
+const float INITIAL_DENSITY = 0.1F; /**< Share of the initial pattern. */
+
+/**
+ * \fn std::vector<uint8_t> generate(uint32_t size, uint32_t channels,
+ * uint32_t seed)
+ *
+ * \brief Generates a tileable blue noise texture with the void and cluster
+ * method.
+ *
+ * Every channel is an independent rank map, each value in [0, 255] appears
+ * equally often per channel.
+ *
+ * \param size The side of the square texture.
+ * \param channels The interleaved channels per texel.
+ * \param seed The seed of the initial patterns.
+ *
+ * \return The texels, size * size * channels bytes.
+ */
+std::vector<uint8_t> generate(uint32_t size = DEFAULT_SIZE,
+                              uint32_t channels = 4, uint32_t seed = 0);
+} // namespace blue_noise
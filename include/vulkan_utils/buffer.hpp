@@ -45,8 +45,10 @@ class Buffer {
      *
      * \brief Maps the buffer memory into host-accessible memory.
      *
-     * This function maps the buffer memory into host-accessible memory,
-     * allowing the host to read or modify the buffer's data.
+     * Host visible memory is persistently mapped by the allocator, so this
+     * only exposes the mapped pointer of the allocation.
+     *
+     * \throw std::runtime_error if the memory is not host visible
      */
     void map();
 
@@ -181,8 +183,8 @@ class Buffer {
     operator VkBuffer() const { return buffer; }
 
     VkBuffer buffer = VK_NULL_HANDLE; /**< The Vulkan buffer handle. */
-    VkDeviceMemory memory =
-        VK_NULL_HANDLE;                /**< The Vulkan device memory handle. */
+    memory_allocator::Allocation
+        memory; /**< The memory range the buffer is bound to. */
     VkDescriptorBufferInfo descriptor; /**< Descriptor for the buffer. */
     VkDeviceSize size = 0;             /**< Size of the buffer in bytes. */
     VkDeviceSize alignment = 0; /**< Alignment requirement for the buffer. */
@@ -196,7 +198,9 @@ class Buffer {
     /**
      * \fn void m_makeBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                       VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                      VkDeviceMemory &bufferMemory, VkSharingMode sharingMode)
+                      memory_allocator::Allocation &bufferMemory,
+                      VkSharingMode sharingMode, memory_allocator::Lifetime
+                      lifetime)
      *
      * \brief Creates a buffer with the specified properties.
      *
@@ -207,12 +211,30 @@ class Buffer {
      * \param usage The usage flags specifying how the buffer will be used.
      * \param properties The memory property flags for the buffer memory.
      * \param buffer [out] The created Vulkan buffer handle.
-     * \param bufferMemory [out] The allocated Vulkan device memory handle.
+     * \param bufferMemory [out] The allocated memory range.
      * \param sharingMode The sharing mode of the buffer.
+     * \param lifetime How long the buffer is expected to live.
      */
     void m_makeBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                       VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                      VkDeviceMemory &bufferMemory, VkSharingMode sharingMode);
+                      memory_allocator::Allocation &bufferMemory,
+                      VkSharingMode sharingMode,
+                      memory_allocator::Lifetime lifetime =
+                          memory_allocator::Lifetime::Persistent);
+
+    /**
+     * \fn memory_allocator::Allocation m_subRange(VkDeviceSize size,
+     * VkDeviceSize offset) const
+     *
+     * \brief A range of the buffer memory, for flushes and invalidations.
+     *
+     * \param size The size of the range, VK_WHOLE_SIZE for the rest.
+     * \param offset The offset of the range in the buffer.
+     *
+     * \return The range as an allocation.
+     */
+    [[nodiscard]] memory_allocator::Allocation
+    m_subRange(VkDeviceSize size, VkDeviceSize offset) const;
 
     std::shared_ptr<command_buffer::CommandBufferHandler>
         m_commandBuffer; /**< Command buffer handler associated with the buffer.
@@ -230,6 +230,9 @@ VkPushConstantRange pushConstantRange(VkShaderStageFlags stageFlags,
 
 VkBindSparseInfo bindSparseInfo();
 
+VkQueryPoolCreateInfo queryPoolCreateInfo(VkQueryType queryType,
+                                          uint32_t queryCount);
+
 /** @brief Initialize a map entry for a shader specialization constant */
 VkSpecializationMapEntry specializationMapEntry(uint32_t constantID,
                                                 uint32_t offset, size_t size);
@@ -20,7 +20,7 @@ class DepthBuffer {
     DepthBuffer(std::shared_ptr<device::DeviceHandler> deviceHandler);
 
     VkImage depthImage; /**< The depth image. */
-    VkDeviceMemory
+    memory_allocator::Allocation
         depthImageMemory;       /**< The device memory for the depth image. */
     VkImageView depthImageView; /**< The image view for the depth image. */
     VkFormat format;            /**< The format of the depth buffer. */
@@ -1,5 +1,7 @@
 #pragma once
 #include "common.hpp"
+#include "vulkan_utils/memory_allocator.hpp"
+#include "vulkan_utils/pipeline_cache.hpp"
 
 namespace device {
 const int DISCRETE_GPU_BONUS = 1000;  /**< Bonus for descrete GPU */
@@ -29,20 +31,28 @@ class DeviceHandler {
      * \param vkInstance The Vulkan instance associated
      * with the device.
      * \param vkSurface The Vulkan surface associated with the
+     * device, or VK_NULL_HANDLE for headless rendering. In that case no
+     * present or swap chain support is required from the device.
      * \param pNext The pNext with extensions.
-     * device.
+     * \param optionalExt Extensions that are enabled only if the picked
+     * device supports them, see isExtensionEnabled().
      */
     DeviceHandler(std::vector<const char *> &devExt,
                   std::vector<const char *> &validations, VkInstance vkInstance,
                   VkSurfaceKHR vkSurface,
-                  VkPhysicalDeviceFeatures2 *pNext = VK_NULL_HANDLE);
+                  VkPhysicalDeviceFeatures2 *pNext = VK_NULL_HANDLE,
+                  const std::vector<const char *> &optionalExt = {});
 
     /**
      * \fn ~DeviceHandler()
      *
      * \brief Destructor for the DeviceHandler class.
      */
-    ~DeviceHandler() { cleanupDevice(nullptr); }
+    ~DeviceHandler() {
+        pipelineCache.reset();
+        allocator.reset();
+        cleanupDevice(nullptr);
+    }
 
     /**
      * \fn VkDevice()
@@ -91,6 +101,15 @@ class DeviceHandler {
                             physical device */
     VkPhysicalDeviceProperties
         properties; /**< The device physica properties, e. g. memory */
+    VkPhysicalDeviceAccelerationStructureFeaturesKHR
+        enabledAccelerationStructureFeatures{}; /**< The acceleration structure
+                                                   features enabled on the
+                                                   device, all false if the
+                                                   feature chain had none */
+    VkPhysicalDeviceRayQueryFeaturesKHR
+        enabledRayQueryFeatures{}; /**< The ray query features enabled on the
+                                      device, all false if the chain had none
+                                      or VK_KHR_ray_query is unavailable */
 
     /**
      * \fn inline VkQueue getTransferQueue()
@@ -104,6 +123,20 @@ class DeviceHandler {
         return transferQueue != VK_NULL_HANDLE ? transferQueue : graphicsQueue;
     }
 
+    std::vector<const char *>
+        enabledExtensions; /**< Required plus supported optional extensions. */
+
+    /**
+     * \fn bool isExtensionEnabled(const char *name) const
+     *
+     * \brief Checks whether an extension has been enabled on the device.
+     *
+     * \param name The extension name.
+     *
+     * \return True if the extension is enabled.
+     */
+    [[nodiscard]] bool isExtensionEnabled(const char *name) const;
+
     VkPhysicalDevice physicalDevice =
         VK_NULL_HANDLE;                      /**< The physical device. */
     VkDevice logicalDevice = VK_NULL_HANDLE; /**< The logical device. */
@@ -138,6 +171,13 @@ class DeviceHandler {
     uint32_t getMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties,
                            VkBool32 *memTypeFound = nullptr) const;
 
+    std::unique_ptr<memory_allocator::MemoryAllocator>
+        allocator; /**< Sub-allocates all device memory. */
+
+    std::unique_ptr<pipeline_cache::PipelineCache>
+        pipelineCache; /**< Shared by every pipeline created on the device,
+                          persisted between runs. */
+
     /**
      * Create a buffer on the device
      *
@@ -149,10 +189,11 @@ class DeviceHandler {
      * the buffer in byes
      * \param buffer Pointer to the buffer handle acquired by
      * the function
-     * \param memory Pointer to the memory handle acquired by the
-     * function
+     * \param memory Pointer to the allocation acquired by the function
      * \param data Pointer to the data that should be copied to the
      * buffer after creation (optional, if not set, no data is copied over)
+     * \param lifetime Transient for staging and scratch buffers that are
+     * freed soon after creation
      *
      * \return VK_SUCCESS if buffer handle and memory have been created and
      * (optionally passed) data has been copied
@@ -160,7 +201,56 @@ class DeviceHandler {
     VkResult createBuffer(VkBufferUsageFlags usageFlags,
                           VkMemoryPropertyFlags memoryPropertyFlags,
                           VkDeviceSize size, VkBuffer *buffer,
-                          VkDeviceMemory *memory, void *data) const;
+                          memory_allocator::Allocation *memory,
+                          void *data = nullptr,
+                          memory_allocator::Lifetime lifetime =
+                              memory_allocator::Lifetime::Persistent) const;
+
+    /**
+     * \fn void allocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags
+     * memoryPropertyFlags, memory_allocator::Allocation *memory,
+     * memory_allocator::Lifetime lifetime) const
+     *
+     * \brief Allocates memory for a buffer and binds it.
+     *
+     * \param buffer The buffer.
+     * \param memoryPropertyFlags The required memory properties.
+     * \param memory The allocation acquired by the function.
+     * \param lifetime How long the buffer is expected to live.
+     */
+    void allocateBufferMemory(VkBuffer buffer,
+                              VkMemoryPropertyFlags memoryPropertyFlags,
+                              memory_allocator::Allocation *memory,
+                              memory_allocator::Lifetime lifetime =
+                                  memory_allocator::Lifetime::Persistent) const;
+
+    /**
+     * \fn void allocateImageMemory(VkImage image, VkMemoryPropertyFlags
+     * memoryPropertyFlags, memory_allocator::Allocation *memory,
+     * VkImageTiling tiling) const
+     *
+     * \brief Allocates memory for an image and binds it.
+     *
+     * \param image The image.
+     * \param memoryPropertyFlags The required memory properties.
+     * \param memory The allocation acquired by the function.
+     * \param tiling The tiling the image was created with. Linear images
+     * share pools with buffers.
+     */
+    void allocateImageMemory(
+        VkImage image, VkMemoryPropertyFlags memoryPropertyFlags,
+        memory_allocator::Allocation *memory,
+        VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL) const;
+
+    /**
+     * \fn void freeMemory(memory_allocator::Allocation &memory) const
+     *
+     * \brief Returns memory to the allocator, the resource bound to it must
+     * have been destroyed.
+     *
+     * \param memory The allocation, reset by the function.
+     */
+    void freeMemory(memory_allocator::Allocation &memory) const;
 
   private:
     std::vector<const char *>
@@ -172,6 +262,20 @@ class DeviceHandler {
     VkSurfaceKHR
         m_vkSurface; /**< The Vulkan surface associated with the device. */
 
+    /**
+     * \fn bool m_isExtensionSupported(VkPhysicalDevice device, const char
+     * *name)
+     *
+     * \brief Checks if the specified physical device supports an extension.
+     *
+     * \param device The physical device to check.
+     * \param name The extension name.
+     *
+     * \return True if the extension is supported.
+     */
+    static bool m_isExtensionSupported(VkPhysicalDevice device,
+                                       const char *name);
+
     /**
      * \fn bool m_checkDeviceExtensions(VkPhysicalDevice device)
      *
@@ -222,5 +326,43 @@ class DeviceHandler {
      * \return The rating of the device.
      */
     int m_rateDevice(VkPhysicalDevice device);
+
+    /**
+     * \fn static bool m_hasBufferDeviceAddress(VkPhysicalDeviceFeatures2
+     * *pNext)
+     *
+     * \brief Checks whether a feature chain enables bufferDeviceAddress.
+     *
+     * \param pNext The feature chain passed to the device.
+     *
+     * \return True if buffer device addresses are enabled.
+     */
+    static bool m_hasBufferDeviceAddress(VkPhysicalDeviceFeatures2 *pNext);
+
+    /**
+     * \fn void m_resolveAccelerationStructureFeatures(VkPhysicalDeviceFeatures2
+     * *pNext)
+     *
+     * \brief Clears the optional acceleration structure features the picked
+     * device lacks and records the ones that will be enabled.
+     *
+     * accelerationStructureHostCommands is optional, the other features
+     * requested in the chain are required.
+     *
+     * \param pNext The feature chain passed to the device.
+     */
+    void
+    m_resolveAccelerationStructureFeatures(VkPhysicalDeviceFeatures2 *pNext);
+
+    /**
+     * \fn void m_resolveRayQueryFeatures(VkPhysicalDeviceFeatures2 *pNext)
+     *
+     * \brief Unlinks the ray query features from the chain unless
+     * VK_KHR_ray_query is enabled and the picked device supports them, and
+     * records the ones that will be enabled.
+     *
+     * \param pNext The feature chain passed to the device.
+     */
+    void m_resolveRayQueryFeatures(VkPhysicalDeviceFeatures2 *pNext);
 };
 } // namespace device
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+
+namespace embedded_shaders {
+/**
+ * \file
+ * \brief SPIR-V modules compiled into the binary.
+ *
+ * The table is generated by cmake_modules/EmbedShaders.cmake and only linked
+ * in when the project is configured with PARAFLOP_EMBED_SHADERS, which also
+ * defines the macro of the same name for the base library.
+ */
+
+/**
+ * \struct Shader
+ * \brief An embedded SPIR-V module.
+ */
+struct Shader {
+    const char *name;          /**< The path the module would be loaded from */
+    const unsigned char *code; /**< The SPIR-V code, 4 byte aligned */
+    size_t size;               /**< The size of the code in bytes */
+};
+
+/**
+ * \fn const Shader *find(const char *name)
+ *
+ * \brief Looks up an embedded module.
+ *
+ * \param name The path of the module, e.g. "shaders/raygen.rgen.spv".
+ *
+ * \return The module, nullptr if it was not embedded.
+ */
+const Shader *find(const char *name);
+} // namespace embedded_shaders
@@ -0,0 +1,216 @@
+#pragma once
+#include "common.hpp"
+#include "vulkan_utils/device.hpp"
+
+#include <deque>
+
+namespace gpu_profiler {
+/**
+ * \file
+ * \brief Timestamp query based GPU profiling of individual passes.
+ */
+
+const uint32_t DEFAULT_MAX_PASSES = 8; /**< Default number of passes */
+const size_t DEFAULT_HISTORY_SIZE = 256; /**< Default samples kept per pass */
+
+/**
+ * \struct PassStats
+ * \brief Rolling statistics of a single pass, in milliseconds.
+ */
+struct PassStats {
+    float min = 0.0F;   /**< The fastest sample in the history. */
+    float avg = 0.0F;   /**< The average over the history. */
+    float p99 = 0.0F;   /**< The 99th percentile over the history. */
+    size_t samples = 0; /**< The number of samples in the history. */
+};
+
+/**
+ * \class GpuProfiler
+ * \brief Measures GPU time of named passes with timestamp queries.
+ *
+ * Each pass gets a pair of timestamps in every slot of a ring. A slot is
+ * meant to be owned by one command buffer (one frame in flight, or a one-time
+ * setup command buffer), so recording into a slot never races with reading
+ * another one. Results are polled without waiting, a slot is only read back
+ * once all of its queries are available, so collecting never stalls the CPU.
+ */
+class GpuProfiler {
+  public:
+    /**
+     * \fn GpuProfiler(std::shared_ptr<device::DeviceHandler> m_deviceHandler,
+     *                 uint32_t slotCount, uint32_t maxPasses,
+     *                 size_t historySize)
+     *
+     * \brief Creates the timestamp query pool.
+     *
+     * \param m_deviceHandler The device the queries are issued on.
+     * \param slotCount The number of ring slots.
+     * \param maxPasses The maximum number of registered passes.
+     * \param historySize The number of samples the statistics are computed
+     * over.
+     */
+    GpuProfiler(std::shared_ptr<device::DeviceHandler> m_deviceHandler,
+                uint32_t slotCount, uint32_t maxPasses = DEFAULT_MAX_PASSES,
+                size_t historySize = DEFAULT_HISTORY_SIZE);
+
+    /**
+     * \fn ~GpuProfiler()
+     *
+     * \brief Destroys the query pool.
+     */
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    /**
+     * \fn uint32_t registerPass(const std::string &name)
+     *
+     * \brief Registers a pass to be profiled.
+     *
+     * \param name The name the pass is reported under.
+     *
+     * \return The pass index used when writing timestamps.
+     */
+    uint32_t registerPass(const std::string &name);
+
+    /**
+     * \fn void beginPass(VkCommandBuffer cmd, uint32_t slot, uint32_t pass,
+     *                    VkPipelineStageFlagBits stage)
+     *
+     * \brief Resets the queries of the pass and writes its start timestamp.
+     *
+     * \param cmd The command buffer to record into, outside a render pass.
+     * \param slot The ring slot owned by the command buffer.
+     * \param pass The pass index.
+     * \param stage The stage the timestamp is written at.
+     */
+    void beginPass(VkCommandBuffer cmd, uint32_t slot, uint32_t pass,
+                   VkPipelineStageFlagBits stage =
+                       VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
+    /**
+     * \fn void endPass(VkCommandBuffer cmd, uint32_t slot, uint32_t pass,
+     *                  VkPipelineStageFlagBits stage)
+     *
+     * \brief Writes the end timestamp of the pass.
+     *
+     * \param cmd The command buffer to record into.
+     * \param slot The ring slot owned by the command buffer.
+     * \param pass The pass index.
+     * \param stage The stage the timestamp is written at.
+     */
+    void endPass(VkCommandBuffer cmd, uint32_t slot, uint32_t pass,
+                 VkPipelineStageFlagBits stage =
+                     VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+    /**
+     * \fn void markSubmitted(uint32_t slot)
+     *
+     * \brief Marks the passes recorded in the slot as submitted, so that
+     * collect() reads them back once they are available.
+     *
+     * \param slot The slot whose command buffer has been submitted.
+     */
+    void markSubmitted(uint32_t slot);
+
+    /**
+     * \fn void collect()
+     *
+     * \brief Reads back every submitted pass whose timestamps are available,
+     * without waiting for the rest.
+     */
+    void collect();
+
+    /**
+     * \fn PassStats getStats(uint32_t pass) const
+     *
+     * \brief Computes the rolling statistics of a pass.
+     *
+     * \param pass The pass index.
+     *
+     * \return min/avg/p99 of the pass over the history, in milliseconds.
+     */
+    [[nodiscard]] PassStats getStats(uint32_t pass) const;
+
+    /**
+     * \fn void printStats(std::ostream &out) const
+     *
+     * \brief Prints the statistics of every pass that has samples.
+     *
+     * \param out The stream to print to.
+     */
+    void printStats(std::ostream &out) const;
+
+    /**
+     * \fn inline bool isSupported() const
+     *
+     * \brief Checks whether the graphics queue supports timestamps. All
+     * recording calls are no-ops if it does not.
+     *
+     * \return True if timestamps are supported.
+     */
+    [[nodiscard]] inline bool isSupported() const {
+        return m_queryPool != VK_NULL_HANDLE;
+    }
+
+    /**
+     * \fn inline uint32_t getSlotCount() const
+     *
+     * \return The number of ring slots.
+     */
+    [[nodiscard]] inline uint32_t getSlotCount() const { return m_slotCount; }
+
+    /**
+     * \fn inline uint32_t getPassCount() const
+     *
+     * \return The number of registered passes.
+     */
+    [[nodiscard]] inline uint32_t getPassCount() const {
+        return static_cast<uint32_t>(m_passNames.size());
+    }
+
+    /**
+     * \fn inline const std::string &getPassName(uint32_t pass) const
+     *
+     * \return The name of the pass.
+     */
+    [[nodiscard]] inline const std::string &getPassName(uint32_t pass) const {
+        return m_passNames[pass];
+    }
+
+  private:
+    std::shared_ptr<device::DeviceHandler>
+        m_deviceHandler; /**< Device the queries are issued on. */
+    VkQueryPool m_queryPool = VK_NULL_HANDLE; /**< The timestamp pool. */
+    uint32_t m_slotCount;                     /**< The number of ring slots. */
+    uint32_t m_maxPasses;   /**< The maximum number of passes. */
+    size_t m_historySize;   /**< The number of samples kept per pass. */
+    float m_timestampPeriod; /**< Nanoseconds per timestamp tick. */
+    uint64_t m_timestampMask; /**< Mask of the valid timestamp bits. */
+
+    std::vector<std::string> m_passNames; /**< Names of registered passes. */
+    std::vector<std::deque<float>>
+        m_history; /**< Per pass samples in milliseconds. */
+    std::vector<bool>
+        m_recorded; /**< Per slot and pass, whether it has been recorded
+                       since the slot was last submitted. */
+    std::vector<bool>
+        m_pending; /**< Per slot and pass, whether it awaits read back. */
+    std::vector<uint64_t>
+        m_submitted; /**< Per pass, the submissions that recorded it. */
+    std::vector<uint64_t>
+        m_sampled; /**< Per pass, the samples read back, never more than
+                      m_submitted. */
+
+    /**
+     * \fn inline uint32_t m_queryIndex(uint32_t slot, uint32_t pass) const
+     *
+     * \return The index of the begin query of a pass in a slot.
+     */
+    [[nodiscard]] inline uint32_t m_queryIndex(uint32_t slot,
+                                               uint32_t pass) const {
+        return (slot * m_maxPasses + pass) * 2;
+    }
+};
+} // namespace gpu_profiler
@@ -0,0 +1,103 @@
+#pragma once
+#include "common.hpp"
+
+namespace light_sampler {
+/**
+ * \file
+ * \brief Importance sampling structures over the scene lights.
+ *
+ * Lights are vec4s, a position and a power. Both structures are built on the
+ * host and read by light_sampling.glsl, which picks a light with probability
+ * roughly proportional to its contribution instead of looping over all of
+ * them.
+ */
+
+const uint32_t LEAF_BIT =
+    0x80000000U; /**< Marks a LightNode payload as a light index */
+
+/**
+ * \brief How the hit shader picks the lights it traces shadow rays to.
+ */
+enum class Strategy : uint32_t {
+    AliasTable = 0, /**< Proportional to power, in constant time. */
+    Bvh = 1,        /**< Proportional to power over squared distance,
+                       approximated by walking the light BVH. */
+};
+
+/**
+ * \fn Strategy parseStrategy(const std::string &name)
+ *
+ * \brief Parses a light sampling strategy name.
+ *
+ * \param name Either alias or bvh.
+ *
+ * \return The strategy.
+ *
+ * \throw std::runtime_error if the name is unknown
+ */
+Strategy parseStrategy(const std::string &name);
+
+/**
+ * \struct AliasEntry
+ * \brief A bucket of the alias table, AliasEntry in light_sampling.glsl.
+ */
+struct AliasEntry {
+    float probability = 1.0F; /**< Chance to keep the bucket's own light. */
+    uint32_t alias = 0;       /**< The light picked otherwise. */
+    float pdf = 0.0F;         /**< The probability of the bucket's light. */
+    uint32_t padding = 0;
+};
+
+/**
+ * \struct LightNode
+ * \brief A node of the light BVH, LightNode in light_sampling.glsl.
+ *
+ * Nodes are stored depth first, the left child of an interior node directly
+ * follows it.
+ */
+struct LightNode {
+    glm::vec3 boundsMin{0.0F}; /**< The lower corner of the bounds. */
+    float power = 0.0F;        /**< The summed power of the lights below. */
+    glm::vec3 boundsMax{0.0F}; /**< The upper corner of the bounds. */
+    uint32_t payload = 0;      /**< The right child index, or the light index
+                                  with LEAF_BIT set. */
+};
+
+/**
+ * \fn float lightPower(const glm::vec4 &light)
+ *
+ * \brief The power a light is sampled by.
+ *
+ * \param light The light, the position and the power.
+ *
+ * \return The power, negative powers are clamped to zero.
+ */
+inline float lightPower(const glm::vec4 &light) {
+    return std::max(light.w, 0.0F);
+}
+
+/**
+ * \fn std::vector<AliasEntry> buildAliasTable(const std::vector<glm::vec4>
+ * &lights)
+ *
+ * \brief Builds an alias table that picks lights proportional to their
+ * power. If no light has any power, every light is equally likely.
+ *
+ * \param lights The lights.
+ *
+ * \return One entry per light.
+ */
+std::vector<AliasEntry> buildAliasTable(const std::vector<glm::vec4> &lights);
+
+/**
+ * \fn std::vector<LightNode> buildBvh(const std::vector<glm::vec4> &lights)
+ *
+ * \brief Builds a binary BVH with one light per leaf, split at the median
+ * of the longest axis.
+ *
+ * \param lights The lights.
+ *
+ * \return The nodes, 2 * lights.size() - 1 of them, the root first.
+ */
+std::vector<LightNode> buildBvh(const std::vector<glm::vec4> &lights);
+} // namespace light_sampler
@@ -0,0 +1,243 @@
+#pragma once
+#include "common.hpp"
+
+#include <array>
+#include <map>
+#include <mutex>
+
+namespace memory_allocator {
+/**
+ * \file
+ * \brief Sub-allocation of device memory.
+ *
+ * Resources are placed into large VkDeviceMemory blocks instead of getting a
+ * vkAllocateMemory call each, which keeps the allocation count far below
+ * maxMemoryAllocationCount and makes creating a resource cheap.
+ */
+
+const VkDeviceSize DEFAULT_BLOCK_SIZE =
+    64ULL * 1024 * 1024; /**< Size of a pooled block */
+const VkDeviceSize DEFAULT_LINEAR_BLOCK_SIZE =
+    16ULL * 1024 * 1024; /**< Size of a transient block */
+const VkDeviceSize SMALL_HEAP_SIZE =
+    1024ULL * 1024 * 1024; /**< Heaps up to this size get smaller blocks */
+const VkDeviceSize MIN_SIZE_CLASS = 256; /**< The smallest size class */
+const VkDeviceSize MAX_SIZE_CLASS =
+    64ULL * 1024; /**< Larger allocations are not rounded to a size class */
+const uint32_t SIZE_CLASS_COUNT = 9; /**< 256 B to 64 KiB, powers of two */
+const uint32_t INVALID_INDEX = UINT32_MAX; /**< Marks an unused index */
+
+/**
+ * \brief The kind of resource memory is bound to.
+ *
+ * Buffers and optimally tiled images are kept in separate pools so that
+ * bufferImageGranularity never has to be respected inside a block.
+ */
+enum class ResourceKind : uint32_t {
+    Buffer = 0, /**< Buffers and linearly tiled images. */
+    Image = 1,  /**< Optimally tiled images. */
+};
+
+/**
+ * \brief How long an allocation is expected to live.
+ */
+enum class Lifetime : uint32_t {
+    Persistent = 0, /**< Sub-allocated from free lists, freed individually. */
+    Transient = 1,  /**< Bump allocated from a linear block, e.g. staging or
+                       scratch memory. A block is rewound once every
+                       allocation in it is freed. */
+};
+
+/**
+ * \struct Allocation
+ * \brief A range of device memory handed out by the MemoryAllocator.
+ */
+struct Allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE; /**< The backing memory object. */
+    VkDeviceSize offset = 0; /**< The offset of the range in memory. */
+    VkDeviceSize size = 0;   /**< The size reserved for the range. */
+    void *mapped = nullptr;  /**< The mapped range, if host visible. */
+    uint32_t memoryType = 0; /**< The memory type index. */
+    uint32_t pool = INVALID_INDEX;  /**< The pool, INVALID_INDEX if dedicated */
+    uint32_t block = INVALID_INDEX; /**< The block inside the pool. */
+
+    /**
+     * \fn bool isValid() const
+     *
+     * \return True if the allocation holds memory.
+     */
+    [[nodiscard]] bool isValid() const { return memory != VK_NULL_HANDLE; }
+};
+
+/**
+ * \struct HeapStats
+ * \brief Memory usage of a single memory heap.
+ */
+struct HeapStats {
+    VkDeviceSize heapSize = 0;       /**< The size of the heap. */
+    VkDeviceSize reservedBytes = 0;  /**< Bytes in device memory objects. */
+    VkDeviceSize usedBytes = 0;      /**< Bytes handed out to resources. */
+    uint32_t memoryObjectCount = 0;  /**< vkAllocateMemory calls alive. */
+    uint32_t allocationCount = 0;    /**< Allocations alive. */
+};
+
+/**
+ * \class MemoryAllocator
+ * \brief A pooled device memory allocator.
+ *
+ * Every memory type has one pool per ResourceKind and Lifetime. Persistent
+ * allocations up to MAX_SIZE_CLASS are rounded up to a power of two size
+ * class and recycled through per-class free lists; bigger ones are placed
+ * first-fit into the block's free ranges, which are merged again on free.
+ * Allocations larger than half a block get memory of their own. Host
+ * visible blocks are mapped once for their whole lifetime.
+ *
+ * All methods are thread safe.
+ */
+class MemoryAllocator {
+  public:
+    /**
+     * \fn MemoryAllocator(VkDevice device,
+     *                     const VkPhysicalDeviceMemoryProperties &
+     *                         memoryProperties,
+     *                     const VkPhysicalDeviceLimits &limits,
+     *                     bool bufferDeviceAddress)
+     *
+     * \brief Creates an empty allocator.
+     *
+     * \param device The logical device.
+     * \param memoryProperties The memory properties of the physical device.
+     * \param limits The limits of the physical device.
+     * \param bufferDeviceAddress Whether buffer memory must support
+     * VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT.
+     */
+    MemoryAllocator(VkDevice device,
+                    const VkPhysicalDeviceMemoryProperties &memoryProperties,
+                    const VkPhysicalDeviceLimits &limits,
+                    bool bufferDeviceAddress);
+
+    /**
+     * \fn ~MemoryAllocator()
+     *
+     * \brief Frees every block. Leaked allocations are reported.
+     */
+    ~MemoryAllocator();
+
+    MemoryAllocator(const MemoryAllocator &) = delete;
+    MemoryAllocator &operator=(const MemoryAllocator &) = delete;
+
+    /**
+     * \fn Allocation allocate(const VkMemoryRequirements &requirements,
+     *                         VkMemoryPropertyFlags properties,
+     *                         ResourceKind kind, Lifetime lifetime)
+     *
+     * \brief Allocates memory for a resource.
+     *
+     * \param requirements The memory requirements of the resource.
+     * \param properties The required memory properties.
+     * \param kind The kind of resource the memory is bound to.
+     * \param lifetime How long the allocation is expected to live.
+     *
+     * \return The allocation.
+     *
+     * \throw std::runtime_error if no memory type matches or the device is
+     * out of memory
+     */
+    Allocation allocate(const VkMemoryRequirements &requirements,
+                        VkMemoryPropertyFlags properties, ResourceKind kind,
+                        Lifetime lifetime = Lifetime::Persistent);
+
+    /**
+     * \fn void free(Allocation &allocation)
+     *
+     * \brief Returns an allocation and resets it. Invalid allocations are
+     * ignored.
+     *
+     * \param allocation The allocation to free.
+     */
+    void free(Allocation &allocation);
+
+    /**
+     * \fn void flush(const Allocation &allocation) const
+     *
+     * \brief Makes host writes visible to the device, a no-op on coherent
+     * memory.
+     *
+     * \param allocation The host visible allocation to flush.
+     */
+    void flush(const Allocation &allocation) const;
+
+    /**
+     * \fn void invalidate(const Allocation &allocation) const
+     *
+     * \brief Makes device writes visible to the host, a no-op on coherent
+     * memory.
+     *
+     * \param allocation The host visible allocation to invalidate.
+     */
+    void invalidate(const Allocation &allocation) const;
+
+    /**
+     * \fn std::vector<HeapStats> getHeapStats() const
+     *
+     * \return The usage of every memory heap, indexed by heap.
+     */
+    [[nodiscard]] std::vector<HeapStats> getHeapStats() const;
+
+    /**
+     * \fn void printStats(std::ostream &out) const
+     *
+     * \brief Prints the usage of every heap that holds memory.
+     *
+     * \param out The stream to print to.
+     */
+    void printStats(std::ostream &out) const;
+
+  private:
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint8_t *mapped = nullptr;
+        std::map<VkDeviceSize, VkDeviceSize> freeRanges; // offset -> size
+        VkDeviceSize head = 0; // linear blocks only
+        VkDeviceSize usedBytes = 0;
+        uint32_t allocationCount = 0;
+    };
+
+    struct Pool {
+        uint32_t memoryType = 0;
+        ResourceKind kind = ResourceKind::Buffer;
+        Lifetime lifetime = Lifetime::Persistent;
+        VkDeviceSize blockSize = 0;
+        std::vector<std::unique_ptr<Block>> blocks;
+        // Freed size class ranges as (block, offset)
+        std::array<std::vector<std::pair<uint32_t, VkDeviceSize>>,
+                   SIZE_CLASS_COUNT>
+            freeLists;
+    };
+
+    VkDevice m_device;
+    VkPhysicalDeviceMemoryProperties m_memoryProperties;
+    VkDeviceSize m_nonCoherentAtomSize;
+    bool m_bufferDeviceAddress;
+
+    mutable std::mutex m_mutex;
+    std::vector<Pool> m_pools;
+    std::vector<HeapStats> m_dedicatedStats;
+
+    uint32_t m_findMemoryType(uint32_t typeBits,
+                              VkMemoryPropertyFlags properties) const;
+    uint32_t m_poolIndex(uint32_t memoryType, ResourceKind kind,
+                         Lifetime lifetime) const;
+    static uint32_t m_sizeClass(VkDeviceSize size);
+    std::unique_ptr<Block> m_createBlock(const Pool &pool, VkDeviceSize size);
+    void m_destroyBlock(Block &block);
+    Allocation m_allocateDedicated(const VkMemoryRequirements &requirements,
+                                   uint32_t memoryType, ResourceKind kind);
+    bool m_allocateFromBlock(Pool &pool, uint32_t blockIdx, VkDeviceSize size,
+                             VkDeviceSize alignment, Allocation &allocation);
+    void m_releaseEmptyBlock(Pool &pool, uint32_t blockIdx);
+    void m_mappedRange(const Allocation &allocation,
+                       VkMappedMemoryRange &range) const;
+};
+} // namespace memory_allocator
@@ -0,0 +1,85 @@
+#pragma once
+#include "common.hpp"
+
+namespace pipeline_cache {
+/**
+ * \file
+ * \brief A VkPipelineCache that persists between runs.
+ *
+ * Compiling the ray tracing pipeline dominates startup, the driver can skip
+ * most of it when it gets the cache of a previous run. Cache data is only
+ * valid for the device and driver that produced it, so the header is checked
+ * against the device before the data is handed to the driver.
+ */
+
+const char *const DEFAULT_PATH =
+    "cache/pipeline_cache.bin"; /**< Where the cache is kept by default */
+
+/**
+ * \class PipelineCache
+ * \brief Loads a pipeline cache from a file and writes it back on
+ * destruction.
+ */
+class PipelineCache {
+  public:
+    /**
+     * \fn PipelineCache(VkDevice device, const VkPhysicalDeviceProperties
+     * &properties, std::string path)
+     *
+     * \brief Creates the pipeline cache, seeded with the file contents if
+     * they were written for this device. A missing, damaged or foreign file
+     * gives an empty cache.
+     *
+     * \param device The logical device.
+     * \param properties The properties of the physical device.
+     * \param path The cache file.
+     */
+    PipelineCache(VkDevice device, const VkPhysicalDeviceProperties &properties,
+                  std::string path);
+
+    /**
+     * \fn ~PipelineCache()
+     *
+     * \brief Saves and destroys the cache.
+     */
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache &) = delete;
+    PipelineCache &operator=(const PipelineCache &) = delete;
+
+    /**
+     * \fn VkPipelineCache()
+     *
+     * \brief Operator for PipelineCache to be used like VkPipelineCache
+     *
+     * \return A VkPipelineCache
+     * */
+    operator VkPipelineCache() const { return m_cache; };
+
+    /**
+     * \fn void save() const
+     *
+     * \brief Writes the cache to its file. Failures only cost a slower next
+     * start, so they are reported and ignored.
+     */
+    void save() const;
+
+  private:
+    VkDevice m_device;
+    VkPipelineCache m_cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties m_properties;
+    std::string m_path;
+
+    /**
+     * \fn bool m_isCompatible(const std::vector<uint8_t> &data) const
+     *
+     * \brief Checks the cache header against the device.
+     *
+     * \param data The cache file contents.
+     *
+     * \return True if the header version, vendor, device and cache UUID
+     * match.
+     */
+    [[nodiscard]] bool m_isCompatible(const std::vector<uint8_t> &data) const;
+};
+} // namespace pipeline_cache
@@ -4,6 +4,7 @@
 #include "vulkan_utils/command_buffer.hpp"
 #include "vulkan_utils/device.hpp"
 #include "vulkan_utils/shader_binding_table.hpp"
+#include "vulkan_utils/thread_pool.hpp"
 
 namespace raytracer {
 /**
@@ -21,7 +22,8 @@ class RaytracerBase {
      * \brief Constructs a RaytracerBase object.
      *
      * \param m_deviceHandler The device handler for Vulkan operations.
-     * \param m_swapChain The swap chain for rendering.
+     * \param m_swapChain The swap chain for rendering, nullptr when rendering
+     * headless.
      * \param m_commandBuffer The command buffer handler for Vulkan operations.
      *
      * \fn RaytracerBase::RaytracerBase(
@@ -66,6 +68,43 @@ class RaytracerBase {
         vkCmdBuildAccelerationStructuresKHR; /**< Function pointer for
                                                 vkCmdBuildAccelerationStructuresKHR.
                                               */
+    PFN_vkCmdWriteAccelerationStructuresPropertiesKHR
+        vkCmdWriteAccelerationStructuresPropertiesKHR; /**< Function pointer
+                                                          for
+                                                          vkCmdWriteAccelerationStructuresPropertiesKHR.
+                                                        */
+    PFN_vkWriteAccelerationStructuresPropertiesKHR
+        vkWriteAccelerationStructuresPropertiesKHR; /**< Function pointer for
+                                                       vkWriteAccelerationStructuresPropertiesKHR.
+                                                     */
+    PFN_vkCmdCopyAccelerationStructureKHR
+        vkCmdCopyAccelerationStructureKHR; /**< Function pointer for
+                                              vkCmdCopyAccelerationStructureKHR.
+                                            */
+    PFN_vkCmdCopyAccelerationStructureToMemoryKHR
+        vkCmdCopyAccelerationStructureToMemoryKHR; /**< Function pointer for
+                                                      vkCmdCopyAccelerationStructureToMemoryKHR.
+                                                    */
+    PFN_vkCmdCopyMemoryToAccelerationStructureKHR
+        vkCmdCopyMemoryToAccelerationStructureKHR; /**< Function pointer for
+                                                      vkCmdCopyMemoryToAccelerationStructureKHR.
+                                                    */
+    PFN_vkCreateDeferredOperationKHR
+        vkCreateDeferredOperationKHR; /**< Function pointer for
+                                         vkCreateDeferredOperationKHR. */
+    PFN_vkDestroyDeferredOperationKHR
+        vkDestroyDeferredOperationKHR; /**< Function pointer for
+                                          vkDestroyDeferredOperationKHR. */
+    PFN_vkGetDeferredOperationMaxConcurrencyKHR
+        vkGetDeferredOperationMaxConcurrencyKHR; /**< Function pointer for
+                                                    vkGetDeferredOperationMaxConcurrencyKHR.
+                                                  */
+    PFN_vkGetDeferredOperationResultKHR
+        vkGetDeferredOperationResultKHR; /**< Function pointer for
+                                            vkGetDeferredOperationResultKHR. */
+    PFN_vkDeferredOperationJoinKHR
+        vkDeferredOperationJoinKHR; /**< Function pointer for
+                                       vkDeferredOperationJoinKHR. */
     PFN_vkCmdTraceRaysKHR
         vkCmdTraceRaysKHR; /**< Function pointer for vkCmdTraceRaysKHR. */
     PFN_vkGetRayTracingShaderGroupHandlesKHR
@@ -79,6 +118,11 @@ class RaytracerBase {
     // Available features and properties
     VkPhysicalDeviceRayTracingPipelinePropertiesKHR
         rayTracingPipelineProperties{}; /**< Ray tracing pipeline properties. */
+    VkPhysicalDeviceAccelerationStructurePropertiesKHR
+        accelerationStructureProperties{}; /**< Acceleration structure
+                                            properties. */
+    VkPhysicalDeviceSubgroupProperties
+        subgroupProperties{}; /**< Subgroup properties. */
     VkPhysicalDeviceAccelerationStructureFeaturesKHR
         accelerationStructureFeatures{}; /**< Acceleration structure features.
                                           */
@@ -93,6 +137,8 @@ class RaytracerBase {
     VkPhysicalDeviceAccelerationStructureFeaturesKHR
         enabledAccelerationStructureFeatures{}; /**< Enabled acceleration
                                                  structure features. */
+    VkPhysicalDeviceRayQueryFeaturesKHR
+        enabledRayQueryFeatures{}; /**< Enabled ray query features. */
 
     /**
      * \struct ScratchBuffer
@@ -101,7 +147,7 @@ class RaytracerBase {
     struct ScratchBuffer {
         uint64_t deviceAddress; /**< Device address of the scratch buffer. */
         VkBuffer handle;        /**< Handle of the scratch buffer. */
-        VkDeviceMemory
+        memory_allocator::Allocation
             memory; /**< Device memory associated with the scratch buffer. */
     };
 
@@ -114,10 +160,13 @@ class RaytracerBase {
             handle; /**< Handle of the acceleration structure. */
         uint64_t
             deviceAddress; /**< Device address of the acceleration structure. */
-        VkDeviceMemory memory; /**< Device memory associated with the
-                                  acceleration structure. */
+        memory_allocator::Allocation memory; /**< Device memory associated
+                                                with the acceleration
+                                                structure. */
         VkBuffer
             buffer; /**< Buffer associated with the acceleration structure. */
+        VkDeviceSize size = 0; /**< The size the structure was created with,
+                                  its memory may be larger. */
     };
 
     /**
@@ -126,25 +175,39 @@ class RaytracerBase {
      * tracing shaders.
      */
     struct StorageImage {
-        VkDeviceMemory
+        memory_allocator::Allocation
             memory;    /**< Device memory associated with the storage image. */
         VkImage image; /**< Handle of the storage image. */
         VkImageView view; /**< ImageView of the storage image. */
         VkFormat format;  /**< Format of the storage image. */
     } storageImage;
 
-    ScratchBuffer createScratchBuffer(VkDeviceSize size);
+    ScratchBuffer createScratchBuffer(
+        VkDeviceSize size,
+        memory_allocator::Lifetime lifetime =
+            memory_allocator::Lifetime::Transient);
     VkDescriptorPool
         descriptorPool; /**< Descriptor pool for ray tracing operations. */
     void deleteScratchBuffer(ScratchBuffer &scratchBuffer);
     void createAccelerationStructure(
         AccelerationStructure &accelerationStructure,
         VkAccelerationStructureTypeKHR type,
-        VkAccelerationStructureBuildSizesInfoKHR buildSizeInfo);
+        VkAccelerationStructureBuildSizesInfoKHR buildSizeInfo,
+        VkMemoryPropertyFlags memoryPropertyFlags =
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
     void
     deleteAccelerationStructure(AccelerationStructure &accelerationStructure);
     uint64_t getBufferDeviceAddress(VkBuffer buffer);
     void createStorageImage(VkFormat format, VkExtent3D extent);
+
+    /**
+     * \brief Picks the format of an image the shaders store to.
+     * \param preferred The format to use if the device can store to it.
+     * \return preferred, or VK_FORMAT_R8G8B8A8_UNORM if the device can not
+     * store to preferred.
+     * \throw std::runtime_error if the device can store to neither
+     */
+    [[nodiscard]] VkFormat storageImageFormat(VkFormat preferred) const;
     void deleteStorageImage();
     VkStridedDeviceAddressRegionKHR
     getSbtEntryStridedDeviceAddressRegion(VkBuffer buffer,
@@ -161,7 +224,8 @@ class RaytracerBase {
      * \brief Prepares the ray tracer for execution.
      *
      * This function prepares the ray tracer by updating the render pass and
-     * loading the shader modules.
+     * loading the shader modules. The render pass is left alone when there is
+     * no swap chain (headless rendering).
      *
      * \fn void RaytracerBase::prepare()
      */
@@ -170,6 +234,70 @@ class RaytracerBase {
     std::vector<VkShaderModule>
         shaderModules; /**< Vector of loaded shader modules. */
 
+    /**
+     * \fn bool RaytracerBase::supportsHostBuilds() const
+     *
+     * \return True if acceleration structures can be built on the host.
+     */
+    [[nodiscard]] bool supportsHostBuilds() const {
+        return static_cast<bool>(
+            enabledAccelerationStructureFeatures
+                .accelerationStructureHostCommands);
+    }
+
+    /**
+     * \fn bool RaytracerBase::supportsRayQuery() const
+     *
+     * \return True if shaders can trace rays inline with ray queries, in
+     * compute and in the ray tracing pipeline alike.
+     */
+    [[nodiscard]] bool supportsRayQuery() const {
+        return static_cast<bool>(enabledRayQueryFeatures.rayQuery);
+    }
+
+    /**
+     * \fn bool RaytracerBase::supportsSubgroupBallot() const
+     *
+     * \return True if compute shaders can use the basic and ballot subgroup
+     * operations.
+     */
+    [[nodiscard]] bool supportsSubgroupBallot() const {
+        const VkSubgroupFeatureFlags ballot =
+            VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+        return (subgroupProperties.supportedStages &
+                VK_SHADER_STAGE_COMPUTE_BIT) != 0 &&
+               (subgroupProperties.supportedOperations & ballot) == ballot;
+    }
+
+    /**
+     * \brief Builds acceleration structures on the host.
+     *
+     * The build is issued as a deferred operation, which the workers of
+     * hostBuildPool join until it completes. The acceleration structures must
+     * be bound to host visible memory and every address in the build infos
+     * must be a host address.
+     *
+     * \fn VkResult RaytracerBase::buildAccelerationStructuresOnHost(
+     * uint32_t infoCount,
+     * const VkAccelerationStructureBuildGeometryInfoKHR *pInfos,
+     * const VkAccelerationStructureBuildRangeInfoKHR *const *ppBuildRangeInfos)
+     *
+     * \param infoCount The number of acceleration structures to build.
+     * \param pInfos The build infos.
+     * \param ppBuildRangeInfos The build ranges of every build info.
+     *
+     * \return The result of the build.
+     */
+    VkResult buildAccelerationStructuresOnHost(
+        uint32_t infoCount,
+        const VkAccelerationStructureBuildGeometryInfoKHR *pInfos,
+        const VkAccelerationStructureBuildRangeInfoKHR *const
+            *ppBuildRangeInfos);
+
+    std::unique_ptr<thread_pool::ThreadPool>
+        hostBuildPool; /**< Joins deferred host builds, started on first use.
+                        */
+
   protected:
     /**
      * \brief Updates the default render pass with different color attachment
@@ -7,8 +7,9 @@ class ShaderBindingTable {
   public:
     VkStridedDeviceAddressRegionKHR stridedDeviceAddressRegion{};
     VkDevice device;
+    std::shared_ptr<device::DeviceHandler> deviceHandler;
     VkBuffer buffer = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    memory_allocator::Allocation memory;
     VkDescriptorBufferInfo descriptor;
     VkDeviceSize size = 0;
     VkDeviceSize alignment = 0;
@@ -16,7 +17,8 @@ class ShaderBindingTable {
     VkResult create(std::shared_ptr<device::DeviceHandler> &deviceHandler,
                     VkBufferUsageFlags usageFlags,
                     VkMemoryPropertyFlags memoryPropertyFlags,
-                    VkDeviceSize size, void *data = nullptr);
+                    VkDeviceSize size, void *data = nullptr,
+                    VkDeviceSize minAlignment = 1);
     /** @brief Usage flags to be filled by external source at buffer
      * creation (to query at some later point) */
     VkBufferUsageFlags usageFlags;
@@ -32,6 +34,10 @@ class ShaderBindingTable {
                                  VkDeviceSize offset = 0) const;
     [[nodiscard]] VkResult invalidate(VkDeviceSize size = VK_WHOLE_SIZE,
                                       VkDeviceSize offset = 0) const;
-    void destroy() const;
+    void destroy();
+
+  private:
+    [[nodiscard]] memory_allocator::Allocation
+    m_subRange(VkDeviceSize size, VkDeviceSize offset) const;
 };
 } // namespace raytracer
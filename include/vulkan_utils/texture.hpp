@@ -25,8 +25,8 @@ class Texture {
   public:
     VkImage image;             /**< Vulkan image object. */
     VkImageLayout imageLayout; /**< Current layout of the image. */
-    VkDeviceMemory
-        deviceMemory; /**< Device memory object associated with the image. */
+    memory_allocator::Allocation
+        deviceMemory; /**< Device memory range associated with the image. */
     VkImageView view; /**< Image view object. */
     uint32_t width, height; /**< Dimensions of the texture. */
     uint32_t mipLevels;     /**< Number of mip levels in the texture. */
@@ -0,0 +1,75 @@
+#pragma once
+#include "common.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace thread_pool {
+/**
+ * \class ThreadPool
+ * \brief A fixed set of worker threads running queued tasks.
+ *
+ * Used to join deferred host operations, every worker that joins an operation
+ * takes a share of its work.
+ */
+class ThreadPool {
+  public:
+    /**
+     * \fn explicit ThreadPool(uint32_t threadCount)
+     *
+     * \brief Starts the workers.
+     *
+     * \param threadCount The number of workers, the hardware concurrency if 0.
+     */
+    explicit ThreadPool(uint32_t threadCount = 0);
+
+    /**
+     * \fn ~ThreadPool()
+     *
+     * \brief Finishes the queued tasks and joins the workers.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * \fn void submit(std::function<void()> task)
+     *
+     * \brief Queues a task, it runs on the first idle worker.
+     *
+     * \param task The task.
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * \fn void wait()
+     *
+     * \brief Blocks until every queued task has finished.
+     */
+    void wait();
+
+    /**
+     * \fn uint32_t size() const
+     *
+     * \return The number of workers.
+     */
+    [[nodiscard]] uint32_t size() const {
+        return static_cast<uint32_t>(m_workers.size());
+    }
+
+  private:
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_taskReady;
+    std::condition_variable m_idle;
+    uint32_t m_running = 0;
+    bool m_stopping = false;
+
+    void m_work();
+};
+} // namespace thread_pool
@@ -0,0 +1,105 @@
+#pragma once
+#include "common.hpp"
+#include "vulkan_utils/device.hpp"
+
+namespace uniform_ring {
+/**
+ * \file
+ * \brief A ring of per-frame uniform arenas addressed with dynamic offsets.
+ */
+
+/**
+ * \class UniformRing
+ * \brief One persistently mapped, host visible uniform buffer split into an
+ * arena per frame in flight.
+ *
+ * Uniform data is pushed into the arena of the frame being recorded and bound
+ * through a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptor with the
+ * returned offset. A frame's arena is only reused once its fence has
+ * signaled, so writing never races with the device and the descriptor sets
+ * never have to be updated.
+ */
+class UniformRing {
+  public:
+    /**
+     * \fn UniformRing(std::shared_ptr<device::DeviceHandler> m_deviceHandler,
+     *                 uint32_t frameCount, VkDeviceSize frameCapacity)
+     *
+     * \brief Creates and maps the ring buffer.
+     *
+     * \param m_deviceHandler The device the buffer lives on.
+     * \param frameCount The number of arenas, usually MAX_FRAMES_IN_FLIGHT.
+     * \param frameCapacity The bytes available to a single frame.
+     */
+    UniformRing(std::shared_ptr<device::DeviceHandler> m_deviceHandler,
+                uint32_t frameCount, VkDeviceSize frameCapacity);
+
+    /**
+     * \fn ~UniformRing()
+     *
+     * \brief Destroys the ring buffer.
+     */
+    ~UniformRing();
+
+    UniformRing(const UniformRing &) = delete;
+    UniformRing &operator=(const UniformRing &) = delete;
+
+    /**
+     * \fn void beginFrame(uint32_t frame)
+     *
+     * \brief Starts pushing into a frame's arena, dropping what it held.
+     *
+     * \param frame The frame in flight, its previous submission must be done.
+     */
+    void beginFrame(uint32_t frame);
+
+    /**
+     * \fn uint32_t push(const void *data, VkDeviceSize size)
+     *
+     * \brief Copies data into the current frame's arena.
+     *
+     * \param data The data to copy.
+     * \param size The size of the data.
+     *
+     * \return The dynamic offset of the data.
+     *
+     * \throw std::runtime_error if the frame's arena is full
+     */
+    uint32_t push(const void *data, VkDeviceSize size);
+
+    /**
+     * \fn template <typename T> uint32_t push(const T &data)
+     *
+     * \brief Copies a struct into the current frame's arena.
+     *
+     * \param data The struct to copy.
+     *
+     * \return The dynamic offset of the struct.
+     */
+    template <typename T> uint32_t push(const T &data) {
+        return push(&data, sizeof(T));
+    }
+
+    /**
+     * \fn VkDescriptorBufferInfo descriptor(VkDeviceSize range) const
+     *
+     * \brief The dynamic descriptor of the ring.
+     *
+     * \param range The size of the data bound through the descriptor.
+     *
+     * \return The descriptor info, with a zero base offset.
+     */
+    [[nodiscard]] VkDescriptorBufferInfo descriptor(VkDeviceSize range) const;
+
+  private:
+    std::shared_ptr<device::DeviceHandler> m_deviceHandler;
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    memory_allocator::Allocation m_memory;
+    uint8_t *m_mapped = nullptr;
+    VkDeviceSize m_alignment = 1;
+    VkDeviceSize m_frameCapacity = 0;
+    uint32_t m_frameCount = 0;
+    VkDeviceSize m_frameBegin = 0;
+    VkDeviceSize m_head = 0;
+};
+} // namespace uniform_ring
@@ -41,6 +41,13 @@ void setImageLayout(
 
 uint32_t alignedSize(uint32_t value, uint32_t alignment);
 
+VkDeviceSize alignedSize(VkDeviceSize value, VkDeviceSize alignment);
+
+// 64-bit FNV-1a hash of a byte range, pass a previous hash as the seed to
+// hash several ranges
+uint64_t hashBytes(const void *data, size_t size,
+                   uint64_t seed = 14695981039346656037ULL);
+
 VkShaderModule loadShader(const char *fileName, VkDevice device);
 
 } // namespace utils
@@ -0,0 +1,164 @@
+#include "vulkan_utils/as_build_scheduler.hpp"
+#include "vulkan_utils/utils.hpp"
+
+#include <numeric>
+
+namespace as_build_scheduler {
+BuildScheduler::BuildScheduler(raytracer::RaytracerBase &raytracer,
+                               VkDeviceSize arenaSize)
+    : m_raytracer(raytracer), m_arenaSize(arenaSize),
+      m_alignment(std::max<VkDeviceSize>(
+          raytracer.accelerationStructureProperties
+              .minAccelerationStructureScratchOffsetAlignment,
+          1)) {}
+
+BuildScheduler::~BuildScheduler() {
+    if (m_deviceArenaSize > 0) {
+        m_raytracer.deleteScratchBuffer(m_deviceArena);
+    }
+}
+
+void BuildScheduler::add(
+    const VkAccelerationStructureBuildGeometryInfoKHR &info,
+    const VkAccelerationStructureBuildRangeInfoKHR *ranges,
+    VkDeviceSize scratchSize) {
+    m_requests.push_back({info, ranges, scratchSize});
+}
+
+void BuildScheduler::record(VkCommandBuffer commandBuffer) {
+    m_pack();
+    if (m_batches.empty()) {
+        return;
+    }
+
+    if (m_deviceArenaSize < m_requiredArenaSize) {
+        if (m_deviceArenaSize > 0) {
+            m_raytracer.deleteScratchBuffer(m_deviceArena);
+        }
+        m_deviceArenaSize =
+            std::max<VkDeviceSize>(m_requiredArenaSize, m_alignment);
+        m_deviceArena = m_raytracer.createScratchBuffer(m_deviceArenaSize);
+    }
+
+    std::vector<VkAccelerationStructureBuildGeometryInfoKHR> infos;
+    std::vector<const VkAccelerationStructureBuildRangeInfoKHR *> ranges;
+    for (size_t batch = 0; batch < m_batches.size(); batch++) {
+        // The previous batch has to finish with the arena first
+        if (batch > 0) {
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask =
+                VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+            barrier.dstAccessMask =
+                VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR |
+                VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+            vkCmdPipelineBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1,
+                &barrier, 0, nullptr, 0, nullptr);
+        }
+
+        infos.clear();
+        ranges.clear();
+        for (uint32_t request : m_batches[batch]) {
+            VkAccelerationStructureBuildGeometryInfoKHR info =
+                m_requests[request].info;
+            info.scratchData.deviceAddress =
+                m_deviceArena.deviceAddress + m_scratchOffsets[request];
+            infos.push_back(info);
+            ranges.push_back(m_requests[request].ranges);
+        }
+        m_raytracer.vkCmdBuildAccelerationStructuresKHR(
+            commandBuffer, static_cast<uint32_t>(infos.size()), infos.data(),
+            ranges.data());
+    }
+
+    m_clear();
+}
+
+VkResult BuildScheduler::buildOnHost() {
+    m_pack();
+
+    if (m_hostArena.size() < m_requiredArenaSize + m_alignment) {
+        m_hostArena.resize(m_requiredArenaSize + m_alignment);
+    }
+    auto arenaAddress = utils::alignedSize(
+        reinterpret_cast<VkDeviceSize>(m_hostArena.data()), m_alignment);
+
+    // Host builds return once complete, so the batches need no barriers
+    VkResult result = VK_SUCCESS;
+    std::vector<VkAccelerationStructureBuildGeometryInfoKHR> infos;
+    std::vector<const VkAccelerationStructureBuildRangeInfoKHR *> ranges;
+    for (const std::vector<uint32_t> &batch : m_batches) {
+        infos.clear();
+        ranges.clear();
+        for (uint32_t request : batch) {
+            VkAccelerationStructureBuildGeometryInfoKHR info =
+                m_requests[request].info;
+            info.scratchData.hostAddress = reinterpret_cast<void *>(
+                arenaAddress + m_scratchOffsets[request]);
+            infos.push_back(info);
+            ranges.push_back(m_requests[request].ranges);
+        }
+        result = m_raytracer.buildAccelerationStructuresOnHost(
+            static_cast<uint32_t>(infos.size()), infos.data(), ranges.data());
+        if (result != VK_SUCCESS) {
+            break;
+        }
+    }
+
+    m_clear();
+    return result;
+}
+
+/*
+    First-fit decreasing: the largest builds open the batches, the smaller
+   ones fill the gaps. A build larger than the budget gets an arena of its size
+*/
+void BuildScheduler::m_pack() {
+    const size_t requestCount = m_requests.size();
+    std::vector<VkDeviceSize> sizes(requestCount);
+    VkDeviceSize capacity = m_arenaSize;
+    for (size_t i = 0; i < requestCount; i++) {
+        sizes[i] = utils::alignedSize(m_requests[i].scratchSize, m_alignment);
+        capacity = std::max(capacity, sizes[i]);
+    }
+
+    std::vector<uint32_t> order(requestCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&sizes](uint32_t a, uint32_t b) {
+                         return sizes[a] > sizes[b];
+                     });
+
+    m_batches.clear();
+    m_scratchOffsets.assign(requestCount, 0);
+    std::vector<VkDeviceSize> used;
+    for (uint32_t request : order) {
+        size_t batch = 0;
+        while (batch < used.size() && used[batch] + sizes[request] > capacity) {
+            batch++;
+        }
+        if (batch == used.size()) {
+            used.push_back(0);
+            m_batches.emplace_back();
+        }
+        m_scratchOffsets[request] = used[batch];
+        used[batch] += sizes[request];
+        m_batches[batch].push_back(request);
+    }
+
+    m_requiredArenaSize = 0;
+    for (VkDeviceSize batchSize : used) {
+        m_requiredArenaSize = std::max(m_requiredArenaSize, batchSize);
+    }
+    m_batchCount = static_cast<uint32_t>(m_batches.size());
+}
+
+void BuildScheduler::m_clear() {
+    m_requests.clear();
+    m_batches.clear();
+    m_scratchOffsets.clear();
+}
+} // namespace as_build_scheduler
@@ -0,0 +1,129 @@
+#include "vulkan_utils/as_cache.hpp"
+#include "vulkan_utils/utils.hpp"
+
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+
+namespace as_cache {
+AccelerationStructureCache::AccelerationStructureCache(
+    const device::DeviceHandler &deviceHandler, std::string directory)
+    : m_device(deviceHandler.logicalDevice),
+      m_vkGetDeviceAccelerationStructureCompatibilityKHR(
+          reinterpret_cast<
+              PFN_vkGetDeviceAccelerationStructureCompatibilityKHR>(
+              vkGetDeviceProcAddr(
+                  deviceHandler.logicalDevice,
+                  "vkGetDeviceAccelerationStructureCompatibilityKHR"))),
+      m_directory(std::move(directory)) {
+    VkPhysicalDeviceIDProperties idProperties{};
+    idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &idProperties;
+    vkGetPhysicalDeviceProperties2(deviceHandler.physicalDevice,
+                                   &properties2);
+
+    m_deviceHash = utils::hashBytes(idProperties.deviceUUID, VK_UUID_SIZE);
+    m_deviceHash =
+        utils::hashBytes(idProperties.driverUUID, VK_UUID_SIZE, m_deviceHash);
+    m_deviceHash = utils::hashBytes(&properties2.properties.driverVersion,
+                                    sizeof(uint32_t), m_deviceHash);
+}
+
+std::string AccelerationStructureCache::key(
+    uint64_t geometryHash, VkBuildAccelerationStructureFlagsKHR flags) const {
+    std::ostringstream key;
+    key << std::hex << std::setfill('0') << std::setw(16) << geometryHash << "-"
+        << std::setw(16)
+        << utils::hashBytes(&flags, sizeof(flags), m_deviceHash);
+    return key.str();
+}
+
+bool AccelerationStructureCache::load(const std::string &key,
+                                      std::vector<uint8_t> &data) const {
+    data.clear();
+
+    std::ifstream file(m_path(key), std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    auto size = static_cast<size_t>(file.tellg());
+    if (size < SERIALIZED_HEADER_SIZE) {
+        return false;
+    }
+
+    data.resize(size);
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char *>(data.data()),
+                   static_cast<std::streamsize>(size))) {
+        data.clear();
+        return false;
+    }
+
+    // The header records the serialized size, a truncated file is a miss
+    uint64_t serializedSize = 0;
+    memcpy(&serializedSize, data.data() + 2 * VK_UUID_SIZE, sizeof(uint64_t));
+    if (serializedSize != size) {
+        data.clear();
+        return false;
+    }
+
+    // The header starts with the driver and compatibility UUIDs
+    VkAccelerationStructureVersionInfoKHR versionInfo{};
+    versionInfo.sType =
+        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_VERSION_INFO_KHR;
+    versionInfo.pVersionData = data.data();
+    VkAccelerationStructureCompatibilityKHR compatibility =
+        VK_ACCELERATION_STRUCTURE_COMPATIBILITY_INCOMPATIBLE_KHR;
+    m_vkGetDeviceAccelerationStructureCompatibilityKHR(m_device, &versionInfo,
+                                                       &compatibility);
+    if (compatibility !=
+        VK_ACCELERATION_STRUCTURE_COMPATIBILITY_COMPATIBLE_KHR) {
+        data.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void AccelerationStructureCache::store(const std::string &key,
+                                       const void *data, size_t size) const {
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+
+    // Written under a temporary name first, so a crash never leaves a
+    // truncated entry behind
+    std::string path = m_path(key);
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open() ||
+            !file.write(static_cast<const char *>(data),
+                        static_cast<std::streamsize>(size))) {
+            std::cerr << "Could not write acceleration structure cache entry "
+                      << path << "\n";
+            return;
+        }
+    }
+    std::filesystem::rename(tmpPath, path, error);
+    if (error) {
+        std::cerr << "Could not write acceleration structure cache entry "
+                  << path << ": " << error.message() << "\n";
+    }
+}
+
+VkDeviceSize AccelerationStructureCache::deserializedSize(
+    const std::vector<uint8_t> &data) {
+    uint64_t size = 0;
+    memcpy(&size, data.data() + 2 * VK_UUID_SIZE + sizeof(uint64_t),
+           sizeof(uint64_t));
+    return size;
+}
+
+std::string AccelerationStructureCache::m_path(const std::string &key) const {
+    return m_directory + "/" + key + ".blas";
+}
+} // namespace as_cache
@@ -0,0 +1,121 @@
+#include "vulkan_utils/blue_noise.hpp"
+
+#include <random>
+
+namespace blue_noise {
+namespace {
+/*
+    Ranks the pixels of one channel. The energy of a pixel is the Gaussian
+   weighted sum over the set pixels around it on the torus, so the tightest
+   cluster is the set pixel with the most energy and the largest void is the
+   unset pixel with the least
+*/
+std::vector<uint32_t> rankMap(uint32_t size, std::mt19937 &rng) {
+    const uint32_t count = size * size;
+    // The filter is negligible past a few sigma, so set pixels only update
+    // the energy in a window around them
+    const int radius = std::min(
+        static_cast<int>(std::ceil(KERNEL_RADIUS_SIGMAS * DEFAULT_SIGMA)),
+        static_cast<int>(size / 2) - 1);
+    const int width = 2 * radius + 1;
+    std::vector<float> kernel(static_cast<size_t>(width) * width);
+    for (int y = -radius; y <= radius; y++) {
+        for (int x = -radius; x <= radius; x++) {
+            kernel[(y + radius) * width + x + radius] =
+                std::exp(-static_cast<float>(x * x + y * y) /
+                         (2.0F * DEFAULT_SIGMA * DEFAULT_SIGMA));
+        }
+    }
+
+    std::vector<uint8_t> pattern(count, 0);
+    std::vector<float> energy(count, 0.0F);
+    const auto side = static_cast<int>(size);
+    auto toggle = [&](uint32_t idx, bool set) {
+        pattern[idx] = set ? 1 : 0;
+        const auto px = static_cast<int>(idx % size);
+        const auto py = static_cast<int>(idx / size);
+        const float sign = set ? 1.0F : -1.0F;
+        for (int y = -radius; y <= radius; y++) {
+            const int row = ((py + y + side) % side) * side;
+            for (int x = -radius; x <= radius; x++) {
+                energy[row + (px + x + side) % side] +=
+                    sign * kernel[(y + radius) * width + x + radius];
+            }
+        }
+    };
+    auto find = [&](bool tightestCluster) {
+        uint32_t best = 0;
+        float bestEnergy = tightestCluster ? -FLT_MAX : FLT_MAX;
+        for (uint32_t i = 0; i < count; i++) {
+            if ((pattern[i] != 0) != tightestCluster) {
+                continue;
+            }
+            if (tightestCluster ? energy[i] > bestEnergy
+                                : energy[i] < bestEnergy) {
+                best = i;
+                bestEnergy = energy[i];
+            }
+        }
+        return best;
+    };
+
+    // Random initial pattern
+    const auto initialCount = std::max<uint32_t>(
+        1, static_cast<uint32_t>(INITIAL_DENSITY * static_cast<float>(count)));
+    std::uniform_int_distribution<uint32_t> pixel(0, count - 1);
+    for (uint32_t placed = 0; placed < initialCount;) {
+        const uint32_t idx = pixel(rng);
+        if (pattern[idx] == 0) {
+            toggle(idx, true);
+            placed++;
+        }
+    }
+
+    // Spread it out by moving the tightest cluster into the largest void
+    // until that changes nothing
+    for (uint32_t iteration = 0; iteration < count; iteration++) {
+        const uint32_t cluster = find(true);
+        toggle(cluster, false);
+        const uint32_t voidIdx = find(false);
+        toggle(voidIdx, true);
+        if (voidIdx == cluster) {
+            break;
+        }
+    }
+    const std::vector<uint8_t> prototype = pattern;
+    const std::vector<float> prototypeEnergy = energy;
+
+    std::vector<uint32_t> ranks(count, 0);
+    // Ranks below the prototype, remove the tightest clusters
+    for (uint32_t rank = initialCount; rank-- > 0;) {
+        const uint32_t cluster = find(true);
+        toggle(cluster, false);
+        ranks[cluster] = rank;
+    }
+    // Ranks above it, fill the largest voids
+    pattern = prototype;
+    energy = prototypeEnergy;
+    for (uint32_t rank = initialCount; rank < count; rank++) {
+        const uint32_t voidIdx = find(false);
+        toggle(voidIdx, true);
+        ranks[voidIdx] = rank;
+    }
+    return ranks;
+}
+} // namespace
+
+std::vector<uint8_t> generate(uint32_t size, uint32_t channels,
+                              uint32_t seed) {
+    const uint32_t count = size * size;
+    std::vector<uint8_t> texels(static_cast<size_t>(count) * channels);
+    std::mt19937 rng(seed);
+    for (uint32_t channel = 0; channel < channels; channel++) {
+        const std::vector<uint32_t> ranks = rankMap(size, rng);
+        for (uint32_t i = 0; i < count; i++) {
+            texels[i * channels + channel] = static_cast<uint8_t>(
+                static_cast<uint64_t>(ranks[i]) * 256 / count);
+        }
+    }
+    return texels;
+}
+} // namespace blue_noise
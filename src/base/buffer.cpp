@@ -17,8 +17,9 @@ Buffer::Buffer(
 
 void Buffer::m_makeBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                           VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                          VkDeviceMemory &bufferMemory,
-                          VkSharingMode sharingMode) {
+                          memory_allocator::Allocation &bufferMemory,
+                          VkSharingMode sharingMode,
+                          memory_allocator::Lifetime lifetime) {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
@@ -27,34 +28,23 @@ void Buffer::m_makeBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 
     VK_CHECK(vkCreateBuffer(*m_deviceHandler, &bufferInfo, nullptr, &buffer));
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(*m_deviceHandler, buffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = m_deviceHandler->getMemoryType(
-        memRequirements.memoryTypeBits, properties);
-
-    VK_CHECK(
-        vkAllocateMemory(*m_deviceHandler, &allocInfo, nullptr, &bufferMemory));
-
-    vkBindBufferMemory(*m_deviceHandler, buffer, bufferMemory, 0);
+    m_deviceHandler->allocateBufferMemory(buffer, properties, &bufferMemory,
+                                          lifetime);
 }
 
 void Buffer::map() {
-    VK_CHECK(vkMapMemory(*m_deviceHandler, memory, 0, size, 0, &mapped));
-}
-
-void Buffer::unmap() {
-    if (mapped != nullptr) {
-        vkUnmapMemory(*m_deviceHandler, memory);
-        mapped = nullptr;
+    // Host visible memory stays mapped for the lifetime of its block
+    if (memory.mapped == nullptr) {
+        throw std::runtime_error("Buffer memory is not host visible");
     }
+    mapped = memory.mapped;
 }
 
+void Buffer::unmap() { mapped = nullptr; }
+
 void Buffer::bind(VkDeviceSize offset) {
-    VK_CHECK(vkBindBufferMemory(*m_deviceHandler, buffer, memory, offset));
+    VK_CHECK(vkBindBufferMemory(*m_deviceHandler, buffer, memory.memory,
+                                memory.offset + offset));
 }
 
 void Buffer::setupDescriptor() {
@@ -65,21 +55,19 @@ void Buffer::setupDescriptor() {
 
 void Buffer::copy(void *data, VkDeviceSize size) {
     VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    memory_allocator::Allocation stagingBufferMemory;
     m_makeBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 stagingBuffer, stagingBufferMemory, VK_SHARING_MODE_EXCLUSIVE);
+                 stagingBuffer, stagingBufferMemory, VK_SHARING_MODE_EXCLUSIVE,
+                 memory_allocator::Lifetime::Transient);
 
-    void *mem;
-    vkMapMemory(*m_deviceHandler, stagingBufferMemory, 0, size, 0, &mem);
-    memcpy(mem, data, (size_t)size);
-    vkUnmapMemory(*m_deviceHandler, stagingBufferMemory);
+    memcpy(stagingBufferMemory.mapped, data, (size_t)size);
 
     copyFrom(stagingBuffer);
 
     vkDestroyBuffer(*m_deviceHandler, stagingBuffer, nullptr);
-    vkFreeMemory(*m_deviceHandler, stagingBufferMemory, nullptr);
+    m_deviceHandler->freeMemory(stagingBufferMemory);
 }
 
 void Buffer::fastCopy(void *data, VkDeviceSize size) {
@@ -90,22 +78,19 @@ void Buffer::fastCopy(void *data, VkDeviceSize size) {
 }
 
 void Buffer::flush(VkDeviceSize size, VkDeviceSize offset) {
-    VkMappedMemoryRange mappedRange = {};
-    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = memory;
-    mappedRange.offset = offset;
-    mappedRange.size = size;
-
-    VK_CHECK(vkFlushMappedMemoryRanges(*m_deviceHandler, 1, &mappedRange));
+    m_deviceHandler->allocator->flush(m_subRange(size, offset));
 }
 
 void Buffer::invalidate(VkDeviceSize size, VkDeviceSize offset) {
-    VkMappedMemoryRange mappedRange = {};
-    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = memory;
-    mappedRange.offset = offset;
-    mappedRange.size = size;
-    VK_CHECK(vkInvalidateMappedMemoryRanges(*m_deviceHandler, 1, &mappedRange));
+    m_deviceHandler->allocator->invalidate(m_subRange(size, offset));
+}
+
+memory_allocator::Allocation Buffer::m_subRange(VkDeviceSize size,
+                                                VkDeviceSize offset) const {
+    memory_allocator::Allocation range = memory;
+    range.offset += offset;
+    range.size = size == VK_WHOLE_SIZE ? memory.size - offset : size;
+    return range;
 }
 
 void Buffer::destroy() {
@@ -114,9 +99,10 @@ void Buffer::destroy() {
     }
     if (buffer != VK_NULL_HANDLE) {
         vkDestroyBuffer(*m_deviceHandler, buffer, nullptr);
+        buffer = VK_NULL_HANDLE;
     }
-    if (memory != nullptr) {
-        vkFreeMemory(*m_deviceHandler, memory, nullptr);
+    if (memory.isValid()) {
+        m_deviceHandler->freeMemory(memory);
     }
 }
 
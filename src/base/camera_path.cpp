@@ -0,0 +1,145 @@
+#include "geometry/camera_path.hpp"
+
+#include <sstream>
+
+namespace geometry {
+namespace {
+/* Catmull-Rom interpolation between p1 and p2 */
+template <typename T>
+T catmullRom(const T &p0, const T &p1, const T &p2, const T &p3, float t) {
+    float t2 = t * t;
+    float t3 = t2 * t;
+    return 0.5F * ((2.0F * p1) + (-p0 + p2) * t +
+                   (2.0F * p0 - 5.0F * p1 + 4.0F * p2 - p3) * t2 +
+                   (-p0 + 3.0F * p1 - 3.0F * p2 + p3) * t3);
+}
+
+/* Shift an angle by full turns so it is closest to the previous one */
+float unwrapAngle(float angle, float previous) {
+    while (angle - previous > HALF_ROTATION) {
+        angle -= FULL_ROTATION;
+    }
+    while (angle - previous < -HALF_ROTATION) {
+        angle += FULL_ROTATION;
+    }
+    return angle;
+}
+} // namespace
+
+void CameraPath::record(float time, const Camera &camera, float minInterval) {
+    if (!keys.empty() && time - keys.back().time < minInterval) {
+        return;
+    }
+
+    CameraKey key{time, camera.position, camera.rotationVert,
+                  camera.rotationHoriz};
+
+    // Keep the yaw continuous so the spline does not spin around on wrap
+    if (!keys.empty()) {
+        key.rotationVert = unwrapAngle(key.rotationVert, keys.back().rotationVert);
+    }
+
+    keys.push_back(key);
+}
+
+void CameraPath::apply(float time, Camera &camera) const {
+    if (keys.empty()) {
+        return;
+    }
+
+    time = std::clamp(time, keys.front().time, keys.back().time);
+
+    auto next = std::upper_bound(
+        keys.begin(), keys.end(), time,
+        [](float t, const CameraKey &key) { return t < key.time; });
+    size_t i2 = std::min(static_cast<size_t>(next - keys.begin()),
+                         keys.size() - 1);
+    size_t i1 = i2 > 0 ? i2 - 1 : 0;
+    size_t i0 = i1 > 0 ? i1 - 1 : 0;
+    size_t i3 = std::min(i2 + 1, keys.size() - 1);
+
+    const CameraKey &k0 = keys[i0];
+    const CameraKey &k1 = keys[i1];
+    const CameraKey &k2 = keys[i2];
+    const CameraKey &k3 = keys[i3];
+
+    float span = k2.time - k1.time;
+    float t = span > 0.0F ? (time - k1.time) / span : 0.0F;
+
+    camera.position = catmullRom(k0.position, k1.position, k2.position,
+                                 k3.position, t);
+    float yaw = catmullRom(k0.rotationVert, k1.rotationVert, k2.rotationVert,
+                           k3.rotationVert, t);
+    float pitch = catmullRom(k0.rotationHoriz, k1.rotationHoriz,
+                             k2.rotationHoriz, k3.rotationHoriz, t);
+    camera.calcRotation(yaw, pitch);
+}
+
+float CameraPath::duration() const {
+    return keys.empty() ? 0.0F : keys.back().time;
+}
+
+void CameraPath::save(const std::string &filename) const {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open camera path file " +
+                                 filename);
+    }
+
+    file << "# time x y z yaw pitch\n";
+    for (const CameraKey &key : keys) {
+        file << key.time << " " << key.position.x << " " << key.position.y
+             << " " << key.position.z << " " << key.rotationVert << " "
+             << key.rotationHoriz << "\n";
+    }
+}
+
+CameraPath CameraPath::load(const std::string &filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open camera path file " +
+                                 filename);
+    }
+
+    CameraPath path;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::istringstream stream(line);
+        CameraKey key;
+        if (!(stream >> key.time >> key.position.x >> key.position.y >>
+              key.position.z >> key.rotationVert >> key.rotationHoriz)) {
+            throw std::runtime_error("Malformed camera path line: " + line);
+        }
+
+        if (!path.keys.empty()) {
+            key.rotationVert =
+                unwrapAngle(key.rotationVert, path.keys.back().rotationVert);
+        }
+        path.keys.push_back(key);
+    }
+
+    if (path.keys.empty()) {
+        throw std::runtime_error("Camera path file " + filename +
+                                 " has no keys");
+    }
+
+    return path;
+}
+
+CameraPath CameraPath::sponzaFlythrough() {
+    CameraPath path;
+    path.keys = {
+        {0.0F, {0.0F, 3.0F, -10.0F}, 0.0F, 0.0F},
+        {4.0F, {6.0F, 3.0F, -4.0F}, 60.0F, -5.0F},
+        {8.0F, {6.0F, 5.0F, 4.0F}, 150.0F, 10.0F},
+        {12.0F, {-6.0F, 5.0F, 4.0F}, 210.0F, 10.0F},
+        {16.0F, {-6.0F, 3.0F, -4.0F}, 300.0F, -5.0F},
+        {20.0F, {0.0F, 3.0F, -10.0F}, 360.0F, 0.0F},
+    };
+    return path;
+}
+} // namespace geometry
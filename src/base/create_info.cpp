@@ -725,6 +725,15 @@ VkBindSparseInfo bindSparseInfo() {
     return bindSparseInfo;
 }
 
+VkQueryPoolCreateInfo queryPoolCreateInfo(VkQueryType queryType,
+                                          uint32_t queryCount) {
+    VkQueryPoolCreateInfo queryPoolCreateInfo{};
+    queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolCreateInfo.queryType = queryType;
+    queryPoolCreateInfo.queryCount = queryCount;
+    return queryPoolCreateInfo;
+}
+
 /** @brief Initialize a map entry for a shader specialization constant */
 VkSpecializationMapEntry specializationMapEntry(uint32_t constantID,
                                                 uint32_t offset, size_t size) {
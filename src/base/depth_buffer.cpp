@@ -39,18 +39,8 @@ void DepthBuffer::createDepthResources(uint32_t width, uint32_t height) {
     VK_CHECK(
         vkCreateImage(*m_deviceHandler, &imgCreateInfo, nullptr, &depthImage));
 
-    VkMemoryRequirements memReqs;
-    vkGetImageMemoryRequirements(*m_deviceHandler, depthImage, &memReqs);
-
-    VkMemoryAllocateInfo allocInfo = create_info::memoryAllocInfo(
-        memReqs.size,
-        m_deviceHandler->getMemoryType(memReqs.memoryTypeBits,
-                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
-
-    VK_CHECK(vkAllocateMemory(*m_deviceHandler, &allocInfo, nullptr,
-                              &depthImageMemory));
-
-    vkBindImageMemory(*m_deviceHandler, depthImage, depthImageMemory, 0);
+    m_deviceHandler->allocateImageMemory(
+        depthImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depthImageMemory);
 
     VkImageViewCreateInfo viewInfo =
         create_info::imageViewCreateInfo(depthImage, format);
@@ -63,6 +53,6 @@ void DepthBuffer::createDepthResources(uint32_t width, uint32_t height) {
 void DepthBuffer::cleanup() {
     vkDestroyImageView(*m_deviceHandler, depthImageView, nullptr);
     vkDestroyImage(*m_deviceHandler, depthImage, nullptr);
-    vkFreeMemory(*m_deviceHandler, depthImageMemory, nullptr);
+    m_deviceHandler->freeMemory(depthImageMemory);
 }
 } // namespace swap_chain
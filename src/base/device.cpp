@@ -21,6 +21,28 @@ bool DeviceHandler::m_checkDeviceExtensions(VkPhysicalDevice device) {
     return requiredExtensions.empty();
 }
 
+bool DeviceHandler::m_isExtensionSupported(VkPhysicalDevice device,
+                                           const char *name) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                         nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                         availableExtensions.data());
+
+    return std::any_of(availableExtensions.begin(), availableExtensions.end(),
+                       [name](const VkExtensionProperties &extension) {
+                           return strcmp(extension.extensionName, name) == 0;
+                       });
+}
+
+bool DeviceHandler::isExtensionEnabled(const char *name) const {
+    return std::any_of(
+        enabledExtensions.begin(), enabledExtensions.end(),
+        [name](const char *extension) { return strcmp(extension, name) == 0; });
+}
+
 SwapChainSupportDetails
 DeviceHandler::querySwapChainSupport(VkPhysicalDevice &device) {
     SwapChainSupportDetails details;
@@ -57,8 +79,10 @@ bool DeviceHandler::m_deviceIsSuitable(VkPhysicalDevice device) {
 
     bool extensionsSupported = m_checkDeviceExtensions(device);
 
-    bool swapChainAdequate = false;
-    if (extensionsSupported) {
+    // Without a surface nothing is ever presented, so there is no swap chain
+    // to be adequate for
+    bool swapChainAdequate = m_vkSurface == VK_NULL_HANDLE;
+    if (extensionsSupported && !swapChainAdequate) {
         SwapChainSupportDetails swapChainSupport =
             querySwapChainSupport(device);
         swapChainAdequate = !swapChainSupport.formats.empty() &&
@@ -107,6 +131,9 @@ void DeviceHandler::m_pickDevice() {
     if (candidates.rbegin()->first > 0) {
         physicalDevice = candidates.rbegin()->second;
         vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        // Rating overwrites these with each candidate's, so restore the pick's
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        vkGetPhysicalDeviceFeatures(physicalDevice, &enabledFeatures);
 
     } else {
         throw std::runtime_error("failed to find a suitable GPU!");
@@ -139,7 +166,7 @@ void DeviceHandler::m_createLogicalDevice(VkPhysicalDeviceFeatures2 *pNext,
     // deviceFeatures.bufferDeviceAddress = VK_TRUE;
 
     VkDeviceCreateInfo createInfo =
-        create_info::deviceCreateInfo(queueCreateInfos, m_deviceExtensions,
+        create_info::deviceCreateInfo(queueCreateInfos, enabledExtensions,
                                       m_validationLayers, &deviceFeatures);
 
     if (pNext != VK_NULL_HANDLE) {
@@ -187,8 +214,14 @@ DeviceHandler::getQueueFamilyIndices(VkPhysicalDevice &device) {
         }
 
         auto presentSupport = static_cast<VkBool32>(false);
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, idx, m_vkSurface,
-                                             &presentSupport);
+        if (m_vkSurface != VK_NULL_HANDLE) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, idx, m_vkSurface,
+                                                 &presentSupport);
+        } else {
+            // Headless: the graphics family stands in for the present one
+            presentSupport = static_cast<VkBool32>(
+                queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+        }
 
         if (static_cast<bool>(presentSupport)) {
             indices.presentFamily = idx;
@@ -207,11 +240,130 @@ DeviceHandler::getQueueFamilyIndices(VkPhysicalDevice &device) {
 DeviceHandler::DeviceHandler(std::vector<const char *> &devExt,
                              std::vector<const char *> &validations,
                              VkInstance m_vkInstance, VkSurfaceKHR m_vkSurface,
-                             VkPhysicalDeviceFeatures2 *pNext)
+                             VkPhysicalDeviceFeatures2 *pNext,
+                             const std::vector<const char *> &optionalExt)
     : m_deviceExtensions(devExt), m_validationLayers(validations),
       m_vkInstance(m_vkInstance), m_vkSurface(m_vkSurface) {
     m_pickDevice();
+
+    enabledExtensions = m_deviceExtensions;
+    for (const char *extension : optionalExt) {
+        if (m_isExtensionSupported(physicalDevice, extension)) {
+            enabledExtensions.push_back(extension);
+        }
+    }
+
+    m_resolveAccelerationStructureFeatures(pNext);
+    m_resolveRayQueryFeatures(pNext);
     m_createLogicalDevice(pNext);
+
+    allocator = std::make_unique<memory_allocator::MemoryAllocator>(
+        logicalDevice, memoryProperties, properties.limits,
+        m_hasBufferDeviceAddress(pNext));
+    pipelineCache = std::make_unique<pipeline_cache::PipelineCache>(
+        logicalDevice, properties, pipeline_cache::DEFAULT_PATH);
+}
+
+void DeviceHandler::m_resolveAccelerationStructureFeatures(
+    VkPhysicalDeviceFeatures2 *pNext) {
+    auto *feature =
+        static_cast<VkBaseOutStructure *>(static_cast<void *>(pNext));
+    for (; feature != nullptr; feature = feature->pNext) {
+        if (feature->sType ==
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR) {
+            break;
+        }
+    }
+    if (feature == nullptr) {
+        return;
+    }
+
+    auto *requested =
+        static_cast<VkPhysicalDeviceAccelerationStructureFeaturesKHR *>(
+            static_cast<void *>(feature));
+
+    VkPhysicalDeviceAccelerationStructureFeaturesKHR supported{};
+    supported.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &supported;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+    requested->accelerationStructureHostCommands =
+        static_cast<VkBool32>(requested->accelerationStructureHostCommands &&
+                              supported.accelerationStructureHostCommands);
+
+    enabledAccelerationStructureFeatures = *requested;
+    enabledAccelerationStructureFeatures.pNext = nullptr;
+}
+
+void DeviceHandler::m_resolveRayQueryFeatures(
+    VkPhysicalDeviceFeatures2 *pNext) {
+    auto *previous =
+        static_cast<VkBaseOutStructure *>(static_cast<void *>(pNext));
+    if (previous == nullptr) {
+        return;
+    }
+    VkBaseOutStructure *feature = previous->pNext;
+    for (; feature != nullptr; previous = feature, feature = feature->pNext) {
+        if (feature->sType ==
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR) {
+            break;
+        }
+    }
+    if (feature == nullptr) {
+        return;
+    }
+
+    auto *requested = static_cast<VkPhysicalDeviceRayQueryFeaturesKHR *>(
+        static_cast<void *>(feature));
+
+    VkPhysicalDeviceRayQueryFeaturesKHR supported{};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
+    if (isExtensionEnabled(VK_KHR_RAY_QUERY_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &supported;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+    }
+
+    requested->rayQuery =
+        static_cast<VkBool32>(requested->rayQuery && supported.rayQuery);
+
+    // The structure of an extension that is not enabled must not be chained
+    if (requested->rayQuery == VK_FALSE) {
+        previous->pNext = feature->pNext;
+    }
+
+    enabledRayQueryFeatures = *requested;
+    enabledRayQueryFeatures.pNext = nullptr;
+}
+
+bool DeviceHandler::m_hasBufferDeviceAddress(VkPhysicalDeviceFeatures2 *pNext) {
+    const auto *feature = static_cast<const VkBaseInStructure *>(
+        static_cast<const void *>(pNext));
+    for (; feature != nullptr; feature = feature->pNext) {
+        if (feature->sType ==
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES) {
+            const auto *bda = static_cast<
+                const VkPhysicalDeviceBufferDeviceAddressFeatures *>(
+                static_cast<const void *>(feature));
+            if (static_cast<bool>(bda->bufferDeviceAddress)) {
+                return true;
+            }
+        }
+        if (feature->sType ==
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES) {
+            const auto *vulkan12 =
+                static_cast<const VkPhysicalDeviceVulkan12Features *>(
+                    static_cast<const void *>(feature));
+            if (static_cast<bool>(vulkan12->bufferDeviceAddress)) {
+                return true;
+            }
+        }
+    }
+    return false;
 }
 
 uint32_t DeviceHandler::getMemoryType(uint32_t typeBits,
@@ -240,52 +392,59 @@ uint32_t DeviceHandler::getMemoryType(uint32_t typeBits,
 VkResult DeviceHandler::createBuffer(VkBufferUsageFlags usageFlags,
                                      VkMemoryPropertyFlags memoryPropertyFlags,
                                      VkDeviceSize size, VkBuffer *buffer,
-                                     VkDeviceMemory *memory, void *data) const {
+                                     memory_allocator::Allocation *memory,
+                                     void *data,
+                                     memory_allocator::Lifetime lifetime) const {
     // Create the buffer handle
     VkBufferCreateInfo bufferCreateInfo =
         create_info::bufferCreateInfo(usageFlags, size);
     VK_CHECK(vkCreateBuffer(logicalDevice, &bufferCreateInfo, nullptr, buffer));
 
-    // Create the memory backing up the buffer handle
-    VkMemoryRequirements memReqs;
-    vkGetBufferMemoryRequirements(logicalDevice, *buffer, &memReqs);
-
-    VkMemoryAllocateInfo memAlloc = create_info::memoryAllocInfo(
-        memReqs.size,
-        getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags));
-    // If the buffer has VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT set we also
-    // need to enable the appropriate flag during allocation
-    VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{};
-    if (static_cast<bool>(usageFlags &
-                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)) {
-        allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
-        allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-        memAlloc.pNext = &allocFlagsInfo;
-    }
-    VK_CHECK(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, memory));
+    // Sub-allocate the memory backing up the buffer handle and attach it
+    allocateBufferMemory(*buffer, memoryPropertyFlags, memory, lifetime);
 
-    // If a pointer to the buffer data has been passed, map the buffer and copy
-    // over the data
+    // If a pointer to the buffer data has been passed, copy over the data
+    // through the persistent mapping
     if (data != nullptr) {
-        void *mapped;
-        VK_CHECK(vkMapMemory(logicalDevice, *memory, 0, size, 0, &mapped));
-        memcpy(mapped, data, size);
+        memcpy(memory->mapped, data, size);
         // If host coherency hasn't been requested, do a manual flush to make
         // writes visible
-        if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0) {
-            VkMappedMemoryRange mappedRange{};
-            mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-            mappedRange.memory = *memory;
-            mappedRange.offset = 0;
-            mappedRange.size = size;
-            vkFlushMappedMemoryRanges(logicalDevice, 1, &mappedRange);
-        }
-        vkUnmapMemory(logicalDevice, *memory);
+        allocator->flush(*memory);
     }
 
-    // Attach the memory to the buffer object
-    VK_CHECK(vkBindBufferMemory(logicalDevice, *buffer, *memory, 0));
-
     return VK_SUCCESS;
 }
+
+void DeviceHandler::allocateBufferMemory(
+    VkBuffer buffer, VkMemoryPropertyFlags memoryPropertyFlags,
+    memory_allocator::Allocation *memory,
+    memory_allocator::Lifetime lifetime) const {
+    VkMemoryRequirements memReqs;
+    vkGetBufferMemoryRequirements(logicalDevice, buffer, &memReqs);
+
+    *memory = allocator->allocate(memReqs, memoryPropertyFlags,
+                                  memory_allocator::ResourceKind::Buffer,
+                                  lifetime);
+    VK_CHECK(vkBindBufferMemory(logicalDevice, buffer, memory->memory,
+                                memory->offset));
+}
+
+void DeviceHandler::allocateImageMemory(
+    VkImage image, VkMemoryPropertyFlags memoryPropertyFlags,
+    memory_allocator::Allocation *memory, VkImageTiling tiling) const {
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(logicalDevice, image, &memReqs);
+
+    *memory = allocator->allocate(
+        memReqs, memoryPropertyFlags,
+        tiling == VK_IMAGE_TILING_OPTIMAL
+            ? memory_allocator::ResourceKind::Image
+            : memory_allocator::ResourceKind::Buffer);
+    VK_CHECK(vkBindImageMemory(logicalDevice, image, memory->memory,
+                               memory->offset));
+}
+
+void DeviceHandler::freeMemory(memory_allocator::Allocation &memory) const {
+    allocator->free(memory);
+}
 } // namespace device
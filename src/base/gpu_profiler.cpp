@@ -0,0 +1,185 @@
+#include "vulkan_utils/gpu_profiler.hpp"
+#include "vulkan_utils/create_info.hpp"
+
+#include <cassert>
+
+namespace gpu_profiler {
+GpuProfiler::GpuProfiler(std::shared_ptr<device::DeviceHandler> m_deviceHandler,
+                         uint32_t slotCount, uint32_t maxPasses,
+                         size_t historySize)
+    : m_deviceHandler(std::move(m_deviceHandler)), m_slotCount(slotCount),
+      m_maxPasses(maxPasses), m_historySize(historySize),
+      m_recorded(static_cast<size_t>(slotCount) * maxPasses, false),
+      m_pending(static_cast<size_t>(slotCount) * maxPasses, false) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(this->m_deviceHandler->physicalDevice,
+                                  &properties);
+    m_timestampPeriod = properties.limits.timestampPeriod;
+
+    QueueFamilyIndices indices = this->m_deviceHandler->getQueueFamilyIndices(
+        this->m_deviceHandler->physicalDevice);
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(
+        this->m_deviceHandler->physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(
+        this->m_deviceHandler->physicalDevice, &queueFamilyCount,
+        queueFamilies.data());
+
+    uint32_t validBits =
+        queueFamilies[indices.graphicsFamily.value()].timestampValidBits;
+    if (validBits == 0 || m_timestampPeriod == 0.0F) {
+        std::cerr << "GPU profiler: timestamps are not supported on the "
+                     "graphics queue\n";
+        return;
+    }
+    m_timestampMask = validBits >= 64 ? ~0ULL : (1ULL << validBits) - 1;
+
+    VkQueryPoolCreateInfo queryPoolInfo = create_info::queryPoolCreateInfo(
+        VK_QUERY_TYPE_TIMESTAMP, m_slotCount * m_maxPasses * 2);
+    VK_CHECK(vkCreateQueryPool(*this->m_deviceHandler, &queryPoolInfo, nullptr,
+                               &m_queryPool));
+}
+
+GpuProfiler::~GpuProfiler() {
+    if (m_queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(*m_deviceHandler, m_queryPool, nullptr);
+    }
+}
+
+uint32_t GpuProfiler::registerPass(const std::string &name) {
+    auto it = std::find(m_passNames.begin(), m_passNames.end(), name);
+    if (it != m_passNames.end()) {
+        return static_cast<uint32_t>(it - m_passNames.begin());
+    }
+
+    if (m_passNames.size() >= m_maxPasses) {
+        throw std::runtime_error("GPU profiler: too many passes registered");
+    }
+
+    m_passNames.push_back(name);
+    m_history.emplace_back();
+    m_submitted.push_back(0);
+    m_sampled.push_back(0);
+    return static_cast<uint32_t>(m_passNames.size() - 1);
+}
+
+void GpuProfiler::beginPass(VkCommandBuffer cmd, uint32_t slot, uint32_t pass,
+                            VkPipelineStageFlagBits stage) {
+    if (!isSupported() || slot >= m_slotCount) {
+        return;
+    }
+
+    uint32_t query = m_queryIndex(slot, pass);
+    vkCmdResetQueryPool(cmd, m_queryPool, query, 2);
+    vkCmdWriteTimestamp(cmd, stage, m_queryPool, query);
+    m_recorded[slot * m_maxPasses + pass] = true;
+}
+
+void GpuProfiler::endPass(VkCommandBuffer cmd, uint32_t slot, uint32_t pass,
+                          VkPipelineStageFlagBits stage) {
+    if (!isSupported() || slot >= m_slotCount) {
+        return;
+    }
+
+    vkCmdWriteTimestamp(cmd, stage, m_queryPool, m_queryIndex(slot, pass) + 1);
+}
+
+void GpuProfiler::markSubmitted(uint32_t slot) {
+    if (!isSupported() || slot >= m_slotCount) {
+        return;
+    }
+
+    // A pass the next submission of the slot skips must not be read again
+    for (uint32_t pass = 0; pass < getPassCount(); pass++) {
+        size_t idx = slot * m_maxPasses + pass;
+        if (m_recorded[idx]) {
+            m_pending[idx] = true;
+            m_recorded[idx] = false;
+            m_submitted[pass]++;
+        }
+    }
+}
+
+void GpuProfiler::collect() {
+    if (!isSupported()) {
+        return;
+    }
+
+    // Two timestamps, each followed by its availability value
+    std::array<uint64_t, 4> results{};
+
+    for (uint32_t slot = 0; slot < m_slotCount; slot++) {
+        for (uint32_t pass = 0; pass < getPassCount(); pass++) {
+            size_t idx = slot * m_maxPasses + pass;
+            if (!m_pending[idx]) {
+                continue;
+            }
+
+            VkResult result = vkGetQueryPoolResults(
+                *m_deviceHandler, m_queryPool, m_queryIndex(slot, pass), 2,
+                sizeof(results), results.data(), sizeof(uint64_t) * 2,
+                VK_QUERY_RESULT_64_BIT |
+                    VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+            // VK_NOT_READY just means the frame is still in flight
+            if (result != VK_SUCCESS || results[1] == 0 || results[3] == 0) {
+                continue;
+            }
+
+            uint64_t ticks = (results[2] - results[0]) & m_timestampMask;
+            float ms = static_cast<float>(ticks) * m_timestampPeriod / 1.0e6F;
+
+            // Every sample stems from a submission that recorded the pass
+            m_sampled[pass]++;
+            assert(m_sampled[pass] <= m_submitted[pass]);
+
+            std::deque<float> &history = m_history[pass];
+            history.push_back(ms);
+            if (history.size() > m_historySize) {
+                history.pop_front();
+            }
+
+            m_pending[idx] = false;
+        }
+    }
+}
+
+PassStats GpuProfiler::getStats(uint32_t pass) const {
+    PassStats stats{};
+    if (pass >= m_history.size() || m_history[pass].empty()) {
+        return stats;
+    }
+
+    std::vector<float> sorted(m_history[pass].begin(), m_history[pass].end());
+    std::sort(sorted.begin(), sorted.end());
+
+    float sum = 0.0F;
+    for (float sample : sorted) {
+        sum += sample;
+    }
+
+    const float percentile = 0.99F;
+    auto p99Idx = static_cast<size_t>(
+        std::ceil(percentile * static_cast<float>(sorted.size())) - 1);
+
+    stats.min = sorted.front();
+    stats.avg = sum / static_cast<float>(sorted.size());
+    stats.p99 = sorted[std::min(p99Idx, sorted.size() - 1)];
+    stats.samples = sorted.size();
+    return stats;
+}
+
+void GpuProfiler::printStats(std::ostream &out) const {
+    for (uint32_t pass = 0; pass < getPassCount(); pass++) {
+        PassStats stats = getStats(pass);
+        if (stats.samples == 0) {
+            continue;
+        }
+        out << m_passNames[pass] << ": min " << stats.min << " ms, avg "
+            << stats.avg << " ms, p99 " << stats.p99 << " ms ("
+            << stats.samples << " samples)\n";
+    }
+}
+} // namespace gpu_profiler
@@ -30,9 +30,9 @@ void CustomGraphicsPipeline::createGraphicsPipelineFromInfo(
     VkGraphicsPipelineCreateInfo pipelineCreateInfo) {
     VK_CHECK(vkCreatePipelineLayout(*m_deviceHandler, &pipelineLayoutCreateInfo,
                                     nullptr, &pipelineLayout));
-    VK_CHECK(vkCreateGraphicsPipelines(*m_deviceHandler, VK_NULL_HANDLE, 1,
-                                       &pipelineCreateInfo, nullptr,
-                                       &graphicsPipeline));
+    VK_CHECK(vkCreateGraphicsPipelines(
+        *m_deviceHandler, *m_deviceHandler->pipelineCache, 1,
+        &pipelineCreateInfo, nullptr, &graphicsPipeline));
 }
 
 std::vector<char>
@@ -0,0 +1,136 @@
+#include "vulkan_utils/light_sampler.hpp"
+
+#include <numeric>
+
+namespace light_sampler {
+namespace {
+/*
+    Emits the node over lights [begin, end) and everything below it, returns
+   the index of the node
+*/
+uint32_t buildNode(const std::vector<glm::vec4> &lights,
+                   std::vector<uint32_t> &order, uint32_t begin, uint32_t end,
+                   std::vector<LightNode> &nodes) {
+    const auto index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+
+    LightNode node{};
+    node.boundsMin = glm::vec3(lights[order[begin]]);
+    node.boundsMax = node.boundsMin;
+    for (uint32_t i = begin; i < end; i++) {
+        node.boundsMin = glm::min(node.boundsMin, glm::vec3(lights[order[i]]));
+        node.boundsMax = glm::max(node.boundsMax, glm::vec3(lights[order[i]]));
+        node.power += lightPower(lights[order[i]]);
+    }
+
+    if (end - begin == 1) {
+        node.payload = order[begin] | LEAF_BIT;
+        nodes[index] = node;
+        return index;
+    }
+
+    const glm::vec3 extent = node.boundsMax - node.boundsMin;
+    int axis = 0;
+    if (extent.y > extent[axis]) {
+        axis = 1;
+    }
+    if (extent.z > extent[axis]) {
+        axis = 2;
+    }
+
+    const uint32_t middle = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + middle,
+                     order.begin() + end, [&](uint32_t a, uint32_t b) {
+                         return lights[a][axis] < lights[b][axis];
+                     });
+
+    buildNode(lights, order, begin, middle, nodes);
+    node.payload = buildNode(lights, order, middle, end, nodes);
+    nodes[index] = node;
+    return index;
+}
+} // namespace
+
+Strategy parseStrategy(const std::string &name) {
+    if (name == "alias") {
+        return Strategy::AliasTable;
+    }
+    if (name == "bvh") {
+        return Strategy::Bvh;
+    }
+    throw std::runtime_error("Unknown light sampling strategy " + name);
+}
+
+/*
+    Vose's alias method: every bucket holds the average probability, split
+   between its own light and one alias that tops it up
+*/
+std::vector<AliasEntry> buildAliasTable(const std::vector<glm::vec4> &lights) {
+    const auto count = static_cast<uint32_t>(lights.size());
+    std::vector<AliasEntry> table(count);
+    if (count == 0) {
+        return table;
+    }
+
+    double totalPower = 0.0;
+    for (const glm::vec4 &light : lights) {
+        totalPower += lightPower(light);
+    }
+
+    std::vector<double> scaled(count);
+    for (uint32_t i = 0; i < count; i++) {
+        const double pdf = totalPower > 0.0
+                               ? lightPower(lights[i]) / totalPower
+                               : 1.0 / count;
+        table[i].pdf = static_cast<float>(pdf);
+        scaled[i] = pdf * count;
+    }
+
+    std::vector<uint32_t> small;
+    std::vector<uint32_t> large;
+    for (uint32_t i = 0; i < count; i++) {
+        (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty()) {
+        const uint32_t less = small.back();
+        small.pop_back();
+        const uint32_t more = large.back();
+
+        table[less].probability = static_cast<float>(scaled[less]);
+        table[less].alias = more;
+
+        scaled[more] -= 1.0 - scaled[less];
+        if (scaled[more] < 1.0) {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+
+    // Whatever is left is full up to rounding errors
+    for (uint32_t i : small) {
+        table[i].probability = 1.0F;
+        table[i].alias = i;
+    }
+    for (uint32_t i : large) {
+        table[i].probability = 1.0F;
+        table[i].alias = i;
+    }
+
+    return table;
+}
+
+std::vector<LightNode> buildBvh(const std::vector<glm::vec4> &lights) {
+    std::vector<LightNode> nodes;
+    if (lights.empty()) {
+        return nodes;
+    }
+
+    std::vector<uint32_t> order(lights.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    nodes.reserve(2 * lights.size() - 1);
+    buildNode(lights, order, 0, static_cast<uint32_t>(lights.size()), nodes);
+    return nodes;
+}
+} // namespace light_sampler
@@ -0,0 +1,478 @@
+#include "vulkan_utils/memory_allocator.hpp"
+#include "vulkan_utils/create_info.hpp"
+
+namespace memory_allocator {
+namespace {
+const VkDeviceSize MEBIBYTE = 1024ULL * 1024;
+const VkDeviceSize SMALL_HEAP_BLOCK_DIVISOR = 8;
+
+VkDeviceSize alignDown(VkDeviceSize value, VkDeviceSize alignment) {
+    return value / alignment * alignment;
+}
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+MemoryAllocator::MemoryAllocator(
+    VkDevice device, const VkPhysicalDeviceMemoryProperties &memoryProperties,
+    const VkPhysicalDeviceLimits &limits, bool bufferDeviceAddress)
+    : m_device(device), m_memoryProperties(memoryProperties),
+      m_nonCoherentAtomSize(std::max<VkDeviceSize>(limits.nonCoherentAtomSize,
+                                                   1)),
+      m_bufferDeviceAddress(bufferDeviceAddress),
+      m_dedicatedStats(memoryProperties.memoryHeapCount) {
+    m_pools.resize(static_cast<size_t>(m_memoryProperties.memoryTypeCount) * 4);
+
+    for (uint32_t type = 0; type < m_memoryProperties.memoryTypeCount;
+         type++) {
+        VkDeviceSize heapSize =
+            m_memoryProperties
+                .memoryHeaps[m_memoryProperties.memoryTypes[type].heapIndex]
+                .size;
+        // Small heaps, e.g. the host visible window into VRAM, get smaller
+        // blocks so a single block does not take most of the heap
+        VkDeviceSize blockSize =
+            heapSize <= SMALL_HEAP_SIZE
+                ? alignUp(heapSize / SMALL_HEAP_BLOCK_DIVISOR, MEBIBYTE)
+                : DEFAULT_BLOCK_SIZE;
+
+        for (auto kind : {ResourceKind::Buffer, ResourceKind::Image}) {
+            for (auto lifetime : {Lifetime::Persistent, Lifetime::Transient}) {
+                Pool &pool = m_pools[m_poolIndex(type, kind, lifetime)];
+                pool.memoryType = type;
+                pool.kind = kind;
+                pool.lifetime = lifetime;
+                pool.blockSize =
+                    lifetime == Lifetime::Transient
+                        ? std::min(blockSize, DEFAULT_LINEAR_BLOCK_SIZE)
+                        : blockSize;
+            }
+        }
+    }
+}
+
+MemoryAllocator::~MemoryAllocator() {
+    uint32_t leaked = 0;
+    for (Pool &pool : m_pools) {
+        for (std::unique_ptr<Block> &block : pool.blocks) {
+            if (block == nullptr) {
+                continue;
+            }
+            leaked += block->allocationCount;
+            m_destroyBlock(*block);
+        }
+    }
+    for (const HeapStats &stats : m_dedicatedStats) {
+        leaked += stats.allocationCount;
+    }
+
+    if (leaked != 0) {
+        std::cerr << "Memory allocator: " << leaked
+                  << " allocations were never freed\n";
+    }
+}
+
+Allocation MemoryAllocator::allocate(const VkMemoryRequirements &requirements,
+                                     VkMemoryPropertyFlags properties,
+                                     ResourceKind kind, Lifetime lifetime) {
+    uint32_t memoryType =
+        m_findMemoryType(requirements.memoryTypeBits, properties);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t poolIdx = m_poolIndex(memoryType, kind, lifetime);
+    Pool &pool = m_pools[poolIdx];
+
+    if (requirements.size > pool.blockSize / 2) {
+        return m_allocateDedicated(requirements, memoryType, kind);
+    }
+
+    VkDeviceSize size = requirements.size;
+    VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+    Allocation allocation;
+
+    uint32_t sizeClass = lifetime == Lifetime::Persistent
+                             ? m_sizeClass(size)
+                             : INVALID_INDEX;
+    if (sizeClass != INVALID_INDEX) {
+        // Class ranges are aligned to their size, so a recycled range fits
+        // any alignment up to the class size
+        size = MIN_SIZE_CLASS << sizeClass;
+        alignment = std::max(alignment, size);
+
+        auto &freeList = pool.freeLists[sizeClass];
+        for (auto it = freeList.rbegin(); it != freeList.rend(); ++it) {
+            if (it->second % alignment != 0) {
+                continue;
+            }
+
+            Block &block = *pool.blocks[it->first];
+            allocation.memory = block.memory;
+            allocation.offset = it->second;
+            allocation.size = size;
+            allocation.mapped =
+                block.mapped != nullptr ? block.mapped + it->second : nullptr;
+            allocation.memoryType = memoryType;
+            allocation.pool = poolIdx;
+            allocation.block = it->first;
+            block.allocationCount++;
+            block.usedBytes += size;
+
+            freeList.erase(std::next(it).base());
+            return allocation;
+        }
+    }
+
+    for (uint32_t blockIdx = 0; blockIdx < pool.blocks.size(); blockIdx++) {
+        if (m_allocateFromBlock(pool, blockIdx, size, alignment, allocation)) {
+            return allocation;
+        }
+    }
+
+    // No block has room left, reuse a released slot or add one
+    auto slot = std::find(pool.blocks.begin(), pool.blocks.end(), nullptr);
+    auto blockIdx = static_cast<uint32_t>(slot - pool.blocks.begin());
+    if (slot == pool.blocks.end()) {
+        pool.blocks.emplace_back();
+    }
+    pool.blocks[blockIdx] = m_createBlock(pool, pool.blockSize);
+
+    if (!m_allocateFromBlock(pool, blockIdx, size, alignment, allocation)) {
+        throw std::runtime_error("Memory allocator: allocation does not fit "
+                                 "into a fresh block");
+    }
+    return allocation;
+}
+
+void MemoryAllocator::free(Allocation &allocation) {
+    if (!allocation.isValid()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (allocation.pool == INVALID_INDEX) {
+        HeapStats &stats =
+            m_dedicatedStats[m_memoryProperties
+                                 .memoryTypes[allocation.memoryType]
+                                 .heapIndex];
+        stats.reservedBytes -= allocation.size;
+        stats.usedBytes -= allocation.size;
+        stats.memoryObjectCount--;
+        stats.allocationCount--;
+        // Freeing implicitly unmaps
+        vkFreeMemory(m_device, allocation.memory, nullptr);
+        allocation = {};
+        return;
+    }
+
+    Pool &pool = m_pools[allocation.pool];
+    Block &block = *pool.blocks[allocation.block];
+    block.allocationCount--;
+    block.usedBytes -= allocation.size;
+
+    if (pool.lifetime == Lifetime::Persistent) {
+        uint32_t sizeClass = m_sizeClass(allocation.size);
+        if (sizeClass != INVALID_INDEX) {
+            pool.freeLists[sizeClass].emplace_back(allocation.block,
+                                                   allocation.offset);
+        } else {
+            // Merge the range with its free neighbours
+            VkDeviceSize begin = allocation.offset;
+            VkDeviceSize end = allocation.offset + allocation.size;
+
+            auto next = block.freeRanges.lower_bound(begin);
+            if (next != block.freeRanges.end() && next->first == end) {
+                end += next->second;
+                next = block.freeRanges.erase(next);
+            }
+            if (next != block.freeRanges.begin()) {
+                auto prev = std::prev(next);
+                if (prev->first + prev->second == begin) {
+                    begin = prev->first;
+                    block.freeRanges.erase(prev);
+                }
+            }
+            block.freeRanges[begin] = end - begin;
+        }
+    }
+
+    if (block.allocationCount == 0) {
+        m_releaseEmptyBlock(pool, allocation.block);
+    }
+
+    allocation = {};
+}
+
+void MemoryAllocator::flush(const Allocation &allocation) const {
+    if (static_cast<bool>(
+            m_memoryProperties.memoryTypes[allocation.memoryType]
+                .propertyFlags &
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        return;
+    }
+
+    VkMappedMemoryRange range{};
+    m_mappedRange(allocation, range);
+    VK_CHECK(vkFlushMappedMemoryRanges(m_device, 1, &range));
+}
+
+void MemoryAllocator::invalidate(const Allocation &allocation) const {
+    if (static_cast<bool>(
+            m_memoryProperties.memoryTypes[allocation.memoryType]
+                .propertyFlags &
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        return;
+    }
+
+    VkMappedMemoryRange range{};
+    m_mappedRange(allocation, range);
+    VK_CHECK(vkInvalidateMappedMemoryRanges(m_device, 1, &range));
+}
+
+std::vector<HeapStats> MemoryAllocator::getHeapStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<HeapStats> stats = m_dedicatedStats;
+    for (uint32_t heap = 0; heap < m_memoryProperties.memoryHeapCount;
+         heap++) {
+        stats[heap].heapSize = m_memoryProperties.memoryHeaps[heap].size;
+    }
+
+    for (const Pool &pool : m_pools) {
+        HeapStats &heapStats =
+            stats[m_memoryProperties.memoryTypes[pool.memoryType].heapIndex];
+        for (const std::unique_ptr<Block> &block : pool.blocks) {
+            if (block == nullptr) {
+                continue;
+            }
+            heapStats.reservedBytes += block->size;
+            heapStats.usedBytes += block->usedBytes;
+            heapStats.memoryObjectCount++;
+            heapStats.allocationCount += block->allocationCount;
+        }
+    }
+
+    return stats;
+}
+
+void MemoryAllocator::printStats(std::ostream &out) const {
+    std::vector<HeapStats> stats = getHeapStats();
+    for (uint32_t heap = 0; heap < stats.size(); heap++) {
+        if (stats[heap].memoryObjectCount == 0) {
+            continue;
+        }
+
+        bool deviceLocal = static_cast<bool>(
+            m_memoryProperties.memoryHeaps[heap].flags &
+            VK_MEMORY_HEAP_DEVICE_LOCAL_BIT);
+        out << "heap " << heap << (deviceLocal ? " (device local)" : "")
+            << ": " << stats[heap].usedBytes / MEBIBYTE << " MiB used of "
+            << stats[heap].reservedBytes / MEBIBYTE << " MiB reserved in "
+            << stats[heap].memoryObjectCount << " memory objects, "
+            << stats[heap].allocationCount << " allocations, heap size "
+            << stats[heap].heapSize / MEBIBYTE << " MiB\n";
+    }
+}
+
+uint32_t
+MemoryAllocator::m_findMemoryType(uint32_t typeBits,
+                                  VkMemoryPropertyFlags properties) const {
+    for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++) {
+        if (static_cast<bool>(typeBits & (1U << i)) &&
+            (m_memoryProperties.memoryTypes[i].propertyFlags & properties) ==
+                properties) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("Could not find a matching memory type");
+}
+
+uint32_t MemoryAllocator::m_poolIndex(uint32_t memoryType, ResourceKind kind,
+                                      Lifetime lifetime) const {
+    return memoryType * 4 + static_cast<uint32_t>(kind) * 2 +
+           static_cast<uint32_t>(lifetime);
+}
+
+uint32_t MemoryAllocator::m_sizeClass(VkDeviceSize size) {
+    if (size > MAX_SIZE_CLASS) {
+        return INVALID_INDEX;
+    }
+
+    uint32_t sizeClass = 0;
+    while ((MIN_SIZE_CLASS << sizeClass) < size) {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+std::unique_ptr<MemoryAllocator::Block>
+MemoryAllocator::m_createBlock(const Pool &pool, VkDeviceSize size) {
+    auto block = std::make_unique<Block>();
+    block->size = size;
+
+    VkMemoryAllocateInfo memAlloc =
+        create_info::memoryAllocInfo(size, pool.memoryType);
+    // Buffers with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT may be placed in
+    // any buffer block
+    VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{};
+    if (m_bufferDeviceAddress && pool.kind == ResourceKind::Buffer) {
+        allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
+        allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+        memAlloc.pNext = &allocFlagsInfo;
+    }
+
+    if (vkAllocateMemory(m_device, &memAlloc, nullptr, &block->memory) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Memory allocator: out of device memory");
+    }
+
+    if (static_cast<bool>(
+            m_memoryProperties.memoryTypes[pool.memoryType].propertyFlags &
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+        void *mapped = nullptr;
+        VK_CHECK(vkMapMemory(m_device, block->memory, 0, VK_WHOLE_SIZE, 0,
+                             &mapped));
+        block->mapped = static_cast<uint8_t *>(mapped);
+    }
+
+    block->freeRanges[0] = size;
+    return block;
+}
+
+void MemoryAllocator::m_destroyBlock(Block &block) {
+    // Freeing implicitly unmaps
+    vkFreeMemory(m_device, block.memory, nullptr);
+    block = {};
+}
+
+Allocation
+MemoryAllocator::m_allocateDedicated(const VkMemoryRequirements &requirements,
+                                     uint32_t memoryType, ResourceKind kind) {
+    Pool dedicatedPool;
+    dedicatedPool.memoryType = memoryType;
+    dedicatedPool.kind = kind;
+    std::unique_ptr<Block> block =
+        m_createBlock(dedicatedPool, requirements.size);
+
+    Allocation allocation;
+    allocation.memory = block->memory;
+    allocation.offset = 0;
+    allocation.size = requirements.size;
+    allocation.mapped = block->mapped;
+    allocation.memoryType = memoryType;
+
+    HeapStats &stats =
+        m_dedicatedStats[m_memoryProperties.memoryTypes[memoryType].heapIndex];
+    stats.reservedBytes += allocation.size;
+    stats.usedBytes += allocation.size;
+    stats.memoryObjectCount++;
+    stats.allocationCount++;
+
+    return allocation;
+}
+
+bool MemoryAllocator::m_allocateFromBlock(Pool &pool, uint32_t blockIdx,
+                                          VkDeviceSize size,
+                                          VkDeviceSize alignment,
+                                          Allocation &allocation) {
+    if (pool.blocks[blockIdx] == nullptr) {
+        return false;
+    }
+    Block &block = *pool.blocks[blockIdx];
+
+    VkDeviceSize offset = 0;
+    if (pool.lifetime == Lifetime::Transient) {
+        offset = alignUp(block.head, alignment);
+        if (offset + size > block.size) {
+            return false;
+        }
+        block.head = offset + size;
+    } else {
+        // First fit over the free ranges
+        auto it = block.freeRanges.begin();
+        for (; it != block.freeRanges.end(); ++it) {
+            offset = alignUp(it->first, alignment);
+            if (offset + size <= it->first + it->second) {
+                break;
+            }
+        }
+        if (it == block.freeRanges.end()) {
+            return false;
+        }
+
+        VkDeviceSize begin = it->first;
+        VkDeviceSize end = it->first + it->second;
+        block.freeRanges.erase(it);
+        if (offset > begin) {
+            block.freeRanges[begin] = offset - begin;
+        }
+        if (offset + size < end) {
+            block.freeRanges[offset + size] = end - offset - size;
+        }
+    }
+
+    allocation.memory = block.memory;
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.mapped =
+        block.mapped != nullptr ? block.mapped + offset : nullptr;
+    allocation.memoryType = pool.memoryType;
+    allocation.pool = static_cast<uint32_t>(&pool - m_pools.data());
+    allocation.block = blockIdx;
+    block.allocationCount++;
+    block.usedBytes += size;
+    return true;
+}
+
+void MemoryAllocator::m_releaseEmptyBlock(Pool &pool, uint32_t blockIdx) {
+    for (auto &freeList : pool.freeLists) {
+        freeList.erase(std::remove_if(freeList.begin(), freeList.end(),
+                                      [blockIdx](const auto &range) {
+                                          return range.first == blockIdx;
+                                      }),
+                       freeList.end());
+    }
+
+    Block &block = *pool.blocks[blockIdx];
+    block.freeRanges.clear();
+    block.freeRanges[0] = block.size;
+    block.head = 0;
+
+    // Keep a single empty block around so allocating and freeing in a loop
+    // does not hit vkAllocateMemory every time
+    bool otherEmptyBlock = false;
+    for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+        if (i != blockIdx && pool.blocks[i] != nullptr &&
+            pool.blocks[i]->allocationCount == 0) {
+            otherEmptyBlock = true;
+            break;
+        }
+    }
+
+    if (otherEmptyBlock) {
+        m_destroyBlock(block);
+        pool.blocks[blockIdx] = nullptr;
+    }
+}
+
+void MemoryAllocator::m_mappedRange(const Allocation &allocation,
+                                    VkMappedMemoryRange &range) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    VkDeviceSize memorySize =
+        allocation.pool == INVALID_INDEX
+            ? allocation.size
+            : m_pools[allocation.pool].blocks[allocation.block]->size;
+
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = allocation.memory;
+    range.offset = alignDown(allocation.offset, m_nonCoherentAtomSize);
+    VkDeviceSize end =
+        alignUp(allocation.offset + allocation.size, m_nonCoherentAtomSize);
+    range.size = end >= memorySize ? VK_WHOLE_SIZE : end - range.offset;
+}
+} // namespace memory_allocator
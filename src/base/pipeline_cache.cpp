@@ -0,0 +1,96 @@
+#include "vulkan_utils/pipeline_cache.hpp"
+#include "vulkan_utils/utils.hpp"
+
+#include <filesystem>
+
+namespace pipeline_cache {
+PipelineCache::PipelineCache(VkDevice device,
+                             const VkPhysicalDeviceProperties &properties,
+                             std::string path)
+    : m_device(device), m_properties(properties), m_path(std::move(path)) {
+    std::vector<uint8_t> data;
+    std::ifstream file(m_path, std::ios::binary | std::ios::ate);
+    if (file.is_open()) {
+        data.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        if (!file.read(reinterpret_cast<char *>(data.data()),
+                       static_cast<std::streamsize>(data.size())) ||
+            !m_isCompatible(data)) {
+            data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    // Drivers are allowed to reject data that passed the header check
+    if (vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_cache) !=
+        VK_SUCCESS) {
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+        VK_CHECK(
+            vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_cache));
+    }
+}
+
+PipelineCache::~PipelineCache() {
+    save();
+    vkDestroyPipelineCache(m_device, m_cache, nullptr);
+}
+
+void PipelineCache::save() const {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(m_device, m_cache, &size, nullptr) !=
+            VK_SUCCESS ||
+        size == 0) {
+        return;
+    }
+    std::vector<uint8_t> data(size);
+    if (vkGetPipelineCacheData(m_device, m_cache, &size, data.data()) !=
+        VK_SUCCESS) {
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::path parent = std::filesystem::path(m_path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, error);
+    }
+
+    // Written under a temporary name first, so a crash never leaves a
+    // truncated cache behind
+    std::string tmpPath = m_path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open() ||
+            !file.write(reinterpret_cast<const char *>(data.data()),
+                        static_cast<std::streamsize>(size))) {
+            std::cerr << "Could not write pipeline cache " << m_path << "\n";
+            return;
+        }
+    }
+    std::filesystem::rename(tmpPath, m_path, error);
+    if (error) {
+        std::cerr << "Could not write pipeline cache " << m_path << ": "
+                  << error.message() << "\n";
+    }
+}
+
+bool PipelineCache::m_isCompatible(const std::vector<uint8_t> &data) const {
+    VkPipelineCacheHeaderVersionOne header{};
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+
+    return header.headerSize >= sizeof(header) &&
+           header.headerSize <= data.size() &&
+           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == m_properties.vendorID &&
+           header.deviceID == m_properties.deviceID &&
+           memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID,
+                  VK_UUID_SIZE) == 0;
+}
+} // namespace pipeline_cache
@@ -85,56 +85,47 @@ void RaytracerBase::updateRenderPass() {
 }
 
 RaytracerBase::ScratchBuffer
-RaytracerBase::createScratchBuffer(VkDeviceSize size) {
+RaytracerBase::createScratchBuffer(VkDeviceSize size,
+                                   memory_allocator::Lifetime lifetime) {
     ScratchBuffer scratchBuffer{};
-    // Buffer and memory
+    // Buffer and memory. Sub-allocated memory only guarantees the buffer's
+    // own alignment, so leave room to align the address for the build
+    VkDeviceSize scratchAlignment = std::max<VkDeviceSize>(
+        accelerationStructureProperties
+            .minAccelerationStructureScratchOffsetAlignment,
+        1);
     VkBufferCreateInfo bufferCreateInfo{};
     bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferCreateInfo.size = size;
+    bufferCreateInfo.size = size + scratchAlignment - 1;
     bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
                              VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
     VK_CHECK(vkCreateBuffer(*m_deviceHandler, &bufferCreateInfo, nullptr,
                             &scratchBuffer.handle));
-    VkMemoryRequirements memoryRequirements{};
-    vkGetBufferMemoryRequirements(*m_deviceHandler, scratchBuffer.handle,
-                                  &memoryRequirements);
-
-    VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo{};
-    memoryAllocateFlagsInfo.sType =
-        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
-    memoryAllocateFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-    VkMemoryAllocateInfo memoryAllocateInfo = {};
-    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memoryAllocateInfo.pNext = &memoryAllocateFlagsInfo;
-    memoryAllocateInfo.allocationSize = memoryRequirements.size;
-    memoryAllocateInfo.memoryTypeIndex = m_deviceHandler->getMemoryType(
-        memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    VK_CHECK(vkAllocateMemory(*m_deviceHandler, &memoryAllocateInfo, nullptr,
-                              &scratchBuffer.memory));
-    VK_CHECK(vkBindBufferMemory(*m_deviceHandler, scratchBuffer.handle,
-                                scratchBuffer.memory, 0));
+    m_deviceHandler->allocateBufferMemory(
+        scratchBuffer.handle, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &scratchBuffer.memory, lifetime);
     // Buffer device address
     VkBufferDeviceAddressInfoKHR bufferDeviceAddresInfo{};
     bufferDeviceAddresInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
     bufferDeviceAddresInfo.buffer = scratchBuffer.handle;
-    scratchBuffer.deviceAddress =
-        vkGetBufferDeviceAddressKHR(*m_deviceHandler, &bufferDeviceAddresInfo);
+    scratchBuffer.deviceAddress = utils::alignedSize(
+        vkGetBufferDeviceAddressKHR(*m_deviceHandler, &bufferDeviceAddresInfo),
+        scratchAlignment);
     return scratchBuffer;
 }
 
 void RaytracerBase::deleteScratchBuffer(ScratchBuffer &scratchBuffer) {
-    if (scratchBuffer.memory != VK_NULL_HANDLE) {
-        vkFreeMemory(*m_deviceHandler, scratchBuffer.memory, nullptr);
-    }
     if (scratchBuffer.handle != VK_NULL_HANDLE) {
         vkDestroyBuffer(*m_deviceHandler, scratchBuffer.handle, nullptr);
     }
+    m_deviceHandler->freeMemory(scratchBuffer.memory);
 }
 
 void RaytracerBase::createAccelerationStructure(
     AccelerationStructure &accelerationStructure,
     VkAccelerationStructureTypeKHR type,
-    VkAccelerationStructureBuildSizesInfoKHR buildSizeInfo) {
+    VkAccelerationStructureBuildSizesInfoKHR buildSizeInfo,
+    VkMemoryPropertyFlags memoryPropertyFlags) {
     // Buffer and memory
     VkBufferCreateInfo bufferCreateInfo{};
     bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -145,23 +136,9 @@ void RaytracerBase::createAccelerationStructure(
     VK_CHECK(vkCreateBuffer(*m_deviceHandler, &bufferCreateInfo, nullptr,
                             &accelerationStructure.buffer));
 
-    VkMemoryRequirements memoryRequirements{};
-    vkGetBufferMemoryRequirements(
-        *m_deviceHandler, accelerationStructure.buffer, &memoryRequirements);
-    VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo{};
-    memoryAllocateFlagsInfo.sType =
-        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
-    memoryAllocateFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-    VkMemoryAllocateInfo memoryAllocateInfo{};
-    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memoryAllocateInfo.pNext = &memoryAllocateFlagsInfo;
-    memoryAllocateInfo.allocationSize = memoryRequirements.size;
-    memoryAllocateInfo.memoryTypeIndex = m_deviceHandler->getMemoryType(
-        memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    VK_CHECK(vkAllocateMemory(*m_deviceHandler, &memoryAllocateInfo, nullptr,
-                              &accelerationStructure.memory));
-    VK_CHECK(vkBindBufferMemory(*m_deviceHandler, accelerationStructure.buffer,
-                                accelerationStructure.memory, 0));
+    m_deviceHandler->allocateBufferMemory(accelerationStructure.buffer,
+                                          memoryPropertyFlags,
+                                          &accelerationStructure.memory);
 
     // Acceleration structure
     VkAccelerationStructureCreateInfoKHR accelerationStructureCreate_info{};
@@ -171,6 +148,7 @@ void RaytracerBase::createAccelerationStructure(
     accelerationStructureCreate_info.size =
         buildSizeInfo.accelerationStructureSize;
     accelerationStructureCreate_info.type = type;
+    accelerationStructure.size = buildSizeInfo.accelerationStructureSize;
     vkCreateAccelerationStructureKHR(*m_deviceHandler,
                                      &accelerationStructureCreate_info, nullptr,
                                      &accelerationStructure.handle);
@@ -187,10 +165,53 @@ void RaytracerBase::createAccelerationStructure(
 
 void RaytracerBase::deleteAccelerationStructure(
     AccelerationStructure &accelerationStructure) {
-    vkFreeMemory(*m_deviceHandler, accelerationStructure.memory, nullptr);
-    vkDestroyBuffer(*m_deviceHandler, accelerationStructure.buffer, nullptr);
     vkDestroyAccelerationStructureKHR(*m_deviceHandler,
                                       accelerationStructure.handle, nullptr);
+    vkDestroyBuffer(*m_deviceHandler, accelerationStructure.buffer, nullptr);
+    m_deviceHandler->freeMemory(accelerationStructure.memory);
+}
+
+VkResult RaytracerBase::buildAccelerationStructuresOnHost(
+    uint32_t infoCount,
+    const VkAccelerationStructureBuildGeometryInfoKHR *pInfos,
+    const VkAccelerationStructureBuildRangeInfoKHR *const *ppBuildRangeInfos) {
+    VkDeferredOperationKHR operation = VK_NULL_HANDLE;
+    VK_CHECK(
+        vkCreateDeferredOperationKHR(*m_deviceHandler, nullptr, &operation));
+
+    VkResult result = vkBuildAccelerationStructuresKHR(
+        *m_deviceHandler, operation, infoCount, pInfos, ppBuildRangeInfos);
+
+    if (result == VK_OPERATION_DEFERRED_KHR) {
+        if (hostBuildPool == nullptr) {
+            hostBuildPool = std::make_unique<thread_pool::ThreadPool>();
+        }
+
+        uint32_t concurrency = std::clamp(
+            vkGetDeferredOperationMaxConcurrencyKHR(*m_deviceHandler,
+                                                    operation),
+            1U, hostBuildPool->size());
+        for (uint32_t i = 0; i < concurrency; i++) {
+            hostBuildPool->submit([this, operation] {
+                // Idle means other threads still hold the remaining work
+                VkResult joined =
+                    vkDeferredOperationJoinKHR(*m_deviceHandler, operation);
+                while (joined == VK_THREAD_IDLE_KHR) {
+                    std::this_thread::yield();
+                    joined =
+                        vkDeferredOperationJoinKHR(*m_deviceHandler, operation);
+                }
+            });
+        }
+        hostBuildPool->wait();
+
+        result = vkGetDeferredOperationResultKHR(*m_deviceHandler, operation);
+    } else if (result == VK_OPERATION_NOT_DEFERRED_KHR) {
+        result = VK_SUCCESS;
+    }
+
+    vkDestroyDeferredOperationKHR(*m_deviceHandler, operation, nullptr);
+    return result;
 }
 
 uint64_t RaytracerBase::getBufferDeviceAddress(VkBuffer buffer) {
@@ -201,15 +222,38 @@ uint64_t RaytracerBase::getBufferDeviceAddress(VkBuffer buffer) {
     return vkGetBufferDeviceAddressKHR(*m_deviceHandler, &bufferDeviceAI);
 }
 
+VkFormat RaytracerBase::storageImageFormat(VkFormat preferred) const {
+    // Every shader declares the image rgba8, which both formats match
+    for (VkFormat format : {preferred, VK_FORMAT_R8G8B8A8_UNORM}) {
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(m_deviceHandler->physicalDevice,
+                                            format, &formatProperties);
+        if ((formatProperties.optimalTilingFeatures &
+             VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0) {
+            return format;
+        }
+    }
+    throw std::runtime_error(
+        "The device can not store to images of format " +
+        std::to_string(static_cast<int>(preferred)) + " or RGBA8");
+}
+
 void RaytracerBase::createStorageImage(VkFormat format, VkExtent3D extent) {
     // Release ressources if image is to be recreated
     if (storageImage.image != VK_NULL_HANDLE) {
         vkDestroyImageView(*m_deviceHandler, storageImage.view, nullptr);
         vkDestroyImage(*m_deviceHandler, storageImage.image, nullptr);
-        vkFreeMemory(*m_deviceHandler, storageImage.memory, nullptr);
+        m_deviceHandler->freeMemory(storageImage.memory);
         storageImage = {};
     }
 
+    // The shaders write the image, not every format allows that
+    if (storageImageFormat(format) != format) {
+        throw std::runtime_error(
+            "The device can not store to images of format " +
+            std::to_string(static_cast<int>(format)));
+    }
+
     VkImageCreateInfo image = create_info::imageCreateInfo(
         VK_IMAGE_TYPE_2D, format,
         VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
@@ -222,18 +266,9 @@ void RaytracerBase::createStorageImage(VkFormat format, VkExtent3D extent) {
     VK_CHECK(
         vkCreateImage(*m_deviceHandler, &image, nullptr, &storageImage.image));
 
-    VkMemoryRequirements memReqs;
-    vkGetImageMemoryRequirements(*m_deviceHandler, storageImage.image,
-                                 &memReqs);
-    VkMemoryAllocateInfo memoryAllocateInfo{};
-    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memoryAllocateInfo.allocationSize = memReqs.size;
-    memoryAllocateInfo.memoryTypeIndex = m_deviceHandler->getMemoryType(
-        memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    VK_CHECK(vkAllocateMemory(*m_deviceHandler, &memoryAllocateInfo, nullptr,
-                              &storageImage.memory));
-    VK_CHECK(vkBindImageMemory(*m_deviceHandler, storageImage.image,
-                               storageImage.memory, 0));
+    m_deviceHandler->allocateImageMemory(storageImage.image,
+                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                         &storageImage.memory);
 
     VkImageViewCreateInfo colorImageView{};
     colorImageView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -262,12 +297,18 @@ void RaytracerBase::createStorageImage(VkFormat format, VkExtent3D extent) {
 void RaytracerBase::deleteStorageImage() {
     vkDestroyImageView(*m_deviceHandler, storageImage.view, nullptr);
     vkDestroyImage(*m_deviceHandler, storageImage.image, nullptr);
-    vkFreeMemory(*m_deviceHandler, storageImage.memory, nullptr);
+    m_deviceHandler->freeMemory(storageImage.memory);
 }
 
 void RaytracerBase::prepare() {
     rayTracingPipelineProperties.sType =
         VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
+    accelerationStructureProperties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+    subgroupProperties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    rayTracingPipelineProperties.pNext = &accelerationStructureProperties;
+    accelerationStructureProperties.pNext = &subgroupProperties;
 
     VkPhysicalDeviceProperties2 deviceProperties2{};
     deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
@@ -285,6 +326,9 @@ void RaytracerBase::prepare() {
 
     vkGetPhysicalDeviceFeatures2(m_deviceHandler->physicalDevice,
                                  &deviceFeatures2);
+    enabledAccelerationStructureFeatures =
+        m_deviceHandler->enabledAccelerationStructureFeatures;
+    enabledRayQueryFeatures = m_deviceHandler->enabledRayQueryFeatures;
 
     // Get the function pointers required for ray tracing
     vkGetBufferDeviceAddressKHR =
@@ -314,6 +358,45 @@ void RaytracerBase::prepare() {
         reinterpret_cast<PFN_vkGetAccelerationStructureDeviceAddressKHR>(
             vkGetDeviceProcAddr(*m_deviceHandler,
                                 "vkGetAccelerationStructureDeviceAddressKHR"));
+    vkCmdWriteAccelerationStructuresPropertiesKHR =
+        reinterpret_cast<PFN_vkCmdWriteAccelerationStructuresPropertiesKHR>(
+            vkGetDeviceProcAddr(
+                *m_deviceHandler,
+                "vkCmdWriteAccelerationStructuresPropertiesKHR"));
+    vkWriteAccelerationStructuresPropertiesKHR =
+        reinterpret_cast<PFN_vkWriteAccelerationStructuresPropertiesKHR>(
+            vkGetDeviceProcAddr(*m_deviceHandler,
+                                "vkWriteAccelerationStructuresPropertiesKHR"));
+    vkCmdCopyAccelerationStructureKHR =
+        reinterpret_cast<PFN_vkCmdCopyAccelerationStructureKHR>(
+            vkGetDeviceProcAddr(*m_deviceHandler,
+                                "vkCmdCopyAccelerationStructureKHR"));
+    vkCmdCopyAccelerationStructureToMemoryKHR =
+        reinterpret_cast<PFN_vkCmdCopyAccelerationStructureToMemoryKHR>(
+            vkGetDeviceProcAddr(*m_deviceHandler,
+                                "vkCmdCopyAccelerationStructureToMemoryKHR"));
+    vkCmdCopyMemoryToAccelerationStructureKHR =
+        reinterpret_cast<PFN_vkCmdCopyMemoryToAccelerationStructureKHR>(
+            vkGetDeviceProcAddr(*m_deviceHandler,
+                                "vkCmdCopyMemoryToAccelerationStructureKHR"));
+    vkCreateDeferredOperationKHR =
+        reinterpret_cast<PFN_vkCreateDeferredOperationKHR>(vkGetDeviceProcAddr(
+            *m_deviceHandler, "vkCreateDeferredOperationKHR"));
+    vkDestroyDeferredOperationKHR =
+        reinterpret_cast<PFN_vkDestroyDeferredOperationKHR>(
+            vkGetDeviceProcAddr(*m_deviceHandler,
+                                "vkDestroyDeferredOperationKHR"));
+    vkGetDeferredOperationMaxConcurrencyKHR =
+        reinterpret_cast<PFN_vkGetDeferredOperationMaxConcurrencyKHR>(
+            vkGetDeviceProcAddr(*m_deviceHandler,
+                                "vkGetDeferredOperationMaxConcurrencyKHR"));
+    vkGetDeferredOperationResultKHR =
+        reinterpret_cast<PFN_vkGetDeferredOperationResultKHR>(
+            vkGetDeviceProcAddr(*m_deviceHandler,
+                                "vkGetDeferredOperationResultKHR"));
+    vkDeferredOperationJoinKHR =
+        reinterpret_cast<PFN_vkDeferredOperationJoinKHR>(vkGetDeviceProcAddr(
+            *m_deviceHandler, "vkDeferredOperationJoinKHR"));
     vkCmdTraceRaysKHR = reinterpret_cast<PFN_vkCmdTraceRaysKHR>(
         vkGetDeviceProcAddr(*m_deviceHandler, "vkCmdTraceRaysKHR"));
     vkGetRayTracingShaderGroupHandlesKHR =
@@ -324,7 +407,9 @@ void RaytracerBase::prepare() {
         reinterpret_cast<PFN_vkCreateRayTracingPipelinesKHR>(
             vkGetDeviceProcAddr(*m_deviceHandler,
                                 "vkCreateRayTracingPipelinesKHR"));
-    updateRenderPass();
+    if (m_swapChain != nullptr) {
+        updateRenderPass();
+    }
 }
 
 VkStridedDeviceAddressRegionKHR
@@ -350,7 +435,8 @@ void RaytracerBase::createShaderBindingTable(
             VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        rayTracingPipelineProperties.shaderGroupHandleSize * handleCount));
+        rayTracingPipelineProperties.shaderGroupHandleSize * handleCount,
+        nullptr, rayTracingPipelineProperties.shaderGroupBaseAlignment));
     // Get the strided address to be used when dispatching the rays
     shaderBindingTable.stridedDeviceAddressRegion =
         getSbtEntryStridedDeviceAddressRegion(shaderBindingTable.buffer,
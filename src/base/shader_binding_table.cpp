@@ -4,18 +4,20 @@
 namespace raytracer {
 
 VkResult ShaderBindingTable::map(VkDeviceSize size, VkDeviceSize offset) {
-    return vkMapMemory(device, memory, offset, size, 0, &mapped);
-}
-
-void ShaderBindingTable::unmap() {
-    if (mapped != nullptr) {
-        vkUnmapMemory(device, memory);
-        mapped = nullptr;
+    UNUSED(size);
+    // Host visible memory stays mapped for the lifetime of its block
+    if (memory.mapped == nullptr) {
+        return VK_ERROR_MEMORY_MAP_FAILED;
     }
+    mapped = static_cast<uint8_t *>(memory.mapped) + offset;
+    return VK_SUCCESS;
 }
 
+void ShaderBindingTable::unmap() { mapped = nullptr; }
+
 [[nodiscard]] VkResult ShaderBindingTable::bind(VkDeviceSize offset) const {
-    return vkBindBufferMemory(device, buffer, memory, offset);
+    return vkBindBufferMemory(device, buffer, memory.memory,
+                              memory.offset + offset);
 }
 
 void ShaderBindingTable::setupDescriptor(VkDeviceSize size,
@@ -27,38 +29,41 @@ void ShaderBindingTable::setupDescriptor(VkDeviceSize size,
 
 [[nodiscard]] VkResult ShaderBindingTable::flush(VkDeviceSize size,
                                                  VkDeviceSize offset) const {
-    VkMappedMemoryRange mappedRange = {};
-    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = memory;
-    mappedRange.offset = offset;
-    mappedRange.size = size;
-    return vkFlushMappedMemoryRanges(device, 1, &mappedRange);
+    deviceHandler->allocator->flush(m_subRange(size, offset));
+    return VK_SUCCESS;
 }
 
 [[nodiscard]] VkResult
 ShaderBindingTable::invalidate(VkDeviceSize size, VkDeviceSize offset) const {
-    VkMappedMemoryRange mappedRange = {};
-    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = memory;
-    mappedRange.offset = offset;
-    mappedRange.size = size;
-    return vkInvalidateMappedMemoryRanges(device, 1, &mappedRange);
+    deviceHandler->allocator->invalidate(m_subRange(size, offset));
+    return VK_SUCCESS;
 }
 
-void ShaderBindingTable::destroy() const {
+memory_allocator::Allocation
+ShaderBindingTable::m_subRange(VkDeviceSize size, VkDeviceSize offset) const {
+    memory_allocator::Allocation range = memory;
+    range.offset += offset;
+    range.size = size == VK_WHOLE_SIZE ? memory.size - offset : size;
+    return range;
+}
+
+void ShaderBindingTable::destroy() {
+    unmap();
     if (buffer != VK_NULL_HANDLE) {
         vkDestroyBuffer(device, buffer, nullptr);
+        buffer = VK_NULL_HANDLE;
     }
-    if (memory != VK_NULL_HANDLE) {
-        vkFreeMemory(device, memory, nullptr);
+    if (memory.isValid()) {
+        deviceHandler->freeMemory(memory);
     }
 }
 
 VkResult ShaderBindingTable::create(
     std::shared_ptr<device::DeviceHandler> &deviceHandler,
     VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags,
-    VkDeviceSize size, void *data) {
+    VkDeviceSize size, void *data, VkDeviceSize minAlignment) {
     this->device = *deviceHandler;
+    this->deviceHandler = deviceHandler;
 
     // Create the buffer handle
     VkBufferCreateInfo bufferCreateInfo =
@@ -67,22 +72,12 @@ VkResult ShaderBindingTable::create(
 
     // Create the memory backing up the buffer handle
     VkMemoryRequirements memReqs;
-    VkMemoryAllocateInfo memAlloc = create_info::memoryAllocateInfo();
     vkGetBufferMemoryRequirements(*deviceHandler, buffer, &memReqs);
-    memAlloc.allocationSize = memReqs.size;
-    // Find a memory type index that fits the properties of the buffer
-    memAlloc.memoryTypeIndex = deviceHandler->getMemoryType(
-        memReqs.memoryTypeBits, memoryPropertyFlags);
-    // If the buffer has VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT set we also
-    // need to enable the appropriate flag during allocation
-    VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{};
-    if (static_cast<bool>(usageFlags &
-                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)) {
-        allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
-        allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-        memAlloc.pNext = &allocFlagsInfo;
-    }
-    VK_CHECK(vkAllocateMemory(*deviceHandler, &memAlloc, nullptr, &memory));
+    // The table's device address must be aligned to shaderGroupBaseAlignment,
+    // which a sub-allocated buffer only gets if asked for
+    memReqs.alignment = std::max(memReqs.alignment, minAlignment);
+    memory = deviceHandler->allocator->allocate(
+        memReqs, memoryPropertyFlags, memory_allocator::ResourceKind::Buffer);
 
     this->alignment = memReqs.alignment;
     this->size = size;
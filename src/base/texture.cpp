@@ -19,7 +19,7 @@ void Texture::destroy() {
     if (sampler != nullptr) {
         vkDestroySampler(*m_deviceHandler, sampler, nullptr);
     }
-    vkFreeMemory(*m_deviceHandler, deviceMemory, nullptr);
+    m_deviceHandler->freeMemory(deviceMemory);
 }
 
 ktxResult Texture::loadKTXFile(const std::string &filename,
@@ -55,10 +55,6 @@ void Texture2D::createImageWithStaging(ktxTexture *ktxTexture,
                                        VkFormat format,
                                        VkImageUsageFlags imageUsageFlags) {
 
-    VkMemoryAllocateInfo memAllocInfo{};
-    memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    VkMemoryRequirements memReqs;
-
     // Use a separate command buffer for texture loading
     VkCommandBuffer copyCmd = m_commandBufferHandler->createCommandBuffer(
         VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
@@ -104,15 +100,8 @@ void Texture2D::createImageWithStaging(ktxTexture *ktxTexture,
     VK_CHECK(
         vkCreateImage(*m_deviceHandler, &imageCreateInfo, nullptr, &image));
 
-    vkGetImageMemoryRequirements(*m_deviceHandler, image, &memReqs);
-
-    memAllocInfo.allocationSize = memReqs.size;
-
-    memAllocInfo.memoryTypeIndex = m_deviceHandler->getMemoryType(
-        memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    VK_CHECK(vkAllocateMemory(*m_deviceHandler, &memAllocInfo, nullptr,
-                              &deviceMemory));
-    VK_CHECK(vkBindImageMemory(*m_deviceHandler, image, deviceMemory, 0));
+    m_deviceHandler->allocateImageMemory(
+        image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &deviceMemory);
 
     VkImageSubresourceRange subresourceRange = {};
     subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -151,8 +140,6 @@ void Texture2D::createImageWithoutStaging(ktx_uint8_t *ktxTextureData,
     vkGetPhysicalDeviceFormatProperties(m_deviceHandler->physicalDevice, format,
                                         &formatProperties);
 
-    VkMemoryAllocateInfo memAllocInfo{};
-    memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     VkMemoryRequirements memReqs;
 
     // Use a separate command buffer for texture loading
@@ -168,7 +155,7 @@ void Texture2D::createImageWithoutStaging(ktx_uint8_t *ktxTextureData,
            VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
 
     VkImage mappableImage;
-    VkDeviceMemory mappableMemory;
+    memory_allocator::Allocation mappableMemory;
 
     VkImageCreateInfo imageCreateInfo =
         create_info::imageCreateInfo(VK_IMAGE_TYPE_2D, format, imageUsageFlags);
@@ -181,21 +168,13 @@ void Texture2D::createImageWithoutStaging(ktx_uint8_t *ktxTextureData,
     // Get memory requirements for this image
     // like size and alignment
     vkGetImageMemoryRequirements(*m_deviceHandler, mappableImage, &memReqs);
-    // Set memory allocation size to required memory size
-    memAllocInfo.allocationSize = memReqs.size;
-
-    // Get memory type that can be mapped to host memory
-    memAllocInfo.memoryTypeIndex = m_deviceHandler->getMemoryType(
-        memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-    // Allocate host memory
-    VK_CHECK(vkAllocateMemory(*m_deviceHandler, &memAllocInfo, nullptr,
-                              &mappableMemory));
-
-    // Bind allocated image for use
-    VK_CHECK(
-        vkBindImageMemory(*m_deviceHandler, mappableImage, mappableMemory, 0));
+    // Allocate memory that can be mapped to host memory and bind it
+    m_deviceHandler->allocateImageMemory(
+        mappableImage,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &mappableMemory, imageCreateInfo.tiling);
 
     // Get sub resource layout
     // Mip map count, array layer, etc.
@@ -204,21 +183,14 @@ void Texture2D::createImageWithoutStaging(ktx_uint8_t *ktxTextureData,
     subRes.mipLevel = 0;
 
     VkSubresourceLayout subResLayout;
-    void *data;
 
     // Get sub resources layout
     // Includes row pitch, size offsets, etc.
     vkGetImageSubresourceLayout(*m_deviceHandler, mappableImage, &subRes,
                                 &subResLayout);
 
-    // Map image memory
-    VK_CHECK(vkMapMemory(*m_deviceHandler, mappableMemory, 0, memReqs.size, 0,
-                         &data));
-
-    // Copy image data into memory
-    memcpy(data, ktxTextureData, memReqs.size);
-
-    vkUnmapMemory(*m_deviceHandler, mappableMemory);
+    // Copy image data into the persistently mapped memory
+    memcpy(mappableMemory.mapped, ktxTextureData, memReqs.size);
 
     // Linear tiled images don't need to be staged
     // and can be directly used as textures
@@ -347,9 +319,6 @@ Texture2D::Texture2D(void *buffer, VkDeviceSize bufferSize, VkFormat format,
     height = texHeight;
     mipLevels = 1;
 
-    VkMemoryAllocateInfo memAllocInfo{};
-    VkMemoryRequirements memReqs;
-
     // Use a separate command buffer for texture loading
     VkCommandBuffer copyCmd = m_commandBufferHandler->createCommandBuffer(
         VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
@@ -371,15 +340,8 @@ Texture2D::Texture2D(void *buffer, VkDeviceSize bufferSize, VkFormat format,
     VK_CHECK(vkCreateImage(*this->m_deviceHandler, &imageCreateInfo, nullptr,
                            &image));
 
-    vkGetImageMemoryRequirements(*this->m_deviceHandler, image, &memReqs);
-
-    memAllocInfo.allocationSize = memReqs.size;
-
-    memAllocInfo.memoryTypeIndex = this->m_deviceHandler->getMemoryType(
-        memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    VK_CHECK(vkAllocateMemory(*this->m_deviceHandler, &memAllocInfo, nullptr,
-                              &deviceMemory));
-    VK_CHECK(vkBindImageMemory(*this->m_deviceHandler, image, deviceMemory, 0));
+    this->m_deviceHandler->allocateImageMemory(
+        image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &deviceMemory);
 
     VkImageSubresourceRange subresourceRange = {};
     subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -455,10 +417,6 @@ Texture2DArray::Texture2DArray(
     ktx_uint8_t *ktxTextureData = ktxTexture_GetData(ktxTexture);
     ktx_size_t ktxTextureSize = ktxTexture_GetDataSize(ktxTexture);
 
-    VkMemoryAllocateInfo memAllocInfo{};
-    memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    VkMemoryRequirements memReqs;
-
     buffer::StagingBuffer buf = buffer::StagingBuffer(
         this->m_deviceHandler, m_commandBufferHandler, ktxTextureSize);
     buf.copy(ktxTextureData, ktxTextureSize);
@@ -502,15 +460,8 @@ Texture2DArray::Texture2DArray(
     VK_CHECK(vkCreateImage(*this->m_deviceHandler, &imageCreateInfo, nullptr,
                            &image));
 
-    vkGetImageMemoryRequirements(*this->m_deviceHandler, image, &memReqs);
-
-    memAllocInfo.allocationSize = memReqs.size;
-    memAllocInfo.memoryTypeIndex = this->m_deviceHandler->getMemoryType(
-        memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    VK_CHECK(vkAllocateMemory(*this->m_deviceHandler, &memAllocInfo, nullptr,
-                              &deviceMemory));
-    VK_CHECK(vkBindImageMemory(*this->m_deviceHandler, image, deviceMemory, 0));
+    this->m_deviceHandler->allocateImageMemory(
+        image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &deviceMemory);
 
     // Use a separate command buffer for texture loading
     VkCommandBuffer copyCmd = m_commandBufferHandler->createCommandBuffer(
@@ -0,0 +1,62 @@
+#include "vulkan_utils/thread_pool.hpp"
+
+namespace thread_pool {
+ThreadPool::ThreadPool(uint32_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    m_workers.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++) {
+        m_workers.emplace_back([this] { m_work(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_taskReady.notify_all();
+    for (std::thread &worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_taskReady.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_tasks.empty() && m_running == 0; });
+}
+
+void ThreadPool::m_work() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_taskReady.wait(lock,
+                         [this] { return m_stopping || !m_tasks.empty(); });
+        if (m_tasks.empty()) {
+            // Only stopping with nothing left to do
+            return;
+        }
+
+        std::function<void()> task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        m_running++;
+
+        lock.unlock();
+        task();
+        lock.lock();
+
+        m_running--;
+        if (m_tasks.empty() && m_running == 0) {
+            m_idle.notify_all();
+        }
+    }
+}
+} // namespace thread_pool
@@ -0,0 +1,52 @@
+#include "vulkan_utils/uniform_ring.hpp"
+#include "vulkan_utils/utils.hpp"
+
+namespace uniform_ring {
+UniformRing::UniformRing(std::shared_ptr<device::DeviceHandler> m_deviceHandler,
+                         uint32_t frameCount, VkDeviceSize frameCapacity)
+    : m_deviceHandler(std::move(m_deviceHandler)), m_frameCount(frameCount) {
+    m_alignment = std::max<VkDeviceSize>(
+        this->m_deviceHandler->properties.limits
+            .minUniformBufferOffsetAlignment,
+        1);
+    // Every arena starts on an aligned offset
+    m_frameCapacity = utils::alignedSize(frameCapacity, m_alignment);
+
+    VK_CHECK(this->m_deviceHandler->createBuffer(
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        m_frameCapacity * m_frameCount, &m_buffer, &m_memory));
+
+    // Host visible memory stays mapped for the lifetime of its block
+    m_mapped = static_cast<uint8_t *>(m_memory.mapped);
+}
+
+UniformRing::~UniformRing() {
+    if (m_buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(*m_deviceHandler, m_buffer, nullptr);
+    }
+    m_deviceHandler->freeMemory(m_memory);
+}
+
+void UniformRing::beginFrame(uint32_t frame) {
+    m_frameBegin = static_cast<VkDeviceSize>(frame % m_frameCount) *
+                   m_frameCapacity;
+    m_head = m_frameBegin;
+}
+
+uint32_t UniformRing::push(const void *data, VkDeviceSize size) {
+    VkDeviceSize offset = utils::alignedSize(m_head, m_alignment);
+    if (offset + size > m_frameBegin + m_frameCapacity) {
+        throw std::runtime_error("Uniform ring: frame arena is full");
+    }
+
+    memcpy(m_mapped + offset, data, size);
+    m_head = offset + size;
+    return static_cast<uint32_t>(offset);
+}
+
+VkDescriptorBufferInfo UniformRing::descriptor(VkDeviceSize range) const {
+    return {m_buffer, 0, range};
+}
+} // namespace uniform_ring
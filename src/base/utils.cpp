@@ -1,4 +1,5 @@
 #include "common.hpp"
+#include "vulkan_utils/embedded_shaders.hpp"
 
 namespace utils {
 void exitFatal(const std::string &message, int32_t exitCode) {
@@ -155,7 +156,37 @@ uint32_t alignedSize(uint32_t value, uint32_t alignment) {
     return (value + alignment - 1) & ~(alignment - 1);
 }
 
+VkDeviceSize alignedSize(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed) {
+    const uint64_t prime = 1099511628211ULL;
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= prime;
+    }
+    return hash;
+}
+
 VkShaderModule loadShader(const char *fileName, VkDevice device) {
+#ifdef PARAFLOP_EMBED_SHADERS
+    if (const embedded_shaders::Shader *shader =
+            embedded_shaders::find(fileName)) {
+        VkShaderModule shaderModule;
+        VkShaderModuleCreateInfo moduleCreateInfo{};
+        moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleCreateInfo.codeSize = shader->size;
+        moduleCreateInfo.pCode =
+            reinterpret_cast<const uint32_t *>(shader->code);
+
+        VK_CHECK(vkCreateShaderModule(device, &moduleCreateInfo, nullptr,
+                                      &shaderModule));
+        return shaderModule;
+    }
+#endif
     std::ifstream input(fileName,
                         std::ios::binary | std::ios::in | std::ios::ate);
 
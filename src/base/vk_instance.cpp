@@ -89,8 +89,12 @@ std::vector<const char *> getRequiredExtensions() {
     const char **glfwExtensions;
     glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-    std::vector<const char *> extensions(glfwExtensions,
-                                         glfwExtensions + glfwExtensionCount);
+    // GLFW is not initialized when rendering headless, no surface extensions
+    // are needed then
+    std::vector<const char *> extensions;
+    if (glfwExtensions != nullptr) {
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (enableValidationLayers) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
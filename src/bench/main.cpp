@@ -0,0 +1,470 @@
+#include "common.hpp"
+#include "geometry/camera_path.hpp"
+#include "gltf_model/model.hpp"
+#include "vulkan_utils/command_buffer.hpp"
+#include "vulkan_utils/device.hpp"
+#include "vulkan_utils/vk_instance.hpp"
+
+#include "device_features.hpp"
+#include "raytracer.hpp"
+
+#include <random>
+
+#if defined(__unix__)
+#include <sys/resource.h>
+#endif
+
+/* Benchmark defaults */
+const uint32_t DEFAULT_FRAMES = 600;
+const uint32_t DEFAULT_WARMUP_FRAMES = 10;
+const float DEFAULT_FPS = 60.0F;
+const char *const DEFAULT_SCENE = "assets/models/sponza/sponza.gltf";
+const char *const DEFAULT_REPORT = "benchmark.json";
+
+const std::vector<glm::vec4> LIGHT_POSITIONS = {
+    glm::vec4(40.0F, -50.0F, 25.0F, 10.0F),
+    glm::vec4(40.0F, -50.0F, -25.0F, 6.0F)};
+const float EXTRA_LIGHT_POWER = 1.0F; /**< Upper bound of --lights powers */
+
+/**
+ * \struct BenchmarkOptions
+ * \brief Command line options of the benchmark.
+ */
+struct BenchmarkOptions {
+    std::string scene = DEFAULT_SCENE;   /**< The glTF scene to load. */
+    std::string cameraPath;              /**< Recorded path, scripted if empty. */
+    std::string report = DEFAULT_REPORT; /**< Where the JSON report goes. */
+    uint32_t frames = DEFAULT_FRAMES;    /**< Number of measured frames. */
+    uint32_t warmupFrames = DEFAULT_WARMUP_FRAMES; /**< Unmeasured frames. */
+    float fps = DEFAULT_FPS; /**< Path time advanced per frame is 1 / fps. */
+    uint32_t width = WIDTH;   /**< Render width. */
+    uint32_t height = HEIGHT; /**< Render height. */
+    bool hostBuilds = false;  /**< Build acceleration structures on the host. */
+    bool asCache = false; /**< Load BLASes from the cache instead of building
+                             them, which skips the build times. */
+    bool blueNoise = true;    /**< Sample with blue instead of white noise. */
+    Raytracer::QualityPreset quality =
+        Raytracer::QualityPreset::Medium; /**< The shader quality tier. */
+    uint32_t extraLights = 0; /**< Random lights added inside the scene. */
+    light_sampler::Strategy lightSampling =
+        light_sampler::Strategy::Bvh; /**< How the hit shader picks lights. */
+    bool restir = true; /**< Light primary hits with ReSTIR DI. */
+    bool restirGI = false; /**< Resample one bounce with ReSTIR GI. */
+    std::optional<bool> denoise; /**< Filter with SVGF, the tier's choice if
+                                    unset. */
+    uint32_t denoiseIterations = 5; /**< The denoiser's wavelet passes. */
+    Raytracer::Integrator integrator =
+        Raytracer::Integrator::Megakernel; /**< How the paths are traced. */
+    bool rayQueryShadows = true; /**< Trace shadow rays inline if the device
+                                    has ray queries. */
+    bool accumulate = false; /**< Average the frames of a still camera. */
+    float targetNoise = 0.0F; /**< Stop tracing below this noise, 0 never
+                                 stops. */
+};
+
+/**
+ * \brief Parses the command line.
+ * \param argc The argument count.
+ * \param argv The arguments.
+ * \return The parsed options.
+ */
+BenchmarkOptions parseOptions(int argc, char **argv) {
+    BenchmarkOptions options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        std::string value = argv[i + 1];
+        if (arg == "--scene") {
+            options.scene = value;
+        } else if (arg == "--path") {
+            options.cameraPath = value;
+        } else if (arg == "--output") {
+            options.report = value;
+        } else if (arg == "--frames") {
+            options.frames = std::stoul(value);
+        } else if (arg == "--warmup") {
+            options.warmupFrames = std::stoul(value);
+        } else if (arg == "--fps") {
+            options.fps = std::stof(value);
+        } else if (arg == "--width") {
+            options.width = std::stoul(value);
+        } else if (arg == "--height") {
+            options.height = std::stoul(value);
+        } else if (arg == "--host-builds") {
+            options.hostBuilds = value != "0";
+        } else if (arg == "--as-cache") {
+            options.asCache = value != "0";
+        } else if (arg == "--blue-noise") {
+            options.blueNoise = value != "0";
+        } else if (arg == "--quality") {
+            options.quality = Raytracer::parseQualityPreset(value);
+        } else if (arg == "--lights") {
+            options.extraLights = std::stoul(value);
+        } else if (arg == "--light-sampling") {
+            options.lightSampling = light_sampler::parseStrategy(value);
+        } else if (arg == "--restir") {
+            options.restir = value != "0";
+        } else if (arg == "--restir-gi") {
+            options.restirGI = value != "0";
+        } else if (arg == "--denoise") {
+            options.denoise = value != "0";
+        } else if (arg == "--denoise-iterations") {
+            options.denoiseIterations = std::stoul(value);
+        } else if (arg == "--integrator") {
+            options.integrator = Raytracer::parseIntegrator(value);
+        } else if (arg == "--ray-query-shadows") {
+            options.rayQueryShadows = value != "0";
+        } else if (arg == "--accumulate") {
+            options.accumulate = value != "0";
+        } else if (arg == "--target-noise") {
+            options.targetNoise = std::stof(value);
+        } else {
+            throw std::runtime_error("Unknown benchmark option " + arg);
+        }
+    }
+
+    if (options.frames == 0) {
+        throw std::runtime_error("The benchmark needs at least one frame");
+    }
+
+    return options;
+}
+
+/**
+ * \brief Scatters random lights inside a box, always the same ones for the
+ * same count.
+ * \param count The number of lights.
+ * \param min The lower corner of the box.
+ * \param max The upper corner of the box.
+ * \return The lights.
+ */
+std::vector<glm::vec4> randomLights(uint32_t count, glm::vec3 min,
+                                    glm::vec3 max) {
+    std::mt19937 rng(count);
+    std::uniform_real_distribution<float> unit(0.0F, 1.0F);
+    std::vector<glm::vec4> lights(count);
+    for (glm::vec4 &light : lights) {
+        glm::vec3 position(unit(rng), unit(rng), unit(rng));
+        light = glm::vec4(glm::mix(min, max, position),
+                          EXTRA_LIGHT_POWER * unit(rng));
+    }
+    return lights;
+}
+
+/**
+ * \brief Picks a percentile from sorted samples.
+ * \param sorted The samples, in ascending order.
+ * \param percentile The percentile, in [0, 1].
+ * \return The sample at the percentile.
+ */
+float percentile(const std::vector<float> &sorted, float percentile) {
+    auto idx = static_cast<size_t>(
+        std::ceil(percentile * static_cast<float>(sorted.size())) - 1);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+/**
+ * \brief Quotes a string for the report, escaping what JSON does not allow
+ * in a string.
+ * \param value The string, such as a Windows path.
+ * \return The quoted string.
+ */
+std::string jsonString(const std::string &value) {
+    const char *const hexDigits = "0123456789abcdef";
+    std::string quoted = "\"";
+    for (char c : value) {
+        switch (c) {
+        case '"':
+            quoted += "\\\"";
+            break;
+        case '\\':
+            quoted += "\\\\";
+            break;
+        case '\n':
+            quoted += "\\n";
+            break;
+        case '\r':
+            quoted += "\\r";
+            break;
+        case '\t':
+            quoted += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                quoted += "\\u00";
+                quoted += hexDigits[(c >> 4) & 0xF];
+                quoted += hexDigits[c & 0xF];
+            } else {
+                quoted += c;
+            }
+        }
+    }
+    return quoted + "\"";
+}
+
+/**
+ * \brief Sums the usage of the device local heaps.
+ * \param deviceHandler The device, with VK_EXT_memory_budget enabled.
+ * \return The used device local memory in bytes.
+ */
+VkDeviceSize deviceLocalUsage(const device::DeviceHandler &deviceHandler) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+    budget.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+    memoryProperties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memoryProperties.pNext = &budget;
+
+    vkGetPhysicalDeviceMemoryProperties2(deviceHandler.physicalDevice,
+                                         &memoryProperties);
+
+    VkDeviceSize usage = 0;
+    const VkPhysicalDeviceMemoryProperties &props =
+        memoryProperties.memoryProperties;
+    for (uint32_t i = 0; i < props.memoryHeapCount; i++) {
+        if (static_cast<bool>(props.memoryHeaps[i].flags &
+                              VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
+            usage += budget.heapUsage[i];
+        }
+    }
+    return usage;
+}
+
+/**
+ * \brief The peak resident memory of the process.
+ * \return The peak resident set size in bytes, 0 where unsupported.
+ */
+uint64_t peakHostMemory() {
+#if defined(__unix__)
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    // ru_maxrss is in kilobytes on Linux
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#else
+    return 0;
+#endif
+}
+
+int main(int argc, char **argv) {
+    BenchmarkOptions options = parseOptions(argc, argv);
+
+    geometry::CameraPath path =
+        options.cameraPath.empty()
+            ? geometry::CameraPath::sponzaFlythrough()
+            : geometry::CameraPath::load(options.cameraPath);
+
+    std::vector<const char *> validation = {};
+    std::vector<const char *> devExt = rayTracingDeviceExtensions(false);
+    RayTracingDeviceFeatures features;
+
+    std::unique_ptr<vk_instance::Instance> instance =
+        std::make_unique<vk_instance::Instance>();
+
+    std::vector<const char *> optionalExt =
+        rayTracingOptionalDeviceExtensions();
+    optionalExt.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+    std::shared_ptr<device::DeviceHandler> deviceHandler =
+        std::make_shared<device::DeviceHandler>(
+            devExt, validation, instance->instance, VK_NULL_HANDLE,
+            features.chain(), optionalExt);
+    bool hasMemoryBudget =
+        deviceHandler->isExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+    std::shared_ptr<command_buffer::CommandBufferHandler> commandBuffer =
+        std::make_shared<command_buffer::CommandBufferHandler>(deviceHandler,
+                                                               nullptr);
+
+    uint32_t glTFLoadingFlags =
+        gltf_model::FileLoadingFlags::PreMultiplyVertexColors |
+        gltf_model::FileLoadingFlags::FlipY;
+    if (options.hostBuilds) {
+        glTFLoadingFlags |= gltf_model::FileLoadingFlags::KeepHostGeometry;
+    }
+
+    std::shared_ptr<gltf_model::Model> model =
+        std::make_shared<gltf_model::Model>();
+    model->loadFromFile(options.scene, deviceHandler, commandBuffer,
+                        deviceHandler->getTransferQueue(), glTFLoadingFlags);
+
+    const VkExtent2D extent = {options.width, options.height};
+    auto renderer = Raytracer(
+        deviceHandler, commandBuffer, model, extent, VK_FORMAT_B8G8R8A8_UNORM,
+        options.asCache ? Raytracer::AS_CACHE_DIRECTORY : "");
+    std::vector<glm::vec4> lights = LIGHT_POSITIONS;
+    std::vector<glm::vec4> extraLights =
+        randomLights(options.extraLights, model->dimensions.min,
+                     model->dimensions.max);
+    lights.insert(lights.end(), extraLights.begin(), extraLights.end());
+    renderer.updateLightsBuffer(lights);
+    renderer.frameConstants.blueNoise = options.blueNoise ? 1 : 0;
+    if (options.quality != Raytracer::QualityPreset::Medium ||
+        options.lightSampling != light_sampler::Strategy::Bvh ||
+        !options.restir || options.restirGI || options.denoise.has_value() ||
+        options.integrator != Raytracer::Integrator::Megakernel ||
+        !options.rayQueryShadows) {
+        Raytracer::QualitySettings quality =
+            Raytracer::qualityPreset(options.quality);
+        quality.lightSampling = options.lightSampling;
+        quality.restir = options.restir ? VK_TRUE : VK_FALSE;
+        quality.restirGI = options.restirGI ? VK_TRUE : VK_FALSE;
+        quality.denoise = options.denoise.value_or(quality.denoise == VK_TRUE)
+                              ? VK_TRUE
+                              : VK_FALSE;
+        quality.denoiseIterations = options.denoiseIterations;
+        quality.integrator = options.integrator;
+        quality.rayQueryShadows = options.rayQueryShadows ? VK_TRUE : VK_FALSE;
+        renderer.setQuality(quality);
+    }
+    renderer.accumulation.enabled = options.accumulate;
+    renderer.accumulation.targetNoise = options.targetNoise;
+
+    geometry::Camera camera;
+    const float timeStep = 1.0F / options.fps;
+    const uint32_t totalFrames = options.warmupFrames + options.frames;
+
+    std::vector<float> frameTimes;
+    frameTimes.reserve(options.frames);
+    VkDeviceSize peakDeviceMemory = 0;
+
+    for (uint32_t frame = 0; frame < totalFrames; frame++) {
+        // The path is sampled at a fixed rate so every run sees the same views
+        path.apply(std::fmod(static_cast<float>(frame) * timeStep,
+                             std::max(path.duration(), timeStep)),
+                   camera);
+        auto mats = camera.transformMatrices(static_cast<float>(extent.width),
+                                             static_cast<float>(extent.height));
+        renderer.frameConstants.dTime = timeStep;
+        renderer.updateUniformBuffers(mats.proj, mats.view);
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        renderer.renderHeadless(1);
+        auto endTime = std::chrono::high_resolution_clock::now();
+
+        if (hasMemoryBudget) {
+            peakDeviceMemory =
+                std::max(peakDeviceMemory, deviceLocalUsage(*deviceHandler));
+        }
+
+        if (frame >= options.warmupFrames) {
+            frameTimes.push_back(
+                std::chrono::duration<float, std::chrono::milliseconds::period>(
+                    endTime - startTime)
+                    .count());
+        }
+    }
+
+    std::vector<float> sorted = frameTimes;
+    std::sort(sorted.begin(), sorted.end());
+    float total = 0.0F;
+    for (float frameTime : sorted) {
+        total += frameTime;
+    }
+
+    gpu_profiler::PassStats traceStats =
+        renderer.profiler->getStats(renderer.profilerPasses.trace);
+    double raysPerFrame = static_cast<double>(extent.width) * extent.height *
+                          renderer.getQuality().samples;
+    double raysPerSecond =
+        traceStats.avg > 0.0F ? raysPerFrame / (traceStats.avg / 1000.0) : 0.0;
+
+    std::ofstream report(options.report);
+    if (!report.is_open()) {
+        throw std::runtime_error("Could not open report file " +
+                                 options.report);
+    }
+
+    report << "{\n";
+    report << "  \"scene\": " << jsonString(options.scene) << ",\n";
+    report << "  \"camera_path\": "
+           << jsonString(options.cameraPath.empty() ? "scripted"
+                                                    : options.cameraPath)
+           << ",\n";
+    report << "  \"device\": "
+           << jsonString(deviceHandler->properties.deviceName) << ",\n";
+    report << "  \"width\": " << extent.width << ",\n";
+    report << "  \"height\": " << extent.height << ",\n";
+    report << "  \"frames\": " << options.frames << ",\n";
+    report << "  \"samples_per_pixel\": " << renderer.getQuality().samples
+           << ",\n";
+    report << "  \"lights\": " << lights.size() << ",\n";
+    report << "  \"light_sampling\": "
+           << jsonString(options.lightSampling == light_sampler::Strategy::Bvh
+                             ? "bvh"
+                             : "alias")
+           << ",\n";
+    report << "  \"integrator\": "
+           << jsonString(renderer.getQuality().integrator ==
+                                 Raytracer::Integrator::Wavefront
+                             ? "wavefront"
+                             : "megakernel")
+           << ",\n";
+    report << "  \"as_cache\": " << (options.asCache ? "true" : "false")
+           << ",\n";
+    report << "  \"ray_query_shadows\": "
+           << (renderer.usesRayQueryShadows() ? "true" : "false") << ",\n";
+    // The wavefront path tracer turns ReSTIR off
+    report << "  \"restir\": "
+           << (renderer.getQuality().restir == VK_TRUE ? "true" : "false")
+           << ",\n";
+    report << "  \"restir_gi\": "
+           << (renderer.getQuality().restirGI == VK_TRUE ? "true" : "false")
+           << ",\n";
+    report << "  \"denoise\": "
+           << (renderer.getQuality().denoise == VK_TRUE ? "true" : "false")
+           << ",\n";
+    if (options.accumulate) {
+        report << "  \"accumulation\": {\"samples_per_pixel\": "
+               << renderer.accumulation.samplesPerPixel
+               << ", \"noise\": " << renderer.accumulation.noise
+               << ", \"converged\": "
+               << (renderer.accumulation.converged ? "true" : "false")
+               << "},\n";
+    }
+    report << "  \"frame_time_ms\": {\n";
+    report << "    \"min\": " << sorted.front() << ",\n";
+    report << "    \"avg\": " << total / static_cast<float>(sorted.size())
+           << ",\n";
+    report << "    \"p50\": " << percentile(sorted, 0.5F) << ",\n";
+    report << "    \"p90\": " << percentile(sorted, 0.9F) << ",\n";
+    report << "    \"p95\": " << percentile(sorted, 0.95F) << ",\n";
+    report << "    \"p99\": " << percentile(sorted, 0.99F) << ",\n";
+    report << "    \"max\": " << sorted.back() << "\n";
+    report << "  },\n";
+    report << "  \"gpu_passes_ms\": {";
+    for (uint32_t pass = 0; pass < renderer.profiler->getPassCount(); pass++) {
+        gpu_profiler::PassStats stats = renderer.profiler->getStats(pass);
+        report << (pass == 0 ? "\n" : ",\n");
+        report << "    " << jsonString(renderer.profiler->getPassName(pass))
+               << ": {\"min\": " << stats.min << ", \"avg\": " << stats.avg
+               << ", \"p99\": " << stats.p99
+               << ", \"samples\": " << stats.samples << "}";
+    }
+    report << "\n  },\n";
+    report << "  \"primary_rays_per_second\": " << raysPerSecond << ",\n";
+    report << "  \"peak_host_memory_bytes\": " << peakHostMemory() << ",\n";
+    report << "  \"peak_device_memory_bytes\": "
+           << (hasMemoryBudget ? std::to_string(peakDeviceMemory) : "null")
+           << ",\n";
+    report << "  \"memory_heaps\": [";
+    std::vector<memory_allocator::HeapStats> heapStats =
+        deviceHandler->allocator->getHeapStats();
+    for (uint32_t heap = 0; heap < heapStats.size(); heap++) {
+        report << (heap == 0 ? "\n" : ",\n");
+        report << "    {\"heap\": " << heap
+               << ", \"size\": " << heapStats[heap].heapSize
+               << ", \"reserved_bytes\": " << heapStats[heap].reservedBytes
+               << ", \"used_bytes\": " << heapStats[heap].usedBytes
+               << ", \"memory_objects\": "
+               << heapStats[heap].memoryObjectCount
+               << ", \"allocations\": " << heapStats[heap].allocationCount
+               << "}";
+    }
+    report << "\n  ]\n";
+    report << "}\n";
+
+    std::cout << "Benchmark report written to " << options.report << "\n";
+
+    return 0;
+}
@@ -19,14 +19,13 @@ gltf_model::Mesh::Mesh(
                                     sizeof(uniformBlock), &uniformBuffer.buffer,
                                     &uniformBuffer.memory, &uniformBlock));
 
-    VK_CHECK(vkMapMemory(*deviceHandler, uniformBuffer.memory, 0,
-                         sizeof(uniformBlock), 0, &uniformBuffer.mapped));
+    uniformBuffer.mapped = uniformBuffer.memory.mapped;
     uniformBuffer.descriptor = {uniformBuffer.buffer, 0, sizeof(uniformBlock)};
 };
 
 gltf_model::Mesh::~Mesh() {
     vkDestroyBuffer(*deviceHandler, uniformBuffer.buffer, nullptr);
-    vkFreeMemory(*deviceHandler, uniformBuffer.memory, nullptr);
+    deviceHandler->freeMemory(uniformBuffer.memory);
     for (auto *primitive : primitives) {
         delete primitive;
     }
@@ -77,8 +77,6 @@ void gltf_model::Model::createEmptyTexture(VkQueue transferQueue) {
 
     buffer::StagingBuffer buf =
         buffer::StagingBuffer(m_deviceHandler, m_commandBuffer, bufferSize);
-    VkMemoryRequirements memReqs;
-    vkGetBufferMemoryRequirements(*m_deviceHandler, buf.buffer, &memReqs);
     buf.copy(buffer, bufferSize);
 
     VkBufferImageCopy bufferCopyRegion = {};
@@ -102,18 +100,9 @@ void gltf_model::Model::createEmptyTexture(VkQueue transferQueue) {
     VK_CHECK(vkCreateImage(*m_deviceHandler, &imageCreateInfo, nullptr,
                            &emptyTexture.image));
 
-    VkMemoryAllocateInfo memAllocInfo = create_info::memoryAllocInfo(
-        memReqs.size,
-        m_deviceHandler->getMemoryType(memReqs.memoryTypeBits,
-                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
-
-    vkGetImageMemoryRequirements(*m_deviceHandler, emptyTexture.image,
-                                 &memReqs);
-
-    VK_CHECK(vkAllocateMemory(*m_deviceHandler, &memAllocInfo, nullptr,
-                              &emptyTexture.deviceMemory));
-    VK_CHECK(vkBindImageMemory(*m_deviceHandler, emptyTexture.image,
-                               emptyTexture.deviceMemory, 0));
+    m_deviceHandler->allocateImageMemory(emptyTexture.image,
+                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                         &emptyTexture.deviceMemory);
 
     VkImageSubresourceRange subresourceRange{};
     subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -166,14 +155,50 @@ void gltf_model::Model::createEmptyTexture(VkQueue transferQueue) {
     emptyTexture.descriptor.sampler = emptyTexture.sampler;
 }
 
+/*
+    Creates a device local buffer and fills it through a staging buffer
+*/
+void gltf_model::Model::uploadBuffer(VkQueue transferQueue,
+                                     VkBufferUsageFlags usage,
+                                     const void *data, VkDeviceSize size,
+                                     VkBuffer *buffer,
+                                     memory_allocator::Allocation *memory) {
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    memory_allocator::Allocation stagingMemory;
+    VK_CHECK(m_deviceHandler->createBuffer(
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        size, &stagingBuffer, &stagingMemory, const_cast<void *>(data),
+        memory_allocator::Lifetime::Transient));
+
+    VK_CHECK(m_deviceHandler->createBuffer(
+        usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, size, buffer, memory, nullptr));
+
+    VkCommandBuffer copyCmd = m_commandBuffer->createCommandBuffer(
+        VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    VkBufferCopy copyRegion = {};
+    copyRegion.size = size;
+    vkCmdCopyBuffer(copyCmd, stagingBuffer, *buffer, 1, &copyRegion);
+    m_commandBuffer->flushCommandBuffer(copyCmd, transferQueue, true);
+
+    vkDestroyBuffer(*m_deviceHandler, stagingBuffer, nullptr);
+    m_deviceHandler->freeMemory(stagingMemory);
+}
+
 /*
     glTF model loading and rendering class
 */
 gltf_model::Model::~Model() {
     vkDestroyBuffer(*m_deviceHandler, vertices.buffer, nullptr);
-    vkFreeMemory(*m_deviceHandler, vertices.memory, nullptr);
+    m_deviceHandler->freeMemory(vertices.memory);
     vkDestroyBuffer(*m_deviceHandler, indices.buffer, nullptr);
-    vkFreeMemory(*m_deviceHandler, indices.memory, nullptr);
+    m_deviceHandler->freeMemory(indices.memory);
+    for (VertexStream *stream : {&positions, &attributes}) {
+        vkDestroyBuffer(*m_deviceHandler, stream->buffer, nullptr);
+        m_deviceHandler->freeMemory(stream->memory);
+    }
     for (auto texture : textures) {
         texture.destroy();
     }
@@ -412,16 +437,6 @@ void gltf_model::Model::loadNode(gltf_model::Node *parent,
                                        ? glm::vec4(glm::make_vec4(
                                              &bufferTangents[idx * 4]))
                                        : glm::vec4(0.0F);
-                    vert.texId = {
-                        findTexture(
-                            this->materials[prim.material].baseColorTexture),
-                        findTexture(
-                            this->materials[prim.material].emissiveTexture),
-                        this->materials[prim.material].roughnessFactor,
-                        findTexture(
-                            this->materials[prim.material].normalTexture),
-                    };
-
                     vert.weight0 = hasSkin
                                        ? glm::make_vec4(&bufferWeights[idx * 4])
                                        : glm::vec4(0.0F);
@@ -611,8 +626,15 @@ void gltf_model::Model::loadMaterials(tinygltf::Model &gltfModel) {
             }
             if (param.string_value == "MASK") {
                 material.alphaMode = Material::ALPHAMODE_MASK;
+                // The glTF default cutoff
+                material.alphaCutoff = 0.5F;
             }
         }
+        if (mat.additionalValues.find("alphaCutoff") !=
+            mat.additionalValues.end()) {
+            material.alphaCutoff = static_cast<float>(
+                mat.additionalValues["alphaCutoff"].Factor());
+        }
 
         materials.push_back(material);
     }
@@ -769,6 +791,7 @@ void gltf_model::Model::loadFromFile(
 
     size_t pos = filename.find_last_of('/');
     path = filename.substr(0, pos);
+    this->fileLoadingFlags = fileLoadingFlags;
 
     std::string error;
     std::string warning;
@@ -866,6 +889,30 @@ void gltf_model::Model::loadFromFile(
         }
     }
 
+    // Hash the final geometry, indices are taken relative to the primitive
+    // so the hash does not depend on where the mesh sits in the buffers
+    for (Node *node : linearNodes) {
+        if (node->mesh == nullptr || node->mesh->geometryHash != 0) {
+            continue;
+        }
+        uint64_t hash = utils::hashBytes(nullptr, 0);
+        for (const Primitive *primitive : node->mesh->primitives) {
+            hash = utils::hashBytes(&primitive->indexCount, sizeof(uint32_t),
+                                    hash);
+            for (uint32_t i = 0; i < primitive->vertexCount; i++) {
+                const glm::vec3 &pos =
+                    vertexBuffer[primitive->firstVertex + i].pos;
+                hash = utils::hashBytes(&pos, sizeof(glm::vec3), hash);
+            }
+            for (uint32_t i = 0; i < primitive->indexCount; i++) {
+                uint32_t index = indexBuffer[primitive->firstIndex + i] -
+                                 primitive->firstVertex;
+                hash = utils::hashBytes(&index, sizeof(uint32_t), hash);
+            }
+        }
+        node->mesh->geometryHash = hash;
+    }
+
     for (const auto &extension : gltfModel.extensionsUsed) {
         if (extension == "KHR_materials_pbrSpecularGlossiness") {
             std::cout << "Required extension: " << extension;
@@ -882,7 +929,7 @@ void gltf_model::Model::loadFromFile(
 
     struct StagingBuffer {
         VkBuffer buffer;
-        VkDeviceMemory memory;
+        memory_allocator::Allocation memory;
     } vertexStaging, indexStaging;
 
     // Create staging buffers
@@ -892,14 +939,14 @@ void gltf_model::Model::loadFromFile(
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
         vertexBufferSize, &vertexStaging.buffer, &vertexStaging.memory,
-        vertexBuffer.data()));
+        vertexBuffer.data(), memory_allocator::Lifetime::Transient));
     // Index data
     VK_CHECK(m_deviceHandler->createBuffer(
         VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
         indexBufferSize, &indexStaging.buffer, &indexStaging.memory,
-        indexBuffer.data()));
+        indexBuffer.data(), memory_allocator::Lifetime::Transient));
 
     // Create device local buffers
     // Vertex buffer
@@ -933,9 +980,37 @@ void gltf_model::Model::loadFromFile(
     m_commandBuffer->flushCommandBuffer(copyCmd, transferQueue, true);
 
     vkDestroyBuffer(*m_deviceHandler, vertexStaging.buffer, nullptr);
-    vkFreeMemory(*m_deviceHandler, vertexStaging.memory, nullptr);
+    m_deviceHandler->freeMemory(vertexStaging.memory);
     vkDestroyBuffer(*m_deviceHandler, indexStaging.buffer, nullptr);
-    vkFreeMemory(*m_deviceHandler, indexStaging.memory, nullptr);
+    m_deviceHandler->freeMemory(indexStaging.memory);
+
+    // Ray tracing streams, the hit shaders fetch 16 instead of 80 bytes per
+    // vertex and BLAS builds read 12
+    std::vector<glm::vec3> positionStream(vertexBuffer.size());
+    std::vector<PackedVertex> attributeStream(vertexBuffer.size());
+    for (size_t i = 0; i < vertexBuffer.size(); i++) {
+        positionStream[i] = vertexBuffer[i].pos;
+        attributeStream[i] = PackedVertex::pack(vertexBuffer[i]);
+    }
+    uploadBuffer(transferQueue,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+                     VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
+                     memoryPropertyFlags,
+                 positionStream.data(),
+                 positionStream.size() * sizeof(glm::vec3), &positions.buffer,
+                 &positions.memory);
+    uploadBuffer(transferQueue,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | memoryPropertyFlags,
+                 attributeStream.data(),
+                 attributeStream.size() * sizeof(PackedVertex),
+                 &attributes.buffer, &attributes.memory);
+
+    if (static_cast<bool>(fileLoadingFlags &
+                          FileLoadingFlags::KeepHostGeometry)) {
+        hostPositions = std::move(positionStream);
+        hostIndices = std::move(indexBuffer);
+    }
 
     getSceneDimensions();
 
@@ -1146,6 +1221,7 @@ void gltf_model::Model::updateAnimation(uint32_t index, float time) {
                         break;
                     }
                     }
+                    channel.node->markDirty();
                     updated = true;
                 }
             }
@@ -19,6 +19,14 @@ namespace gltf_model {
     return mat;
 }
 
+void gltf_model::Node::markDirty() {
+    // The world matrix of every descendant depends on this node
+    transformDirty = true;
+    for (auto &child : children) {
+        child->markDirty();
+    }
+}
+
 void gltf_model::Node::update() {
     if (mesh != nullptr) {
         glm::mat4 mat = getMatrix();
@@ -17,7 +17,7 @@ void gltf_model::Texture::destroy() {
     if (deviceHandler) {
         vkDestroyImageView(*deviceHandler, view, nullptr);
         vkDestroyImage(*deviceHandler, image, nullptr);
-        vkFreeMemory(*deviceHandler, deviceMemory, nullptr);
+        deviceHandler->freeMemory(deviceMemory);
         vkDestroySampler(*deviceHandler, sampler, nullptr);
     }
 }
@@ -86,19 +86,8 @@ void gltf_model::Texture::makeglTFImage(tinygltf::Image &gltfimage,
                             VK_IMAGE_USAGE_SAMPLED_BIT;
     VK_CHECK(vkCreateImage(*deviceHandler, &imageCreateInfo, nullptr, &image));
 
-    VkMemoryAllocateInfo memAllocInfo{};
-    memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    VkMemoryRequirements memReqs{};
-
-    vkGetImageMemoryRequirements(*deviceHandler, image, &memReqs);
-    memAllocInfo.allocationSize = memReqs.size;
-    memAllocInfo.memoryTypeIndex = deviceHandler->getMemoryType(
-        memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    VK_CHECK(vkAllocateMemory(*deviceHandler, &memAllocInfo, nullptr,
-                              &deviceMemory));
-
-    VK_CHECK(vkBindImageMemory(*deviceHandler, image, deviceMemory, 0));
+    deviceHandler->allocateImageMemory(
+        image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &deviceMemory);
 
     VkCommandBuffer copyCmd = commandBuffer->createCommandBuffer(
         VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
@@ -284,9 +273,6 @@ void gltf_model::Texture::makeKTXImage(const std::string &filename,
     buf.copy(ktxTextureData, ktxTextureSize);
     buf.unmap();
 
-    VkMemoryAllocateInfo memAllocInfo{};
-    memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    VkMemoryRequirements memReqs;
 
     std::vector<VkBufferImageCopy> bufferCopyRegions;
     for (uint32_t i = 0; i < mipLevels; i++) {
@@ -326,13 +312,8 @@ void gltf_model::Texture::makeKTXImage(const std::string &filename,
         VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     VK_CHECK(vkCreateImage(*deviceHandler, &imageCreateInfo, nullptr, &image));
 
-    vkGetImageMemoryRequirements(*deviceHandler, image, &memReqs);
-    memAllocInfo.allocationSize = memReqs.size;
-    memAllocInfo.memoryTypeIndex = deviceHandler->getMemoryType(
-        memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    VK_CHECK(vkAllocateMemory(*deviceHandler, &memAllocInfo, nullptr,
-                              &deviceMemory));
-    VK_CHECK(vkBindImageMemory(*deviceHandler, image, deviceMemory, 0));
+    deviceHandler->allocateImageMemory(
+        image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &deviceMemory);
 
     VkImageSubresourceRange subresourceRange = {};
     subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -1,5 +1,28 @@
 #include "gltf_model/vertex.hpp"
 
+namespace {
+// The lowest bit of the second snorm16 of a packed tangent
+const uint32_t BITANGENT_SIGN_BIT = 0x10000U;
+
+/*
+    Projects a direction onto the octahedron and unfolds the lower half, the
+   result is in [-1, 1]^2
+*/
+glm::vec2 octahedralEncode(glm::vec3 dir) {
+    const float norm = std::abs(dir.x) + std::abs(dir.y) + std::abs(dir.z);
+    if (norm == 0.0F) {
+        return glm::vec2(0.0F);
+    }
+    dir /= norm;
+    if (dir.z >= 0.0F) {
+        return glm::vec2(dir.x, dir.y);
+    }
+    return (1.0F - glm::abs(glm::vec2(dir.y, dir.x))) *
+           glm::vec2(dir.x >= 0.0F ? 1.0F : -1.0F,
+                     dir.y >= 0.0F ? 1.0F : -1.0F);
+}
+} // namespace
+
 /*
     glTF default vertex layout with easy Vulkan mapping functions
 */
@@ -43,10 +66,6 @@ VkVertexInputAttributeDescription gltf_model::Vertex::inputAttributeDescription(
         return VkVertexInputAttributeDescription({location, binding,
                                                   VK_FORMAT_R32G32B32A32_SFLOAT,
                                                   offsetof(Vertex, weight0)});
-    case VertexComponent::TextureID:
-        return VkVertexInputAttributeDescription({location, binding,
-                                                  VK_FORMAT_R32G32B32A32_SFLOAT,
-                                                  offsetof(Vertex, texId)});
     default:
         return VkVertexInputAttributeDescription({});
     }
@@ -84,3 +103,17 @@ gltf_model::Vertex::getPipelineVertexInputState(
         Vertex::vertexInputAttributeDescriptions.data();
     return &pipelineVertexInputStateCreateInfo;
 }
+
+gltf_model::PackedVertex gltf_model::PackedVertex::pack(const Vertex &vertex) {
+    PackedVertex packed{};
+    packed.normal = glm::packSnorm2x16(octahedralEncode(vertex.normal));
+    packed.tangent =
+        glm::packSnorm2x16(octahedralEncode(glm::vec3(vertex.tangent))) &
+        ~BITANGENT_SIGN_BIT;
+    if (vertex.tangent.w < 0.0F) {
+        packed.tangent |= BITANGENT_SIGN_BIT;
+    }
+    packed.uv = glm::packHalf2x16(vertex.uv);
+    packed.color = glm::packUnorm4x8(vertex.color);
+    return packed;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "common.hpp"
+
+/**
+ * \struct RayTracingDeviceFeatures
+ * \brief The device feature chain the raytracer needs.
+ *
+ * The structures point at each other, so the struct can neither be copied
+ * nor moved. Pass chain() to the DeviceHandler.
+ */
+struct RayTracingDeviceFeatures {
+    VkPhysicalDeviceBufferDeviceAddressFeatures
+        bufferDeviceAddress{}; /**< Buffer device address features. */
+    VkPhysicalDeviceRayTracingPipelineFeaturesKHR
+        rayTracingPipeline{}; /**< Ray tracing pipeline features. */
+    VkPhysicalDeviceAccelerationStructureFeaturesKHR
+        accelerationStructure{}; /**< Acceleration structure features. */
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT
+        indexing{};                    /**< Descriptor indexing features. */
+    VkPhysicalDeviceRayQueryFeaturesKHR
+        rayQuery{}; /**< Ray query features, optional. */
+    VkPhysicalDeviceFeatures2 features2{}; /**< Head of the chain. */
+
+    RayTracingDeviceFeatures() {
+        indexing.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        indexing.pNext = nullptr;
+
+        bufferDeviceAddress.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+        bufferDeviceAddress.bufferDeviceAddress = VK_TRUE;
+        bufferDeviceAddress.pNext = &indexing;
+
+        rayTracingPipeline.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR;
+        rayTracingPipeline.rayTracingPipeline = VK_TRUE;
+        rayTracingPipeline.pNext = &bufferDeviceAddress;
+
+        accelerationStructure.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
+        accelerationStructure.accelerationStructure = VK_TRUE;
+        // Optional, cleared by the DeviceHandler if the device lacks it
+        accelerationStructure.accelerationStructureHostCommands = VK_TRUE;
+        accelerationStructure.pNext = &rayTracingPipeline;
+
+        rayQuery.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
+        // Optional, unlinked by the DeviceHandler without VK_KHR_ray_query
+        rayQuery.rayQuery = VK_TRUE;
+        rayQuery.pNext = &accelerationStructure;
+
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &rayQuery;
+    }
+
+    RayTracingDeviceFeatures(const RayTracingDeviceFeatures &) = delete;
+    RayTracingDeviceFeatures &
+    operator=(const RayTracingDeviceFeatures &) = delete;
+
+    /**
+     * \fn VkPhysicalDeviceFeatures2 *chain()
+     *
+     * \return The head of the feature chain.
+     */
+    VkPhysicalDeviceFeatures2 *chain() { return &features2; }
+};
+
+/**
+ * \fn std::vector<const char *> rayTracingDeviceExtensions(bool swapChain)
+ *
+ * \brief The device extensions the raytracer needs.
+ *
+ * \param swapChain Whether the results are presented to a swap chain.
+ *
+ * \return The extension names.
+ */
+inline std::vector<const char *> rayTracingDeviceExtensions(bool swapChain) {
+    std::vector<const char *> devExt = {
+        VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
+        VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
+        VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,
+        VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
+        VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
+        VK_KHR_SPIRV_1_4_EXTENSION_NAME,
+        VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME};
+
+    if (swapChain) {
+        devExt.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+
+    return devExt;
+}
+
+/**
+ * \fn std::vector<const char *> rayTracingOptionalDeviceExtensions()
+ *
+ * \brief The device extensions the raytracer uses if the device has them.
+ *
+ * VK_KHR_ray_query traces rays inline, from the compute shaders of
+ * Raytracer::Integrator::Wavefront and for the shadow rays of the ray tracing
+ * pipeline, which otherwise fall back to a shadow miss shader.
+ *
+ * \return The extension names.
+ */
+inline std::vector<const char *> rayTracingOptionalDeviceExtensions() {
+    return {VK_KHR_RAY_QUERY_EXTENSION_NAME};
+}
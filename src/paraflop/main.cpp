@@ -1,4 +1,5 @@
 #include "common.hpp"
+#include "geometry/camera_path.hpp"
 #include "gltf_model/model.hpp"
 #include "interface/glfw_callbacks.hpp"
 #include "vulkan_utils/buffer.hpp"
@@ -17,53 +18,215 @@
 #include "vulkan_utils/vk_instance.hpp"
 #include "vulkan_utils/window.hpp"
 
+#include "device_features.hpp"
 #include "raytracer.hpp"
 
-int main() {
+// Frames between two GPU pass timing reports
+const uint32_t PROFILER_REPORT_INTERVAL = 500;
+
+const glm::vec3 START_POSITION = {0.0F, 3.0F, -10.0F};
+
+const std::vector<glm::vec4> LIGHT_POSITIONS = {
+    glm::vec4(40.0F, -50.0F, 25.0F, 10.0F),
+    glm::vec4(40.0F, -50.0F, -25.0F, 6.0F)};
+
+/**
+ * \brief Loads the demo scene.
+ * \param deviceHandler The device to upload the scene to.
+ * \param commandBuffer The command buffer handler used for the uploads.
+ * \param hostBuilds Keep the geometry in host memory, so that the
+ * acceleration structures can be built on the host if the device allows it.
+ * \return The loaded model.
+ */
+std::shared_ptr<gltf_model::Model>
+loadScene(const std::shared_ptr<device::DeviceHandler> &deviceHandler,
+          const std::shared_ptr<command_buffer::CommandBufferHandler>
+              &commandBuffer,
+          bool hostBuilds) {
+    uint32_t glTFLoadingFlags =
+        gltf_model::FileLoadingFlags::PreMultiplyVertexColors |
+        gltf_model::FileLoadingFlags::FlipY;
+    if (hostBuilds) {
+        glTFLoadingFlags |= gltf_model::FileLoadingFlags::KeepHostGeometry;
+    }
+
+    std::shared_ptr<gltf_model::Model> model =
+        std::make_shared<gltf_model::Model>();
+    model->loadFromFile("assets/models/sponza/sponza.gltf", deviceHandler,
+                        commandBuffer, deviceHandler->getTransferQueue(),
+                        glTFLoadingFlags);
+    // model->loadFromFile("assets/models/FlightHelmet/glTF/FlightHelmet.gltf",
+    //                     deviceHandler, commandBuffer,
+    //                     deviceHandler->getTransferQueue(), glTFLoadingFlags);
+    // model->loadFromFile("assets/models/retroufo_glow.gltf", deviceHandler,
+    //                     commandBuffer, deviceHandler->getTransferQueue(),
+    //                     glTFLoadingFlags);
+    // model->loadFromFile("assets/models/vulkanscene_shadow.gltf",
+    // deviceHandler,
+    //                     commandBuffer, deviceHandler->getTransferQueue(),
+    //                     glTFLoadingFlags);
+    return model;
+}
+
+/**
+ * \brief Places a camera where the viewer starts, so that headless frames
+ * show what the window would.
+ * \param camera The camera to place.
+ */
+void placeStartCamera(geometry::Camera &camera) {
+    camera.calcRotation(0.0F, 0.0F);
+    camera.position = START_POSITION;
+}
+
+/**
+ * \brief Renders a number of frames offscreen, without a window or a swap
+ * chain, and reports the average frame time.
+ * \param devExt The device extensions, without VK_KHR_swapchain.
+ * \param validation The validation layers.
+ * \param features The device feature chain.
+ * \param frameCount The number of frames to render.
+ * \param hostBuilds Build the acceleration structures on the host if the
+ * device allows it.
+ * \param quality The shader quality tier.
+ * \param integrator How the paths are traced.
+ * \param accumulate Average the frames, see Raytracer::Accumulation.
+ * \param targetNoise Stop tracing once the image is this clean, 0 never
+ * stops.
+ * \param asCacheDirectory Where built BLASes are cached, empty to always
+ * build them.
+ * \return The process exit code.
+ */
+int renderHeadless(std::vector<const char *> &devExt,
+                   std::vector<const char *> &validation,
+                   VkPhysicalDeviceFeatures2 *features, uint32_t frameCount,
+                   bool hostBuilds, Raytracer::QualityPreset quality,
+                   Raytracer::Integrator integrator, bool accumulate,
+                   float targetNoise, const std::string &asCacheDirectory) {
+    std::unique_ptr<vk_instance::Instance> instance =
+        std::make_unique<vk_instance::Instance>();
+
+    std::shared_ptr<device::DeviceHandler> deviceHandler =
+        std::make_shared<device::DeviceHandler>(
+            devExt, validation, instance->instance, VK_NULL_HANDLE, features,
+            rayTracingOptionalDeviceExtensions());
+
+    std::shared_ptr<command_buffer::CommandBufferHandler> commandBuffer =
+        std::make_shared<command_buffer::CommandBufferHandler>(deviceHandler,
+                                                               nullptr);
+
+    std::shared_ptr<gltf_model::Model> model =
+        loadScene(deviceHandler, commandBuffer, hostBuilds);
+
+    {
+        const VkExtent2D extent = {WIDTH, HEIGHT};
+        auto renderer =
+            Raytracer(deviceHandler, commandBuffer, model, extent,
+                      VK_FORMAT_B8G8R8A8_UNORM, asCacheDirectory);
+        if (quality != Raytracer::QualityPreset::Medium ||
+            integrator != Raytracer::Integrator::Megakernel) {
+            Raytracer::QualitySettings settings =
+                Raytracer::qualityPreset(quality);
+            settings.integrator = integrator;
+            renderer.setQuality(settings);
+        }
+        renderer.accumulation.enabled = accumulate;
+        renderer.accumulation.targetNoise = targetNoise;
+
+        geometry::Camera camera;
+        placeStartCamera(camera);
+        auto mats = camera.transformMatrices(extent.width, extent.height);
+
+        renderer.updateUniformBuffers(mats.proj, mats.view);
+        renderer.updateLightsBuffer(LIGHT_POSITIONS);
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        renderer.renderHeadless(frameCount);
+        auto endTime = std::chrono::high_resolution_clock::now();
+
+        float elapsed =
+            std::chrono::duration<float, std::chrono::milliseconds::period>(
+                endTime - startTime)
+                .count();
+        std::cout << frameCount << " frames in " << elapsed << " ms, "
+                  << elapsed / static_cast<float>(frameCount)
+                  << " ms per frame\n";
+        if (accumulate) {
+            std::cout << renderer.accumulation.samplesPerPixel
+                      << " samples per pixel, noise "
+                      << renderer.accumulation.noise
+                      << (renderer.accumulation.converged ? ", converged"
+                                                          : "")
+                      << "\n";
+        }
+        renderer.profiler->printStats(std::cout);
+        deviceHandler->allocator->printStats(std::cout);
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    uint32_t headlessFrames = 0;
+    std::string recordPath;
+    bool hostBuilds = false;
+    std::string asCacheDirectory = Raytracer::AS_CACHE_DIRECTORY;
+    Raytracer::QualityPreset quality = Raytracer::QualityPreset::Medium;
+    Raytracer::Integrator integrator = Raytracer::Integrator::Megakernel;
+    bool accumulate = false;
+    float targetNoise = 0.0F;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            // The frame count is optional, a following flag is left alone
+            headlessFrames = 1;
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+                char *end = nullptr;
+                const unsigned long frames = std::strtoul(argv[++i], &end, 10);
+                if (end == argv[i] || *end != '\0' || frames == 0 ||
+                    frames > UINT32_MAX || argv[i][0] == '-') {
+                    std::cerr << "usage: paraflop --headless [frames], frames "
+                                 "must be a positive integer, got \""
+                              << argv[i] << "\"\n";
+                    return 1;
+                }
+                headlessFrames = static_cast<uint32_t>(frames);
+            }
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--host-builds") == 0) {
+            hostBuilds = true;
+        } else if (strcmp(argv[i], "--no-as-cache") == 0) {
+            asCacheDirectory.clear();
+        } else if (strcmp(argv[i], "--quality") == 0 && i + 1 < argc) {
+            quality = Raytracer::parseQualityPreset(argv[++i]);
+        } else if (strcmp(argv[i], "--integrator") == 0 && i + 1 < argc) {
+            integrator = Raytracer::parseIntegrator(argv[++i]);
+        } else if (strcmp(argv[i], "--accumulate") == 0) {
+            accumulate = true;
+            // The target noise is optional, a following flag is left alone
+            if (i + 1 < argc) {
+                char *end = nullptr;
+                const float noise = std::strtof(argv[i + 1], &end);
+                if (end != argv[i + 1] && *end == '\0') {
+                    targetNoise = noise;
+                    i++;
+                }
+            }
+        }
+    }
+
     std::vector<const char *> validation = {"VK_LAYER_KHRONOS_validation"};
 
-    std::vector<const char *> devExt = {
-        VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
-        VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
-        VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,
-        VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
-        VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
-        VK_KHR_SPIRV_1_4_EXTENSION_NAME,
-        VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME,
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME};
-
-    VkPhysicalDeviceBufferDeviceAddressFeatures
-        enabledBufferDeviceAddresFeatures{};
-    VkPhysicalDeviceRayTracingPipelineFeaturesKHR
-        enabledRayTracingPipelineFeatures{};
-    VkPhysicalDeviceAccelerationStructureFeaturesKHR
-        enabledAccelerationStructureFeatures{};
-    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
-    indexingFeatures.sType =
-        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
-    indexingFeatures.pNext = nullptr;
-
-    enabledBufferDeviceAddresFeatures.sType =
-        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
-    enabledBufferDeviceAddresFeatures.bufferDeviceAddress = VK_TRUE;
-    enabledBufferDeviceAddresFeatures.pNext = &indexingFeatures;
-
-    enabledRayTracingPipelineFeatures.sType =
-        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR;
-    enabledRayTracingPipelineFeatures.rayTracingPipeline = VK_TRUE;
-    enabledRayTracingPipelineFeatures.pNext =
-        &enabledBufferDeviceAddresFeatures;
-
-    enabledAccelerationStructureFeatures.sType =
-        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
-    enabledAccelerationStructureFeatures.accelerationStructure = VK_TRUE;
-    enabledAccelerationStructureFeatures.pNext =
-        &enabledRayTracingPipelineFeatures;
-
-    VkPhysicalDeviceFeatures2 physicalDeviceFeatures2{};
-    physicalDeviceFeatures2.sType =
-        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
-    physicalDeviceFeatures2.pNext = &enabledAccelerationStructureFeatures;
+    RayTracingDeviceFeatures features;
+
+    if (headlessFrames > 0) {
+        // Nothing is presented, so the swap chain extension is not required
+        std::vector<const char *> devExt = rayTracingDeviceExtensions(false);
+        return renderHeadless(devExt, validation, features.chain(),
+                              headlessFrames, hostBuilds, quality, integrator,
+                              accumulate, targetNoise, asCacheDirectory);
+    }
+
+    std::vector<const char *> devExt = rayTracingDeviceExtensions(true);
 
     auto *cam = new CameraRotation(nullptr);
 
@@ -80,7 +243,7 @@ int main() {
     std::shared_ptr<device::DeviceHandler> deviceHandler =
         std::make_shared<device::DeviceHandler>(
             devExt, validation, instance->instance, surface->surface,
-            &physicalDeviceFeatures2);
+            features.chain(), rayTracingOptionalDeviceExtensions());
 
     std::shared_ptr<swap_chain::DepthBufferSwapChain> swapChain =
         std::make_shared<swap_chain::DepthBufferSwapChain>(
@@ -90,54 +253,36 @@ int main() {
         std::make_shared<command_buffer::CommandBufferHandler>(deviceHandler,
                                                                swapChain);
 
-    const uint32_t glTFLoadingFlags =
-        gltf_model::FileLoadingFlags::PreTransformVertices |
-        gltf_model::FileLoadingFlags::PreMultiplyVertexColors |
-        gltf_model::FileLoadingFlags::FlipY;
-
     std::shared_ptr<gltf_model::Model> model =
-        std::make_shared<gltf_model::Model>();
-    model->loadFromFile("assets/models/sponza/sponza.gltf", deviceHandler,
-                        commandBuffer, deviceHandler->getTransferQueue(),
-                        glTFLoadingFlags);
-    // model->loadFromFile("assets/models/FlightHelmet/glTF/FlightHelmet.gltf",
-    //                     deviceHandler, commandBuffer,
-    //                     deviceHandler->getTransferQueue(), glTFLoadingFlags);
-    // model->loadFromFile("assets/models/retroufo_glow.gltf", deviceHandler,
-    //                     commandBuffer, deviceHandler->getTransferQueue(),
-    //                     glTFLoadingFlags);
-    // model->loadFromFile("assets/models/vulkanscene_shadow.gltf",
-    // deviceHandler,
-    //                     commandBuffer, deviceHandler->getTransferQueue(),
-    //                     glTFLoadingFlags);
-
-    auto renderer =
-        Raytracer(deviceHandler, swapChain, commandBuffer, model, window);
+        loadScene(deviceHandler, commandBuffer, hostBuilds);
+
+    auto renderer = Raytracer(deviceHandler, swapChain, commandBuffer, model,
+                              window, asCacheDirectory);
+    if (quality != Raytracer::QualityPreset::Medium ||
+        integrator != Raytracer::Integrator::Megakernel) {
+        Raytracer::QualitySettings settings = Raytracer::qualityPreset(quality);
+        settings.integrator = integrator;
+        renderer.setQuality(settings);
+    }
+    renderer.accumulation.enabled = accumulate;
+    renderer.accumulation.targetNoise = targetNoise;
 
     std::shared_ptr<geometry::Camera> camera =
         std::make_shared<geometry::Camera>();
 
     cam->camera = camera;
 
-    const glm::vec3 pos = {0.0F, 3.0F, -10.0F};
-    camera->moveForward(0.0F);
-
-    camera->position = pos;
-    camera->position.y = -camera->position.y;
-
+    placeStartCamera(*camera);
     auto mats = camera->transformMatrices(swapChain->swapChainExtent.width,
                                           swapChain->swapChainExtent.height);
 
-    camera->position.y = -camera->position.y;
-
-    const std::vector<glm::vec4> lightPos = {
-        glm::vec4(40.0F, -50.0F, 25.0F, 10.0F),
-        glm::vec4(40.0F, -50.0F, -25.0F, 6.0F)};
     renderer.updateUniformBuffers(mats.proj, mats.view);
-    renderer.updateLightsBuffer(lightPos);
+    renderer.updateLightsBuffer(LIGHT_POSITIONS);
 
     static auto startTime = std::chrono::system_clock::now();
     auto prevTime = startTime;
+    uint32_t frameCount = 0;
+    geometry::CameraPath recording;
 
     while (!static_cast<bool>(glfwWindowShouldClose(window))) {
         glfwPollEvents();
@@ -154,11 +299,52 @@ int main() {
 
         prevTime = currentTime;
 
-        renderer.uniformData.dTime = cam->timePassed;
+        renderer.frameConstants.dTime = cam->timePassed;
         renderer.updateUniformBuffers(mats.proj, mats.view);
-        std::cout << cam->timePassed << "\n";
 
+        // Animated nodes reach the TLAS with the next recorded frame
+        if (!model->animations.empty()) {
+            const gltf_model::Animation &animation = model->animations[0];
+            float time = std::chrono::duration<float>(currentTime - startTime)
+                             .count();
+            model->updateAnimation(
+                0, animation.start +
+                       std::fmod(time, std::max(animation.end - animation.start,
+                                                0.001F)));
+        }
+
+        if (!recordPath.empty()) {
+            recording.record(
+                std::chrono::duration<float, std::chrono::seconds::period>(
+                    currentTime - startTime)
+                    .count(),
+                *camera);
+        }
+
+        const bool converged = renderer.accumulation.converged;
         renderer.renderFrame();
+        if (renderer.accumulation.converged && !converged) {
+            std::cout << "converged after "
+                      << renderer.accumulation.samplesPerPixel
+                      << " samples per pixel\n";
+        }
+
+        if (++frameCount % PROFILER_REPORT_INTERVAL == 0) {
+            std::cout << "frame time: " << cam->timePassed * 1000.0F
+                      << " ms\n";
+            if (accumulate) {
+                std::cout << renderer.accumulation.samplesPerPixel
+                          << " samples per pixel, noise "
+                          << renderer.accumulation.noise << "\n";
+            }
+            renderer.profiler->printStats(std::cout);
+            deviceHandler->allocator->printStats(std::cout);
+        }
+    }
+
+    if (!recordPath.empty()) {
+        recording.save(recordPath);
+        std::cout << "Camera path written to " << recordPath << "\n";
     }
 
     glfwDestroyWindow(window);
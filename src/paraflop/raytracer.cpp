@@ -1,154 +1,646 @@
 #include "raytracer.hpp"
+#include "vulkan_utils/as_build_scheduler.hpp"
+#include "vulkan_utils/as_cache.hpp"
 #include "vulkan_utils/utils.hpp"
 
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+
+namespace {
+// The variance of a few frames is no estimate, it is 0 after the first one
+const uint32_t ACCUMULATION_MIN_FRAMES = 16;
+
+/*
+    Converts a column major glm matrix into the row major 3x4 matrix of an
+   instance
+*/
+VkTransformMatrixKHR toTransformMatrix(const glm::mat4 &matrix) {
+    VkTransformMatrixKHR transform{};
+    for (uint32_t row = 0; row < 3; row++) {
+        for (uint32_t col = 0; col < 4; col++) {
+            transform.matrix[row][col] = matrix[col][row];
+        }
+    }
+    return transform;
+}
+
+bool isMasked(const gltf_model::Material &material) {
+    return material.alphaMode == gltf_model::Material::ALPHAMODE_MASK;
+}
+
+/*
+    Alpha masked primitives need their any-hit shader, everything else stays
+   opaque so traversal never leaves the fast path for it
+*/
+VkGeometryFlagsKHR geometryFlags(const gltf_model::Primitive &primitive) {
+    return isMasked(primitive.material)
+               ? VkGeometryFlagsKHR{0}
+               : VkGeometryFlagsKHR{VK_GEOMETRY_OPAQUE_BIT_KHR};
+}
+
+// Hit groups, after the ray generation and the two miss groups
+const uint32_t OPAQUE_HIT_GROUP = 3;
+const uint32_t MASKED_HIT_GROUP = 4;
+const uint32_t OPAQUE_SHADOW_HIT_GROUP = 5;
+const uint32_t MASKED_SHADOW_HIT_GROUP = 6;
+// The ReSTIR shading ray generation group, after the hit groups
+const uint32_t RESTIR_SHADE_GROUP = 7;
+} // namespace
+
 /*
-    Create the bottom level acceleration structure contains the scene's actual
-   geometry (vertices, triangles)
+    Create a bottom level acceleration structure per mesh. Each of them contains
+   the actual geometry (vertices, triangles) of the mesh's primitives, in the
+   mesh's own space
 */
-void Raytracer::createBottomLevelAccelerationStructure() {
+void Raytracer::createBottomLevelAccelerationStructures() {
+    // Host builds read the model's host copy of the geometry
+    const bool hostBuild =
+        supportsHostBuilds() && !scene->hostPositions.empty();
+
     VkDeviceOrHostAddressConstKHR vertexBufferDeviceAddress{};
     VkDeviceOrHostAddressConstKHR indexBufferDeviceAddress{};
 
-    vertexBufferDeviceAddress.deviceAddress =
-        getBufferDeviceAddress(scene->vertices.buffer);
+    if (hostBuild) {
+        vertexBufferDeviceAddress.hostAddress = scene->hostPositions.data();
+        indexBufferDeviceAddress.hostAddress = scene->hostIndices.data();
+    } else {
+        vertexBufferDeviceAddress.deviceAddress =
+            getBufferDeviceAddress(scene->positions.buffer);
+        indexBufferDeviceAddress.deviceAddress =
+            getBufferDeviceAddress(scene->indices.buffer);
+    }
 
-    indexBufferDeviceAddress.deviceAddress =
-        getBufferDeviceAddress(scene->indices.buffer);
+    auto maxVertex = static_cast<uint32_t>(scene->vertices.count);
 
-    uint32_t numTriangles = static_cast<uint32_t>(scene->indices.count) / 3;
-    uint32_t maxVertex = scene->vertices.count;
+    // Gather the meshes, a mesh referenced by several nodes is only built once
+    for (gltf_model::Node *node : scene->linearNodes) {
+        if (node->mesh == nullptr || node->mesh->primitives.empty()) {
+            continue;
+        }
+        bool known = false;
+        for (const MeshAccelerationStructure &blas : bottomLevelASes) {
+            known = known || blas.mesh == node->mesh;
+        }
+        if (known) {
+            continue;
+        }
+        MeshAccelerationStructure blas{};
+        blas.mesh = node->mesh;
+        blas.firstGeometry = static_cast<uint32_t>(geometryInfos.size());
+        for (gltf_model::Primitive *primitive : node->mesh->primitives) {
+            GeometryInfo info{};
+            info.firstIndex = primitive->firstIndex;
+            info.materialIndex = static_cast<uint32_t>(
+                &primitive->material - scene->materials.data());
+            geometryInfos.push_back(info);
+        }
+        bottomLevelASes.push_back(blas);
+    }
 
-    // Build
-    VkAccelerationStructureGeometryKHR accelerationStructureGeometry =
-        create_info::accelerationStructureGeometryKHR();
-    accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
-    accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
-    accelerationStructureGeometry.geometry.triangles.sType =
-        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
-    accelerationStructureGeometry.geometry.triangles.vertexFormat =
-        VK_FORMAT_R32G32B32_SFLOAT;
-    accelerationStructureGeometry.geometry.triangles.vertexData =
-        vertexBufferDeviceAddress;
-    accelerationStructureGeometry.geometry.triangles.maxVertex = maxVertex;
-    accelerationStructureGeometry.geometry.triangles.vertexStride =
-        sizeof(gltf_model::Vertex);
-    accelerationStructureGeometry.geometry.triangles.indexType =
-        VK_INDEX_TYPE_UINT32;
-    accelerationStructureGeometry.geometry.triangles.indexData =
-        indexBufferDeviceAddress;
-    accelerationStructureGeometry.geometry.triangles.transformData
-        .deviceAddress = 0;
-    accelerationStructureGeometry.geometry.triangles.transformData.hostAddress =
-        nullptr;
+    const size_t blasCount = bottomLevelASes.size();
+    const VkBuildAccelerationStructureFlagsKHR buildFlags =
+        VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR |
+        VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+    std::vector<std::vector<VkAccelerationStructureGeometryKHR>> geometries(
+        blasCount);
+    std::vector<std::vector<VkAccelerationStructureBuildRangeInfoKHR>>
+        buildRanges(blasCount);
+    std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildGeometryInfos(
+        blasCount);
+    std::vector<VkDeviceSize> scratchSizes(blasCount);
+
+    // Structures found in the cache are deserialized instead of built
+    std::vector<std::string> cacheKeys(blasCount);
+    std::vector<std::vector<uint8_t>> serialized(blasCount);
+    std::vector<uint32_t> built;
+    std::vector<uint32_t> cached;
+
+    for (uint32_t i = 0; i < blasCount; i++) {
+        MeshAccelerationStructure &blas = bottomLevelASes[i];
+
+        if (asCache != nullptr) {
+            // The geometry flags are part of the built structure
+            uint64_t geometryHash = blas.mesh->geometryHash;
+            for (const gltf_model::Primitive *primitive :
+                 blas.mesh->primitives) {
+                VkGeometryFlagsKHR flags = geometryFlags(*primitive);
+                geometryHash =
+                    utils::hashBytes(&flags, sizeof(flags), geometryHash);
+            }
+            cacheKeys[i] = asCache->key(geometryHash, buildFlags);
+            if (asCache->load(cacheKeys[i], serialized[i])) {
+                VkAccelerationStructureBuildSizesInfoKHR sizeInfo =
+                    create_info::accelerationStructureBuildSizesInfoKHR();
+                sizeInfo.accelerationStructureSize =
+                    as_cache::AccelerationStructureCache::deserializedSize(
+                        serialized[i]);
+                createAccelerationStructure(
+                    blas.accelerationStructure,
+                    VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, sizeInfo);
+                cached.push_back(i);
+                continue;
+            }
+        }
+        built.push_back(i);
+
+        std::vector<uint32_t> primitiveCounts;
+        for (gltf_model::Primitive *primitive : blas.mesh->primitives) {
+            // The indices are absolute, so every geometry sees the whole
+            // position stream and starts at the primitive's first index
+            VkAccelerationStructureGeometryKHR geometry =
+                create_info::accelerationStructureGeometryKHR();
+            geometry.flags = geometryFlags(*primitive);
+            geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+            geometry.geometry.triangles.sType =
+                VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+            geometry.geometry.triangles.vertexFormat =
+                VK_FORMAT_R32G32B32_SFLOAT;
+            geometry.geometry.triangles.vertexData = vertexBufferDeviceAddress;
+            geometry.geometry.triangles.maxVertex = maxVertex;
+            geometry.geometry.triangles.vertexStride = sizeof(glm::vec3);
+            geometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
+            geometry.geometry.triangles.indexData = indexBufferDeviceAddress;
+            geometry.geometry.triangles.transformData.deviceAddress = 0;
+            geometry.geometry.triangles.transformData.hostAddress = nullptr;
+            geometries[i].push_back(geometry);
+
+            VkAccelerationStructureBuildRangeInfoKHR buildRange{};
+            buildRange.primitiveCount = primitive->indexCount / 3;
+            buildRange.primitiveOffset =
+                primitive->firstIndex * static_cast<uint32_t>(sizeof(uint32_t));
+            buildRange.firstVertex = 0;
+            buildRange.transformOffset = 0;
+            buildRanges[i].push_back(buildRange);
+            primitiveCounts.push_back(buildRange.primitiveCount);
+        }
 
-    // Get size info
-    VkAccelerationStructureBuildGeometryInfoKHR
-        accelerationStructureBuildGeometryInfo =
+        // Get size info
+        VkAccelerationStructureBuildGeometryInfoKHR &buildGeometryInfo =
+            buildGeometryInfos[i];
+        buildGeometryInfo =
             create_info::accelerationStructureBuildGeometryInfoKHR();
-    accelerationStructureBuildGeometryInfo.type =
-        VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-    accelerationStructureBuildGeometryInfo.flags =
-        VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-    accelerationStructureBuildGeometryInfo.geometryCount = 1;
-    accelerationStructureBuildGeometryInfo.pGeometries =
-        &accelerationStructureGeometry;
+        buildGeometryInfo.type =
+            VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+        buildGeometryInfo.flags = buildFlags;
+        buildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+        buildGeometryInfo.geometryCount =
+            static_cast<uint32_t>(geometries[i].size());
+        buildGeometryInfo.pGeometries = geometries[i].data();
+
+        VkAccelerationStructureBuildSizesInfoKHR
+            accelerationStructureBuildSizesInfo =
+                create_info::accelerationStructureBuildSizesInfoKHR();
+        vkGetAccelerationStructureBuildSizesKHR(
+            *m_deviceHandler,
+            hostBuild ? VK_ACCELERATION_STRUCTURE_BUILD_TYPE_HOST_KHR
+                      : VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+            &buildGeometryInfo, primitiveCounts.data(),
+            &accelerationStructureBuildSizesInfo);
+
+        // The host writes host built structures directly, compaction moves
+        // them into device local memory afterwards
+        createAccelerationStructure(
+            blas.accelerationStructure,
+            VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+            accelerationStructureBuildSizesInfo,
+            hostBuild ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                      : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        buildGeometryInfo.dstAccelerationStructure =
+            blas.accelerationStructure.handle;
+        scratchSizes[i] = accelerationStructureBuildSizesInfo.buildScratchSize;
+    }
 
-    VkAccelerationStructureBuildSizesInfoKHR
-        accelerationStructureBuildSizesInfo =
-            create_info::accelerationStructureBuildSizesInfoKHR();
-    vkGetAccelerationStructureBuildSizesKHR(
-        *m_deviceHandler, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
-        &accelerationStructureBuildGeometryInfo, &numTriangles,
-        &accelerationStructureBuildSizesInfo);
+    geometryBuffer = std::make_unique<buffer::Buffer>(
+        m_deviceHandler, m_commandBuffer,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE,
+        std::max<VkDeviceSize>(geometryInfos.size() * sizeof(GeometryInfo),
+                               sizeof(GeometryInfo)));
+    if (!geometryInfos.empty()) {
+        geometryBuffer->copy(geometryInfos.data(),
+                             geometryInfos.size() * sizeof(GeometryInfo));
+    }
 
-    createAccelerationStructure(bottomLevelAS,
-                                VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
-                                accelerationStructureBuildSizesInfo);
+    if (blasCount == 0) {
+        return;
+    }
 
-    // Create a small scratch buffer used during build of the bottom level
-    // acceleration structure
-    ScratchBuffer scratchBuffer = createScratchBuffer(
-        accelerationStructureBuildSizesInfo.buildScratchSize);
+    // The builds share one scratch arena, packed into as few build
+    // commands as it allows
+    as_build_scheduler::BuildScheduler scheduler(*this);
+    std::vector<VkAccelerationStructureKHR> builtHandles;
+    for (uint32_t i : built) {
+        scheduler.add(buildGeometryInfos[i], buildRanges[i].data(),
+                      scratchSizes[i]);
+        builtHandles.push_back(bottomLevelASes[i].accelerationStructure.handle);
+    }
+    const auto builtCount = static_cast<uint32_t>(built.size());
 
-    VkAccelerationStructureBuildGeometryInfoKHR accelerationBuildGeometryInfo =
-        create_info::accelerationStructureBuildGeometryInfoKHR();
-    accelerationBuildGeometryInfo.type =
-        VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-    accelerationBuildGeometryInfo.flags =
-        VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-    accelerationBuildGeometryInfo.mode =
-        VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-    accelerationBuildGeometryInfo.dstAccelerationStructure =
-        bottomLevelAS.handle;
-    accelerationBuildGeometryInfo.geometryCount = 1;
-    accelerationBuildGeometryInfo.pGeometries = &accelerationStructureGeometry;
-    accelerationBuildGeometryInfo.scratchData.deviceAddress =
-        scratchBuffer.deviceAddress;
+    if (hostBuild && builtCount > 0) {
+        VK_CHECK(scheduler.buildOnHost());
+    }
 
-    VkAccelerationStructureBuildRangeInfoKHR
-        accelerationStructureBuildRangeInfo{};
-    accelerationStructureBuildRangeInfo.primitiveCount = numTriangles;
-    accelerationStructureBuildRangeInfo.primitiveOffset = 0;
-    accelerationStructureBuildRangeInfo.firstVertex = 0;
-    accelerationStructureBuildRangeInfo.transformOffset = 0;
-    std::vector<VkAccelerationStructureBuildRangeInfoKHR *>
-        accelerationBuildStructureRangeInfos = {
-            &accelerationStructureBuildRangeInfo};
+    // Cached structures are read by the device from an upload buffer
+    Raytracer::Buffer upload{};
+    std::vector<VkDeviceSize> uploadOffsets;
+    uint64_t uploadAddress = 0;
+    if (!cached.empty()) {
+        std::vector<VkDeviceSize> sizes;
+        for (uint32_t i : cached) {
+            sizes.push_back(serialized[i].size());
+        }
+        uploadAddress =
+            m_createSerializationBuffer(sizes, upload, uploadOffsets);
+        for (size_t j = 0; j < cached.size(); j++) {
+            memcpy(static_cast<uint8_t *>(upload.mapped) + uploadOffsets[j],
+                   serialized[cached[j]].data(), sizes[j]);
+        }
+    }
+
+    // The compacted sizes of device builds are written by the same
+    // submission as the builds, host built structures report them on the
+    // host without waiting for the device
+    const bool deviceBuild = !hostBuild && builtCount > 0;
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    if (deviceBuild) {
+        VkQueryPoolCreateInfo queryPoolCreateInfo{};
+        queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolCreateInfo.queryType =
+            VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+        queryPoolCreateInfo.queryCount = builtCount;
+        VK_CHECK(vkCreateQueryPool(*m_deviceHandler, &queryPoolCreateInfo,
+                                   nullptr, &queryPool));
+    }
+
+    // Without host builds the acceleration structures are built on the
+    // device via a one-time command buffer submission, along with the
+    // deserialization of the cached ones
+    if (deviceBuild || !cached.empty()) {
+        VkCommandBuffer commandBuffer = m_commandBuffer->createCommandBuffer(
+            VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        if (deviceBuild) {
+            vkCmdResetQueryPool(commandBuffer, queryPool, 0, builtCount);
+        }
+        profiler->beginPass(commandBuffer, PROFILER_SETUP_SLOT,
+                            profilerPasses.blasBuild);
+        for (size_t j = 0; j < cached.size(); j++) {
+            VkCopyMemoryToAccelerationStructureInfoKHR copyInfo{};
+            copyInfo.sType =
+                VK_STRUCTURE_TYPE_COPY_MEMORY_TO_ACCELERATION_STRUCTURE_INFO_KHR;
+            copyInfo.src.deviceAddress = uploadAddress + uploadOffsets[j];
+            copyInfo.dst =
+                bottomLevelASes[cached[j]].accelerationStructure.handle;
+            copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_DESERIALIZE_KHR;
+            vkCmdCopyMemoryToAccelerationStructureKHR(commandBuffer, &copyInfo);
+        }
+        if (deviceBuild) {
+            scheduler.record(commandBuffer);
+        }
+        profiler->endPass(commandBuffer, PROFILER_SETUP_SLOT,
+                          profilerPasses.blasBuild);
+
+        if (deviceBuild) {
+            // The size queries read the finished structures
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask =
+                VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+            barrier.dstAccessMask =
+                VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+            vkCmdPipelineBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1,
+                &barrier, 0, nullptr, 0, nullptr);
+            vkCmdWriteAccelerationStructuresPropertiesKHR(
+                commandBuffer, builtCount, builtHandles.data(),
+                VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+                queryPool, 0);
+        }
+
+        m_commandBuffer->flushCommandBuffer(commandBuffer,
+                                            m_deviceHandler->graphicsQueue);
+        profiler->markSubmitted(PROFILER_SETUP_SLOT);
+        profiler->collect();
+    }
+
+    upload.destroy(*m_deviceHandler);
+
+    if (builtCount == 0) {
+        return;
+    }
+
+    std::vector<VkDeviceSize> compactedSizes(builtCount);
+    if (hostBuild) {
+        VK_CHECK(vkWriteAccelerationStructuresPropertiesKHR(
+            *m_deviceHandler, builtCount, builtHandles.data(),
+            VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+            compactedSizes.size() * sizeof(VkDeviceSize),
+            compactedSizes.data(), sizeof(VkDeviceSize)));
+    } else {
+        VK_CHECK(vkGetQueryPoolResults(
+            *m_deviceHandler, queryPool, 0, builtCount,
+            compactedSizes.size() * sizeof(VkDeviceSize),
+            compactedSizes.data(), sizeof(VkDeviceSize),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+        vkDestroyQueryPool(*m_deviceHandler, queryPool, nullptr);
+    }
+
+    compactBottomLevelAccelerationStructures(compactedSizes, built,
+                                             hostBuild);
+
+    if (asCache != nullptr) {
+        storeBottomLevelAccelerationStructures(built, cacheKeys);
+    }
+}
+
+/*
+    The hit shaders look materials up through the geometry buffer instead of
+   reading them from every vertex
+*/
+void Raytracer::createMaterialBuffer() {
+    std::vector<MaterialInfo> materialInfos;
+    materialInfos.reserve(scene->materials.size());
+    for (const gltf_model::Material &material : scene->materials) {
+        MaterialInfo info{};
+        info.baseColorFactor = material.baseColorFactor;
+        info.baseColorTexture = scene->findTexture(material.baseColorTexture);
+        info.emissiveTexture = scene->findTexture(material.emissiveTexture);
+        info.normalTexture = scene->findTexture(material.normalTexture);
+        info.roughnessFactor = material.roughnessFactor;
+        info.alphaCutoff = isMasked(material) ? material.alphaCutoff : 0.0F;
+        materialInfos.push_back(info);
+    }
+
+    materialBuffer = std::make_unique<buffer::Buffer>(
+        m_deviceHandler, m_commandBuffer,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE,
+        std::max<VkDeviceSize>(materialInfos.size() * sizeof(MaterialInfo),
+                               sizeof(MaterialInfo)));
+    if (!materialInfos.empty()) {
+        materialBuffer->copy(materialInfos.data(),
+                             materialInfos.size() * sizeof(MaterialInfo));
+    }
+}
+
+void Raytracer::createBlueNoiseTexture() {
+    std::vector<uint8_t> texels = blue_noise::generate();
+    blueNoiseTexture = std::make_unique<texture::Texture2D>(
+        texels.data(), texels.size(), VK_FORMAT_R8G8B8A8_UNORM,
+        blue_noise::DEFAULT_SIZE, blue_noise::DEFAULT_SIZE, m_deviceHandler,
+        m_commandBuffer, VK_FILTER_NEAREST);
+}
+
+/*
+    Compaction is a copy into a right-sized acceleration structure, all the
+   copies are recorded into one command buffer
+*/
+void Raytracer::compactBottomLevelAccelerationStructures(
+    const std::vector<VkDeviceSize> &compactedSizes,
+    const std::vector<uint32_t> &blasIndices, bool relocate) {
+    const auto blasCount = static_cast<uint32_t>(blasIndices.size());
+
+    std::vector<AccelerationStructure> compacted(blasCount);
+    std::vector<bool> isCompacted(blasCount, false);
 
-    // Build the acceleration structure on the device via a one-time command
-    // buffer submission Some implementations may support acceleration structure
-    // building on the host
-    // (VkPhysicalDeviceAccelerationStructureFeaturesKHR->accelerationStructureHostCommands),
-    // but we prefer device builds
     VkCommandBuffer commandBuffer = m_commandBuffer->createCommandBuffer(
         VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-    vkCmdBuildAccelerationStructuresKHR(
-        commandBuffer, 1, &accelerationBuildGeometryInfo,
-        accelerationBuildStructureRangeInfos.data());
+    profiler->beginPass(commandBuffer, PROFILER_SETUP_SLOT,
+                        profilerPasses.blasCompaction);
+    for (uint32_t i = 0; i < blasCount; i++) {
+        const AccelerationStructure &original =
+            bottomLevelASes[blasIndices[i]].accelerationStructure;
+        // Nothing to gain if the structure does not shrink and already is
+        // in device local memory. The allocation may be rounded up, so the
+        // size it was created with is compared
+        if (compactedSizes[i] == 0 ||
+            (!relocate && compactedSizes[i] >= original.size)) {
+            continue;
+        }
+
+        VkAccelerationStructureBuildSizesInfoKHR sizeInfo =
+            create_info::accelerationStructureBuildSizesInfoKHR();
+        sizeInfo.accelerationStructureSize = compactedSizes[i];
+        createAccelerationStructure(
+            compacted[i], VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+            sizeInfo);
+        isCompacted[i] = true;
+
+        VkCopyAccelerationStructureInfoKHR copyInfo{};
+        copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+        copyInfo.src = original.handle;
+        copyInfo.dst = compacted[i].handle;
+        copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+        vkCmdCopyAccelerationStructureKHR(commandBuffer, &copyInfo);
+    }
+    profiler->endPass(commandBuffer, PROFILER_SETUP_SLOT,
+                      profilerPasses.blasCompaction);
     m_commandBuffer->flushCommandBuffer(commandBuffer,
                                         m_deviceHandler->graphicsQueue);
+    profiler->markSubmitted(PROFILER_SETUP_SLOT);
+    profiler->collect();
+
+    for (uint32_t i = 0; i < blasCount; i++) {
+        if (isCompacted[i]) {
+            AccelerationStructure &original =
+                bottomLevelASes[blasIndices[i]].accelerationStructure;
+            deleteAccelerationStructure(original);
+            original = compacted[i];
+        }
+    }
+}
+
+/*
+    Serializes freshly built bottom level acceleration structures into the
+   cache, so the next start deserializes them instead of building
+*/
+void Raytracer::storeBottomLevelAccelerationStructures(
+    const std::vector<uint32_t> &blasIndices,
+    const std::vector<std::string> &cacheKeys) {
+    const auto blasCount = static_cast<uint32_t>(blasIndices.size());
+    std::vector<VkAccelerationStructureKHR> handles;
+    handles.reserve(blasCount);
+    for (uint32_t i : blasIndices) {
+        handles.push_back(bottomLevelASes[i].accelerationStructure.handle);
+    }
+
+    VkQueryPoolCreateInfo queryPoolCreateInfo{};
+    queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolCreateInfo.queryType =
+        VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR;
+    queryPoolCreateInfo.queryCount = blasCount;
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateQueryPool(*m_deviceHandler, &queryPoolCreateInfo, nullptr,
+                               &queryPool));
+
+    VkCommandBuffer commandBuffer = m_commandBuffer->createCommandBuffer(
+        VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    vkCmdResetQueryPool(commandBuffer, queryPool, 0, blasCount);
+    vkCmdWriteAccelerationStructuresPropertiesKHR(
+        commandBuffer, blasCount, handles.data(),
+        VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR, queryPool,
+        0);
+    m_commandBuffer->flushCommandBuffer(commandBuffer,
+                                        m_deviceHandler->graphicsQueue);
+
+    std::vector<VkDeviceSize> sizes(blasCount);
+    VK_CHECK(vkGetQueryPoolResults(
+        *m_deviceHandler, queryPool, 0, blasCount,
+        sizes.size() * sizeof(VkDeviceSize), sizes.data(),
+        sizeof(VkDeviceSize),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+    vkDestroyQueryPool(*m_deviceHandler, queryPool, nullptr);
+
+    Raytracer::Buffer readback{};
+    std::vector<VkDeviceSize> offsets;
+    uint64_t address = m_createSerializationBuffer(sizes, readback, offsets);
 
-    deleteScratchBuffer(scratchBuffer);
+    commandBuffer = m_commandBuffer->createCommandBuffer(
+        VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    for (uint32_t i = 0; i < blasCount; i++) {
+        VkCopyAccelerationStructureToMemoryInfoKHR copyInfo{};
+        copyInfo.sType =
+            VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_INFO_KHR;
+        copyInfo.src = handles[i];
+        copyInfo.dst.deviceAddress = address + offsets[i];
+        copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_SERIALIZE_KHR;
+        vkCmdCopyAccelerationStructureToMemoryKHR(commandBuffer, &copyInfo);
+    }
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(
+        commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+        VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    m_commandBuffer->flushCommandBuffer(commandBuffer,
+                                        m_deviceHandler->graphicsQueue);
+
+    m_deviceHandler->allocator->invalidate(readback.memory);
+    for (uint32_t i = 0; i < blasCount; i++) {
+        asCache->store(cacheKeys[blasIndices[i]],
+                       static_cast<uint8_t *>(readback.mapped) + offsets[i],
+                       sizes[i]);
+    }
+    readback.destroy(*m_deviceHandler);
+}
+
+uint64_t
+Raytracer::m_createSerializationBuffer(const std::vector<VkDeviceSize> &sizes,
+                                       Buffer &buffer,
+                                       std::vector<VkDeviceSize> &offsets) {
+    // Sub-allocated memory only guarantees the buffer's own alignment, so
+    // leave room to align the first structure
+    const VkDeviceSize alignment = as_cache::SERIALIZED_ALIGNMENT;
+    offsets.clear();
+    VkDeviceSize size = 0;
+    for (VkDeviceSize structureSize : sizes) {
+        offsets.push_back(size);
+        size += utils::alignedSize(structureSize, alignment);
+    }
+
+    buffer.size = size + alignment;
+    VK_CHECK(m_deviceHandler->createBuffer(
+        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        buffer.size, &buffer.buffer, &buffer.memory, nullptr,
+        memory_allocator::Lifetime::Transient));
+    VK_CHECK(buffer.map());
+
+    uint64_t address = getBufferDeviceAddress(buffer.buffer);
+    VkDeviceSize padding = utils::alignedSize(address, alignment) - address;
+    for (VkDeviceSize &offset : offsets) {
+        offset += padding;
+    }
+    return address;
 }
 
 /*
-    The top level acceleration structure contains the scene's object instances
+    The top level acceleration structure contains the scene's object instances,
+   one per node with a mesh
 */
 void Raytracer::createTopLevelAccelerationStructure() {
-    VkTransformMatrixKHR transformMatrix = {1.0F, 0.0F, 0.0F, 0.0F, 0.0F, 1.0F,
-                                            0.0F, 0.0F, 0.0F, 0.0F, 1.0F, 0.0F};
-
-    VkAccelerationStructureInstanceKHR instance{};
-    instance.transform = transformMatrix;
-    instance.instanceCustomIndex = 0;
-    instance.mask = 0xFF;
-    instance.instanceShaderBindingTableRecordOffset = 0;
-    instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-    instance.accelerationStructureReference = bottomLevelAS.deviceAddress;
-
-    // Buffer for instance data
-    Raytracer::Buffer instancesBuffer;
+    const bool preTransformed = static_cast<bool>(
+        scene->fileLoadingFlags &
+        gltf_model::FileLoadingFlags::PreTransformVertices);
+
+    std::unordered_map<const gltf_model::Mesh *, uint32_t> meshBlas;
+    for (uint32_t i = 0; i < bottomLevelASes.size(); i++) {
+        meshBlas[bottomLevelASes[i].mesh] = i;
+    }
+
+    for (gltf_model::Node *node : scene->linearNodes) {
+        auto blasIt = meshBlas.find(node->mesh);
+        if (blasIt == meshBlas.end()) {
+            continue;
+        }
+        const MeshAccelerationStructure &blas = bottomLevelASes[blasIt->second];
+
+        VkAccelerationStructureInstanceKHR instance{};
+        // Pre-transformed vertices are already in world space and are shared
+        // by every node of the mesh, so they need a single identity instance
+        // that never moves
+        if (preTransformed) {
+            instance.transform = toTransformMatrix(glm::mat4(1.0F));
+            meshBlas.erase(blasIt);
+            topLevelInstances.nodes.push_back(nullptr);
+        } else {
+            instance.transform = m_instanceTransform(*node);
+            topLevelInstances.nodes.push_back(node);
+        }
+        node->transformDirty = false;
+        instance.instanceCustomIndex = blas.firstGeometry;
+        instance.mask = 0xFF;
+        // Every geometry has RAY_TYPE_COUNT hit records of its own
+        instance.instanceShaderBindingTableRecordOffset =
+            blas.firstGeometry * RAY_TYPE_COUNT;
+        instance.flags =
+            VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+        instance.accelerationStructureReference =
+            blas.accelerationStructure.deviceAddress;
+        topLevelInstances.instances.push_back(instance);
+    }
+
+    const auto instanceCount =
+        static_cast<uint32_t>(topLevelInstances.instances.size());
+
+    // Animated scenes refit the TLAS every frame, so favour cheap builds
+    topLevelInstances.flags =
+        VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR |
+        (scene->animations.empty() || preTransformed
+             ? VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR
+             : VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR);
+
+    // Instance data, one persistently mapped segment per frame in flight
+    topLevelInstances.segmentSize =
+        std::max<VkDeviceSize>(instanceCount, 1) *
+        sizeof(VkAccelerationStructureInstanceKHR);
+    Raytracer::Buffer &instancesBuffer = topLevelInstances.buffer;
+    instancesBuffer.size = topLevelInstances.segmentSize * MAX_FRAMES_IN_FLIGHT;
     VK_CHECK(m_deviceHandler->createBuffer(
         VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
             VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        sizeof(VkAccelerationStructureInstanceKHR), &instancesBuffer.buffer,
-        &instancesBuffer.memory, &instance));
-
-    VkDeviceOrHostAddressConstKHR instanceDataDeviceAddress{};
-    instanceDataDeviceAddress.deviceAddress =
+        instancesBuffer.size, &instancesBuffer.buffer, &instancesBuffer.memory,
+        nullptr));
+    VK_CHECK(instancesBuffer.map());
+    topLevelInstances.deviceAddress =
         getBufferDeviceAddress(instancesBuffer.buffer);
+    for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+        memcpy(static_cast<uint8_t *>(instancesBuffer.mapped) +
+                   frame * topLevelInstances.segmentSize,
+               topLevelInstances.instances.data(),
+               instanceCount * sizeof(VkAccelerationStructureInstanceKHR));
+    }
+    topLevelInstances.dirty.resize(MAX_FRAMES_IN_FLIGHT);
 
     VkAccelerationStructureGeometryKHR accelerationStructureGeometry =
-        create_info::accelerationStructureGeometryKHR();
-    accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
-    accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
-    accelerationStructureGeometry.geometry.instances.sType =
-        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
-    accelerationStructureGeometry.geometry.instances.arrayOfPointers = VK_FALSE;
-    accelerationStructureGeometry.geometry.instances.data =
-        instanceDataDeviceAddress;
+        m_topLevelGeometry(0);
 
     // Get size info
     VkAccelerationStructureBuildGeometryInfoKHR
@@ -156,49 +648,174 @@ void Raytracer::createTopLevelAccelerationStructure() {
             create_info::accelerationStructureBuildGeometryInfoKHR();
     accelerationStructureBuildGeometryInfo.type =
         VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-    accelerationStructureBuildGeometryInfo.flags =
-        VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+    accelerationStructureBuildGeometryInfo.flags = topLevelInstances.flags;
     accelerationStructureBuildGeometryInfo.geometryCount = 1;
     accelerationStructureBuildGeometryInfo.pGeometries =
         &accelerationStructureGeometry;
 
-    uint32_t primitive_count = 1;
-
     VkAccelerationStructureBuildSizesInfoKHR
         accelerationStructureBuildSizesInfo =
             create_info::accelerationStructureBuildSizesInfoKHR();
     vkGetAccelerationStructureBuildSizesKHR(
         *m_deviceHandler, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
-        &accelerationStructureBuildGeometryInfo, &primitive_count,
+        &accelerationStructureBuildGeometryInfo, &instanceCount,
         &accelerationStructureBuildSizesInfo);
 
-    // @todo: as return value?
     createAccelerationStructure(topLevelAS,
                                 VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
                                 accelerationStructureBuildSizesInfo);
 
-    // Create a small scratch buffer used during build of the top level
-    // acceleration structure
-    ScratchBuffer scratchBuffer = createScratchBuffer(
-        accelerationStructureBuildSizesInfo.buildScratchSize);
+    // The scratch buffer is kept for the refits and periodic rebuilds
+    topLevelInstances.scratch = createScratchBuffer(
+        std::max(accelerationStructureBuildSizesInfo.buildScratchSize,
+                 accelerationStructureBuildSizesInfo.updateScratchSize),
+        memory_allocator::Lifetime::Persistent);
+
+    // Build the acceleration structure on the device via a one-time command
+    // buffer submission Some implementations may support acceleration structure
+    // building on the host
+    // (VkPhysicalDeviceAccelerationStructureFeaturesKHR->accelerationStructureHostCommands),
+    // but we prefer device builds
+    VkCommandBuffer commandBuffer = m_commandBuffer->createCommandBuffer(
+        VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    profiler->beginPass(commandBuffer, PROFILER_SETUP_SLOT,
+                        profilerPasses.tlasBuild);
+    m_recordTopLevelBuild(commandBuffer, 0, false);
+    profiler->endPass(commandBuffer, PROFILER_SETUP_SLOT,
+                      profilerPasses.tlasBuild);
+    m_commandBuffer->flushCommandBuffer(commandBuffer,
+                                        m_deviceHandler->graphicsQueue);
+    profiler->markSubmitted(PROFILER_SETUP_SLOT);
+    profiler->collect();
+}
+
+/*
+    Moves the instances of nodes that were animated since the last frame. Only
+   the frame's own instance segment is written, the frames still in flight read
+   theirs
+*/
+void Raytracer::updateTopLevelAccelerationStructure(VkCommandBuffer cmdBuffer,
+                                                    uint32_t frame) {
+    for (uint32_t i = 0; i < topLevelInstances.nodes.size(); i++) {
+        gltf_model::Node *node = topLevelInstances.nodes[i];
+        if (node == nullptr || !node->transformDirty) {
+            continue;
+        }
+        node->transformDirty = false;
+        topLevelInstances.instances[i].transform = m_instanceTransform(*node);
+        // A moving scene does not converge
+        resetAccumulation();
+        // Every segment has to pick up the new transform
+        for (std::vector<uint32_t> &dirty : topLevelInstances.dirty) {
+            dirty.push_back(i);
+        }
+    }
+
+    std::vector<uint32_t> &dirty = topLevelInstances.dirty[frame];
+    if (dirty.empty()) {
+        return;
+    }
+
+    auto *segment = reinterpret_cast<VkAccelerationStructureInstanceKHR *>(
+        static_cast<uint8_t *>(topLevelInstances.buffer.mapped) +
+        frame * topLevelInstances.segmentSize);
+    for (uint32_t instance : dirty) {
+        segment[instance].transform =
+            topLevelInstances.instances[instance].transform;
+    }
+    dirty.clear();
+
+    // Refits degrade the tree as nodes move, rebuild it from time to time
+    bool rebuild =
+        ++topLevelInstances.updatesSinceBuild >= TLAS_REBUILD_INTERVAL;
+    if (rebuild) {
+        topLevelInstances.updatesSinceBuild = 0;
+    }
+
+    // Frames before this one may still trace the TLAS or use the scratch,
+    // the wavefront stages query it from compute
+    VkMemoryBarrier barrier = create_info::memoryBarrier();
+    barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR |
+                            VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    vkCmdPipelineBarrier(
+        cmdBuffer,
+        VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR |
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+            VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+        VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier,
+        0, nullptr, 0, nullptr);
+
+    uint32_t profilerSlot = frame + 1;
+    profiler->beginPass(cmdBuffer, profilerSlot, profilerPasses.tlasUpdate);
+    m_recordTopLevelBuild(cmdBuffer, frame, !rebuild);
+    profiler->endPass(cmdBuffer, profilerSlot, profilerPasses.tlasUpdate);
+
+    barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    vkCmdPipelineBarrier(
+        cmdBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+        VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR |
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+VkTransformMatrixKHR
+Raytracer::m_instanceTransform(const gltf_model::Node &node) const {
+    // FlipY is applied to the vertices in mesh space, flip them back before
+    // the node transform and flip the result instead
+    const bool flipY = static_cast<bool>(scene->fileLoadingFlags &
+                                         gltf_model::FileLoadingFlags::FlipY);
+    const glm::mat4 flip = glm::scale(
+        glm::mat4(1.0F), glm::vec3(1.0F, flipY ? -1.0F : 1.0F, 1.0F));
+    return toTransformMatrix(flip * node.getMatrix() * flip);
+}
+
+VkAccelerationStructureGeometryKHR
+Raytracer::m_topLevelGeometry(uint32_t segment) const {
+    VkDeviceOrHostAddressConstKHR instanceDataDeviceAddress{};
+    instanceDataDeviceAddress.deviceAddress =
+        topLevelInstances.deviceAddress +
+        segment * topLevelInstances.segmentSize;
+
+    VkAccelerationStructureGeometryKHR accelerationStructureGeometry =
+        create_info::accelerationStructureGeometryKHR();
+    accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+    accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+    accelerationStructureGeometry.geometry.instances.sType =
+        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+    accelerationStructureGeometry.geometry.instances.arrayOfPointers = VK_FALSE;
+    accelerationStructureGeometry.geometry.instances.data =
+        instanceDataDeviceAddress;
+    return accelerationStructureGeometry;
+}
+
+void Raytracer::m_recordTopLevelBuild(VkCommandBuffer cmdBuffer,
+                                      uint32_t segment, bool update) {
+    VkAccelerationStructureGeometryKHR accelerationStructureGeometry =
+        m_topLevelGeometry(segment);
 
     VkAccelerationStructureBuildGeometryInfoKHR accelerationBuildGeometryInfo =
         create_info::accelerationStructureBuildGeometryInfoKHR();
     accelerationBuildGeometryInfo.type =
         VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-    accelerationBuildGeometryInfo.flags =
-        VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+    accelerationBuildGeometryInfo.flags = topLevelInstances.flags;
     accelerationBuildGeometryInfo.mode =
-        VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+        update ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR
+               : VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+    // Updates refit the structure in place
+    accelerationBuildGeometryInfo.srcAccelerationStructure =
+        update ? topLevelAS.handle : VK_NULL_HANDLE;
     accelerationBuildGeometryInfo.dstAccelerationStructure = topLevelAS.handle;
     accelerationBuildGeometryInfo.geometryCount = 1;
     accelerationBuildGeometryInfo.pGeometries = &accelerationStructureGeometry;
     accelerationBuildGeometryInfo.scratchData.deviceAddress =
-        scratchBuffer.deviceAddress;
+        topLevelInstances.scratch.deviceAddress;
 
     VkAccelerationStructureBuildRangeInfoKHR
         accelerationStructureBuildRangeInfo{};
-    accelerationStructureBuildRangeInfo.primitiveCount = 1;
+    accelerationStructureBuildRangeInfo.primitiveCount =
+        static_cast<uint32_t>(topLevelInstances.instances.size());
     accelerationStructureBuildRangeInfo.primitiveOffset = 0;
     accelerationStructureBuildRangeInfo.firstVertex = 0;
     accelerationStructureBuildRangeInfo.transformOffset = 0;
@@ -206,21 +823,9 @@ void Raytracer::createTopLevelAccelerationStructure() {
         accelerationBuildStructureRangeInfos = {
             &accelerationStructureBuildRangeInfo};
 
-    // Build the acceleration structure on the device via a one-time command
-    // buffer submission Some implementations may support acceleration structure
-    // building on the host
-    // (VkPhysicalDeviceAccelerationStructureFeaturesKHR->accelerationStructureHostCommands),
-    // but we prefer device builds
-    VkCommandBuffer commandBuffer = m_commandBuffer->createCommandBuffer(
-        VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
     vkCmdBuildAccelerationStructuresKHR(
-        commandBuffer, 1, &accelerationBuildGeometryInfo,
+        cmdBuffer, 1, &accelerationBuildGeometryInfo,
         accelerationBuildStructureRangeInfos.data());
-    m_commandBuffer->flushCommandBuffer(commandBuffer,
-                                        m_deviceHandler->graphicsQueue);
-
-    deleteScratchBuffer(scratchBuffer);
-    instancesBuffer.destroy(*m_deviceHandler);
 }
 
 /*
@@ -255,32 +860,54 @@ void Raytracer::createShaderBindingTables() {
     createShaderBindingTable(shaderBindingTables.raygen, 1);
     // We are using two miss shaders
     createShaderBindingTable(shaderBindingTables.miss, 2);
-    createShaderBindingTable(shaderBindingTables.hit, 1);
+    // Every geometry has a record per ray type, in the order of the
+    // geometry buffer
+    const auto hitRecordCount = static_cast<uint32_t>(
+        std::max<size_t>(geometryInfos.size(), 1) * RAY_TYPE_COUNT);
+    createShaderBindingTable(shaderBindingTables.hit, hitRecordCount);
+    createShaderBindingTable(shaderBindingTables.shade, 1);
 
     // Copy handles
     memcpy(shaderBindingTables.raygen.mapped, shaderHandleStorage.data(),
            handleSize);
+    memcpy(shaderBindingTables.shade.mapped,
+           shaderHandleStorage.data() + RESTIR_SHADE_GROUP * handleSizeAligned,
+           handleSize);
     // We are using two miss shaders, so we need to get two handles for the miss
     // shader binding table
     memcpy(shaderBindingTables.miss.mapped,
            shaderHandleStorage.data() + handleSizeAligned, handleSize * 2);
-    memcpy(shaderBindingTables.hit.mapped,
-           shaderHandleStorage.data() + handleSizeAligned * 3, handleSize);
+    auto *hitRecords = static_cast<uint8_t *>(shaderBindingTables.hit.mapped);
+    for (uint32_t record = 0; record < hitRecordCount; record++) {
+        const uint32_t geometry = record / RAY_TYPE_COUNT;
+        const bool shadow = record % RAY_TYPE_COUNT == 1;
+        const bool masked =
+            geometry < geometryInfos.size() &&
+            isMasked(scene->materials[geometryInfos[geometry].materialIndex]);
+        uint32_t group = masked ? MASKED_HIT_GROUP : OPAQUE_HIT_GROUP;
+        if (shadow) {
+            group = masked ? MASKED_SHADOW_HIT_GROUP : OPAQUE_SHADOW_HIT_GROUP;
+        }
+        memcpy(hitRecords + record * handleSizeAligned,
+               shaderHandleStorage.data() + group * handleSizeAligned,
+               handleSize);
+    }
 }
 
 /*
-    Create the descriptor sets used for the ray tracing dispatch
+    Create the descriptor sets used for the ray tracing dispatch, one per frame
+   in flight
 */
 void Raytracer::createDescriptorSets() {
+    const uint32_t frames = MAX_FRAMES_IN_FLIGHT;
     std::vector<VkDescriptorPoolSize> poolSizes = {
-        {VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1},
-        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
-        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
-        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3},
-        {VK_DESCRIPTOR_TYPE_SAMPLER, 1},
+        {VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, frames},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 * frames},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         (16 + WAVEFRONT_BINDING_COUNT) * frames},
+        {VK_DESCRIPTOR_TYPE_SAMPLER, frames},
         {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
-         static_cast<uint32_t>(scene->textures.size())},
-        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
+         static_cast<uint32_t>(scene->textures.size() + 1) * frames},
     };
 
     VkDescriptorPoolCreateInfo descriptorPoolCreateInfo{};
@@ -289,23 +916,71 @@ void Raytracer::createDescriptorSets() {
     descriptorPoolCreateInfo.poolSizeCount =
         static_cast<uint32_t>(poolSizes.size());
     descriptorPoolCreateInfo.pPoolSizes = poolSizes.data();
-    descriptorPoolCreateInfo.maxSets = 1;
+    descriptorPoolCreateInfo.maxSets = frames;
     descriptorPoolCreateInfo.flags =
         VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
 
     VK_CHECK(vkCreateDescriptorPool(*m_deviceHandler, &descriptorPoolCreateInfo,
                                     nullptr, &descriptorPool));
 
+    std::vector<VkDescriptorSetLayout> layouts(frames, descriptorSetLayout);
     VkDescriptorSetAllocateInfo descriptorSetAllocateInfo{};
     descriptorSetAllocateInfo.sType =
         VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     descriptorSetAllocateInfo.descriptorPool = descriptorPool;
-    descriptorSetAllocateInfo.pSetLayouts = &descriptorSetLayout;
-    descriptorSetAllocateInfo.descriptorSetCount = 1;
+    descriptorSetAllocateInfo.pSetLayouts = layouts.data();
+    descriptorSetAllocateInfo.descriptorSetCount = frames;
 
+    descriptorSets.resize(frames);
     VK_CHECK(vkAllocateDescriptorSets(
-        *m_deviceHandler, &descriptorSetAllocateInfo, &descriptorSet));
+        *m_deviceHandler, &descriptorSetAllocateInfo, descriptorSets.data()));
+
+    // The uniform ring is set 1, its pool can not allow update-after-bind
+    // with a dynamic uniform buffer in it. One set serves every frame, the
+    // dynamic offset selects the frame's arena
+    VkDescriptorPoolSize uniformPoolSize{
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1};
+    VkDescriptorPoolCreateInfo uniformPoolCreateInfo{};
+    uniformPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    uniformPoolCreateInfo.poolSizeCount = 1;
+    uniformPoolCreateInfo.pPoolSizes = &uniformPoolSize;
+    uniformPoolCreateInfo.maxSets = 1;
+
+    VK_CHECK(vkCreateDescriptorPool(*m_deviceHandler, &uniformPoolCreateInfo,
+                                    nullptr, &uniformDescriptorPool));
+
+    VkDescriptorSetAllocateInfo uniformSetAllocateInfo{};
+    uniformSetAllocateInfo.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    uniformSetAllocateInfo.descriptorPool = uniformDescriptorPool;
+    uniformSetAllocateInfo.pSetLayouts = &uniformDescriptorSetLayout;
+    uniformSetAllocateInfo.descriptorSetCount = 1;
 
+    VK_CHECK(vkAllocateDescriptorSets(*m_deviceHandler, &uniformSetAllocateInfo,
+                                      &uniformDescriptorSet));
+
+    // Set 1, binding 0: Uniform data, offset per frame when binding
+    VkDescriptorBufferInfo uniformDescriptor =
+        uniformRing->descriptor(sizeof(UniformData));
+    VkWriteDescriptorSet uniformWrite = create_info::writeDescriptorSet(
+        uniformDescriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0,
+        &uniformDescriptor);
+    vkUpdateDescriptorSets(*m_deviceHandler, 1, &uniformWrite, 0, nullptr);
+
+    VkSamplerCreateInfo createInfo =
+        create_info::samplerCreateInfo(VK_FILTER_LINEAR);
+
+    VK_CHECK(vkCreateSampler(*m_deviceHandler, &createInfo, nullptr, &sampler));
+    textureDescriptors.clear();
+
+    for (auto &texture : scene->textures) {
+        textureDescriptors.push_back(texture.descriptor);
+    }
+
+    updateDescriptorSets();
+}
+
+void Raytracer::updateDescriptorSets() {
     VkWriteDescriptorSetAccelerationStructureKHR
         descriptorAccelerationStructureInfo{};
     descriptorAccelerationStructureInfo.sType =
@@ -314,81 +989,186 @@ void Raytracer::createDescriptorSets() {
     descriptorAccelerationStructureInfo.pAccelerationStructures =
         &topLevelAS.handle;
 
-    VkWriteDescriptorSet accelerationStructureWrite{};
-    accelerationStructureWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    // The specialized acceleration structure descriptor has to be chained
-    accelerationStructureWrite.pNext = &descriptorAccelerationStructureInfo;
-    accelerationStructureWrite.dstSet = descriptorSet;
-    accelerationStructureWrite.dstBinding = 0;
-    accelerationStructureWrite.descriptorCount = 1;
-    accelerationStructureWrite.descriptorType =
-        VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
-
     VkDescriptorImageInfo storageImageDescriptor{
         VK_NULL_HANDLE, storageImage.view, VK_IMAGE_LAYOUT_GENERAL};
-    VkDescriptorBufferInfo vertexBufferDescriptor{scene->vertices.buffer, 0,
+    VkDescriptorImageInfo accumulationImageDescriptor{
+        VK_NULL_HANDLE, accumulation.image.view, VK_IMAGE_LAYOUT_GENERAL};
+    VkDescriptorBufferInfo vertexBufferDescriptor{scene->attributes.buffer, 0,
                                                   VK_WHOLE_SIZE};
     VkDescriptorBufferInfo indexBufferDescriptor{scene->indices.buffer, 0,
                                                  VK_WHOLE_SIZE};
-    VkDescriptorBufferInfo lightsBufferDescriptor{this->lights.buffer, 0,
-                                                  VK_WHOLE_SIZE};
-    VkDescriptorBufferInfo colorBufferDescriptorInfo{this->colorBuffer.buffer,
-                                                     0, VK_WHOLE_SIZE};
+    VkDescriptorBufferInfo lightsBufferDescriptor{
+        this->lights.buffer, 0, lights.lights.size() * sizeof(glm::vec4)};
+    VkDescriptorBufferInfo lightAliasTableDescriptor{
+        this->lights.buffer, lights.aliasTableOffset,
+        lights.lights.size() * sizeof(light_sampler::AliasEntry)};
+    VkDescriptorBufferInfo lightBvhDescriptor{
+        this->lights.buffer, lights.bvhOffset, VK_WHOLE_SIZE};
+    VkDescriptorBufferInfo geometryBufferDescriptor{*geometryBuffer, 0,
+                                                    VK_WHOLE_SIZE};
+    VkDescriptorBufferInfo materialBufferDescriptor{*materialBuffer, 0,
+                                                    VK_WHOLE_SIZE};
 
-    VkSamplerCreateInfo createInfo =
-        create_info::samplerCreateInfo(VK_FILTER_LINEAR);
+    VkDescriptorImageInfo samplerInfo = {};
+    samplerInfo.sampler = sampler;
 
-    VK_CHECK(vkCreateSampler(*m_deviceHandler, &createInfo, nullptr, &sampler));
-    textureDescriptors.clear();
+    for (uint32_t frame = 0; frame < descriptorSets.size(); frame++) {
+        VkDescriptorSet descriptorSet = descriptorSets[frame];
+
+        VkWriteDescriptorSet accelerationStructureWrite{};
+        accelerationStructureWrite.sType =
+            VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        // The specialized acceleration structure descriptor has to be chained
+        accelerationStructureWrite.pNext = &descriptorAccelerationStructureInfo;
+        accelerationStructureWrite.dstSet = descriptorSet;
+        accelerationStructureWrite.dstBinding = 0;
+        accelerationStructureWrite.descriptorCount = 1;
+        accelerationStructureWrite.descriptorType =
+            VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+
+        // The frame reads the pixels of the frame before it
+        uint32_t prevFrame =
+            (frame + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT;
+        VkDescriptorBufferInfo prevReSTIRDescriptor{
+            restirBuffer.buffer, prevFrame * restirBuffer.segmentSize,
+            restirBuffer.segmentSize};
+        VkDescriptorBufferInfo restirDescriptor{
+            restirBuffer.buffer, frame * restirBuffer.segmentSize,
+            restirBuffer.segmentSize};
+        VkDescriptorBufferInfo prevGIDescriptor{
+            giBuffer.buffer, prevFrame * giBuffer.segmentSize,
+            giBuffer.segmentSize};
+        VkDescriptorBufferInfo giDescriptor{giBuffer.buffer,
+                                            frame * giBuffer.segmentSize,
+                                            giBuffer.segmentSize};
+        VkDescriptorBufferInfo prevDenoiserDescriptor{
+            denoiserBuffer.buffer, prevFrame * denoiserBuffer.segmentSize,
+            denoiserBuffer.segmentSize};
+        VkDescriptorBufferInfo denoiserDescriptor{
+            denoiserBuffer.buffer, frame * denoiserBuffer.segmentSize,
+            denoiserBuffer.segmentSize};
+        std::array<VkDescriptorBufferInfo, 2> denoiserFilterDescriptors = {{
+            {denoiserFilterBuffer.buffer, 0, denoiserFilterBuffer.segmentSize},
+            {denoiserFilterBuffer.buffer, denoiserFilterBuffer.segmentSize,
+             denoiserFilterBuffer.segmentSize},
+        }};
+        VkDescriptorBufferInfo accumulationTilesDescriptor{
+            accumulation.tiles.buffer, frame * accumulation.tileSegmentSize,
+            accumulation.tileSegmentSize};
+
+        std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+            // Binding 0: Top level acceleration structure
+            accelerationStructureWrite,
+            // Binding 1: Ray tracing result image
+            create_info::writeDescriptorSet(descriptorSet,
+                                            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                            1, &storageImageDescriptor),
+            // Binding 4: Packed vertex attributes
+            create_info::writeDescriptorSet(descriptorSet,
+                                            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                            4, &vertexBufferDescriptor),
+            // Binding 5: Scene index buffer
+            create_info::writeDescriptorSet(descriptorSet,
+                                            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                            5, &indexBufferDescriptor),
+            // Binding 6: Texture sampler
+            create_info::writeDescriptorSet(
+                descriptorSet, VK_DESCRIPTOR_TYPE_SAMPLER, 6, &samplerInfo),
+            // Binding 7: Sampled textures
+            create_info::writeDescriptorSet(
+                descriptorSet, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 7,
+                textureDescriptors.data(), textureDescriptors.size()),
+            // Binding 8: Previous frame's ReSTIR buffer segment
+            create_info::writeDescriptorSet(descriptorSet,
+                                            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                            8, &prevReSTIRDescriptor),
+            // Binding 9: This frame's ReSTIR buffer segment
+            create_info::writeDescriptorSet(descriptorSet,
+                                            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                            9, &restirDescriptor),
+            // Binding 10: First index and material of every BLAS geometry
+            create_info::writeDescriptorSet(descriptorSet,
+                                            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                            10, &geometryBufferDescriptor),
+            // Binding 11: Material table
+            create_info::writeDescriptorSet(descriptorSet,
+                                            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                            11, &materialBufferDescriptor),
+            // Binding 12: Blue noise
+            create_info::writeDescriptorSet(
+                descriptorSet, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 12,
+                &blueNoiseTexture->descriptor),
+            // Binding 17: Accumulated moments
+            create_info::writeDescriptorSet(descriptorSet,
+                                            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                            17, &accumulationImageDescriptor),
+            // Binding 18: This frame's tile errors
+            create_info::writeDescriptorSet(descriptorSet,
+                                            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                            18, &accumulationTilesDescriptor),
+        };
+
+        // Bindings 3, 13 and 14: Lights, their alias table and their BVH,
+        // partially bound until lights are set
+        if (lights.buffer != VK_NULL_HANDLE) {
+            writeDescriptorSets.push_back(create_info::writeDescriptorSet(
+                descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3,
+                &lightsBufferDescriptor));
+            writeDescriptorSets.push_back(create_info::writeDescriptorSet(
+                descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 13,
+                &lightAliasTableDescriptor));
+            writeDescriptorSets.push_back(create_info::writeDescriptorSet(
+                descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 14,
+                &lightBvhDescriptor));
+        }
 
-    for (auto &texture : scene->textures) {
-        textureDescriptors.push_back(texture.descriptor);
-    }
+        // Bindings 15 and 16: Previous and this frame's ReSTIR GI segments,
+        // partially bound without ReSTIR GI
+        if (giBuffer.buffer != VK_NULL_HANDLE) {
+            writeDescriptorSets.push_back(create_info::writeDescriptorSet(
+                descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 15,
+                &prevGIDescriptor));
+            writeDescriptorSets.push_back(create_info::writeDescriptorSet(
+                descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 16,
+                &giDescriptor));
+        }
 
-    VkDescriptorImageInfo samplerInfo = {};
-    samplerInfo.sampler = sampler;
+        // Bindings 19 to 22: The denoiser's history and wavelet buffers,
+        // partially bound without the denoiser
+        if (denoiserBuffer.buffer != VK_NULL_HANDLE) {
+            writeDescriptorSets.push_back(create_info::writeDescriptorSet(
+                descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 19,
+                &prevDenoiserDescriptor));
+            writeDescriptorSets.push_back(create_info::writeDescriptorSet(
+                descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 20,
+                &denoiserDescriptor));
+            writeDescriptorSets.push_back(create_info::writeDescriptorSet(
+                descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 21,
+                &denoiserFilterDescriptors[0]));
+            writeDescriptorSets.push_back(create_info::writeDescriptorSet(
+                descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 22,
+                &denoiserFilterDescriptors[1]));
+        }
 
-    std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
-        // Binding 0: Top level acceleration structure
-        accelerationStructureWrite,
-        // Binding 1: Ray tracing result image
-        create_info::writeDescriptorSet(descriptorSet,
-                                        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1,
-                                        &storageImageDescriptor),
-        // Binding 2: Uniform data
-        create_info::writeDescriptorSet(descriptorSet,
-                                        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2,
-                                        &ubo.descriptor),
-        // Binding 4: Scene index buffer
-        create_info::writeDescriptorSet(descriptorSet,
-                                        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3,
-                                        &lightsBufferDescriptor),
-        // Binding 3: Scene vertex buffer
-        create_info::writeDescriptorSet(descriptorSet,
-                                        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4,
-                                        &vertexBufferDescriptor),
-        // Binding 4: Scene index buffer
-        create_info::writeDescriptorSet(descriptorSet,
-                                        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5,
-                                        &indexBufferDescriptor),
-        // Binding 5: Texture sampler
-        create_info::writeDescriptorSet(
-            descriptorSet, VK_DESCRIPTOR_TYPE_SAMPLER, 6, &samplerInfo),
-
-        // // Binding 6: Sampled textures
-        create_info::writeDescriptorSet(
-            descriptorSet, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 7,
-            textureDescriptors.data(), textureDescriptors.size()),
-
-        // Binding 8: Scene color buffer
-        create_info::writeDescriptorSet(descriptorSet,
-                                        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8,
-                                        &colorBufferDescriptorInfo),
-    };
+        // Bindings 23 to 31: The wavefront buffer's regions, partially bound
+        // without the wavefront path tracer
+        std::array<VkDescriptorBufferInfo, WAVEFRONT_BINDING_COUNT>
+            wavefrontDescriptors{};
+        if (wavefront.buffer != VK_NULL_HANDLE) {
+            for (uint32_t i = 0; i < WAVEFRONT_BINDING_COUNT; i++) {
+                wavefrontDescriptors[i] = {wavefront.buffer,
+                                           wavefront.offsets[i],
+                                           wavefront.ranges[i]};
+                writeDescriptorSets.push_back(create_info::writeDescriptorSet(
+                    descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    WAVEFRONT_FIRST_BINDING + i, &wavefrontDescriptors[i]));
+            }
+        }
 
-    vkUpdateDescriptorSets(*m_deviceHandler,
-                           static_cast<uint32_t>(writeDescriptorSets.size()),
-                           writeDescriptorSets.data(), 0, VK_NULL_HANDLE);
+        vkUpdateDescriptorSets(
+            *m_deviceHandler, static_cast<uint32_t>(writeDescriptorSets.size()),
+            writeDescriptorSets.data(), 0, VK_NULL_HANDLE);
+    }
 }
 
 /*
@@ -396,47 +1176,128 @@ void Raytracer::createDescriptorSets() {
 */
 void Raytracer::createRayTracingPipeline() {
     std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-        // Binding 0: Acceleration structure
+        // Binding 0: Acceleration structure, the wavefront stages query it
         create_info::descriptorSetLayoutBinding(
             VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
             VK_SHADER_STAGE_RAYGEN_BIT_KHR |
-                VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR,
+                VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR |
+                VK_SHADER_STAGE_COMPUTE_BIT,
             0),
-        // Binding 1: Storage image
+        // Binding 1: Storage image, the denoiser's last pass writes it
         create_info::descriptorSetLayoutBinding(
-            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_RAYGEN_BIT_KHR,
-            1),
-        // Binding 2: Uniform buffer
-        create_info::descriptorSetLayoutBinding(
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            VK_SHADER_STAGE_RAYGEN_BIT_KHR |
-                VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR |
-                VK_SHADER_STAGE_MISS_BIT_KHR,
-            2),
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT, 1),
         // Binding 3: Lights buffer
         create_info::descriptorSetLayoutBinding(
             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 3),
-        // Binding 4: Vertex buffer
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR |
+                VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR |
+                VK_SHADER_STAGE_COMPUTE_BIT,
+            3),
+        // Binding 4: Packed vertex attributes. Like the other bindings of
+        // the alpha test, raygen reads it for inline shadow rays
         create_info::descriptorSetLayoutBinding(
             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 4),
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR |
+                VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR |
+                VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT,
+            4),
         // Binding 5: Index buffer
         create_info::descriptorSetLayoutBinding(
             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 5),
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR |
+                VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR |
+                VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT,
+            5),
         // Binding 6: Uniform buffer
         create_info::descriptorSetLayoutBinding(
-            VK_DESCRIPTOR_TYPE_SAMPLER, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 6),
+            VK_DESCRIPTOR_TYPE_SAMPLER,
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR |
+                VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR |
+                VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT,
+            6),
         // // Binding 7: Uniform buffer
         create_info::descriptorSetLayoutBinding(
             VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
-            VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 7, scene->textures.size()),
-        // // Binding 8: Color buffer
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR |
+                VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR |
+                VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT,
+            7, scene->textures.size()),
+        // Binding 8: Previous frame's ReSTIR pixels
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT, 8),
+        // Binding 9: Current frame's ReSTIR pixels
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT, 9),
+        // Binding 10: Geometry buffer
         create_info::descriptorSetLayoutBinding(
-            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_RAYGEN_BIT_KHR,
-            8),
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR |
+                VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR |
+                VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT,
+            10),
+        // Binding 11: Material buffer
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR |
+                VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR |
+                VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT,
+            11),
+        // Binding 12: Blue noise texture
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, PUSH_CONSTANT_STAGES, 12),
+        // Binding 13: Light alias table
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR |
+                VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR |
+                VK_SHADER_STAGE_COMPUTE_BIT,
+            13),
+        // Binding 14: Light BVH
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR |
+                VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR |
+                VK_SHADER_STAGE_COMPUTE_BIT,
+            14),
+        // Binding 15: Previous frame's ReSTIR GI pixels
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT, 15),
+        // Binding 16: Current frame's ReSTIR GI pixels
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT, 16),
+        // Binding 17: Accumulation image
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT, 17),
+        // Binding 18: Accumulation tile errors
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 18),
+        // Binding 19: Previous frame's denoiser pixels
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 19),
+        // Binding 20: Current frame's denoiser pixels
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT, 20),
+        // Bindings 21 and 22: Denoiser wavelet ping-pong
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 21),
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 22),
     };
+    // Bindings 23 to 31: The regions of the wavefront buffer
+    for (uint32_t binding = WAVEFRONT_FIRST_BINDING;
+         binding < WAVEFRONT_FIRST_BINDING + WAVEFRONT_BINDING_COUNT;
+         binding++) {
+        setLayoutBindings.push_back(create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT,
+            binding));
+    }
 
     std::vector<VkDescriptorBindingFlags> flags(
         setLayoutBindings.size(),
@@ -460,15 +1321,79 @@ void Raytracer::createRayTracingPipeline() {
                                          &descriptorSetLayoutCI, nullptr,
                                          &descriptorSetLayout));
 
+    // Set 1: The uniform ring, bound with a dynamic offset. Dynamic uniform
+    // buffers are not allowed in an update-after-bind layout, so it can not
+    // share set 0
+    VkDescriptorSetLayoutBinding uniformBinding =
+        create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR |
+                VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR |
+                VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR |
+                VK_SHADER_STAGE_COMPUTE_BIT,
+            0);
+    VkDescriptorSetLayoutCreateInfo uniformSetLayoutCI =
+        create_info::descriptorSetLayoutCreateInfo(&uniformBinding, 1);
+
+    VK_CHECK(vkCreateDescriptorSetLayout(*m_deviceHandler, &uniformSetLayoutCI,
+                                         nullptr,
+                                         &uniformDescriptorSetLayout));
+
+    VkPushConstantRange pushConstantRange = create_info::pushConstantRange(
+        PUSH_CONSTANT_STAGES, sizeof(FrameConstants), 0);
+
+    std::array<VkDescriptorSetLayout, 2> setLayouts = {
+        descriptorSetLayout, uniformDescriptorSetLayout};
     VkPipelineLayoutCreateInfo pPipelineLayoutCI =
-        create_info::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+        create_info::pipelineLayoutCreateInfo(setLayouts.data(),
+                                              setLayouts.size());
+    pPipelineLayoutCI.pushConstantRangeCount = 1;
+    pPipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
     VK_CHECK(vkCreatePipelineLayout(*m_deviceHandler, &pPipelineLayoutCI,
                                     nullptr, &pipelineLayout));
 
+    m_createPipeline();
+}
+
+/*
+    The quality settings are specialization constants of every stage, so a
+   new quality only needs a new pipeline, not new SPIR-V
+*/
+void Raytracer::m_createPipeline() {
+    const std::array<VkSpecializationMapEntry, 14> specializationEntries = {{
+        {0, offsetof(QualitySettings, samples), sizeof(uint32_t)},
+        {1, offsetof(QualitySettings, maxReflections), sizeof(uint32_t)},
+        {2, offsetof(QualitySettings, lightSamples), sizeof(uint32_t)},
+        {3, offsetof(QualitySettings, ambientLight), sizeof(float)},
+        {4, offsetof(QualitySettings, lightMultiplier), sizeof(float)},
+        {5, offsetof(QualitySettings, shadowRays), sizeof(VkBool32)},
+        {6, offsetof(QualitySettings, lightsPerHit), sizeof(uint32_t)},
+        {7, offsetof(QualitySettings, lightSampling), sizeof(uint32_t)},
+        {8, offsetof(QualitySettings, restir), sizeof(VkBool32)},
+        {9, offsetof(QualitySettings, restirCandidates), sizeof(uint32_t)},
+        {10, offsetof(QualitySettings, restirSpatialSamples),
+         sizeof(uint32_t)},
+        {11, offsetof(QualitySettings, restirGI), sizeof(VkBool32)},
+        {12, offsetof(QualitySettings, denoise), sizeof(VkBool32)},
+        {13, offsetof(QualitySettings, denoiseIterations), sizeof(uint32_t)},
+    }};
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount =
+        static_cast<uint32_t>(specializationEntries.size());
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = sizeof(QualitySettings);
+    specializationInfo.pData = &m_quality;
+
     /*
         Setup ray tracing shader groups
     */
     std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+    shaderGroups.clear();
+
+    // The variants built with RAY_QUERY_SHADOWS trace their shadow rays
+    // inline. The shadow miss and hit groups stay, so the SBT layout is the
+    // same either way
+    const bool rayQueryShadows = usesRayQueryShadows();
 
     // Ray generation group
     {
@@ -508,23 +1433,72 @@ void Raytracer::createRayTracingPipeline() {
         shaderGroups.push_back(shaderGroup);
     }
 
-    // Closest hit group
+    // Hit groups, the SBT picks one per geometry and ray type. Only alpha
+    // masked geometries get an any-hit shader
     {
-        shaderStages.push_back(loadShader("shaders/closesthit.rchit.spv",
-                                          VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR));
+        shaderStages.push_back(
+            loadShader(rayQueryShadows ? "shaders/closesthit_query.rchit.spv"
+                                       : "shaders/closesthit.rchit.spv",
+                       VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR));
+        const auto closestHit = static_cast<uint32_t>(shaderStages.size()) - 1;
+        shaderStages.push_back(loadShader("shaders/anyhit.rahit.spv",
+                                          VK_SHADER_STAGE_ANY_HIT_BIT_KHR));
+        const auto anyHit = static_cast<uint32_t>(shaderStages.size()) - 1;
+        // Shadow rays skip the closest hit shader and only need a cheaper
+        // alpha test
+        shaderStages.push_back(loadShader("shaders/shadow.rahit.spv",
+                                          VK_SHADER_STAGE_ANY_HIT_BIT_KHR));
+        const auto shadowAnyHit =
+            static_cast<uint32_t>(shaderStages.size()) - 1;
+
+        const std::array<std::pair<uint32_t, uint32_t>, 4> hitGroups = {{
+            {closestHit, VK_SHADER_UNUSED_KHR}, // OPAQUE_HIT_GROUP
+            {closestHit, anyHit},               // MASKED_HIT_GROUP
+            {VK_SHADER_UNUSED_KHR,
+             VK_SHADER_UNUSED_KHR},             // OPAQUE_SHADOW_HIT_GROUP
+            {VK_SHADER_UNUSED_KHR, shadowAnyHit}, // MASKED_SHADOW_HIT_GROUP
+        }};
+        for (const auto &[closestHitShader, anyHitShader] : hitGroups) {
+            VkRayTracingShaderGroupCreateInfoKHR shaderGroup{};
+            shaderGroup.sType =
+                VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
+            shaderGroup.type =
+                VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
+            shaderGroup.generalShader = VK_SHADER_UNUSED_KHR;
+            shaderGroup.closestHitShader = closestHitShader;
+            shaderGroup.anyHitShader = anyHitShader;
+            shaderGroup.intersectionShader = VK_SHADER_UNUSED_KHR;
+            shaderGroups.push_back(shaderGroup);
+        }
+    }
+
+    // ReSTIR shading group, RESTIR_SHADE_GROUP
+    {
+        shaderStages.push_back(
+            loadShader(rayQueryShadows ? "shaders/restir_shade_query.rgen.spv"
+                                       : "shaders/restir_shade.rgen.spv",
+                       VK_SHADER_STAGE_RAYGEN_BIT_KHR));
         VkRayTracingShaderGroupCreateInfoKHR shaderGroup{};
         shaderGroup.sType =
             VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-        shaderGroup.type =
-            VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
-        shaderGroup.generalShader = VK_SHADER_UNUSED_KHR;
-        shaderGroup.closestHitShader =
+        shaderGroup.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
+        shaderGroup.generalShader =
             static_cast<uint32_t>(shaderStages.size()) - 1;
+        shaderGroup.closestHitShader = VK_SHADER_UNUSED_KHR;
         shaderGroup.anyHitShader = VK_SHADER_UNUSED_KHR;
         shaderGroup.intersectionShader = VK_SHADER_UNUSED_KHR;
         shaderGroups.push_back(shaderGroup);
     }
 
+    for (VkPipelineShaderStageCreateInfo &stage : shaderStages) {
+        stage.pSpecializationInfo = &specializationInfo;
+    }
+
+    // Reflections are traced in a loop in the ray generation shader, only
+    // the closest hit shader's shadow rays nest, unless they are queries
+    const uint32_t recursionDepth =
+        m_quality.shadowRays == VK_TRUE && !rayQueryShadows ? 2 : 1;
+
     VkRayTracingPipelineCreateInfoKHR rayTracingPipelineCI{};
     rayTracingPipelineCI.sType =
         VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR;
@@ -534,16 +1508,202 @@ void Raytracer::createRayTracingPipeline() {
     rayTracingPipelineCI.groupCount =
         static_cast<uint32_t>(shaderGroups.size());
     rayTracingPipelineCI.pGroups = shaderGroups.data();
-    rayTracingPipelineCI.maxPipelineRayRecursionDepth = 4;
+    rayTracingPipelineCI.maxPipelineRayRecursionDepth = std::min(
+        recursionDepth, rayTracingPipelineProperties.maxRayRecursionDepth);
     rayTracingPipelineCI.layout = pipelineLayout;
     VK_CHECK(vkCreateRayTracingPipelinesKHR(
-        *m_deviceHandler, VK_NULL_HANDLE, VK_NULL_HANDLE, 1,
+        *m_deviceHandler, VK_NULL_HANDLE, *m_deviceHandler->pipelineCache, 1,
         &rayTracingPipelineCI, nullptr, &pipeline));
+
+    // The compute passes share the layout, so both bind points use the
+    // same descriptor sets and push constants
+    std::vector<std::pair<const char *, VkPipeline *>> computePipelines = {
+        {"shaders/restir_spatial.comp.spv", &spatialReusePipeline},
+        {"shaders/accumulation_tiles.comp.spv", &accumulationPipeline},
+        {"shaders/svgf_temporal.comp.spv", &denoiserPipelines[0]},
+        {"shaders/svgf_variance.comp.spv", &denoiserPipelines[1]},
+        {"shaders/svgf_atrous.comp.spv", &denoiserPipelines[2]},
+    };
+    // The ray queries of the wavefront stages need VK_KHR_ray_query, so they
+    // are only loaded when picked
+    if (m_quality.integrator == Integrator::Wavefront) {
+        const std::array<const char *, 7> wavefrontShaders = {
+            "shaders/wavefront_generate.comp.spv",
+            "shaders/wavefront_extend.comp.spv",
+            "shaders/wavefront_scan.comp.spv",
+            "shaders/wavefront_scatter.comp.spv",
+            "shaders/wavefront_shade.comp.spv",
+            "shaders/wavefront_shadow.comp.spv",
+            "shaders/wavefront_connect.comp.spv",
+        };
+        for (size_t i = 0; i < wavefrontShaders.size(); i++) {
+            computePipelines.emplace_back(wavefrontShaders[i],
+                                          &wavefrontPipelines[i]);
+        }
+    }
+    for (const auto &[shader, computePipeline] : computePipelines) {
+        VkComputePipelineCreateInfo computePipelineCI =
+            create_info::computePipelineCreateInfo(pipelineLayout);
+        computePipelineCI.stage =
+            loadShader(shader, VK_SHADER_STAGE_COMPUTE_BIT);
+        computePipelineCI.stage.pSpecializationInfo = &specializationInfo;
+        VK_CHECK(vkCreateComputePipelines(*m_deviceHandler,
+                                          *m_deviceHandler->pipelineCache, 1,
+                                          &computePipelineCI, nullptr,
+                                          computePipeline));
+    }
+
+    // The pipelines keep what they need from the modules
+    for (VkShaderModule shaderModule : shaderModules) {
+        vkDestroyShaderModule(*m_deviceHandler, shaderModule, nullptr);
+    }
+    shaderModules.clear();
+}
+
+Raytracer::QualitySettings Raytracer::qualityPreset(QualityPreset preset) {
+    QualitySettings settings{};
+    switch (preset) {
+    case QualityPreset::Low:
+        settings.samples = 1;
+        settings.maxReflections = 1;
+        settings.shadowRays = VK_FALSE;
+        settings.lightsPerHit = 1;
+        // A single path per pixel is only usable denoised
+        settings.denoise = VK_TRUE;
+        break;
+    case QualityPreset::Medium:
+        break;
+    case QualityPreset::High:
+        settings.samples = 8;
+        settings.maxReflections = 5;
+        settings.lightsPerHit = 8;
+        break;
+    }
+    return settings;
 }
 
-VkResult Raytracer::Buffer::map(VkDevice device, VkDeviceSize size,
-                                VkDeviceSize offset) {
-    return vkMapMemory(device, memory, offset, size, 0, &mapped);
+Raytracer::QualityPreset
+Raytracer::parseQualityPreset(const std::string &name) {
+    if (name == "low") {
+        return QualityPreset::Low;
+    }
+    if (name == "medium") {
+        return QualityPreset::Medium;
+    }
+    if (name == "high") {
+        return QualityPreset::High;
+    }
+    throw std::runtime_error("Unknown quality preset " + name);
+}
+
+Raytracer::Integrator Raytracer::parseIntegrator(const std::string &name) {
+    if (name == "megakernel") {
+        return Integrator::Megakernel;
+    }
+    if (name == "wavefront") {
+        return Integrator::Wavefront;
+    }
+    throw std::runtime_error("Unknown integrator " + name);
+}
+
+/*
+    The closest hit shader's traced shadow rays nest, which needs a recursion
+   depth of 2. Below that they are cast as queries or not at all
+*/
+void Raytracer::m_clampShadowRays() {
+    if (m_quality.shadowRays == VK_FALSE ||
+        rayTracingPipelineProperties.maxRayRecursionDepth >= 2 ||
+        usesRayQueryShadows()) {
+        return;
+    }
+    if (supportsRayQuery()) {
+        m_quality.rayQueryShadows = VK_TRUE;
+        std::cerr << "The device can not nest rays, shadow rays are traced "
+                     "with ray queries\n";
+    } else {
+        m_quality.shadowRays = VK_FALSE;
+        std::cerr << "The device can not nest rays and has no ray queries, "
+                     "shadow rays are disabled\n";
+    }
+}
+
+void Raytracer::setQuality(const QualitySettings &settings) {
+    if (settings.integrator == Integrator::Wavefront && !supportsRayQuery()) {
+        throw std::runtime_error(
+            "The wavefront integrator needs VK_KHR_ray_query");
+    }
+    if (settings.integrator == Integrator::Wavefront &&
+        !supportsSubgroupBallot()) {
+        throw std::runtime_error(
+            "The wavefront integrator needs subgroup ballots in compute");
+    }
+
+    // Nothing may still use the old pipeline or its shader binding tables
+    vkDeviceWaitIdle(*m_deviceHandler);
+    vkDestroyPipeline(*m_deviceHandler, pipeline, nullptr);
+    vkDestroyPipeline(*m_deviceHandler, spatialReusePipeline, nullptr);
+    vkDestroyPipeline(*m_deviceHandler, accumulationPipeline, nullptr);
+    for (VkPipeline denoiserPipeline : denoiserPipelines) {
+        vkDestroyPipeline(*m_deviceHandler, denoiserPipeline, nullptr);
+    }
+    for (VkPipeline &wavefrontPipeline : wavefrontPipelines) {
+        vkDestroyPipeline(*m_deviceHandler, wavefrontPipeline, nullptr);
+        wavefrontPipeline = VK_NULL_HANDLE;
+    }
+    shaderBindingTables.raygen.destroy();
+    shaderBindingTables.miss.destroy();
+    shaderBindingTables.hit.destroy();
+    shaderBindingTables.shade.destroy();
+
+    // Reservoirs and frames of different settings do not mix
+    m_restirHistory = false;
+    resetAccumulation();
+    const QualitySettings previous = m_quality;
+    m_quality = settings;
+    m_quality.denoiseIterations = std::max(m_quality.denoiseIterations, 1U);
+    // The wavefront stages write the pixels restir_shade.rgen shades, but
+    // pick no reservoirs
+    if (m_quality.integrator == Integrator::Wavefront) {
+        m_quality.restir = VK_FALSE;
+        m_quality.restirGI = VK_FALSE;
+    }
+    m_clampShadowRays();
+    const bool giChanged = m_quality.restirGI != previous.restirGI;
+    const bool denoiseChanged = m_quality.denoise != previous.denoise;
+    // The shadow ray regions are sized by the lights per hit
+    const bool wavefrontChanged =
+        m_quality.integrator != previous.integrator ||
+        m_quality.lightsPerHit != previous.lightsPerHit;
+    m_createPipeline();
+    createShaderBindingTables();
+
+    // The GI buffer only exists with ReSTIR GI
+    if (giChanged) {
+        cleanupReSTIRBuffer();
+        setupReSTIRBuffer();
+    }
+    // The denoiser buffers only exist with the denoiser
+    if (denoiseChanged) {
+        cleanupDenoiser();
+        setupDenoiser();
+    }
+    // The wavefront buffer only exists with the wavefront path tracer
+    if (wavefrontChanged) {
+        cleanupWavefront();
+        setupWavefront();
+    }
+    if (giChanged || denoiseChanged || wavefrontChanged) {
+        updateDescriptorSets();
+    }
+}
+
+VkResult Raytracer::Buffer::map(VkDeviceSize offset) {
+    // Host visible memory stays mapped for the lifetime of its block
+    if (memory.mapped == nullptr) {
+        return VK_ERROR_MEMORY_MAP_FAILED;
+    }
+    mapped = static_cast<uint8_t *>(memory.mapped) + offset;
+    return VK_SUCCESS;
 }
 
 void Raytracer::setupLightsBuffer() {
@@ -551,7 +1711,24 @@ void Raytracer::setupLightsBuffer() {
         return;
     }
 
-    lights.size = lights.lights.size() * sizeof(glm::vec4);
+    // The hit shader picks lights through these instead of looping over all
+    // of them, see light_sampling.glsl
+    std::vector<light_sampler::AliasEntry> aliasTable =
+        light_sampler::buildAliasTable(lights.lights);
+    std::vector<light_sampler::LightNode> bvh =
+        light_sampler::buildBvh(lights.lights);
+
+    // All three share one buffer, each at an offset it can be bound at
+    const VkDeviceSize alignment =
+        m_deviceHandler->properties.limits.minStorageBufferOffsetAlignment;
+    const VkDeviceSize lightsSize = lights.lights.size() * sizeof(glm::vec4);
+    const VkDeviceSize aliasTableSize =
+        aliasTable.size() * sizeof(light_sampler::AliasEntry);
+    const VkDeviceSize bvhSize = bvh.size() * sizeof(light_sampler::LightNode);
+    lights.aliasTableOffset = utils::alignedSize(lightsSize, alignment);
+    lights.bvhOffset =
+        utils::alignedSize(lights.aliasTableOffset + aliasTableSize, alignment);
+    lights.size = lights.bvhOffset + bvhSize;
 
     lights.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
     lights.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
@@ -560,91 +1737,277 @@ void Raytracer::setupLightsBuffer() {
 
     VK_CHECK(m_deviceHandler->createBuffer(
         lights.usageFlags, lights.memoryPropertyFlags, lights.size,
-        &lights.buffer, &lights.memory, lights.mapped));
+        &lights.buffer, &lights.memory, nullptr));
 
-    if (descriptorSet == VK_NULL_HANDLE) {
+    lights.mapped = lights.memory.mapped;
+    auto *mapped = static_cast<uint8_t *>(lights.mapped);
+    memcpy(mapped, lights.lights.data(), lightsSize);
+    memcpy(mapped + lights.aliasTableOffset, aliasTable.data(),
+           aliasTableSize);
+    memcpy(mapped + lights.bvhOffset, bvh.data(), bvhSize);
+
+    if (descriptorSets.empty()) {
         return;
     }
 
-    vkMapMemory(*m_deviceHandler, lights.memory, 0, lights.size, 0,
-                &lights.mapped);
-    memcpy(&lights.mapped, lights.lights.data(), (size_t)lights.size);
+    updateDescriptorSets();
+}
 
-    VkMappedMemoryRange mappedRange = {};
-    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = this->lights.memory;
-    mappedRange.offset = 0;
-    mappedRange.size = this->lights.size;
-    VK_CHECK(
-        vkFlushMappedMemoryRanges(*this->m_deviceHandler, 1, &mappedRange));
+void Raytracer::setupReSTIRBuffer() {
+    // Every frame in flight gets its own segment, aligned so it can be bound
+    // at an offset
+    restirBuffer.segmentSize = utils::alignedSize(
+        static_cast<VkDeviceSize>(extent.width) * extent.height *
+            sizeof(ReSTIRPixel),
+        m_deviceHandler->properties.limits.minStorageBufferOffsetAlignment);
+    restirBuffer.size = restirBuffer.segmentSize * MAX_FRAMES_IN_FLIGHT;
 
-    updateUniformBuffers();
+    // Only the shaders touch the pixels
+    restirBuffer.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    restirBuffer.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 
-    VkDescriptorBufferInfo lightsBufferDescriptor{this->lights.buffer, 0,
-                                                  VK_WHOLE_SIZE};
-
-    std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
-        // Binding 3: Scene index buffer
-        create_info::writeDescriptorSet(this->descriptorSet,
-                                        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3,
-                                        &lightsBufferDescriptor),
-    };
+    VK_CHECK(m_deviceHandler->createBuffer(
+        restirBuffer.usageFlags, restirBuffer.memoryPropertyFlags,
+        restirBuffer.size, &restirBuffer.buffer, &restirBuffer.memory,
+        nullptr));
+
+    if (m_quality.restirGI == VK_TRUE) {
+        giBuffer.segmentSize = utils::alignedSize(
+            static_cast<VkDeviceSize>(extent.width) * extent.height *
+                sizeof(GIPixel),
+            m_deviceHandler->properties.limits
+                .minStorageBufferOffsetAlignment);
+        giBuffer.size = giBuffer.segmentSize * MAX_FRAMES_IN_FLIGHT;
+        giBuffer.usageFlags = restirBuffer.usageFlags;
+        giBuffer.memoryPropertyFlags = restirBuffer.memoryPropertyFlags;
+
+        VK_CHECK(m_deviceHandler->createBuffer(
+            giBuffer.usageFlags, giBuffer.memoryPropertyFlags, giBuffer.size,
+            &giBuffer.buffer, &giBuffer.memory, nullptr));
+    }
 
-    vkUpdateDescriptorSets(*m_deviceHandler,
-                           static_cast<uint32_t>(writeDescriptorSets.size()),
-                           writeDescriptorSets.data(), 0, VK_NULL_HANDLE);
+    // The new segments hold no history
+    m_restirHistory = false;
 }
 
-void Raytracer::setupColorsBuffer(bool setupDescr) {
-    colorBuffer.size = m_swapChain->swapChainExtent.width *
-                       m_swapChain->swapChainExtent.height * sizeof(glm::vec4) *
-                       2;
+void Raytracer::cleanupReSTIRBuffer() {
+    for (ReSTIRBuffer *buffer : {&restirBuffer, &giBuffer}) {
+        if (buffer->buffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(*m_deviceHandler, buffer->buffer, nullptr);
+        }
 
-    colorBuffer.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-    colorBuffer.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        m_deviceHandler->freeMemory(buffer->memory);
 
-    VK_CHECK(m_deviceHandler->createBuffer(
-        colorBuffer.usageFlags, colorBuffer.memoryPropertyFlags,
-        colorBuffer.size, &colorBuffer.buffer, &colorBuffer.memory, nullptr));
+        buffer->buffer = VK_NULL_HANDLE;
+    }
+}
 
-    if (!setupDescr) {
+void Raytracer::setupDenoiser() {
+    if (m_quality.denoise != VK_TRUE) {
         return;
     }
 
-    VkDescriptorBufferInfo colorBufferDescriptorInfo{this->colorBuffer.buffer,
-                                                     0, VK_WHOLE_SIZE};
+    // The history is segmented like the ReSTIR pixels, the wavelet passes
+    // ping-pong between two segments
+    const VkDeviceSize alignment =
+        m_deviceHandler->properties.limits.minStorageBufferOffsetAlignment;
+    const VkDeviceSize pixelCount =
+        static_cast<VkDeviceSize>(extent.width) * extent.height;
+    denoiserBuffer.segmentSize =
+        utils::alignedSize(pixelCount * sizeof(DenoiserPixel), alignment);
+    denoiserBuffer.size = denoiserBuffer.segmentSize * MAX_FRAMES_IN_FLIGHT;
+    denoiserFilterBuffer.segmentSize =
+        utils::alignedSize(pixelCount * sizeof(glm::vec4), alignment);
+    denoiserFilterBuffer.size = denoiserFilterBuffer.segmentSize * 2;
+
+    for (ReSTIRBuffer *buffer : {&denoiserBuffer, &denoiserFilterBuffer}) {
+        buffer->usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        buffer->memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        VK_CHECK(m_deviceHandler->createBuffer(
+            buffer->usageFlags, buffer->memoryPropertyFlags, buffer->size,
+            &buffer->buffer, &buffer->memory, nullptr));
+    }
+
+    // The new segments hold no history
+    frameConstants.denoiserHistory = 0;
+}
+
+void Raytracer::cleanupDenoiser() {
+    for (ReSTIRBuffer *buffer : {&denoiserBuffer, &denoiserFilterBuffer}) {
+        if (buffer->buffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(*m_deviceHandler, buffer->buffer, nullptr);
+        }
+
+        m_deviceHandler->freeMemory(buffer->memory);
+
+        buffer->buffer = VK_NULL_HANDLE;
+    }
+}
 
-    std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
-        // Binding 8: Scene color buffer
-        create_info::writeDescriptorSet(this->descriptorSet,
-                                        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8,
-                                        &colorBufferDescriptorInfo),
+void Raytracer::setupWavefront() {
+    if (m_quality.integrator != Integrator::Wavefront) {
+        return;
+    }
+
+    // One path per pixel, every hit has a shadow ray slot per sampled light
+    wavefront.pathCount = extent.width * extent.height;
+    const VkDeviceSize paths = wavefront.pathCount;
+    const VkDeviceSize shadowRays =
+        paths * std::max(m_quality.lightsPerHit, 1U);
+    const VkDeviceSize materials =
+        std::max<VkDeviceSize>(scene->materials.size(), 1);
+    wavefront.ranges = {
+        sizeof(WavefrontQueues),
+        paths * sizeof(WavefrontPath),
+        2 * paths * sizeof(WavefrontRay),
+        paths * sizeof(WavefrontHit),
+        paths * sizeof(uint32_t),
+        paths * sizeof(WavefrontSurface),
+        shadowRays * sizeof(WavefrontShadowRay),
+        shadowRays * sizeof(uint32_t),
+        materials * sizeof(glm::uvec2),
     };
 
-    vkUpdateDescriptorSets(*m_deviceHandler,
-                           static_cast<uint32_t>(writeDescriptorSets.size()),
-                           writeDescriptorSets.data(), 0, VK_NULL_HANDLE);
+    // Every region at an offset it can be bound at
+    const VkDeviceSize alignment =
+        m_deviceHandler->properties.limits.minStorageBufferOffsetAlignment;
+    wavefront.size = 0;
+    for (uint32_t i = 0; i < WAVEFRONT_BINDING_COUNT; i++) {
+        wavefront.offsets[i] = utils::alignedSize(wavefront.size, alignment);
+        wavefront.size = wavefront.offsets[i] + wavefront.ranges[i];
+    }
+
+    // The queues at the start double as the indirect dispatch arguments
+    VK_CHECK(m_deviceHandler->createBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, wavefront.size, &wavefront.buffer,
+        &wavefront.memory, nullptr));
 }
 
-void Raytracer::cleanupColorsBuffer() {
-    // if (colorBuffer.memory != VK_NULL_HANDLE) {
-    //     vkUnmapMemory(*m_deviceHandler, colorBuffer.memory);
-    // }
+void Raytracer::cleanupWavefront() {
+    if (wavefront.buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(*m_deviceHandler, wavefront.buffer, nullptr);
+    }
+
+    m_deviceHandler->freeMemory(wavefront.memory);
+
+    wavefront.buffer = VK_NULL_HANDLE;
+}
+
+void Raytracer::setupAccumulation() {
+    VkImageCreateInfo image = create_info::imageCreateInfo(
+        VK_IMAGE_TYPE_2D, ACCUMULATION_FORMAT, VK_IMAGE_USAGE_STORAGE_BIT);
+    image.extent = {extent.width, extent.height, 1};
+    image.mipLevels = 1;
+    image.arrayLayers = 1;
+    image.samples = VK_SAMPLE_COUNT_1_BIT;
+    image.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VK_CHECK(vkCreateImage(*m_deviceHandler, &image, nullptr,
+                           &accumulation.image.image));
+    accumulation.image.format = ACCUMULATION_FORMAT;
+
+    m_deviceHandler->allocateImageMemory(accumulation.image.image,
+                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                         &accumulation.image.memory);
+
+    VkImageViewCreateInfo imageView{};
+    imageView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    imageView.format = ACCUMULATION_FORMAT;
+    imageView.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    imageView.image = accumulation.image.image;
+    VK_CHECK(vkCreateImageView(*m_deviceHandler, &imageView, nullptr,
+                               &accumulation.image.view));
+
+    VkCommandBuffer cmdBuffer = m_commandBuffer->createCommandBuffer(
+        VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    utils::setImageLayout(cmdBuffer, accumulation.image.image,
+                          VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                          {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    m_commandBuffer->flushCommandBuffer(cmdBuffer,
+                                        m_deviceHandler->getTransferQueue());
+
+    // One error per tile and frame in flight, read back by the host
+    const VkDeviceSize tileCount =
+        static_cast<VkDeviceSize>(
+            (extent.width + ACCUMULATION_TILE_SIZE - 1) /
+            ACCUMULATION_TILE_SIZE) *
+        ((extent.height + ACCUMULATION_TILE_SIZE - 1) / ACCUMULATION_TILE_SIZE);
+    accumulation.tileSegmentSize = utils::alignedSize(
+        tileCount * sizeof(float),
+        m_deviceHandler->properties.limits.minStorageBufferOffsetAlignment);
+    Buffer &tiles = accumulation.tiles;
+    tiles.size = accumulation.tileSegmentSize * MAX_FRAMES_IN_FLIGHT;
+    VK_CHECK(m_deviceHandler->createBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        tiles.size, &tiles.buffer, &tiles.memory, nullptr));
+    VK_CHECK(tiles.map());
+
+    accumulation.tileFrames.assign(MAX_FRAMES_IN_FLIGHT, 0);
+    resetAccumulation();
+}
 
-    if (colorBuffer.buffer != VK_NULL_HANDLE) {
-        vkFreeMemory(*m_deviceHandler, colorBuffer.memory, nullptr);
+void Raytracer::cleanupAccumulation() {
+    if (accumulation.image.image != VK_NULL_HANDLE) {
+        vkDestroyImageView(*m_deviceHandler, accumulation.image.view, nullptr);
+        vkDestroyImage(*m_deviceHandler, accumulation.image.image, nullptr);
+        m_deviceHandler->freeMemory(accumulation.image.memory);
+        accumulation.image = {};
     }
+    accumulation.tiles.destroy(*m_deviceHandler);
+}
+
+void Raytracer::resetAccumulation() {
+    accumulation.frames = 0;
+    accumulation.estimatedFrames = 0;
+    accumulation.samplesPerPixel = 0;
+    accumulation.noise = 0.0F;
+    accumulation.converged = false;
+    // Frames in flight still estimate the old image
+    std::fill(accumulation.tileFrames.begin(), accumulation.tileFrames.end(),
+              0);
+}
 
-    if (colorBuffer.buffer != VK_NULL_HANDLE) {
-        vkDestroyBuffer(*m_deviceHandler, colorBuffer.buffer, nullptr);
+void Raytracer::m_collectAccumulation(uint32_t frame) {
+    const uint32_t frames = accumulation.tileFrames[frame];
+    accumulation.tileFrames[frame] = 0;
+    if (frames <= accumulation.estimatedFrames) {
+        return;
     }
+
+    const auto *errors = reinterpret_cast<const float *>(
+        static_cast<uint8_t *>(accumulation.tiles.mapped) +
+        frame * accumulation.tileSegmentSize);
+    const uint32_t tileCount =
+        ((extent.width + ACCUMULATION_TILE_SIZE - 1) / ACCUMULATION_TILE_SIZE) *
+        ((extent.height + ACCUMULATION_TILE_SIZE - 1) / ACCUMULATION_TILE_SIZE);
+    accumulation.noise = *std::max_element(errors, errors + tileCount);
+
+    // ReSTIR GI traces a single path per pixel
+    const uint32_t samples =
+        m_quality.restirGI == VK_TRUE ? 1 : m_quality.samples;
+    accumulation.estimatedFrames = frames;
+    accumulation.samplesPerPixel = frames * samples;
+    accumulation.converged = accumulation.targetNoise > 0.0F &&
+                             frames >= ACCUMULATION_MIN_FRAMES &&
+                             accumulation.noise <= accumulation.targetNoise;
 }
 
 void Raytracer::updateLightsBuffer(std::vector<glm::vec4> newLights) {
+    // Frames in flight may still read the old buffer
+    vkDeviceWaitIdle(*m_deviceHandler);
+
     cleanupLightsBuffer();
     this->lights.lights = std::move(newLights);
     setupLightsBuffer();
+
+    // The reservoirs point at the old lights
+    m_restirHistory = false;
+    resetAccumulation();
 }
 
 void Raytracer::cleanupLightsBuffer() {
@@ -652,30 +2015,20 @@ void Raytracer::cleanupLightsBuffer() {
         vkDestroyBuffer(*m_deviceHandler, lights.buffer, nullptr);
     }
 
-    if (lights.memory != VK_NULL_HANDLE) {
-        vkUnmapMemory(*m_deviceHandler, lights.memory);
-    }
+    m_deviceHandler->freeMemory(lights.memory);
 
-    if (lights.buffer != VK_NULL_HANDLE) {
-        vkFreeMemory(*m_deviceHandler, lights.memory, nullptr);
-    }
+    lights.buffer = VK_NULL_HANDLE;
+    lights.mapped = nullptr;
 }
 
 /*
-    Create the uniform buffer used to pass matrices to the ray tracing ray
-   generation shader
+    Create the uniform ring used to pass matrices to the ray tracing shaders.
+   Each frame in flight pushes into its own arena, so the host never writes
+   data the device is reading
 */
-void Raytracer::createUniformBuffer() {
-    VK_CHECK(m_deviceHandler->createBuffer(
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        sizeof(UniformData), &ubo.buffer, &ubo.memory, nullptr));
-    VK_CHECK(ubo.map(*m_deviceHandler));
-
-    ubo.descriptor.offset = 0;
-    ubo.descriptor.buffer = ubo.buffer;
-    ubo.descriptor.range = sizeof(UniformData);
+void Raytracer::createUniformRing() {
+    uniformRing = std::make_unique<uniform_ring::UniformRing>(
+        m_deviceHandler, MAX_FRAMES_IN_FLIGHT, UNIFORM_ARENA_SIZE);
 
     updateUniformBuffers();
 }
@@ -685,8 +2038,7 @@ void Raytracer::updateUniformBuffers() {
     uniformData.viewInverse = glm::inverse(glm::identity<glm::mat4>());
     uniformData.lightsCount = lights.lights.size();
     // Pass the vertex size to the shader for unpacking vertices
-    uniformData.vertexSize = sizeof(gltf_model::Vertex);
-    memcpy(ubo.mapped, &uniformData, sizeof(uniformData));
+    uniformData.vertexSize = sizeof(gltf_model::PackedVertex);
 }
 
 void Raytracer::updateUniformBuffers(glm::mat4 proj, glm::mat4 view) {
@@ -694,12 +2046,16 @@ void Raytracer::updateUniformBuffers(glm::mat4 proj, glm::mat4 view) {
         1.0F, 0.0F, 0.0F, 0.0F, 0.0F, -1.0F, 0.0F, 0.0F,
         0.0F, 0.0F, 1.0F, 0.0F, 0.0F, 0.0F,  0.0F, 1.0F,
     };
-    uniformData.projInverse = glm::inverse(proj);
-    uniformData.viewInverse = glm::inverse(view * invYAxisMatrix);
-    uniformData.width = m_swapChain->swapChainExtent.width;
+    const glm::mat4 projInverse = glm::inverse(proj);
+    const glm::mat4 viewInverse = glm::inverse(view * invYAxisMatrix);
+    if (projInverse != uniformData.projInverse ||
+        viewInverse != uniformData.viewInverse) {
+        resetAccumulation();
+    }
+    uniformData.projInverse = projInverse;
+    uniformData.viewInverse = viewInverse;
     uniformData.lightsCount = lights.lights.size();
-    uniformData.vertexSize = sizeof(gltf_model::Vertex);
-    memcpy(ubo.mapped, &uniformData, sizeof(uniformData));
+    uniformData.vertexSize = sizeof(gltf_model::PackedVertex);
 }
 
 void Raytracer::handleResize() {
@@ -708,35 +2064,26 @@ void Raytracer::handleResize() {
     m_swapChain->cleanup();
     m_swapChain->init();
     updateRenderPass();
+    extent = m_swapChain->swapChainExtent;
 
-    vkDeviceWaitIdle(*m_deviceHandler);
-
-    cleanupColorsBuffer();
-    setupColorsBuffer();
+    cleanupReSTIRBuffer();
+    setupReSTIRBuffer();
+    cleanupAccumulation();
+    setupAccumulation();
+    cleanupDenoiser();
+    setupDenoiser();
+    cleanupWavefront();
+    setupWavefront();
 
-    uint32_t width = this->m_swapChain->swapChainExtent.width;
-    uint32_t height = this->m_swapChain->swapChainExtent.height;
     createStorageImage(this->m_swapChain->swapChainImageFormat,
-                       {width, height, 1});
-
-    VkDescriptorImageInfo storageImageDescriptor{
-        VK_NULL_HANDLE, storageImage.view, VK_IMAGE_LAYOUT_GENERAL};
-
-    VkWriteDescriptorSet resultImageWrite = create_info::writeDescriptorSet(
-        descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1,
-        &storageImageDescriptor);
-
-    vkUpdateDescriptorSets(*m_deviceHandler, 1, &resultImageWrite, 0,
-                           VK_NULL_HANDLE);
+                       {extent.width, extent.height, 1});
 
-    clearCommandBuffers();
-    makeCommandBuffers();
-    buildCommandBuffers();
-    updateUniformBuffers();
+    // Command buffers are recorded per frame and pick up the new extent
+    updateDescriptorSets();
 }
 
 void Raytracer::makeCommandBuffers() {
-    drawCmdBuffers.resize(m_swapChain->swapChainFramebuffers.size());
+    drawCmdBuffers.resize(MAX_FRAMES_IN_FLIGHT);
     VkCommandBufferAllocateInfo allocInfo = create_info::commandBufferAllocInfo(
         m_commandBuffer->commandPool, drawCmdBuffers.size());
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
@@ -752,98 +2099,356 @@ void Raytracer::clearCommandBuffers() {
     drawCmdBuffers.clear();
 }
 
-void Raytracer::buildCommandBuffers() {
-    uint32_t width = m_swapChain->swapChainExtent.width;
-    uint32_t height = m_swapChain->swapChainExtent.height;
+void Raytracer::recordCommandBuffer(uint32_t frame, uint32_t imageIndex) {
+    uint32_t width = extent.width;
+    uint32_t height = extent.height;
+    VkCommandBuffer cmdBuffer = drawCmdBuffers[frame];
 
     VkCommandBufferBeginInfo cmdBufInfo = create_info::commandBufferBeginInfo();
+    cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
     VkImageSubresourceRange subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1,
                                                 0, 1};
 
-    for (size_t i = 0; i < drawCmdBuffers.size(); ++i) {
-        VK_CHECK(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+    VK_CHECK(vkResetCommandBuffer(cmdBuffer, 0));
+    VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &cmdBufInfo));
 
-        /*
-            Dispatch the ray tracing commands
-        */
-        vkCmdBindPipeline(drawCmdBuffers[i],
-                          VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipeline);
+    // The previous frame's writes to its ReSTIR buffer segment and the
+    // storage image have to land before this frame reads or overwrites them
+    const VkPipelineStageFlags shaderStages =
+        VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR |
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkMemoryBarrier memoryBarrier = create_info::memoryBarrier();
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask =
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, shaderStages, shaderStages, 0, 1,
+                         &memoryBarrier, 0, nullptr, 0, nullptr);
 
-        vkCmdBindDescriptorSets(
-            drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR,
-            pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    updateTopLevelAccelerationStructure(cmdBuffer, frame);
 
+    /*
+        Dispatch the ray tracing commands
+    */
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR,
+                      pipeline);
+
+    // Reprojects this frame's hits into the pixels of the last one
+    const glm::mat4 viewProjection = glm::inverse(uniformData.projInverse) *
+                                     glm::inverse(uniformData.viewInverse);
+    uniformData.prevViewProjection = m_viewProjection;
+    uniformData.restirHistory = m_restirHistory ? 1 : 0;
+    m_viewProjection = viewProjection;
+    const bool restir =
+        m_quality.restir == VK_TRUE || m_quality.restirGI == VK_TRUE;
+    // A converged image is only copied, the skipped frames leave no history
+    const bool trace = !(accumulation.enabled && accumulation.converged);
+    // Accumulated frames are clean without it, see restir_shade.rgen
+    const bool denoise = m_quality.denoise == VK_TRUE && !accumulation.enabled;
+    m_restirHistory = (restir || denoise) && trace;
+    if (!accumulation.enabled) {
+        accumulation.frames = 0;
+    }
+
+    uniformRing->beginFrame(frame);
+    uint32_t uniformOffset = uniformRing->push(uniformData);
+
+    std::array<VkDescriptorSet, 2> sets = {descriptorSets[frame],
+                                           uniformDescriptorSet};
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR,
+                            pipelineLayout, 0, sets.size(), sets.data(), 1,
+                            &uniformOffset);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayout, 0, sets.size(), sets.data(), 1,
+                            &uniformOffset);
+
+    frameConstants.width = static_cast<int32_t>(width);
+    frameConstants.height = static_cast<int32_t>(height);
+    frameConstants.accumulate = accumulation.enabled ? 1 : 0;
+    frameConstants.accumulatedFrames = accumulation.frames;
+    vkCmdPushConstants(cmdBuffer, pipelineLayout, PUSH_CONSTANT_STAGES, 0,
+                       sizeof(FrameConstants), &frameConstants);
+    frameConstants.frameIndex++;
+
+    uint32_t profilerSlot = frame + 1;
+
+    // Each pass reads the pixels the one before it wrote
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    if (trace) {
+        // Paths, initial candidates and temporal reuse
         VkStridedDeviceAddressRegionKHR emptySbtEntry = {};
-        vkCmdTraceRaysKHR(
-            drawCmdBuffers[i],
-            &shaderBindingTables.raygen.stridedDeviceAddressRegion,
-            &shaderBindingTables.miss.stridedDeviceAddressRegion,
-            &shaderBindingTables.hit.stridedDeviceAddressRegion, &emptySbtEntry,
-            width, height, 1);
-
-        /*
-            Copy ray tracing output to swap chain image
-        */
-
-        // Prepare current swap chain image as transfer destination
-        utils::setImageLayout(
-            drawCmdBuffers[i], m_swapChain->swapChainImages[i],
-            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            subresourceRange);
-
-        // Prepare ray tracing output image as transfer source
-        utils::setImageLayout(
-            drawCmdBuffers[i], storageImage.image, VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, subresourceRange);
-
-        VkImageCopy copyRegion{};
-        copyRegion.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-        copyRegion.srcOffset = {0, 0, 0};
-        copyRegion.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-        copyRegion.dstOffset = {0, 0, 0};
-        copyRegion.extent = {width, height, 1};
-        vkCmdCopyImage(drawCmdBuffers[i], storageImage.image,
-                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                       m_swapChain->swapChainImages[i],
-                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-        // Transition swap chain image back for presentation
-        utils::setImageLayout(
-            drawCmdBuffers[i], m_swapChain->swapChainImages[i],
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, subresourceRange);
-
-        // Transition ray tracing output image back to general layout
-        utils::setImageLayout(drawCmdBuffers[i], storageImage.image,
-                              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                              VK_IMAGE_LAYOUT_GENERAL, subresourceRange);
-
-        // drawUI(drawCmdBuffers[i], m_swapChain->swapChainFramebuffers[i]);
-
-        VK_CHECK(vkEndCommandBuffer(drawCmdBuffers[i]));
-    }
-}
-
-void Raytracer::prepareFrame() {
-    vkWaitForFences(m_deviceHandler->logicalDevice, 1,
-                    &m_swapChain->inFlightFences[curFrame], VK_TRUE,
-                    UINT64_MAX);
+        profiler->beginPass(cmdBuffer, profilerSlot, profilerPasses.trace);
+        if (m_quality.integrator == Integrator::Wavefront) {
+            m_recordWavefront(cmdBuffer);
+        } else {
+            vkCmdTraceRaysKHR(
+                cmdBuffer,
+                &shaderBindingTables.raygen.stridedDeviceAddressRegion,
+                &shaderBindingTables.miss.stridedDeviceAddressRegion,
+                &shaderBindingTables.hit.stridedDeviceAddressRegion,
+                &emptySbtEntry, width, height, 1);
+        }
+        profiler->endPass(cmdBuffer, profilerSlot, profilerPasses.trace);
+
+        // Spatial reuse
+        if (restir) {
+            vkCmdPipelineBarrier(cmdBuffer,
+                                 VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                                 &memoryBarrier, 0, nullptr, 0, nullptr);
+
+            profiler->beginPass(cmdBuffer, profilerSlot,
+                                profilerPasses.restirSpatial);
+            vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                              spatialReusePipeline);
+            vkCmdDispatch(
+                cmdBuffer,
+                (width + RESTIR_WORKGROUP_SIZE - 1) / RESTIR_WORKGROUP_SIZE,
+                (height + RESTIR_WORKGROUP_SIZE - 1) / RESTIR_WORKGROUP_SIZE,
+                1);
+            profiler->endPass(cmdBuffer, profilerSlot,
+                              profilerPasses.restirSpatial);
+        }
 
-    VkResult result = m_swapChain->getNextImage(curFrame, &imageIdx);
+        // One shadow ray per pixel and the final color
+        vkCmdPipelineBarrier(cmdBuffer, shaderStages,
+                             VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1,
+                             &memoryBarrier, 0, nullptr, 0, nullptr);
+        profiler->beginPass(cmdBuffer, profilerSlot, profilerPasses.shade);
+        vkCmdTraceRaysKHR(cmdBuffer,
+                          &shaderBindingTables.shade.stridedDeviceAddressRegion,
+                          &shaderBindingTables.miss.stridedDeviceAddressRegion,
+                          &shaderBindingTables.hit.stridedDeviceAddressRegion,
+                          &emptySbtEntry, width, height, 1);
+        profiler->endPass(cmdBuffer, profilerSlot, profilerPasses.shade);
+
+        // The error of every tile, read back once the frame is done
+        if (accumulation.enabled) {
+            vkCmdPipelineBarrier(cmdBuffer,
+                                 VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                                 &memoryBarrier, 0, nullptr, 0, nullptr);
+            profiler->beginPass(cmdBuffer, profilerSlot,
+                                profilerPasses.accumulationTiles);
+            vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                              accumulationPipeline);
+            vkCmdDispatch(cmdBuffer,
+                          (width + ACCUMULATION_TILE_SIZE - 1) /
+                              ACCUMULATION_TILE_SIZE,
+                          (height + ACCUMULATION_TILE_SIZE - 1) /
+                              ACCUMULATION_TILE_SIZE,
+                          1);
+            profiler->endPass(cmdBuffer, profilerSlot,
+                              profilerPasses.accumulationTiles);
+
+            VkMemoryBarrier hostBarrier = create_info::memoryBarrier();
+            hostBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            vkCmdPipelineBarrier(cmdBuffer,
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                 VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier,
+                                 0, nullptr, 0, nullptr);
+
+            accumulation.frames++;
+            accumulation.tileFrames[frame] = accumulation.frames;
+        }
 
-    // Recreate the swapchain if it's no longer compatible with the surface
-    // (OUT_OF_DATE) SRS - If no longer optimal (VK_SUBOPTIMAL_KHR), wait
-    // until submitFrame() in case number of swapchain images will change on
-    // resize
-    if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
-        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-            handleResize();
+        // Temporal accumulation, variance estimation and the wavelet passes,
+        // each reading what the one before it wrote
+        if (denoise) {
+            const uint32_t groupsX =
+                (width + DENOISER_WORKGROUP_SIZE - 1) / DENOISER_WORKGROUP_SIZE;
+            const uint32_t groupsY = (height + DENOISER_WORKGROUP_SIZE - 1) /
+                                     DENOISER_WORKGROUP_SIZE;
+            vkCmdPipelineBarrier(cmdBuffer,
+                                 VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                                 &memoryBarrier, 0, nullptr, 0, nullptr);
+            profiler->beginPass(cmdBuffer, profilerSlot,
+                                profilerPasses.denoise);
+            for (uint32_t pass = 0; pass < 2; pass++) {
+                vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                  denoiserPipelines[pass]);
+                vkCmdDispatch(cmdBuffer, groupsX, groupsY, 1);
+                vkCmdPipelineBarrier(cmdBuffer,
+                                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                                     1, &memoryBarrier, 0, nullptr, 0,
+                                     nullptr);
+            }
+
+            vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                              denoiserPipelines[2]);
+            for (uint32_t step = 0; step < m_quality.denoiseIterations;
+                 step++) {
+                vkCmdPushConstants(cmdBuffer, pipelineLayout,
+                                   PUSH_CONSTANT_STAGES,
+                                   offsetof(FrameConstants, denoiseStep),
+                                   sizeof(uint32_t), &step);
+                vkCmdDispatch(cmdBuffer, groupsX, groupsY, 1);
+                vkCmdPipelineBarrier(cmdBuffer,
+                                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                                     1, &memoryBarrier, 0, nullptr, 0,
+                                     nullptr);
+            }
+            profiler->endPass(cmdBuffer, profilerSlot, profilerPasses.denoise);
         }
+        frameConstants.denoiserHistory = denoise ? 1 : 0;
+    }
+
+    // Headless frames stay in the storage image
+    if (isHeadless()) {
+        VK_CHECK(vkEndCommandBuffer(cmdBuffer));
         return;
     }
 
-    VK_CHECK(result);
+    /*
+        Copy ray tracing output to swap chain image
+    */
+    VkImage swapChainImage = m_swapChain->swapChainImages[imageIndex];
+    profiler->beginPass(cmdBuffer, profilerSlot, profilerPasses.copy);
+
+    // Prepare current swap chain image as transfer destination
+    utils::setImageLayout(cmdBuffer, swapChainImage, VK_IMAGE_LAYOUT_UNDEFINED,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          subresourceRange);
+
+    // Prepare ray tracing output image as transfer source
+    utils::setImageLayout(cmdBuffer, storageImage.image, VK_IMAGE_LAYOUT_GENERAL,
+                          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                          subresourceRange);
+
+    VkImageCopy copyRegion{};
+    copyRegion.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    copyRegion.srcOffset = {0, 0, 0};
+    copyRegion.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    copyRegion.dstOffset = {0, 0, 0};
+    copyRegion.extent = {width, height, 1};
+    vkCmdCopyImage(cmdBuffer, storageImage.image,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swapChainImage,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+
+    // Transition swap chain image back for presentation
+    utils::setImageLayout(cmdBuffer, swapChainImage,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, subresourceRange);
+
+    // Transition ray tracing output image back to general layout
+    utils::setImageLayout(cmdBuffer, storageImage.image,
+                          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                          VK_IMAGE_LAYOUT_GENERAL, subresourceRange);
+    profiler->endPass(cmdBuffer, profilerSlot, profilerPasses.copy);
+
+    VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+}
+
+/*
+    Every stage is dispatched over the queue the one before it filled. The
+   queue lengths never reach the host, the stages read them from the wavefront
+   buffer and the indirect dispatches their workgroup counts
+*/
+void Raytracer::m_recordWavefront(VkCommandBuffer cmdBuffer) {
+    enum Stage : uint32_t {
+        Generate,
+        Extend,
+        Scan,
+        Scatter,
+        Shade,
+        Shadow,
+        Connect
+    };
+
+    // A stage's writes, including the queue lengths, land before the next
+    // stage or indirect dispatch reads them
+    const VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                                        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+    VkMemoryBarrier barrier = create_info::memoryBarrier();
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+                            VK_ACCESS_SHADER_WRITE_BIT |
+                            VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    const auto dispatch = [&](Stage stage, VkDeviceSize queue) {
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          wavefrontPipelines[stage]);
+        vkCmdDispatchIndirect(cmdBuffer, wavefront.buffer,
+                              wavefront.offsets[0] + queue);
+        vkCmdPipelineBarrier(cmdBuffer, stages, stages, 0, 1, &barrier, 0,
+                             nullptr, 0, nullptr);
+    };
+
+    // The previous frame's stages are done with the buffer
+    vkCmdPipelineBarrier(cmdBuffer, stages, stages, 0, 1, &barrier, 0,
+                         nullptr, 0, nullptr);
+
+    const uint32_t generateGroups =
+        std::min((wavefront.pathCount + WAVEFRONT_WORKGROUP_SIZE - 1) /
+                     WAVEFRONT_WORKGROUP_SIZE,
+                 WAVEFRONT_MAX_GROUPS);
+    for (uint32_t sample = 0; sample < m_quality.samples; sample++) {
+        for (uint32_t bounce = 0; bounce < m_quality.maxReflections;
+             bounce++) {
+            const std::array<uint32_t, 2> position = {sample, bounce};
+            vkCmdPushConstants(cmdBuffer, pipelineLayout, PUSH_CONSTANT_STAGES,
+                               offsetof(FrameConstants, wavefrontSample),
+                               sizeof(position), position.data());
+
+            // Camera rays, the first sample also clears the pixels
+            if (bounce == 0) {
+                vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                  wavefrontPipelines[Generate]);
+                vkCmdDispatch(cmdBuffer, generateGroups, 1, 1);
+                vkCmdPipelineBarrier(cmdBuffer, stages, stages, 0, 1,
+                                     &barrier, 0, nullptr, 0, nullptr);
+            }
+
+            const VkDeviceSize parity = bounce % 2;
+            const VkDeviceSize rays = offsetof(WavefrontQueues, rays) +
+                                      parity * sizeof(glm::uvec4);
+            const VkDeviceSize hits = offsetof(WavefrontQueues, hits) +
+                                      parity * sizeof(glm::uvec4);
+            dispatch(Extend, rays);
+
+            // The material bins are few, one workgroup scans them all
+            vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                              wavefrontPipelines[Scan]);
+            vkCmdDispatch(cmdBuffer, 1, 1, 1);
+            vkCmdPipelineBarrier(cmdBuffer, stages, stages, 0, 1, &barrier, 0,
+                                 nullptr, 0, nullptr);
+
+            dispatch(Scatter, hits);
+            dispatch(Shade, hits);
+            if (m_quality.shadowRays == VK_TRUE) {
+                dispatch(Shadow, offsetof(WavefrontQueues, shadows));
+            }
+            dispatch(Connect, hits);
+        }
+    }
+}
+
+bool Raytracer::prepareFrame() {
+    // Only this frame's previous submission has to be done, the other frames
+    // in flight keep running
+    VK_CHECK(vkWaitForFences(m_deviceHandler->logicalDevice, 1,
+                             &m_swapChain->inFlightFences[curFrame], VK_TRUE,
+                             UINT64_MAX));
+
+    VkResult result = m_swapChain->getNextImage(curFrame, &imageIdx);
+
+    // Recreate the swapchain if it's no longer compatible with the surface
+    // (OUT_OF_DATE). If it is only no longer optimal (VK_SUBOPTIMAL_KHR) the
+    // image was still acquired, so render it and recreate in submitFrame()
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        handleResize();
+        return false;
+    }
+
+    if (result != VK_SUBOPTIMAL_KHR) {
+        VK_CHECK(result);
+    }
+    return true;
 }
 
 void Raytracer::submitFrame() {
@@ -869,21 +2474,23 @@ void Raytracer::submitFrame() {
     // (OUT_OF_DATE) or no longer optimal for presentation (SUBOPTIMAL)
     if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
         handleResize();
-        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-            return;
-        }
+        return;
     }
 
     VK_CHECK(result);
-    VK_CHECK(vkQueueWaitIdle(m_deviceHandler->presentQueue));
 }
 
 void Raytracer::renderFrame() {
-    curFrame = (curFrame + 1) % m_swapChain->swapChainFramebuffers.size();
-    prepareFrame();
+    if (!prepareFrame()) {
+        return;
+    }
+    profiler->collect();
+    m_collectAccumulation(curFrame);
+
+    VK_CHECK(vkResetFences(m_deviceHandler->logicalDevice, 1,
+                           &m_swapChain->inFlightFences[curFrame]));
 
-    vkResetFences(m_deviceHandler->logicalDevice, 1,
-                  &m_swapChain->inFlightFences[curFrame]);
+    recordCommandBuffer(curFrame, imageIdx);
 
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &drawCmdBuffers[curFrame];
@@ -896,15 +2503,107 @@ void Raytracer::renderFrame() {
 
     VK_CHECK(vkQueueSubmit(m_deviceHandler->graphicsQueue, 1, &submitInfo,
                            m_swapChain->inFlightFences[curFrame]));
+    profiler->markSubmitted(curFrame + 1);
 
     submitFrame();
+
+    curFrame = (curFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
-void Raytracer::Buffer::destroy(VkDevice device) const {
-    if (buffer != VK_NULL_HANDLE) {
-        vkDestroyBuffer(device, buffer, nullptr);
+void Raytracer::renderHeadlessFrame() {
+    // Only this frame's previous submission has to be done
+    VK_CHECK(vkWaitForFences(*m_deviceHandler, 1, &headlessFences[curFrame],
+                             VK_TRUE, DEFAULT_FENCE_TIMEOUT));
+    VK_CHECK(vkResetFences(*m_deviceHandler, 1, &headlessFences[curFrame]));
+    profiler->collect();
+    m_collectAccumulation(curFrame);
+
+    recordCommandBuffer(curFrame, 0);
+
+    VkSubmitInfo headlessSubmitInfo = create_info::submitInfo();
+    headlessSubmitInfo.commandBufferCount = 1;
+    headlessSubmitInfo.pCommandBuffers = &drawCmdBuffers[curFrame];
+
+    VK_CHECK(vkQueueSubmit(m_deviceHandler->graphicsQueue, 1,
+                           &headlessSubmitInfo, headlessFences[curFrame]));
+    profiler->markSubmitted(curFrame + 1);
+
+    curFrame = (curFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+}
+
+void Raytracer::renderHeadless(uint32_t frameCount) {
+    for (uint32_t i = 0; i < frameCount; i++) {
+        renderHeadlessFrame();
+    }
+
+    VK_CHECK(vkWaitForFences(*m_deviceHandler,
+                             static_cast<uint32_t>(headlessFences.size()),
+                             headlessFences.data(), VK_TRUE,
+                             DEFAULT_FENCE_TIMEOUT));
+    profiler->collect();
+    for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+        m_collectAccumulation(frame);
+    }
+}
+
+void Raytracer::m_init(VkFormat format) {
+    vkDeviceWaitIdle(*m_deviceHandler);
+
+    raytracer::RaytracerBase::prepare();
+
+    // One slot for setup work plus one per frame in flight
+    profiler = std::make_unique<gpu_profiler::GpuProfiler>(
+        m_deviceHandler, MAX_FRAMES_IN_FLIGHT + 1, PROFILER_MAX_PASSES);
+    profilerPasses.trace = profiler->registerPass("trace");
+    profilerPasses.restirSpatial = profiler->registerPass("restir spatial");
+    profilerPasses.shade = profiler->registerPass("shade");
+    profilerPasses.accumulationTiles =
+        profiler->registerPass("accumulation tiles");
+    profilerPasses.denoise = profiler->registerPass("denoise");
+    profilerPasses.copy = profiler->registerPass("copy");
+    profilerPasses.blasBuild = profiler->registerPass("blas build");
+    profilerPasses.blasCompaction = profiler->registerPass("blas compaction");
+    profilerPasses.tlasBuild = profiler->registerPass("tlas build");
+    profilerPasses.tlasUpdate = profiler->registerPass("tlas update");
+
+    if (!m_asCacheDirectory.empty()) {
+        asCache = std::make_unique<as_cache::AccelerationStructureCache>(
+            *m_deviceHandler, m_asCacheDirectory);
     }
-    if (memory != VK_NULL_HANDLE) {
-        vkFreeMemory(device, memory, nullptr);
+
+    createMaterialBuffer();
+    createBlueNoiseTexture();
+    createBottomLevelAccelerationStructures();
+    createTopLevelAccelerationStructure();
+    createUniformRing();
+    setupReSTIRBuffer();
+    setupAccumulation();
+    setupDenoiser();
+    setupWavefront();
+
+    createStorageImage(format, {extent.width, extent.height, 1});
+
+    submitInfo = create_info::submitInfo();
+    submitInfo.pWaitDstStageMask = &waitStages;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.signalSemaphoreCount = 1;
+
+    setupLightsBuffer();
+
+    // The default settings go through the same clamp as setQuality
+    m_clampShadowRays();
+    createRayTracingPipeline();
+    createShaderBindingTables();
+    createDescriptorSets();
+
+    makeCommandBuffers();
+}
+
+void Raytracer::Buffer::destroy(const device::DeviceHandler &deviceHandler) {
+    if (buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(deviceHandler, buffer, nullptr);
+        buffer = VK_NULL_HANDLE;
     }
+    deviceHandler.freeMemory(memory);
+    mapped = nullptr;
 }
@@ -1,8 +1,18 @@
 #include "common.hpp"
 #include "gltf_model/model.hpp"
+#include "vulkan_utils/as_cache.hpp"
+#include "vulkan_utils/blue_noise.hpp"
+#include "vulkan_utils/buffer.hpp"
 #include "vulkan_utils/create_info.hpp"
+#include "vulkan_utils/gpu_profiler.hpp"
+#include "vulkan_utils/light_sampler.hpp"
 #include "vulkan_utils/raytracer_base.hpp"
+#include "vulkan_utils/texture.hpp"
 #include "vulkan_utils/uniform_buffer.hpp"
+#include "vulkan_utils/uniform_ring.hpp"
+
+#include <array>
+
 /**
  * \class Raytracer
  * \brief A class representing a raytracer for Vulkan-based rendering.
@@ -21,6 +31,8 @@ class Raytracer : public raytracer::RaytracerBase {
      * \param m_commandBuffer A shared pointer to a CommandBufferHandler object.
      * \param m_model A shared pointer to a Model object representing the scene.
      * \param window A pointer to the GLFW window used for rendering.
+     * \param asCacheDirectory Where serialized BLASes are cached, empty to
+     * always build them.
      *
      * This constructor initializes the Raytracer object by setting up the base
      * class, preparing for rendering, creating acceleration structures, a
@@ -31,40 +43,53 @@ class Raytracer : public raytracer::RaytracerBase {
         std::shared_ptr<device::DeviceHandler> m_deviceHandler,
         std::shared_ptr<swap_chain::DepthBufferSwapChain> m_swapChain,
         std::shared_ptr<command_buffer::CommandBufferHandler> m_commandBuffer,
-        std::shared_ptr<gltf_model::Model> m_model, GLFWwindow *window)
+        std::shared_ptr<gltf_model::Model> m_model, GLFWwindow *window,
+        std::string asCacheDirectory = AS_CACHE_DIRECTORY)
         : raytracer::RaytracerBase(std::move(m_deviceHandler),
                                    std::move(m_swapChain),
                                    std::move(m_commandBuffer)),
-          window(window), scene(std::move(m_model)) {
-        vkDeviceWaitIdle(*this->m_deviceHandler);
-
-        raytracer::RaytracerBase::prepare();
-        createBottomLevelAccelerationStructure();
-        createTopLevelAccelerationStructure();
-        createUniformBuffer();
-        setupColorsBuffer(false);
-
-        uint32_t width = this->m_swapChain->swapChainExtent.width;
-        uint32_t height = this->m_swapChain->swapChainExtent.height;
-        createStorageImage(this->m_swapChain->swapChainImageFormat,
-                           {width, height, 1});
-
-        VkPipelineStageFlags stages =
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-
-        submitInfo = create_info::submitInfo();
-        submitInfo.pWaitDstStageMask = &stages;
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.signalSemaphoreCount = 1;
-
-        setupLightsBuffer();
+          window(window), scene(std::move(m_model)),
+          m_asCacheDirectory(std::move(asCacheDirectory)) {
+        extent = this->m_swapChain->swapChainExtent;
+        m_init(this->m_swapChain->swapChainImageFormat);
+    }
 
-        createRayTracingPipeline();
-        createShaderBindingTables();
-        createDescriptorSets();
+    /**
+     * \brief Constructs a headless Raytracer object.
+     * \param m_deviceHandler A shared pointer to a DeviceHandler object.
+     * \param m_commandBuffer A shared pointer to a CommandBufferHandler object.
+     * \param m_model A shared pointer to a Model object representing the scene.
+     * \param extent The size of the offscreen storage image.
+     * \param format The preferred format of the offscreen storage image,
+     * VK_FORMAT_R8G8B8A8_UNORM is used if the device can not store to it.
+     * \param asCacheDirectory Where serialized BLASes are cached, empty to
+     * always build them.
+     *
+     * Sets up the same acceleration structures, pipeline, shader binding
+     * tables and descriptor sets as the windowed constructor, but without a
+     * window or a swap chain. Frames are traced into the storage image only
+     * and are never presented, see renderHeadless().
+     */
+    Raytracer(
+        std::shared_ptr<device::DeviceHandler> m_deviceHandler,
+        std::shared_ptr<command_buffer::CommandBufferHandler> m_commandBuffer,
+        std::shared_ptr<gltf_model::Model> m_model, VkExtent2D extent,
+        VkFormat format = VK_FORMAT_B8G8R8A8_UNORM,
+        std::string asCacheDirectory = AS_CACHE_DIRECTORY)
+        : raytracer::RaytracerBase(std::move(m_deviceHandler), nullptr,
+                                   std::move(m_commandBuffer)),
+          window(nullptr), extent(extent), scene(std::move(m_model)),
+          m_asCacheDirectory(std::move(asCacheDirectory)) {
+        // Nothing is presented, so any format the shaders can store to does
+        m_init(storageImageFormat(format));
 
-        makeCommandBuffers();
-        buildCommandBuffers();
+        VkFenceCreateInfo fenceInfo = create_info::fenceCreateInfo(
+            VK_FENCE_CREATE_SIGNALED_BIT);
+        headlessFences.resize(MAX_FRAMES_IN_FLIGHT);
+        for (VkFence &fence : headlessFences) {
+            VK_CHECK(vkCreateFence(*this->m_deviceHandler, &fenceInfo, nullptr,
+                                   &fence));
+        }
     }
 
     /**
@@ -73,7 +98,7 @@ class Raytracer : public raytracer::RaytracerBase {
      * This destructor cleans up all the resources used by the Raytracer,
      * including pipelines, pipeline layouts, descriptor set layouts, lights
      * buffer, storage image, acceleration structures, shader binding tables,
-     * and the uniform buffer.
+     * and the uniform ring.
      */
     ~Raytracer() {
         vkDeviceWaitIdle(*m_deviceHandler);
@@ -82,27 +107,163 @@ class Raytracer : public raytracer::RaytracerBase {
         vkDestroyPipelineLayout(*m_deviceHandler, pipelineLayout, nullptr);
         vkDestroyDescriptorSetLayout(*m_deviceHandler, descriptorSetLayout,
                                      nullptr);
+        vkDestroyDescriptorSetLayout(*m_deviceHandler,
+                                     uniformDescriptorSetLayout, nullptr);
+        vkDestroyDescriptorPool(*m_deviceHandler, uniformDescriptorPool,
+                                nullptr);
+        vkDestroyPipeline(*m_deviceHandler, spatialReusePipeline, nullptr);
+        vkDestroyPipeline(*m_deviceHandler, accumulationPipeline, nullptr);
+        for (VkPipeline denoiserPipeline : denoiserPipelines) {
+            vkDestroyPipeline(*m_deviceHandler, denoiserPipeline, nullptr);
+        }
+        for (VkPipeline wavefrontPipeline : wavefrontPipelines) {
+            vkDestroyPipeline(*m_deviceHandler, wavefrontPipeline, nullptr);
+        }
+        cleanupAccumulation();
+        cleanupDenoiser();
+        cleanupWavefront();
         cleanupLightsBuffer();
-        cleanupColorsBuffer();
+        cleanupReSTIRBuffer();
         deleteStorageImage();
-        deleteAccelerationStructure(bottomLevelAS);
+        for (MeshAccelerationStructure &blas : bottomLevelASes) {
+            deleteAccelerationStructure(blas.accelerationStructure);
+        }
         deleteAccelerationStructure(topLevelAS);
+        deleteScratchBuffer(topLevelInstances.scratch);
+        topLevelInstances.buffer.destroy(*m_deviceHandler);
+        geometryBuffer.reset();
+        materialBuffer.reset();
+        blueNoiseTexture.reset();
         shaderBindingTables.raygen.destroy();
         shaderBindingTables.miss.destroy();
         shaderBindingTables.hit.destroy();
-        ubo.destroy(*m_deviceHandler);
+        shaderBindingTables.shade.destroy();
+        uniformRing.reset();
+        for (VkFence fence : headlessFences) {
+            vkDestroyFence(*m_deviceHandler, fence, nullptr);
+        }
     }
 
     /**
-     * \brief The bottom-level acceleration structure.
+     * \brief A bottom-level acceleration structure holding a single mesh.
+     *
+     * Every primitive of the mesh is one geometry of the BLAS, so
+     * gl_GeometryIndexEXT picks the primitive inside the mesh.
+     */
+    struct MeshAccelerationStructure {
+        const gltf_model::Mesh *mesh =
+            nullptr; /**< The mesh the structure was built from. */
+        AccelerationStructure
+            accelerationStructure; /**< The acceleration structure. */
+        uint32_t firstGeometry =
+            0; /**< The mesh's first entry in the geometry buffer. */
+    };
+
+    /**
+     * \brief The bottom-level acceleration structures, one per mesh.
+     */
+    std::vector<MeshAccelerationStructure> bottomLevelASes;
+
+    /**
+     * \brief A BLAS geometry as seen by the hit shaders, GeometryInfo in
+     * utils.glsl.
+     */
+    struct GeometryInfo {
+        uint32_t firstIndex = 0;    /**< The primitive's first index. */
+        uint32_t materialIndex = 0; /**< The primitive's material. */
+    };
+
+    /**
+     * \brief A material as seen by the hit shaders, MaterialInfo in
+     * utils.glsl. Texture indices are 0 if the material has none.
+     */
+    struct MaterialInfo {
+        glm::vec4 baseColorFactor = glm::vec4(1.0F); /**< Base color. */
+        uint32_t baseColorTexture = 0; /**< The base color texture. */
+        uint32_t emissiveTexture = 0;  /**< The emissive texture. */
+        uint32_t normalTexture = 0;    /**< The normal texture. */
+        float roughnessFactor = 1.0F;  /**< The roughness. */
+        float alphaCutoff = 0.0F; /**< Hits below this alpha are ignored,
+                                     0 unless the material is masked. */
+        uint32_t padding[3] = {}; /**< Pads to the std430 array stride. */
+    };
+
+    /**
+     * \brief The GeometryInfo of every BLAS geometry, indexed by the
+     * instance custom index plus the geometry index.
      */
-    AccelerationStructure bottomLevelAS;
+    std::unique_ptr<buffer::Buffer> geometryBuffer;
+
+    /**
+     * \brief The host copy of the geometry buffer, picks the hit groups of
+     * every geometry's SBT records.
+     */
+    std::vector<GeometryInfo> geometryInfos;
+
+    /**
+     * \brief The MaterialInfo of every scene material, in the order of
+     * gltf_model::Model::materials.
+     */
+    std::unique_ptr<buffer::Buffer> materialBuffer;
+
+    /**
+     * \brief The tiled blue noise the shaders sample with when
+     * FrameConstants::blueNoise is set, BLUE_NOISE_SIZE in sampling.glsl.
+     */
+    std::unique_ptr<texture::Texture2D> blueNoiseTexture;
+
+    static constexpr uint32_t RAY_TYPE_COUNT =
+        2; /**< Hit records per geometry, for primary and shadow rays. This
+              is the sbtRecordStride of every traceRayEXT. */
 
     /**
      * \brief The top-level acceleration structure.
      */
     AccelerationStructure topLevelAS;
 
+    static constexpr uint32_t TLAS_REBUILD_INTERVAL =
+        64; /**< Refits in a row before the TLAS is rebuilt from scratch. */
+
+    static constexpr const char *AS_CACHE_DIRECTORY =
+        "cache/acceleration_structures"; /**< Where serialized BLASes are
+                                            kept, relative to the working
+                                            directory. */
+
+    /**
+     * \brief The on-disk cache of serialized bottom-level acceleration
+     * structures, nullptr if disabled.
+     */
+    std::unique_ptr<as_cache::AccelerationStructureCache> asCache;
+
+    /**
+     * \brief The GPU pass profiler. Slot PROFILER_SETUP_SLOT is used by the
+     * one-time setup command buffers, frame in flight i uses slot i + 1.
+     */
+    std::unique_ptr<gpu_profiler::GpuProfiler> profiler;
+
+    static constexpr uint32_t PROFILER_SETUP_SLOT =
+        0; /**< The profiler slot of one-time setup command buffers. */
+
+    static constexpr uint32_t PROFILER_MAX_PASSES =
+        16; /**< The passes the profiler has room for. */
+
+    /**
+     * \brief The indices of the profiled passes.
+     */
+    struct ProfilerPasses {
+        uint32_t trace; /**< The vkCmdTraceRaysKHR dispatch, or the stages
+                           of the wavefront path tracer. */
+        uint32_t restirSpatial; /**< The ReSTIR spatial reuse dispatch. */
+        uint32_t shade;     /**< The ReSTIR shading dispatch. */
+        uint32_t accumulationTiles; /**< The per-tile noise estimate. */
+        uint32_t denoise;   /**< The SVGF passes. */
+        uint32_t copy;      /**< The storage image to swap chain copy. */
+        uint32_t blasBuild;      /**< The bottom level AS build. */
+        uint32_t blasCompaction; /**< The bottom level AS compaction. */
+        uint32_t tlasBuild;  /**< The top level AS build. */
+        uint32_t tlasUpdate; /**< The per-frame top level AS refit. */
+    } profilerPasses;
+
     /**
      * \brief The vector of shader groups used in the ray tracing pipeline.
      */
@@ -117,6 +278,9 @@ class Raytracer : public raytracer::RaytracerBase {
         raytracer::ShaderBindingTable
             miss; /**< The miss shader binding table. */
         raytracer::ShaderBindingTable hit; /**< The hit shader binding table. */
+        raytracer::ShaderBindingTable
+            shade; /**< The ReSTIR shading ray generation shader binding
+                      table, traced with the same miss and hit tables. */
     } shaderBindingTables;
 
     /**
@@ -125,87 +289,420 @@ class Raytracer : public raytracer::RaytracerBase {
     struct UniformData {
         glm::mat4 viewInverse;   /**< The inverse of the view matrix. */
         glm::mat4 projInverse;   /**< The inverse of the projection matrix. */
-        int32_t vertexSize;      /**< The vertex size. */
+        glm::mat4 prevViewProjection{1.0F}; /**< The previous frame's view
+                                               projection, reprojects the
+                                               ReSTIR history. */
+        int32_t vertexSize;      /**< The packed vertex attribute size. */
         int32_t lightsCount = 0; /**< The number of lights in the scene. */
-        float dTime = 0.0F;
-        int32_t width = 0;
+        uint32_t restirHistory = 0; /**< 1 if the previous frame's ReSTIR
+                                       pixels can be reused. */
     } uniformData;
 
+    /**
+     * \brief The small per-frame values, passed as push constants.
+     */
+    struct FrameConstants {
+        float dTime = 0.0F;      /**< The time since the last frame. */
+        int32_t width = 0;       /**< The width of the traced image. */
+        uint32_t frameIndex = 0; /**< Counts the recorded frames, seeds the
+                                    shaders' random numbers. */
+        uint32_t blueNoise = 1;  /**< Sample with the blue noise texture
+                                    instead of white noise. */
+        int32_t height = 0;      /**< The height of the traced image. */
+        uint32_t accumulate = 0; /**< 1 while accumulation is enabled. */
+        uint32_t accumulatedFrames = 0; /**< Frames already averaged into
+                                           the accumulation image. */
+        uint32_t denoiserHistory = 0; /**< 1 if the last recorded frame ran
+                                         the denoiser. */
+        uint32_t denoiseStep = 0; /**< The wavelet pass being dispatched. */
+        uint32_t wavefrontSample = 0; /**< The sample the wavefront stages
+                                         work on. */
+        uint32_t wavefrontBounce = 0; /**< The bounce the wavefront stages
+                                         work on. */
+    } frameConstants;
+
+    static constexpr VkShaderStageFlags PUSH_CONSTANT_STAGES =
+        VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR |
+        VK_SHADER_STAGE_COMPUTE_BIT; /**< The stages that sample, see
+                                        sampling.glsl. */
+
+    static constexpr uint32_t RESTIR_WORKGROUP_SIZE =
+        8; /**< The side of a restir_spatial.comp workgroup. */
+
+    static constexpr uint32_t ACCUMULATION_TILE_SIZE =
+        16; /**< The side of a noise estimate tile, one
+               accumulation_tiles.comp workgroup. */
+
+    static constexpr uint32_t DENOISER_WORKGROUP_SIZE =
+        8; /**< The side of an SVGF workgroup, see svgf.glsl. */
+
+    static constexpr uint32_t WAVEFRONT_WORKGROUP_SIZE =
+        64; /**< The threads of a wavefront stage's workgroup, see
+               wavefront.glsl. */
+
+    static constexpr uint32_t WAVEFRONT_MAX_GROUPS =
+        65535; /**< The most workgroups a wavefront stage dispatches, the
+                  threads loop over the rest of the queue. */
+
+    static constexpr uint32_t WAVEFRONT_FIRST_BINDING =
+        23; /**< The binding of the first wavefront buffer region. */
+
+    static constexpr uint32_t WAVEFRONT_BINDING_COUNT =
+        9; /**< The wavefront buffer regions, one binding each. */
+
+    static constexpr VkFormat ACCUMULATION_FORMAT =
+        VK_FORMAT_R32G32B32A32_SFLOAT; /**< The format of the accumulation
+                                          image, see accumulation.glsl. */
+
+    static constexpr VkDeviceSize UNIFORM_ARENA_SIZE =
+        4096; /**< The uniform ring bytes available to a single frame. */
+
     /**
      * \brief The lights buffer used in the raytracer.
+     *
+     * The buffer holds the lights, followed by their alias table and their
+     * light BVH at offsets the descriptors can bind.
      */
     struct Lights {
         std::vector<glm::vec4>
-            lights;      /**< The vector of lights in the scene. */
-        VkBuffer buffer; /**< The lights buffer. */
-        VkDeviceMemory
-            memory;        /**< The device memory associated with the buffer. */
-        VkDeviceSize size; /**< The size of the buffer. */
-        void *mapped;      /**< A pointer to the mapped memory of the buffer. */
+            lights; /**< The vector of lights in the scene. */
+        VkBuffer buffer = VK_NULL_HANDLE; /**< The lights buffer. */
+        VkDeviceSize aliasTableOffset = 0; /**< Where the alias table starts. */
+        VkDeviceSize bvhOffset = 0;        /**< Where the light BVH starts. */
+        memory_allocator::Allocation
+            memory; /**< The device memory associated with the buffer. */
+        VkDeviceSize size = 0;  /**< The size of the buffer. */
+        void *mapped = nullptr; /**< A pointer to the mapped memory of the
+                                   buffer. */
         VkBufferUsageFlags usageFlags; /**< The usage flags of the buffer. */
         VkMemoryPropertyFlags memoryPropertyFlags; /**< The memory property
                                                       flags of the buffer. */
     } lights;
 
     /**
-     * \brief The color buffer used in the raytracer.
+     * \brief A weighted reservoir holding one light, Reservoir in
+     * restir.glsl.
+     */
+    struct Reservoir {
+        uint32_t light = 0;     /**< The chosen light. */
+        float weightSum = 0.0F; /**< The summed resampling weights. */
+        float M = 0.0F;         /**< The number of candidates seen. */
+        float W = 0.0F; /**< The unbiased contribution weight of the light. */
+    };
+
+    /**
+     * \brief The primary hit and the reservoirs of a pixel, ReSTIRPixel in
+     * restir.glsl.
+     */
+    struct ReSTIRPixel {
+        glm::vec4 position; /**< The hit and its distance to the camera. */
+        glm::vec4 normal;   /**< The shading normal of the hit. */
+        glm::vec4 albedo;   /**< The color the direct light is applied to. */
+        glm::vec4 indirect; /**< Everything but the hit's direct light. */
+        Reservoir temporal; /**< The reservoir after temporal reuse. */
+        Reservoir reservoir; /**< The reservoir after spatial reuse. */
+    };
+
+    /**
+     * \brief A weighted reservoir holding one indirect light sample,
+     * GIReservoir in restir_gi.glsl.
      */
-    struct ReSTIRColors {
-        VkBuffer buffer; /**< The lights buffer. */
-        VkDeviceMemory
-            memory;        /**< The device memory associated with the buffer. */
-        VkDeviceSize size; /**< The size of the buffer. */
+    struct GIReservoir {
+        glm::vec4 position; /**< The sample point. */
+        glm::vec4 normal;   /**< The normal at the sample point. */
+        glm::vec4 radiance; /**< The radiance leaving the sample point. */
+        float weightSum = 0.0F; /**< The summed resampling weights. */
+        float M = 0.0F;         /**< The number of candidates seen. */
+        float W = 0.0F; /**< The unbiased contribution weight of the sample. */
+        uint32_t padding = 0;
+    };
+
+    /**
+     * \brief The ReSTIR GI reservoirs of a pixel, GIPixel in restir_gi.glsl.
+     */
+    struct GIPixel {
+        GIReservoir temporal;  /**< The reservoir after temporal reuse. */
+        GIReservoir reservoir; /**< The reservoir after spatial reuse. */
+    };
+
+    /**
+     * \brief The ReSTIR pixels, device local.
+     *
+     * The buffer holds one segment per frame in flight. A frame writes its
+     * own segment and reads the previous frame's one, so frames in flight
+     * never write the pixels another frame reads.
+     */
+    struct ReSTIRBuffer {
+        VkBuffer buffer = VK_NULL_HANDLE; /**< The ReSTIR buffer. */
+        memory_allocator::Allocation
+            memory; /**< The device memory associated with the buffer. */
+        VkDeviceSize size = 0;        /**< The size of the buffer. */
+        VkDeviceSize segmentSize = 0; /**< The size of one frame's segment. */
         VkBufferUsageFlags usageFlags; /**< The usage flags of the buffer. */
         VkMemoryPropertyFlags memoryPropertyFlags; /**< The memory property
                                                       flags of the buffer. */
-    } colorBuffer;
+    } restirBuffer;
+
+    /**
+     * \brief The ReSTIR GI pixels, laid out like restirBuffer. Only created
+     * while QualitySettings::restirGI is set.
+     */
+    ReSTIRBuffer giBuffer;
+
+    /**
+     * \brief The denoiser state of a pixel, DenoiserPixel in svgf.glsl.
+     */
+    struct DenoiserPixel {
+        glm::vec4 illumination; /**< The demodulated illumination and its
+                                   variance. */
+        glm::vec4 moments; /**< The luminance moments and the history
+                              length. */
+        glm::vec2 motion;  /**< The offset to the previous frame's pixel. */
+        glm::vec2 padding;
+    };
+
+    /**
+     * \brief The denoiser history, laid out like restirBuffer. Only created
+     * while QualitySettings::denoise is set.
+     */
+    ReSTIRBuffer denoiserBuffer;
+
+    /**
+     * \brief The two segments the wavelet passes ping-pong between, shared
+     * by the frames in flight. Only created with denoiserBuffer.
+     */
+    ReSTIRBuffer denoiserFilterBuffer;
+
+    /**
+     * \brief The queue lengths of the wavefront path tracer and the
+     * workgroups of their indirect dispatches, WavefrontQueues in
+     * wavefront.glsl.
+     */
+    struct WavefrontQueues {
+        std::array<glm::uvec4, 2> rays; /**< The rays of even and odd
+                                           bounces. */
+        std::array<glm::uvec4, 2> hits; /**< Their closest hits. */
+        glm::uvec4 shadows;             /**< The shadow rays to trace. */
+    };
+
+    /**
+     * \brief The path of a pixel, WavefrontPath in wavefront.glsl.
+     */
+    struct WavefrontPath {
+        float throughput = 1.0F; /**< Scales the light of the next hit. */
+        uint32_t dimension = 0;  /**< The next random number dimension. */
+    };
+
+    /**
+     * \brief A queued ray, WavefrontRay in wavefront.glsl.
+     */
+    struct WavefrontRay {
+        glm::vec3 origin;      /**< Where the ray starts. */
+        uint32_t path = 0;     /**< The path the ray extends. */
+        glm::vec3 direction;   /**< The direction of the ray. */
+        uint32_t padding = 0;
+    };
+
+    /**
+     * \brief The closest hit of a queued ray, WavefrontHit in
+     * wavefront.glsl.
+     */
+    struct WavefrontHit {
+        std::array<glm::vec4, 3> normalTransform; /**< The columns of the
+                                                     world to object
+                                                     rotation. */
+        glm::vec2 barycentrics; /**< The hit attributes. */
+        float t = 0.0F;         /**< The distance along the ray. */
+        uint32_t ray = 0;       /**< The ray's index in the ray region. */
+        uint32_t geometry = 0;  /**< The hit's entry in the geometry buffer. */
+        uint32_t primitive = 0; /**< The triangle within the geometry. */
+        uint32_t material = 0;  /**< The material the hits are sorted by. */
+        uint32_t padding = 0;
+    };
+
+    /**
+     * \brief The shading of a hit, WavefrontSurface in wavefront.glsl.
+     */
+    struct WavefrontSurface {
+        glm::vec3 color;        /**< The surface color. */
+        float reflector = 0.0F; /**< How much of the next hit's light is
+                                   reflected. */
+        glm::vec3 normal;       /**< The shading normal. */
+        uint32_t padding = 0;
+    };
 
     /**
-     * \brief The vector of draw command buffers.
+     * \brief A light sampled by a hit, WavefrontShadowRay in
+     * wavefront.glsl.
+     */
+    struct WavefrontShadowRay {
+        uint32_t light = 0;        /**< The sampled light. */
+        float contribution = 0.0F; /**< Its share of the hit's lighting, 0
+                                      if occluded. */
+    };
+
+    /**
+     * \brief The state of the wavefront path tracer, device local. Only
+     * created while QualitySettings::integrator is Integrator::Wavefront.
+     *
+     * A single buffer holds a region per binding, from
+     * WAVEFRONT_FIRST_BINDING on: the queues, the paths, two ray queues, the
+     * hits, the sorted hit indices, the surfaces, the shadow rays, the
+     * shadow ray queue and the material bins. The queues are also read by
+     * the indirect dispatches. Every frame in flight shares it, the stages
+     * of a frame only run once the previous frame's are done with it.
+     */
+    struct WavefrontBuffer {
+        VkBuffer buffer = VK_NULL_HANDLE; /**< The wavefront buffer. */
+        memory_allocator::Allocation
+            memory; /**< The device memory associated with the buffer. */
+        VkDeviceSize size = 0; /**< The size of the buffer. */
+        std::array<VkDeviceSize, WAVEFRONT_BINDING_COUNT>
+            offsets{}; /**< Where every region starts. */
+        std::array<VkDeviceSize, WAVEFRONT_BINDING_COUNT>
+            ranges{};  /**< The size of every region. */
+        uint32_t pathCount = 0; /**< One path per pixel. */
+    } wavefront;
+
+    /**
+     * \brief The draw command buffers, one per frame in flight. They are
+     * recorded again every frame for the acquired swap chain image.
      */
     std::vector<VkCommandBuffer> drawCmdBuffers;
 
     /**
-     * \brief The uniform buffer object used in the raytracer.
+     * \brief A host visible buffer used by the raytracer.
      */
     struct Buffer {
-        VkBuffer buffer; /**< The buffer object. */
-        VkDeviceMemory
+        VkBuffer buffer = VK_NULL_HANDLE; /**< The buffer object. */
+        memory_allocator::Allocation
             memory; /**< The device memory associated with the buffer. */
         VkDescriptorBufferInfo
             descriptor;         /**< The descriptor for the buffer. */
         VkDeviceSize size;      /**< The size of the buffer. */
         VkDeviceSize alignment; /**< The alignment of the buffer. */
-        void *mapped; /**< A pointer to the mapped memory of the buffer. */
+        void *mapped =
+            nullptr; /**< A pointer to the mapped memory of the buffer. */
         VkBufferUsageFlags usageFlags; /**< The usage flags of the buffer. */
         VkMemoryPropertyFlags memoryPropertyFlags; /**< The memory property
                                                       flags of the buffer. */
 
         /**
-         * \brief Maps the buffer memory.
-         * \param device The Vulkan device.
-         * \param size The size of the memory region to map (optional).
-         * \param offset The offset into the memory region to map (optional).
-         * \return The result of the memory mapping operation.
+         * \brief Exposes the persistently mapped buffer memory.
+         * \param offset The offset into the buffer (optional).
+         * \return VK_ERROR_MEMORY_MAP_FAILED if the memory is not host
+         * visible.
          */
-        VkResult map(VkDevice device, VkDeviceSize size = VK_WHOLE_SIZE,
-                     VkDeviceSize offset = 0);
+        VkResult map(VkDeviceSize offset = 0);
 
         /**
-         * \brief Destroys the buffer object.
+         * \brief Destroys the buffer object and frees its memory.
+         * \param deviceHandler The device the buffer was created on.
          */
-        void destroy(VkDevice device) const;
-    } ubo;
+        void destroy(const device::DeviceHandler &deviceHandler);
+    };
+
+    /**
+     * \brief The TLAS instances and the state needed to refit them when nodes
+     * move.
+     *
+     * The instance buffer holds one segment per frame in flight, a frame only
+     * writes its own segment so the builds of frames in flight never read
+     * instance data that is being overwritten.
+     */
+    struct TopLevelInstances {
+        std::vector<VkAccelerationStructureInstanceKHR>
+            instances; /**< The current instances. */
+        std::vector<gltf_model::Node *>
+            nodes; /**< The node of each instance, nullptr if it never moves. */
+        std::vector<std::vector<uint32_t>>
+            dirty; /**< The instances each segment has yet to pick up. */
+        Buffer buffer; /**< The persistently mapped instance buffer. */
+        uint64_t deviceAddress = 0;   /**< The instance buffer address. */
+        VkDeviceSize segmentSize = 0; /**< The size of one frame's segment. */
+        ScratchBuffer scratch{}; /**< Scratch memory of builds and refits. */
+        VkBuildAccelerationStructureFlagsKHR flags =
+            0; /**< The TLAS build flags, refits need the same ones. */
+        uint32_t updatesSinceBuild = 0; /**< Refits since the last build. */
+    } topLevelInstances;
+
+    /**
+     * \brief Progressive accumulation of a still camera, see
+     * accumulation.glsl.
+     *
+     * While enabled, every frame is averaged into an RGBA32F image until the
+     * matrices, the lights, the scene or the quality change. The relative
+     * standard error of every tile is read back once a frame finishes.
+     */
+    struct Accumulation {
+        bool enabled = false; /**< Average the frames of a still camera. */
+        float targetNoise = 0.0F; /**< Stop tracing once no tile's relative
+                                     standard error is above this, 0 never
+                                     stops. */
+        uint32_t frames = 0; /**< The frames averaged so far. */
+        uint32_t estimatedFrames = 0; /**< The frames behind noise. */
+        uint32_t samplesPerPixel = 0; /**< The primary rays per pixel behind
+                                         noise. */
+        float noise = 0.0F;     /**< The worst relative standard error of a
+                                   tile. */
+        bool converged = false; /**< Whether noise reached targetNoise, no
+                                   more frames are traced. */
+        StorageImage image{}; /**< The first two moments of every pixel. */
+        Buffer tiles{}; /**< The tile errors, one segment per frame in
+                           flight. */
+        VkDeviceSize tileSegmentSize = 0; /**< The size of one segment. */
+        std::vector<uint32_t>
+            tileFrames; /**< The frames behind the errors of each segment, 0
+                           if it holds none. */
+    } accumulation;
+
+    /**
+     * \brief The per-frame uniform arenas. uniformData is pushed into the
+     * recorded frame's arena and bound with a dynamic offset through set 1.
+     */
+    std::unique_ptr<uniform_ring::UniformRing> uniformRing;
 
     bool resized =
         false; /**< Flag indicating whether the window has been resized. */
-    GLFWwindow *window;              /**< Pointer to the GLFW window. */
-    VkSubmitInfo submitInfo;         /**< The Vulkan submit info structure. */
+    GLFWwindow *window; /**< Pointer to the GLFW window, nullptr if headless. */
+    VkExtent2D extent;  /**< The size of the traced image. */
+    VkSubmitInfo submitInfo; /**< The Vulkan submit info structure. */
+    VkPipelineStageFlags waitStages =
+        VK_PIPELINE_STAGE_TRANSFER_BIT; /**< The stages that wait on the
+                                           acquired image, only the copy
+                                           touches it. */
+    std::vector<VkFence>
+        headlessFences; /**< Guard the headless frames in flight. */
     VkPipeline pipeline;             /**< The ray tracing pipeline. */
+    VkPipeline spatialReusePipeline =
+        VK_NULL_HANDLE; /**< The ReSTIR spatial reuse compute pipeline. */
+    VkPipeline accumulationPipeline =
+        VK_NULL_HANDLE; /**< The per-tile noise estimate compute pipeline. */
+    std::array<VkPipeline, 3> denoiserPipelines = {
+        VK_NULL_HANDLE, VK_NULL_HANDLE,
+        VK_NULL_HANDLE}; /**< The SVGF temporal, variance and wavelet compute
+                            pipelines. */
+    std::array<VkPipeline, 7> wavefrontPipelines = {
+        VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE,
+        VK_NULL_HANDLE, VK_NULL_HANDLE,
+        VK_NULL_HANDLE}; /**< The generate, extend, scan, scatter, shade,
+                            shadow and connect stages of the wavefront path
+                            tracer, only created for
+                            Integrator::Wavefront. */
     VkPipelineLayout pipelineLayout; /**< The pipeline layout. */
-    VkDescriptorSet descriptorSet;   /**< The descriptor set. */
+    std::vector<VkDescriptorSet>
+        descriptorSets; /**< The descriptor sets, one per frame in flight. */
     VkDescriptorSetLayout
         descriptorSetLayout; /**< The descriptor set layout. */
+    VkDescriptorSetLayout
+        uniformDescriptorSetLayout; /**< The layout of set 1, the uniform
+                                       ring. */
+    VkDescriptorPool
+        uniformDescriptorPool; /**< The pool of uniformDescriptorSet, without
+                                  update-after-bind. */
+    VkDescriptorSet
+        uniformDescriptorSet; /**< The uniform ring's set, shared by all
+                                 frames in flight. */
     VkSampler sampler;       /**< The texture sampler. */
     std::vector<VkDescriptorImageInfo>
         textureDescriptors; /**< The vector of texture descriptors. */
@@ -213,24 +710,79 @@ class Raytracer : public raytracer::RaytracerBase {
         scene; /**< The shared pointer to the scene model. */
 
     /**
-     * \brief Creates the bottom-level acceleration structure.
+     * \brief Creates a bottom-level acceleration structure per mesh and the
+     * geometry buffer. The builds are packed into as few build commands as
+     * the as_build_scheduler::BuildScheduler arena allows and submitted once.
+     *
+     * If the device supports host builds and the model was loaded with
+     * FileLoadingFlags::KeepHostGeometry, the structures are built on the
+     * host by a thread pool instead, which keeps the graphics queue free.
+     *
+     * Structures found in asCache are deserialized instead of built, the
+     * built ones are stored in it after compaction.
+     */
+    void createBottomLevelAccelerationStructures();
+
+    /**
+     * \brief Uploads the material table.
      */
-    void createBottomLevelAccelerationStructure();
+    void createMaterialBuffer();
 
     /**
-     * \brief Creates the top-level acceleration structure.
+     * \brief Generates and uploads the blue noise texture.
+     */
+    void createBlueNoiseTexture();
+
+    /**
+     * \brief Copies the built bottom-level acceleration structures into
+     * buffers of their compacted size and frees the originals.
+     * \param compactedSizes The compacted size of every structure, read back
+     * right after the build.
+     * \param blasIndices The structures in bottomLevelASes, compactedSizes[i]
+     * is the size of blasIndices[i].
+     * \param relocate Copy every structure, even those that do not shrink.
+     * Host built structures are moved into device local memory this way.
+     */
+    void compactBottomLevelAccelerationStructures(
+        const std::vector<VkDeviceSize> &compactedSizes,
+        const std::vector<uint32_t> &blasIndices, bool relocate);
+
+    /**
+     * \brief Serializes bottom-level acceleration structures into asCache.
+     * \param blasIndices The structures in bottomLevelASes.
+     * \param cacheKeys The cache key of every structure in bottomLevelASes.
+     */
+    void storeBottomLevelAccelerationStructures(
+        const std::vector<uint32_t> &blasIndices,
+        const std::vector<std::string> &cacheKeys);
+
+    /**
+     * \brief Creates the top-level acceleration structure, with an instance
+     * per node that holds a mesh.
      */
     void createTopLevelAccelerationStructure();
 
     /**
-     * \brief Sets up the lights buffer.
+     * \brief Writes the transforms of moved nodes into the frame's instance
+     * segment and records a TLAS refit, or a rebuild every
+     * TLAS_REBUILD_INTERVAL refits. Records nothing if no node moved.
+     * \param cmdBuffer The frame's command buffer, before the trace.
+     * \param frame The frame in flight, its fence must have signaled.
+     */
+    void updateTopLevelAccelerationStructure(VkCommandBuffer cmdBuffer,
+                                             uint32_t frame);
+
+    /**
+     * \brief Sets up the lights buffer, building the light sampling
+     * structures of the lights.
      */
     void setupLightsBuffer();
 
     /**
-     * \brief Sets up the colors buffer.
+     * \brief Sets up the ReSTIR buffer and, with ReSTIR GI, the GI buffer,
+     * one segment per frame in flight.
      */
-    void setupColorsBuffer(bool setupDescr = true);
+    void setupReSTIRBuffer();
 
     /**
      * \brief Updates the lights buffer with new lights.
@@ -244,9 +796,46 @@ class Raytracer : public raytracer::RaytracerBase {
     void cleanupLightsBuffer();
 
     /**
-     * \brief Clean up the colors buffer.
+     * \brief Clean up the ReSTIR and GI buffers.
      */
-    void cleanupColorsBuffer();
+    void cleanupReSTIRBuffer();
+
+    /**
+     * \brief Sets up the denoiser buffers if QualitySettings::denoise is set.
+     */
+    void setupDenoiser();
+
+    /**
+     * \brief Cleans up the denoiser buffers.
+     */
+    void cleanupDenoiser();
+
+    /**
+     * \brief Sets up the wavefront buffer if QualitySettings::integrator is
+     * Integrator::Wavefront.
+     */
+    void setupWavefront();
+
+    /**
+     * \brief Cleans up the wavefront buffer.
+     */
+    void cleanupWavefront();
+
+    /**
+     * \brief Sets up the accumulation image and the tile error buffer for
+     * the current extent.
+     */
+    void setupAccumulation();
+
+    /**
+     * \brief Cleans up the accumulation image and the tile error buffer.
+     */
+    void cleanupAccumulation();
+
+    /**
+     * \brief Restarts the accumulation with the next recorded frame.
+     */
+    void resetAccumulation();
 
     /**
      * \brief Creates the shader binding tables.
@@ -254,19 +843,137 @@ class Raytracer : public raytracer::RaytracerBase {
     void createShaderBindingTables();
 
     /**
-     * \brief Creates the descriptor sets.
+     * \brief Creates the descriptor sets, one per frame in flight.
      */
     void createDescriptorSets();
 
     /**
-     * \brief Creates the ray tracing pipeline.
+     * \brief Points every frame's descriptor set at the current resources.
+     *
+     * Must not be called while frames are in flight.
+     */
+    void updateDescriptorSets();
+
+    /**
+     * \brief Creates the descriptor set layout, the pipeline layout, the
+     * ray tracing pipeline and the ReSTIR spatial reuse pipeline.
      */
     void createRayTracingPipeline();
 
     /**
-     * \brief Creates the uniform buffer.
+     * \brief Quality tiers, see qualityPreset().
+     */
+    enum class QualityPreset : uint32_t {
+        Low = 0,    /**< One sample, one bounce and no shadow rays. */
+        Medium = 1, /**< The defaults of QualitySettings. */
+        High = 2,   /**< More samples and bounces. */
+    };
+
+    /**
+     * \brief How the paths of a frame are traced.
+     */
+    enum class Integrator : uint32_t {
+        Megakernel = 0, /**< The path loop of raygen.rgen, one trace. */
+        Wavefront = 1,  /**< Compute stages over ray queues, see
+                           wavefront.glsl. Needs ray queries. */
+    };
+
+    /**
+     * \brief The shader quality knobs, passed to every stage as
+     * specialization constants with the constant_ids in utils.glsl.
+     */
+    struct QualitySettings {
+        uint32_t samples = 3;        /**< Primary rays per pixel. */
+        uint32_t maxReflections = 3; /**< Bounces per primary ray. */
+        uint32_t lightSamples = 49;  /**< Direct light is divided by its
+                                        square root. */
+        float ambientLight = 0.24F;  /**< Light every hit receives. */
+        float lightMultiplier = 36.0F; /**< Scales the light intensities. */
+        VkBool32 shadowRays = VK_TRUE; /**< Trace shadow rays to the lights,
+                                          every light is unoccluded if not.
+                                          Devices that can not nest rays
+                                          trace them as ray queries or not
+                                          at all. */
+        uint32_t lightsPerHit = 4; /**< Lights sampled per hit, scenes with
+                                      no more lights trace all of them. */
+        light_sampler::Strategy lightSampling =
+            light_sampler::Strategy::Bvh; /**< How the lights are picked. */
+        VkBool32 restir = VK_TRUE; /**< Light primary hits with ReSTIR DI,
+                                      see restir.glsl. */
+        uint32_t restirCandidates = 16; /**< Lights a pixel picks from every
+                                           frame. */
+        uint32_t restirSpatialSamples = 4; /**< Neighbours a pixel reuses. */
+        VkBool32 restirGI = VK_FALSE; /**< Replace the bounces with one
+                                         resampled bounce, see
+                                         restir_gi.glsl. */
+        VkBool32 denoise = VK_FALSE; /**< Filter the image with SVGF, see
+                                        svgf.glsl. */
+        uint32_t denoiseIterations = 5; /**< The a-trous wavelet passes of
+                                           the denoiser, at least 1. */
+        Integrator integrator =
+            Integrator::Megakernel; /**< How the paths are traced, not a
+                                       specialization constant. The
+                                       wavefront path tracer has no
+                                       ReSTIR. */
+        VkBool32 rayQueryShadows =
+            VK_TRUE; /**< Trace the hit and shade shaders' shadow rays with
+                        inline ray queries where the device has them, not a
+                        specialization constant. */
+    };
+
+    /**
+     * \brief The settings of a quality tier.
+     * \param preset The tier.
+     * \return The settings.
      */
-    void createUniformBuffer();
+    static QualitySettings qualityPreset(QualityPreset preset);
+
+    /**
+     * \brief Parses a quality tier name.
+     * \param name One of low, medium or high.
+     * \return The tier.
+     * \throw std::runtime_error if the name is unknown
+     */
+    static QualityPreset parseQualityPreset(const std::string &name);
+
+    /**
+     * \brief Parses an integrator name.
+     * \param name One of megakernel or wavefront.
+     * \return The integrator.
+     * \throw std::runtime_error if the name is unknown
+     */
+    static Integrator parseIntegrator(const std::string &name);
+
+    /**
+     * \brief Rebuilds the pipelines and the shader binding tables with new
+     * quality settings. Waits for the device to be idle.
+     * \param settings The new settings.
+     * \throw std::runtime_error if the wavefront integrator is picked on a
+     * device without ray queries
+     */
+    void setQuality(const QualitySettings &settings);
+
+    /**
+     * \brief The settings of the current pipeline.
+     * \return The quality settings.
+     */
+    [[nodiscard]] const QualitySettings &getQuality() const {
+        return m_quality;
+    }
+
+    /**
+     * \brief Checks whether the pipeline traces its shadow rays inline.
+     * \return True if QualitySettings::rayQueryShadows is set and the device
+     * has ray queries, the pipeline then needs no recursion.
+     */
+    [[nodiscard]] bool usesRayQueryShadows() const {
+        return m_quality.rayQueryShadows == VK_TRUE && supportsRayQuery();
+    }
+
+    /**
+     * \brief Creates the uniform ring, one arena per frame in flight.
+     */
+    void createUniformRing();
 
     /**
      * \brief Handles the window resize event.
@@ -274,18 +981,23 @@ class Raytracer : public raytracer::RaytracerBase {
     void handleResize();
 
     /**
-     * \brief Builds the command buffers.
+     * \brief Records the command buffer of a frame in flight and pushes the
+     * current uniform data into the frame's arena.
+     * \param frame The frame in flight to record, its fence must have
+     * signaled.
+     * \param imageIndex The swap chain image to copy to, ignored if headless.
      */
-    void buildCommandBuffers();
+    void recordCommandBuffer(uint32_t frame, uint32_t imageIndex);
 
     /**
-     * \brief Updates the uniform buffers.
+     * \brief Resets the uniform data. It reaches the shaders with the next
+     * frame.
      */
     void updateUniformBuffers();
 
     /**
-     * \brief Updates the uniform buffers with the given projection and view
-     * matrices.
+     * \brief Updates the uniform data with the given projection and view
+     * matrices. It reaches the shaders with the next frame.
      * \param proj The projection matrix.
      * \param view The view matrix.
      */
@@ -307,15 +1019,124 @@ class Raytracer : public raytracer::RaytracerBase {
     void renderFrame();
 
     /**
-     * \brief Prepares a frame for rendering.
+     * \brief Waits for the current frame in flight and acquires the next swap
+     * chain image.
+     * \return False if the swap chain was recreated and the frame is skipped.
      */
-    void prepareFrame();
+    bool prepareFrame();
 
     /**
      * \brief Submits a frame for rendering.
      */
     void submitFrame();
 
-    uint32_t imageIdx; /**< The index of the image being rendered. */
-    uint32_t curFrame; /**< The current frame number. */
+    /**
+     * \brief Traces a single frame into the storage image without presenting.
+     *
+     * Only waits for the frame in flight that last used the same resources,
+     * up to MAX_FRAMES_IN_FLIGHT frames run at once.
+     */
+    void renderHeadlessFrame();
+
+    /**
+     * \brief Traces a number of frames into the storage image without
+     * presenting and waits for all of them to finish.
+     * \param frameCount The number of frames to render.
+     */
+    void renderHeadless(uint32_t frameCount);
+
+    /**
+     * \brief Checks whether the raytracer renders without a swap chain.
+     * \return True if there is no swap chain to present to.
+     */
+    [[nodiscard]] inline bool isHeadless() const {
+        return m_swapChain == nullptr;
+    }
+
+    uint32_t imageIdx = 0; /**< The index of the image being rendered. */
+    uint32_t curFrame = 0; /**< The current frame in flight. */
+
+  private:
+    /**
+     * \brief Creates everything shared between windowed and headless
+     * rendering: acceleration structures, buffers, the storage image, the
+     * pipeline, shader binding tables, descriptor sets and command buffers.
+     * \param format The format of the storage image.
+     */
+    void m_init(VkFormat format);
+
+    /**
+     * \brief Creates the ray tracing pipeline and the compute pipelines with
+     * the current quality settings.
+     */
+    void m_createPipeline();
+
+    /**
+     * \brief Makes the quality's shadow rays fit the device's recursion
+     * depth, tracing them with ray queries or turning them off if it can not
+     * nest rays.
+     */
+    void m_clampShadowRays();
+
+    /**
+     * \brief Picks up the tile errors of a finished frame.
+     * \param frame The frame in flight, its fence must have signaled.
+     */
+    void m_collectAccumulation(uint32_t frame);
+
+    /**
+     * \brief Records the stages of the wavefront path tracer, every bounce
+     * of every sample, in place of the trace.
+     * \param cmdBuffer The frame's command buffer, with the descriptor set
+     * and the push constants bound.
+     */
+    void m_recordWavefront(VkCommandBuffer cmdBuffer);
+
+    QualitySettings m_quality; /**< The settings of the current pipeline. */
+    std::string m_asCacheDirectory; /**< Where asCache keeps its files, empty
+                                       if there is no cache. */
+
+    glm::mat4 m_viewProjection{
+        1.0F}; /**< The view projection of the last recorded frame. */
+    bool m_restirHistory =
+        false; /**< Whether the last recorded frame left ReSTIR pixels the
+                  next one can reuse. */
+
+    /**
+     * \brief The instance transform of a node.
+     * \param node The node.
+     * \return The node's world matrix, with FlipY applied in world space.
+     */
+    [[nodiscard]] VkTransformMatrixKHR
+    m_instanceTransform(const gltf_model::Node &node) const;
+
+    /**
+     * \brief The TLAS geometry reading a frame's instance segment.
+     * \param segment The frame in flight whose segment is read.
+     * \return The geometry.
+     */
+    [[nodiscard]] VkAccelerationStructureGeometryKHR
+    m_topLevelGeometry(uint32_t segment) const;
+
+    /**
+     * \brief Records a TLAS build over a frame's instance segment.
+     * \param cmdBuffer The command buffer to record into.
+     * \param segment The frame in flight whose segment is read.
+     * \param update True to refit the current TLAS in place.
+     */
+    void m_recordTopLevelBuild(VkCommandBuffer cmdBuffer, uint32_t segment,
+                               bool update);
+
+    /**
+     * \brief Creates a mapped host visible buffer for serialized
+     * acceleration structures, each at an address aligned to
+     * as_cache::SERIALIZED_ALIGNMENT.
+     * \param sizes The serialized size of every structure.
+     * \param buffer The buffer, created by the function.
+     * \param offsets The offset of every structure into the buffer.
+     * \return The device address of the buffer.
+     */
+    uint64_t m_createSerializationBuffer(const std::vector<VkDeviceSize> &sizes,
+                                         Buffer &buffer,
+                                         std::vector<VkDeviceSize> &offsets);
 };